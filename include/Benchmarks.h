@@ -0,0 +1,11 @@
+#pragma once
+
+// Command line benchmarks, they run without opening a window and print their results to stdout.
+// Each returns the process exit code.
+
+// LBVH build time vs. body count and thread count (--bench-lbvh)
+int RunLBVHBenchmark();
+
+// Direct summation in double, mixed precision and plain float: time and force error against the
+// serial double kernel, for a scene at the origin and the same scene far from it (--bench-precision)
+int RunPrecisionBenchmark();
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Small helpers for the compressed binary streams (trajectories, timeline deltas)
+
+inline uint64_t ZigZagEncode(int64_t value) {
+	return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+inline int64_t ZigZagDecode(uint64_t value) {
+	return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+// LEB128: 7 bits per byte, high bit set on all but the last byte
+inline void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(uint8_t(value) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+// Returns false when the input ends inside the number
+inline bool GetVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && in < end; shift += 7) {
+		uint8_t byte = *in++;
+		value |= uint64_t(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+// Raw little-endian fields
+template<typename T>
+inline void PutRaw(std::vector<uint8_t>& out, const T& value) {
+	size_t size = out.size();
+	out.resize(size + sizeof(T));
+	std::memcpy(out.data() + size, &value, sizeof(T));
+}
+
+template<typename T>
+inline bool GetRaw(const uint8_t*& in, const uint8_t* end, T& value) {
+	if (size_t(end - in) < sizeof(T)) return false;
+	std::memcpy(&value, in, sizeof(T));
+	in += sizeof(T);
+	return true;
+}
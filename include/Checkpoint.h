@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+#include <MappedFile.h>
+
+// Binary checkpoint of a scene.
+// Layout (little-endian): a fixed header followed by one SoA block per field, every block
+// starting on a 64-byte boundary so the arrays can be used straight from a memory mapping.
+constexpr char CHECKPOINT_MAGIC[8] = { 'G', 'S', 'C', 'H', 'K', 'P', 'T', '\0' };
+constexpr uint32_t CHECKPOINT_VERSION = 2;   // Version 1 files, without the rails blocks, still load
+constexpr size_t CHECKPOINT_ALIGNMENT = 64;
+constexpr size_t CHECKPOINT_NAME_LENGTH = 16;
+// Planet IDs above the body count a checkpoint may carry (retired by merges and deletes), more means a corrupt file
+constexpr uint32_t CHECKPOINT_MAX_ID_GAP = 1u << 24;
+// Rails primary of bodies that are integrated
+constexpr uint32_t CHECKPOINT_NOT_ON_RAILS = UINT32_MAX;
+
+struct CheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t bodyCount;
+
+	// Clock and integrator state
+	double simTime;          // Simulated time since the scene started [game time]
+	float timeMultiplier;
+	int32_t integrator;
+	int32_t forceSolver;
+	float openingAngle;
+	uint32_t nextPlanetId;
+	uint32_t reserved;
+
+	// Byte offsets of the blocks from the start of the file
+	uint64_t idOffset;       // uint32_t per body
+	uint64_t positionOffset; // glm::vec3 per body [game length]
+	uint64_t velocityOffset; // glm::vec3 per body [game length / game time]
+	uint64_t massOffset;     // double per body [game mass]
+	uint64_t radiusOffset;   // double per body [game length]
+	uint64_t colorOffset;    // glm::vec3 per body
+	uint64_t nameOffset;     // CHECKPOINT_NAME_LENGTH chars per body
+
+	// Version 2
+	uint64_t railsPrimaryOffset;  // uint32_t per body, planet ID of the primary or CHECKPOINT_NOT_ON_RAILS
+	uint64_t railsPositionOffset; // glm::dvec3 per body, relative to the primary [game length]
+	uint64_t railsVelocityOffset; // glm::dvec3 per body [game length / game time]
+};
+
+// Header size of version 1 files
+constexpr size_t CHECKPOINT_V1_HEADER_SIZE = offsetof(CheckpointHeader, railsPrimaryOffset);
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Checkpoint blocks assume tightly packed vec3");
+static_assert(sizeof(glm::dvec3) == 3 * sizeof(double), "Checkpoint blocks assume tightly packed dvec3");
+
+// Pointers to the per body arrays, either the caller's memory when writing or the mapping when reading
+struct CheckpointArrays {
+	size_t count = 0;
+	const uint32_t* id = nullptr;
+	const glm::vec3* position = nullptr;
+	const glm::vec3* velocity = nullptr;
+	const double* mass = nullptr;
+	const double* radius = nullptr;
+	const glm::vec3* color = nullptr;
+	const char* name = nullptr;
+	// Null when reading a version 1 file
+	const uint32_t* railsPrimary = nullptr;
+	const glm::dvec3* railsPosition = nullptr;
+	const glm::dvec3* railsVelocity = nullptr;
+};
+
+// The block offsets in the header are filled in by the writer
+bool WriteCheckpoint(const std::string& path, CheckpointHeader header, const CheckpointArrays& arrays);
+
+// Maps a checkpoint and exposes its arrays in place, nothing is parsed or copied
+class Checkpoint {
+public:
+	bool Open(const std::string& path);
+	void Close();
+
+	const CheckpointHeader& Header() const { return m_header; }
+	const CheckpointArrays& Arrays() const { return m_arrays; }
+	const std::string& Error() const { return m_error; }
+
+private:
+	bool fail(const char* message);
+
+	MappedFile m_file;
+	CheckpointHeader m_header = {};
+	CheckpointArrays m_arrays;
+	std::string m_error;
+};
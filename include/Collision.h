@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <NBody.h>
+#include <ThreadPool.h>
+#include <LBVH.h>
+
+// Uniform grid spatial hash used as the collision broad phase.
+// Rebuilt in parallel every step: cell hashes are computed per body, bodies are radix
+// sorted by hash and the start/end of every hash bucket is found from the sorted keys.
+// Bodies larger than a cell go to coarser levels, each sized for the bodies it holds and
+// sharing the one hash table. A body looks for partners on its own level and every coarser one.
+class SpatialHash {
+public:
+	void Build(const BodyState& bodies, const std::vector<double>& radius, ThreadPool& pool = ThreadPool::Global());
+
+	// Overlapping sphere pairs (a < b), exact sphere-sphere narrow phase
+	void FindContacts(const BodyState& bodies, const std::vector<double>& radius, std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+		ThreadPool& pool = ThreadPool::Global()) const;
+
+	// Cell size of the finest level
+	double CellSize() const { return m_levelCellSize.empty() ? 1.0 : m_levelCellSize[0]; }
+	size_t LevelCount() const { return m_levelCellSize.size(); }
+
+private:
+	uint32_t hashCell(int64_t x, int64_t y, int64_t z, uint32_t level) const;
+
+	std::vector<double> m_levelCellSize; // Growing from the finest level
+	std::vector<uint8_t> m_level;        // Per body
+	uint32_t m_tableMask = 0;
+	std::vector<uint64_t> m_hashes;      // Sorted cell hashes
+	std::vector<uint32_t> m_sortedBodies; // Body indices sorted by cell hash
+	std::vector<uint32_t> m_cellStart;   // Per hash bucket range into m_sortedBodies
+	std::vector<uint32_t> m_cellEnd;
+};
+
+// Merges every connected group of touching bodies into its most massive member.
+// Mass, momentum and volume are conserved and the merged body sits at the group's centre of mass.
+// dead[i] is set for absorbed bodies and survivor[i] holds the index each body ended up in.
+void MergeContacts(BodyState& bodies, std::vector<double>& radius, const std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+	std::vector<uint8_t>& dead, std::vector<uint32_t>& survivor);
+
+// Resolves the contacts with an impulse along the contact normal (restitution 1 = elastic)
+// and pushes the spheres apart so they no longer overlap
+void BounceContacts(BodyState& bodies, const std::vector<double>& radius, const std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+	double restitution);
+
+// Continuous collision detection over one step of linear motion from start[i] to bodies.position[i].
+// Time of impact is the fraction [0, 1] of the step at which the two spheres first touch.
+struct SweptContact {
+	uint32_t a;
+	uint32_t b;
+	double toi;
+};
+
+// Smallest t in [0, 1] with |d0 + t * dd| = r for approaching spheres, or -1 if they do not meet.
+// Pairs that already overlap at t = 0 are left to the discrete contacts.
+double SphereTimeOfImpact(const glm::dvec3& d0, const glm::dvec3& dd, double r);
+
+// Broad phase on the swept AABBs of every body (built into tree), exact sphere sweep in the narrow phase.
+// Contacts are returned sorted by time of impact.
+void FindSweptContacts(const std::vector<glm::dvec3>& start, const BodyState& bodies, const std::vector<double>& radius,
+	LBVH& tree, std::vector<SweptContact>& contacts, ThreadPool& pool = ThreadPool::Global());
+
+// Resolves the earliest impact of every body at its time of impact: both bodies are moved back to the
+// contact point, merged or bounced, and carried along for the rest of the step. stepTime converts
+// velocity changes into displacement over the step. dead/survivor follow MergeContacts.
+void ResolveSweptContacts(const std::vector<glm::dvec3>& start, BodyState& bodies, std::vector<double>& radius,
+	const std::vector<SweptContact>& contacts, bool merge, double restitution, double stepTime,
+	std::vector<uint8_t>& dead, std::vector<uint32_t>& survivor);
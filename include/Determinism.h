@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <NBody.h>
+#include <ThreadPool.h>
+
+// Reproducible parallel reductions and state hashing.
+// DeterministicReduce splits [0, count) into fixed blocks of `blockSize` items and combines the
+// block results in a fixed pairwise tree, so the floating-point result depends on the block size
+// only, never on the thread count or on which thread finished first.
+template <typename T, typename Map, typename Combine>
+T DeterministicReduce(size_t count, size_t blockSize, const T& identity, Map&& map, Combine&& combine,
+	ThreadPool& pool = ThreadPool::Global()) {
+	size_t blockCount = (count + blockSize - 1) / blockSize;
+	if (blockCount == 0) return identity;
+
+	std::vector<T> partial(blockCount, identity);
+	pool.ParallelFor(blockCount, 1, [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b)
+			partial[b] = map(b * blockSize, std::min((b + 1) * blockSize, count));
+	});
+	for (size_t width = 1; width < blockCount; width *= 2)
+		for (size_t b = 0; b + width < blockCount; b += 2 * width)
+			partial[b] = combine(partial[b], partial[b + width]);
+	return partial[0];
+}
+
+// 64-bit hash of the exact bits of every mass, position and velocity, in body order
+uint64_t HashBodyState(const BodyState& bodies, ThreadPool& pool = ThreadPool::Global());
+
+// Hash logs are text files with one "step hash" line per step, hashes in hex
+bool ReadHashLog(const std::string& path, std::vector<std::pair<uint64_t, uint64_t>>& entries, std::string& error);
+
+// Command line entry points: --hash-log runs a scene headless with a fixed step and writes the
+// hash of every step, --compare-hashes reports the first step at which two logs diverge.
+// The headless run is a double precision reference step over the shared force and contact code, not
+// the game's Euler step; compare logs of the game itself with the hash log of the Main Menu.
+int RunHashLogCommand(int argc, char* argv[]);
+int RunCompareHashesCommand(int argc, char* argv[]);
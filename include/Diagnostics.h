@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include <NBody.h>
+#include <ThreadPool.h>
+
+// Compensated sum (Neumaier's variant of Kahan summation). The rounding error of every addition
+// is carried in a second accumulator, so the total does not drift with the number of terms.
+class KahanSum {
+public:
+	void Add(const KahanSum& other) {
+		Add(other.m_sum);
+		m_compensation += other.m_compensation;
+	}
+
+	void Add(double value) {
+		double t = m_sum + value;
+		if (std::abs(m_sum) >= std::abs(value))
+			m_compensation += (m_sum - t) + value;
+		else
+			m_compensation += (value - t) + m_sum;
+		m_sum = t;
+	}
+
+	double Value() const { return m_sum + m_compensation; }
+	void Reset() { m_sum = m_compensation = 0.0; }
+
+private:
+	double m_sum = 0.0;
+	double m_compensation = 0.0;
+};
+
+// Conserved quantities of a system. The potential energy comes out of the force pass.
+struct Conservation {
+	double kinetic = 0.0;
+	double potential = 0.0;
+	glm::dvec3 momentum{ 0.0 };
+	glm::dvec3 angularMomentum{ 0.0 };    // About the origin
+	double momentumScale = 0.0;           // Sum of m |v|, the yardstick of the momentum drift
+	double angularMomentumScale = 0.0;    // Sum of m |r x v|
+
+	double Energy() const { return kinetic + potential; }
+};
+
+// Relative change of a sample against a reference sample. The vector quantities are measured
+// against the sum of the magnitudes of their terms, as their totals are often close to zero.
+struct ConservationDrift {
+	double energy = 0.0;
+	double momentum = 0.0;
+	double angularMomentum = 0.0;
+};
+
+ConservationDrift RelativeDrift(const Conservation& reference, const Conservation& current);
+
+// Sums the conserved quantities term by term while a force pass walks the bodies
+class ConservationAccumulator {
+public:
+	void Reset();
+
+	// Kinetic, momentum and angular momentum terms of one body
+	void AddBody(double mass, const glm::dvec3& position, const glm::dvec3& velocity);
+
+	// Potential energy of a pair or one body's share of it
+	void AddPotential(double energy) { m_potential.Add(energy); }
+
+	void Merge(const ConservationAccumulator& other);
+
+	Conservation Result() const;
+
+private:
+	KahanSum m_kinetic, m_potential;
+	KahanSum m_momentum[3], m_angularMomentum[3];
+	KahanSum m_momentumScale, m_angularMomentumScale;
+};
+
+// Conserved quantities of a body state with the per-body shares of the potential energy
+// returned by a force pass. Summed in parallel with a deterministic reduction.
+Conservation MeasureConservation(const BodyState& bodies, const std::vector<double>& potentialEnergy,
+	ThreadPool& pool = ThreadPool::Global());
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <NBody.h>
+#include <ExternalField.h>
+#include <ThreadPool.h>
+
+enum class KernelPrecision : uint8_t {
+	Double = 0, // Pair terms in double
+	Mixed = 1,  // Pair terms in float, accumulated in double
+};
+
+enum class SofteningModel : uint8_t {
+	None = 0,    // Newtonian, only the body itself is skipped
+	Plummer = 1, // 1 / sqrt(r^2 + eps^2)
+	Spline = 2,  // Gadget-2 cubic spline, exactly Newtonian beyond 2.8 eps
+};
+
+// Parallel direct summation (O(N^2)) over tiles of nearby bodies.
+// Targets are sorted along a Morton curve and handled in tiles. Every tile shifts all sources to
+// its own origin in double precision before they are rounded to the pair precision, so the
+// differences between nearby bodies keep the precision of their separation rather than of their
+// distance from the scene origin. Pair terms run over structure-of-arrays chunks in SSE2 registers
+// (4 floats or 2 doubles); the partial sums of every chunk go into double accumulators per body,
+// so long sums do not lose the small contributions.
+// Precision, softening and external field are template parameters of the kernel; every
+// combination is instantiated once and picked from a table, the pair loop has no runtime switches.
+class DirectKernel {
+public:
+	// Same results as ComputeAccelerations in NBody.h up to the pair precision and softening.
+	// potentialEnergy receives m_i phi_i / 2 per body plus its energy in the external field.
+	void ComputeAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel,
+		std::vector<double>* potentialEnergy = nullptr, ThreadPool& pool = ThreadPool::Global());
+
+	KernelPrecision precision = KernelPrecision::Mixed;
+	SofteningModel softening = SofteningModel::None;
+	double softeningLength = 0.0;             // eps, game length units
+	const ExternalField* external = nullptr;  // Not owned, skipped when null or empty
+	size_t targetCount = SIZE_MAX;            // Bodies from this index on are sources only, their accel stays zero
+
+private:
+	template <typename Real, template <typename> class Softening, bool WithExternal>
+	void run(size_t count, size_t targets, std::vector<glm::dvec3>& accel, std::vector<double>* potentialEnergy, ThreadPool& pool);
+
+	// Bodies in Morton order
+	std::vector<uint64_t> m_keys;
+	std::vector<uint32_t> m_order;
+	std::vector<double> m_x, m_y, m_z;
+	std::vector<double> m_gm;   // G * mass
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <NBody.h>
+
+// Monte-Carlo ensemble of many perturbed copies of one small planetary system.
+// Members are integrated in batches with one member per SIMD lane (structure of arrays with the
+// member index innermost), and the batches are spread over all cores.
+struct EnsembleConfig {
+	size_t members = 1024;
+	double duration = 0.0;          // Game time units
+	double dt = 0.0;                // Leapfrog step, game time units
+	double positionJitter = 1e-6;   // Relative gaussian perturbation of the positions
+	double velocityJitter = 1e-6;   // Relative gaussian perturbation of the velocities
+	double escapeFactor = 10.0;     // Unstable once a body is this many times further out than the outermost start
+	size_t checkInterval = 100;     // Steps between stability checks
+	uint64_t seed = 1;
+	std::string outputPath = "ensemble.bin";
+};
+
+struct EnsembleMemberResult {
+	float survivalTime;    // Time of the first instability, or the full duration
+	float energyError;     // Relative energy error at the end (or at the instability)
+	float maxEccentricity; // Largest eccentricity seen at the checks, relative to the central body
+	uint8_t stable;
+};
+
+struct EnsembleSummary {
+	size_t members = 0;
+	size_t stableMembers = 0;
+	double meanEnergyError = 0.0;
+	double stdEnergyError = 0.0;
+	double medianSurvivalTime = 0.0;
+	double meanMaxEccentricity = 0.0;
+};
+
+// Runs the ensemble around the base system (body 0 is treated as the central body)
+void RunEnsemble(const BodyState& base, const EnsembleConfig& config, std::vector<EnsembleMemberResult>& results, EnsembleSummary& summary);
+
+// Writes the compact results file (header, summary, one record per member)
+bool WriteEnsembleResults(const std::string& path, const EnsembleConfig& config, size_t bodyCount,
+	const std::vector<EnsembleMemberResult>& results, const EnsembleSummary& summary);
+
+// Sun + Jupiter, Saturn, Uranus and Neptune on circular coplanar orbits, in game units
+BodyState MakeOuterSolarSystem();
+
+// Command line entry point for --ensemble, returns the process exit code
+int RunEnsembleCommand(int argc, char* argv[]);
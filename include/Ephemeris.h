@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <MappedFile.h>
+#include <ThreadPool.h>
+
+// Piecewise Chebyshev fit of every body's trajectory, in the style of the JPL ephemerides.
+// Time is cut into segments of equal length, so the segment of a query time is one division.
+// Inside a segment every coordinate is sum c_k T_k(tau) with tau in [-1, 1]; the coefficients are
+// the least squares fit of all positions recorded in the segment plus the last one before and the
+// first one after it, accumulated while recording so no samples are kept.
+// Table layout per segment: [coefficient k][axis][slot], so the positions of all bodies at one time
+// are evaluated with Clenshaw's recurrence in SIMD registers over consecutive slots.
+// Layout of the file (little-endian): header, slot IDs and the coefficient table, both starting on a
+// 64-byte boundary so a mapped file is queried in place.
+constexpr char EPHEMERIS_MAGIC[8] = { 'G', 'S', 'E', 'P', 'H', 'E', 'M', '\0' };
+constexpr uint32_t EPHEMERIS_VERSION = 1;
+constexpr size_t EPHEMERIS_ALIGNMENT = 64;
+
+struct EphemerisHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	double startTime;            // [game time]
+	double segmentSpan;          // [game time]
+	uint32_t degree;
+	uint32_t slotCount;
+	uint64_t segmentCount;
+	uint64_t idOffset;           // uint32_t planet ID per slot
+	uint64_t coefficientOffset;  // segmentCount * (degree + 1) * 3 * slotCount doubles [game length]
+};
+
+class Ephemeris {
+public:
+	// Forgets the table and closes a mapped file
+	void Clear();
+	// Starts recording segments of the given span from startTime
+	void Begin(double startTime, double segmentSpan, uint32_t degree);
+	// Adds the positions of count bodies at time. An earlier time than the last one drops everything
+	// after it, so recording continues from a rewound scene.
+	void Record(double time, const uint32_t* ids, const glm::dvec3* position, size_t count, ThreadPool& pool = ThreadPool::Global());
+
+	bool Save(const std::string& path) const;
+	// Maps a saved ephemeris for queries, recording is off until the next Begin
+	bool Open(const std::string& path);
+
+	bool Recording() const { return m_segmentSpan > 0.0 && !m_file.IsOpen(); }
+	bool Empty() const { return m_segmentCount == 0; }
+	double StartTime() const { return m_startTime; }
+	double EndTime() const { return m_startTime + m_segmentCount * m_segmentSpan; }
+	double SegmentSpan() const { return m_segmentSpan; }
+	size_t SegmentCount() const { return m_segmentCount; }
+	size_t SlotCount() const { return m_slotCount; }   // Slots in the table, planets seen since the last fitted segment come later
+	uint32_t Degree() const { return m_degree; }
+	const uint32_t* SlotIds() const { return m_file.IsOpen() ? m_mappedIds : m_slotIds.data(); }
+	size_t TableBytes() const { return m_segmentCount * segmentStride() * sizeof(double); }
+	uint64_t SampleCount() const { return m_sampleCount; }   // Body positions recorded so far
+	const std::string& Error() const { return m_error; }
+
+	// Position of one planet, false if the time is not covered or the planet was not there throughout the segment
+	bool Position(uint32_t id, double time, glm::dvec3& position) const;
+	// Positions of all SlotCount() slots at one time, NaN for planets absent in that segment
+	bool Positions(double time, double* x, double* y, double* z) const;
+
+private:
+	size_t segmentStride() const { return (size_t(m_degree) + 1) * 3 * m_slotCount; }
+	const double* coefficients() const { return m_file.IsOpen() ? m_mappedCoefficients : m_table.data(); }
+	bool locate(double time, size_t& segment, double& tau) const;
+	uint32_t slotOf(uint32_t id);
+	uint32_t findSlot(uint32_t id) const;
+	void restride();
+	double windowTau(double time) const;
+	void accumulate(double tau, const uint32_t* ids, const glm::dvec3* position, size_t count, ThreadPool& pool);
+	void resetWindow();
+	void fitWindow(ThreadPool& pool);
+	void truncateAfter(double time, ThreadPool& pool);
+	bool fail(const char* message);
+
+	double m_startTime = 0.0;
+	double m_segmentSpan = 0.0;
+	uint32_t m_degree = 12;
+	size_t m_slotCount = 0;                  // Slot stride of the table
+	size_t m_segmentCount = 0;
+	uint64_t m_sampleCount = 0;
+
+	// Owned table while recording
+	std::vector<double> m_table;
+	std::vector<uint32_t> m_slotIds;         // Can be ahead of m_slotCount, the table grows at the next fit
+	std::vector<uint32_t> m_slotOfId;        // Indexed by planet ID
+
+	// Normal equations of the open segment, shared by every body that was in all of its samples
+	std::vector<double> m_normal;            // (degree + 1)^2
+	std::vector<double> m_rhs;               // Per slot, 3 * (degree + 1)
+	std::vector<uint32_t> m_slotSamples;     // Samples seen per slot in the open segment
+	uint32_t m_windowSamples = 0;
+	double m_lastTime = 0.0;
+	bool m_hasLast = false;
+	std::vector<uint32_t> m_lastIds;         // Last sample, also the first one of the next segment
+	std::vector<glm::dvec3> m_lastPosition;
+
+	MappedFile m_file;
+	const uint32_t* m_mappedIds = nullptr;
+	const double* m_mappedCoefficients = nullptr;
+	std::string m_error;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <NBody.h>
+#include <ThreadPool.h>
+
+// Fixed point mass that pulls on every body but does not move
+struct PointMassField {
+	glm::dvec3 position = glm::dvec3(0.0);
+	double mass = 0.0;   // Game mass units
+};
+
+// Navarro-Frenk-White dark matter halo, rho = rho0 / ((r / rs) (1 + r / rs)^2)
+struct NFWHalo {
+	glm::dvec3 center = glm::dvec3(0.0);
+	double mass = 0.0;          // 4 pi rho0 rs^3, the mass inside r is mass (ln(1 + x) - x / (1 + x)), x = r / rs
+	double scaleRadius = 1.0;   // rs
+};
+
+// Miyamoto-Nagai disk in the xy plane, phi = -G M / sqrt(R^2 + (a + sqrt(z^2 + b^2))^2)
+struct MiyamotoNagaiDisk {
+	glm::dvec3 center = glm::dvec3(0.0);
+	double mass = 0.0;
+	double scaleLength = 1.0;   // a
+	double scaleHeight = 0.1;   // b, > 0
+};
+
+// Fixed analytic background potentials added on top of the N-body forces. Every component is
+// evaluated for a whole block of bodies at a time in SIMD registers (2 doubles with SSE2).
+class ExternalField {
+public:
+	bool Empty() const { return pointMasses.empty() && halos.empty() && disks.empty(); }
+
+	// Adds the field's acceleration and potential per unit mass at count positions
+	void Evaluate(const double* x, const double* y, const double* z, size_t count,
+		double* ax, double* ay, double* az, double* phi) const;
+
+	// Adds the field's acceleration to every body and, if given, m phi to its potential energy
+	void AddAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel,
+		std::vector<double>* potentialEnergy = nullptr, ThreadPool& pool = ThreadPool::Global()) const;
+
+	std::vector<PointMassField> pointMasses;
+	std::vector<NFWHalo> halos;
+	std::vector<MiyamotoNagaiDisk> disks;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+#include <ThreadPool.h>
+
+// Radix-2 complex FFT of one power-of-two size, computing X[n] = sum_k x[k] e^(+-2 pi i k n / N)
+// without normalization. The twiddle factors are computed once in double precision.
+class FFT1D {
+public:
+	explicit FFT1D(size_t n);
+
+	// sign = +1 for the inverse (synthesis) direction, -1 for the forward one
+	void Transform(std::complex<float>* data, int sign) const;
+	size_t Size() const { return m_n; }
+
+private:
+	size_t m_n;
+	std::vector<std::complex<float>> m_twiddles; // e^(-2 pi i k / N), k < N/2
+	std::vector<size_t> m_bitReverse;
+};
+
+// In-place complex-to-real 3D transform of an n^3 grid (n a power of two).
+// Layout as FFTW's in-place r2c: data holds n * n * (n + 2) floats. On input row (x, y) holds the
+// n/2 + 1 complex modes kz = 0..n/2 of a Hermitian spectrum; on output the same row holds n reals
+// (the last two floats are padding). Unnormalized: x(r) = sum_k X(k) e^(+i k r).
+void InverseRealFFT3D(float* data, size_t n, ThreadPool& pool = ThreadPool::Global());
+
+inline bool IsPowerOfTwo(size_t n) {
+	return n >= 2 && (n & (n - 1)) == 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <NBody.h>
+#include <ThreadPool.h>
+
+// Importer for Gadget-2 binary snapshots (SnapFormat 1 and 2, HDF5 is not supported).
+// Either byte order is accepted, detected from the first record marker. Multi-file snapshots
+// are read completely when the first file ("snapshot_000.0") is given.
+constexpr int GADGET_TYPE_COUNT = 6;
+
+struct GadgetHeader {
+	uint32_t npart[GADGET_TYPE_COUNT];      // Particles of each type in this file
+	double massTable[GADGET_TYPE_COUNT];    // Mass per type, 0 when masses are in the MASS block
+	double time;                            // Scale factor for cosmological runs
+	double redshift;
+	int32_t flagSfr;
+	int32_t flagFeedback;
+	uint32_t npartTotal[GADGET_TYPE_COUNT]; // Over all files, low 32 bits
+	int32_t flagCooling;
+	int32_t numFiles;
+	double boxSize;
+	double omega0;
+	double omegaLambda;
+	double hubbleParam;
+	int32_t flagStellarAge;
+	int32_t flagMetals;
+	uint32_t npartTotalHighWord[GADGET_TYPE_COUNT];
+};
+
+struct GadgetImportOptions {
+	// Internal units of the simulation that wrote the file, Gadget-2 defaults: kpc/h, 10^10 Msun/h, km/s
+	double unitLengthInCm = 3.085678e21;
+	double unitMassInG = 1.989e43;
+	double unitVelocityInCmPerS = 1.0e5;
+	double hubbleParam = 0.0;     // Used to remove the h factors, 0 takes it from the header (1 if unset)
+	bool physical = false;        // Convert comoving coordinates to physical with the scale factor
+	uint8_t typeMask = 0x3F;      // Bit t imports particle type t
+};
+
+struct GadgetSnapshot {
+	GadgetHeader header = {};
+	BodyState bodies;             // In game units
+	std::vector<uint8_t> type;
+	std::vector<uint64_t> id;
+};
+
+bool LoadGadget(const std::string& path, const GadgetImportOptions& options, GadgetSnapshot& snapshot, std::string& error,
+	ThreadPool& pool = ThreadPool::Global());
@@ -1,32 +1,13 @@
 #pragma once
 
-#define KG_TO_GMASS 	1.0e-6
-#define METER_TO_GLEN	1.0e-9
-#define KM_TO_GLEN		(1000.0 * METER_TO_GLEN)
-#define SEC_TO_GSEC 	1.0e-6
-
-// DISPLAYED Units:
-// MASS: m [kg]
-// RADIUS: r [km]
-// POSITION: P [10^3 km]
-// VELOCITY: V [km/s]
-
-// Conversion To Game Units:
-// MASS: m [kg] -> m [kg] * kg2gm [gm = Game Mass Unit]
-// LENGTH: r [km] -> (r * 1000)[m] * meter2gl [gl = Game Length Unit]
-// TIME: [s] -> [s] * sec2gs [gs = Game Time Unit]
-// POSITION: P [10^3 km]-> (P * 10^3 * 10^3)[m] * meter2gl [gl]
-// VELOCITY: V [km/s] -> (V * 10^3 [m] * meter2gl) / ([s] * sec2gs) [gl/gs]
-
-
-// G in game units will be = G * meter2gl^3 / (kg2gm * sec2gs^2)
-constexpr double G = (6.67430e-11 * METER_TO_GLEN * METER_TO_GLEN * METER_TO_GLEN) / (KM_TO_GLEN * SEC_TO_GSEC * SEC_TO_GSEC);// In Game Units
+#include <Units.h>
 
 #pragma region Main Headers
 #include <glad/glad.h>
 #include <openglDebug.h>
 #include <vector>
 #include <iostream>
+#include <chrono>
 #pragma endregion
 
 #pragma region SDL3 Headers
@@ -49,9 +30,35 @@ constexpr double G = (6.67430e-11 * METER_TO_GLEN * METER_TO_GLEN * METER_TO_GLE
 #pragma region My Library Includes
 #include <shader.h>
 #include <sphere.h>
+#include <NBody.h>
+#include <WHFast.h>
+#include <Respa.h>
+#include <Parareal.h>
+#include <Hierarchy.h>
+#include <Regularization.h>
+#include <Octree.h>
+#include <Morton.h>
+#include <LBVH.h>
+#include <Kepler.h>
+#include <DirectKernel.h>
+#include <Collision.h>
+#include <Diagnostics.h>
+#include <Determinism.h>
+#include <PerfCounters.h>
+#include <Checkpoint.h>
+#include <Trajectory.h>
+#include <Timeline.h>
+#include <Ephemeris.h>
+#include <SceneLoader.h>
+#include <Gadget.h>
+#include <InitialConditions.h>
 #pragma endregion
 
+// Marks "no planet" wherever a stable planet ID is stored
+constexpr uint32_t INVALID_PLANET_ID = 0xFFFFFFFF;
+
 struct Planet {
+	uint32_t id = INVALID_PLANET_ID; // Stable ID, survives reordering of m_vPlanets
 	double mass;
 	double radius;
 	glm::vec3 position;
@@ -61,6 +68,12 @@ struct Planet {
 	Sphere renderer;
 	char name[16];
 
+	// On rails: follows a Kepler orbit around the primary instead of being integrated
+	uint32_t railsPrimary = INVALID_PLANET_ID;
+	glm::dvec3 railsPosition = glm::dvec3(0.0);   // Relative to the primary
+	glm::dvec3 railsVelocity = glm::dvec3(0.0);
+	bool OnRails() const { return railsPrimary != INVALID_PLANET_ID; }
+
 	Planet(double m, double r, float p[3], float v[3], float mat[3], const char nameData[16])
 		: mass(m), radius(r), position(glm::zero<glm::vec3>()), velocity(glm::zero<glm::vec3>()), material(glm::zero<glm::vec3>()), renderer(r, 10, 10) {
 		// Set Variables
@@ -84,9 +97,10 @@ struct Planet {
 
 	// Move constructor
 	Planet(Planet&& other) noexcept
-		: mass(other.mass), radius(other.radius),
+		: id(other.id), mass(other.mass), radius(other.radius),
 		position(std::move(other.position)), velocity(std::move(other.velocity)),
-		material(std::move(other.material)), renderer(std::move(other.renderer))
+		material(std::move(other.material)), renderer(std::move(other.renderer)),
+		railsPrimary(other.railsPrimary), railsPosition(other.railsPosition), railsVelocity(other.railsVelocity)
 	{
 		std::copy(std::begin(other.name), std::end(other.name), std::begin(name));
 	}
@@ -98,6 +112,7 @@ struct Planet {
 	// Move assignment operator
 	Planet& operator=(Planet&& other) noexcept {
 		if (this != &other) {
+			id = other.id;
 			mass = other.mass;
 			radius = other.radius;
 			position = std::move(other.position);
@@ -105,6 +120,9 @@ struct Planet {
 			material = std::move(other.material);
 			renderer = std::move(other.renderer);
 			std::copy(std::begin(other.name), std::end(other.name), std::begin(name));
+			railsPrimary = other.railsPrimary;
+			railsPosition = other.railsPosition;
+			railsVelocity = other.railsVelocity;
 		}
 		return *this;
 	}
@@ -121,8 +139,47 @@ public:
 	void Shutdown();
 
 private:
-	void ApplyGravity(Planet& pl1, Planet& pl2);
+	double ApplyGravity(Planet& pl1, Planet& pl2);
+	void stepEuler();
+	void updateExternalField();
+	void stepWHFast();
+	void stepRespa();
+	void stepParareal();
+	void stepHierarchical();
+	void updateConservation();
+	void hashState();
+	void resetConservation();
+	void onBodiesChanged();
+	void propagateRails(double gravity, double stepTime);
+	bool putOnRails(Planet& planet);
+	void releaseFromRails(Planet& planet);
+	void rebaseRails();
+	bool releaseCollidedFromRails(uint32_t index);
+	void putLightBodiesOnRails();
+	void reorderBodies();
+	void handleCollisions();
+	void handleSweptCollisions(double stepTime);
+	void applyMergeResult(const std::vector<uint8_t>& dead, const std::vector<uint32_t>& survivor);
+	void compactPlanets(const std::vector<uint8_t>& dead);
+	bool saveCheckpoint(const std::string& path);
+	bool loadCheckpoint(const std::string& path);
+	bool loadScene(const std::string& path, bool replace);
+	bool importGadget(const std::string& path, bool replace);
+	void generateBodies();
+	void appendPlanets(const BodyState& bodies, const uint8_t* group, const uint64_t* labels,
+		const char* const* groupNames, const float (*groupColors)[3], double radius, bool replace);
+	void startRecording();
+	void recordTrajectory();
+	void recordTimeline();
+	void seekTimeline(uint64_t step);
+	void recordEphemeris();
+	void drawEphemerisTrail();
+	Planet* findPlanet(uint32_t id);
+	// Gathers the first count planets, by default all of them
+	void gatherBodies(BodyState& bodies, size_t count = SIZE_MAX);
+	void scatterBodies(const BodyState& bodies);
 	void handleMouseEvent(SDL_Event& event);
+	void pickPlanet(float mouseX, float mouseY);
 	void handleKeyboard();
 
 	enum KeyState {
@@ -152,6 +209,64 @@ private:
 	bool m_runSim = false;
 
 	float m_timeMultiplier = 1.0f;
+	double m_simTime = 0.0; // Simulated time since the scene started [game time]
+	uint64_t m_stepCount = 0;
+
+	// Integrator Variables
+	enum Integrator {
+		INTEGRATOR_EULER = 0,
+		INTEGRATOR_WHFAST = 1,
+		INTEGRATOR_RESPA = 2,
+		INTEGRATOR_PARAREAL = 3,
+		INTEGRATOR_HIERARCHICAL = 4,
+	};
+	int m_integrator = INTEGRATOR_EULER;
+	float m_whOrbitFraction = 0.05f; // Step as a fraction of the innermost orbit
+	WHFast m_whFast;
+	RespaIntegrator m_respa;
+	int m_respaSubsteps = 16;          // Near-field substeps per frame
+	float m_respaCutoff = 100.0f;      // Near/far split distance [10^3 km]
+	Parareal m_parareal;
+	HierarchicalIntegrator m_hierarchy;
+
+	// Force Solver Variables (Euler integrator)
+	enum ForceSolver {
+		FORCE_DIRECT = 0,
+		FORCE_OCTREE = 1,
+		FORCE_LBVH = 2,
+		FORCE_TILED = 3,   // SIMD direct summation over Morton tiles, see DirectKernel
+	};
+	int m_forceSolver = FORCE_DIRECT;
+	float m_openingAngle = 0.5f;
+	Octree m_octree;
+	LBVH m_lbvh;
+	DirectKernel m_directKernel;
+	int m_kernelPrecision = int(KernelPrecision::Mixed);
+	int m_softeningModel = int(SofteningModel::None);
+	float m_softeningLength = 1.0f;    // [10^3 km]
+
+	// Close Pair Regularization (Euler integrator)
+	bool m_regularize = false;
+	float m_regularizeThreshold = 1000.0f; // Pairs closer than this are regularized [10^3 km]
+	PairRegularizer m_regularizer;
+	BodyState m_pairState;             // Integrated planets after the step, only the pairs are written back
+
+	// External Field Variables (Euler integrator), rebuilt from these every step
+	bool m_selfGravity = true;         // Off: bodies are test particles in the field
+	bool m_haloEnabled = false;
+	double m_haloMass = 6.4e31;        // NFW 4 pi rho0 rs^3 [kg]
+	float m_haloScaleRadius = 5.3e5f;  // [10^3 km]
+	bool m_diskEnabled = false;
+	double m_diskMass = 1.0e31;        // [kg]
+	float m_diskScaleLength = 1.0e5f;  // [10^3 km]
+	float m_diskScaleHeight = 9.3e3f;  // [10^3 km]
+	bool m_centralMassEnabled = false;
+	double m_centralMass = 7.4e29;     // [kg]
+	float m_fieldCenter[3] = { 0.0f, 0.0f, 0.0f }; // [10^3 km]
+	ExternalField m_externalField;
+	std::vector<double> m_pickRadii;
+	std::vector<glm::dvec3> m_accel;
+	BodyState m_bodyState;
 
 	// SDL Property
 	int m_width = 0;
@@ -179,6 +294,107 @@ private:
 
 	// Game Variables
 	std::vector<Planet> m_vPlanets;
+	uint32_t m_nextPlanetId = 0;
+	std::vector<uint32_t> m_planetIndexById; // Stable ID -> index in m_vPlanets
+	size_t m_railsBegin = 0;                 // Integrated planets come first, on-rails ones from here on
+	float m_railsMassRatio = 1e-3f;          // Bulk action: below this fraction of their primary's mass
+	std::vector<double> m_railsGm, m_railsX, m_railsY, m_railsZ, m_railsVx, m_railsVy, m_railsVz;
+	uint32_t m_selectedPlanetId = INVALID_PLANET_ID;
+
+	// Collision Variables
+	enum CollisionResponse {
+		COLLISION_MERGE = 0,
+		COLLISION_BOUNCE = 1,
+	};
+	bool m_collisions = false;         // Opt-in, scenes made before collisions keep their behaviour
+	int m_collisionResponse = COLLISION_MERGE;
+	float m_restitution = 0.8f;
+	SpatialHash m_spatialHash;
+	std::vector<double> m_radii;
+	std::vector<std::pair<uint32_t, uint32_t>> m_contacts;
+	std::vector<uint8_t> m_deadFlags;
+	std::vector<uint32_t> m_survivors;
+	size_t m_lastContactCount = 0;
+	size_t m_totalMerged = 0;
+
+	// Continuous Collision Variables
+	bool m_continuousCollisions = true;
+	std::vector<glm::dvec3> m_stepStart; // Positions before the integrator step
+	std::vector<SweptContact> m_sweptContacts;
+	LBVH m_sweptTree;
+	size_t m_lastSweptContactCount = 0;
+
+	// Morton Reordering Variables
+	bool m_mortonReorder = true;
+	int m_reorderInterval = 120; // Frames between reorders
+	int m_framesSinceReorder = 0;
+	std::vector<uint64_t> m_mortonKeys;
+	std::vector<uint32_t> m_mortonOrder;
+
+	// Cache misses of the force pass, measured around the last reorder
+	CacheMissCounter m_cacheMissCounter;
+	uint64_t m_lastForceCacheMisses = 0;
+	uint64_t m_cacheMissesBeforeReorder = 0;
+	uint64_t m_cacheMissesAfterReorder = 0;
+	bool m_measureAfterReorder = false;
+
+	// Determinism Variables
+	static constexpr double DETERMINISTIC_FRAME_TIME = 1.0 / 60.0;
+	double m_frameTime = 0.0;            // Wall time the current simulation step covers
+	bool m_deterministic = false;
+	bool m_hashEveryStep = false;
+	uint64_t m_stateHash = 0;
+	char m_hashLogPath[256] = "hashes.txt";
+	std::ofstream m_hashLog;
+
+	// Conservation Diagnostics
+	static constexpr int DRIFT_HISTORY = 256;
+	bool m_diagnosticsEnabled = true;
+	bool m_conservationValid = false;      // m_conservation was measured during this step
+	bool m_hasConservationReference = false;
+	Conservation m_conservation;
+	Conservation m_conservationReference;  // First sample since the bodies last changed
+	ConservationDrift m_drift;
+	std::vector<double> m_potentialEnergy; // Per body shares, filled by the force pass
+	float m_driftHistory[3][DRIFT_HISTORY] = {}; // log10 of the energy, momentum and angular momentum drift
+	int m_driftHistoryCount = 0;
+	int m_driftHistoryOffset = 0;
+
+	// Checkpoint Variables
+	char m_checkpointPath[256] = "scene.gscp";
+	std::string m_checkpointStatus;
+
+	// Trajectory Recorder Variables
+	TrajectoryRecorder m_recorder;
+	char m_trajectoryPath[256] = "trajectory.gstraj";
+	char m_trajectoryBodies[256] = "";   // Comma separated planet IDs, empty records all
+	int m_trajectoryInterval = 1;        // Record every k steps
+	bool m_trajectoryCompress = true;
+	float m_trajectoryPositionResolution = 1.0f;  // [km]
+	float m_trajectoryVelocityResolution = 1.0f;  // [m/s]
+	int m_trajectoryOverflow = int(TrajectoryOverflow::Throttle);
+	std::vector<uint32_t> m_recordIds;
+	std::string m_trajectoryStatus;
+
+	// Timeline Variables
+	Timeline m_timeline;
+	bool m_timelineEnabled = false;      // Opt-in, a long session spills its history to disk
+	int m_timelineKeyframeInterval = 64; // Steps between full keyframes
+	int m_timelineBudgetMB = 256;        // History kept in memory before spilling to disk
+	TimelineFrame m_timelineFrame;
+
+	// Ephemeris Variables
+	Ephemeris m_ephemeris;
+	bool m_ephemerisEnabled = false;
+	int m_ephemerisDegree = 12;
+	int m_ephemerisSegmentSteps = 64;    // Steps per Chebyshev segment
+	std::vector<uint32_t> m_ephemerisIds;
+	std::string m_ephemerisPath = "scene.ephem";
+	std::string m_ephemerisStatus;
+	double m_ephemerisQueryTime = 0.0;
+	bool m_showTrail = true;
+	int m_trailSegments = 16;            // Trail length of the selected planet
+	std::vector<ImVec2> m_trailPoints;
 
 	// Add Planet Menu Variables
 	double m_uiInputMass = 10;
@@ -187,4 +403,46 @@ private:
 	float  m_uiInputVel[3] = {0.0f, 0.0f, 0.0f};
 	float  m_uiInputCol[3] = {1.0f, 1.0f, 1.0f};
 	char   m_uiInputName[16] = {0};
+
+	// Scene File Variables
+	char m_scenePath[256] = "scene.csv";
+	bool m_sceneReplace = true;
+	std::string m_sceneStatus;
+
+	// Gadget-2 Import Variables
+	char m_gadgetPath[256] = "snapshot_000";
+	bool m_gadgetTypes[GADGET_TYPE_COUNT] = { true, true, true, true, true, true };
+	bool m_gadgetPhysical = false;
+	double m_gadgetHubble = 0.0;           // 0 uses the snapshot header
+	double m_gadgetParticleRadius = 1.0e6; // Drawn radius of a particle [km]
+
+	// Generator Variables
+	enum Generator {
+		GENERATOR_PLUMMER = 0,
+		GENERATOR_HERNQUIST = 1,
+		GENERATOR_DISK = 2,
+		GENERATOR_COLLISION = 3,
+		GENERATOR_ZELDOVICH = 4,
+	};
+	int m_generatorType = GENERATOR_PLUMMER;
+	int m_generatorCount = 10000;
+	double m_generatorMass = 1.0e31;         // [kg]
+	float m_generatorScale = 1.0e5f;         // [10^3 km]
+	float m_generatorScaleHeight = 0.1f;     // Of the disk scale length
+	float m_generatorToomreQ = 1.5f;
+	float m_generatorBulgeFraction = 0.2f;
+	float m_generatorHaloFraction = 1.0f;
+	float m_generatorHaloMassRatio = 5.0f;
+	float m_generatorSeparation = 20.0f;     // [disk scale lengths]
+	float m_generatorPericentre = 2.0f;      // [disk scale lengths]
+	float m_generatorInclination = 30.0f;    // [deg]
+	int m_generatorGridLog2 = 6;             // Zel'dovich bodies per side, as a power of two
+	float m_generatorSpectralIndex = -2.0f;
+	float m_generatorRmsDisplacement = 0.2f; // [cells]
+	char m_generatorSpectrumPath[256] = "";  // "k P(k)" table, k in 1 / 10^3 km, empty uses the power law
+	int m_generatorBudgetMB = 4096;
+	double m_generatorBodyRadius = 1.0e4;    // [km]
+	uint64_t m_generatorSeed = 1;
+	bool m_generatorReplace = true;
+	std::string m_generatorStatus;
 };
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <NBody.h>
+#include <ThreadPool.h>
+
+// Equilibrium initial conditions in game units.
+// Every body draws its random numbers from a Philox stream keyed by the seed and its own index,
+// so the output for a seed is the same for any thread count.
+
+// Plummer sphere, velocities sampled exactly from the isotropic distribution function
+void GeneratePlummer(BodyState& bodies, size_t count, double mass, double scaleRadius, uint64_t seed,
+	ThreadPool& pool = ThreadPool::Global());
+
+// Hernquist sphere, isotropic velocities with the Jeans equation dispersion
+void GenerateHernquist(BodyState& bodies, size_t count, double mass, double scaleRadius, uint64_t seed,
+	ThreadPool& pool = ThreadPool::Global());
+
+// Disk galaxy: exponential disk with an optional Hernquist bulge and halo. The disk rotates with
+// the circular velocity of all components and its dispersions follow from Toomre Q and the
+// vertical scale height; bulge and halo get Jeans dispersions in the total potential.
+struct GalaxyModel {
+	size_t diskCount = 20000;
+	size_t bulgeCount = 0;
+	size_t haloCount = 0;
+	double diskMass = 1.0;
+	double bulgeMass = 0.0;
+	double haloMass = 0.0;
+	double diskScaleLength = 1.0;
+	double diskScaleHeight = 0.1;
+	double bulgeScaleRadius = 0.2;
+	double haloScaleRadius = 5.0;
+	double toomreQ = 1.5;
+
+	size_t Count() const { return diskCount + bulgeCount + haloCount; }
+	double Mass() const { return diskMass + bulgeMass + haloMass; }
+};
+
+enum GalaxyComponent : uint8_t {
+	GALAXY_DISK = 0,
+	GALAXY_BULGE = 1,
+	GALAXY_HALO = 2,
+};
+
+// Disk in the xy plane around the origin, `component` receives a GalaxyComponent per body
+void GenerateGalaxy(BodyState& bodies, std::vector<uint8_t>& component, const GalaxyModel& model, uint64_t seed,
+	ThreadPool& pool = ThreadPool::Global());
+
+// Two copies of `model` on a parabolic orbit, starting `separation` apart with the given pericentre.
+// The second disk is tilted by `inclination` [rad]. The first galaxy's bodies come first.
+void GenerateGalaxyCollision(BodyState& bodies, std::vector<uint8_t>& component, const GalaxyModel& model,
+	double separation, double pericentre, double inclination, uint64_t seed, ThreadPool& pool = ThreadPool::Global());
+
+// Cosmological box: one body per cell of an n^3 lattice, displaced by the Zel'dovich approximation
+// from a Gaussian random density field with spectrum P(k). The field is synthesized mode by mode
+// in Fourier space and brought to the lattice with an in-place real FFT, one displacement component
+// at a time through a single grid, which is written straight into the body positions.
+// There is no expansion in the game, so velocities follow the growing mode of a static background,
+// psi ~ exp(t sqrt(4 pi G rho)).
+struct ZeldovichModel {
+	size_t gridSize = 64;             // Bodies per side, a power of two
+	double boxSize = 1.0;             // Side length, the box is centred on the origin
+	double mass = 1.0;                // Total
+	double spectralIndex = -2.0;      // P(k) ~ k^n when no table is given
+	std::vector<std::pair<double, double>> spectrum; // (k [1 / game length], P), log-log interpolated
+	double rmsDisplacement = 0.2;     // Expected rms displacement [cells], sets the amplitude of P(k)
+	size_t memoryBudget = size_t(4) << 30; // Bytes for the grid and the bodies
+
+	size_t Count() const { return gridSize * gridSize * gridSize; }
+	size_t MemoryRequired() const;
+};
+
+// Fails without touching `bodies` when the model is invalid or does not fit the memory budget
+bool GenerateZeldovich(BodyState& bodies, const ZeldovichModel& model, uint64_t seed, std::string& error,
+	ThreadPool& pool = ThreadPool::Global());
+
+// Two whitespace separated columns "k P(k)" per line, '#' starts a comment
+bool LoadPowerSpectrum(const std::string& path, std::vector<std::pair<double, double>>& spectrum, std::string& error);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Universal-variable Kepler propagation (Danby, "Fundamentals of Celestial Mechanics", ch. 6).
+// Works for elliptic, parabolic and hyperbolic orbits alike.
+
+// Stumpff functions c0..c3 of z = beta * s^2
+void StumpffC(double z, double c[4]);
+
+// State on an ellipse of semi-major axis a and eccentricity e < 1 at the given mean anomaly, with
+// periapsis on +x and the orbit in the xy plane. Solved in the eccentric anomaly, independent of the
+// universal variable drift, so it serves as the exact reference of the checks.
+void KeplerEllipseState(double gm, double a, double e, double meanAnomaly, glm::dvec3& r, glm::dvec3& v);
+
+// Advances a relative two-body state (r, v) by dt around a central mass with gravitational parameter gm
+void KeplerDrift(double gm, glm::dvec3& r, glm::dvec3& v, double dt);
+
+// Batched drift over n independent orbits stored as structure of arrays, two orbits per SSE2
+// register. Every orbit runs the same fixed number of solver iterations and a branch-free Stumpff
+// evaluation, so the loop body has no per-orbit control flow. Whole periods of bound orbits are
+// removed first, so dt may span many orbits.
+void KeplerDriftBatch(const double* gm, double* x, double* y, double* z,
+	double* vx, double* vy, double* vz, size_t n, double dt);
+
+// Checks KeplerDrift and KeplerDriftBatch against KeplerEllipseState, for
+// eccentricities up to 0.99 and drifts of many periods (--check-kepler).
+// Returns the process exit code, 1 if either solver is off.
+int RunKeplerCheck();
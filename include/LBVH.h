@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <NBody.h>
+#include <ThreadPool.h>
+
+// Node of the linear BVH. Internal nodes occupy [0, N-1), leaves [N-1, 2N-1).
+struct LBVHNode {
+	glm::dvec3 boundsMin;
+	glm::dvec3 boundsMax;
+	glm::dvec3 com;
+	double mass;
+	int32_t left;    // Child node indices, -1 for leaves
+	int32_t right;
+	int32_t parent;
+	uint32_t object; // Object index for leaves
+};
+
+// Linear bounding volume hierarchy built from Morton codes (Karras, "Maximizing Parallelism
+// in the Construction of BVHs, Octrees, and k-d Trees", HPG 2012).
+// Every step of the build (keys, radix sort, hierarchy, bottom-up bounds) is parallel, so the
+// build scales across cores like the force pass. One tree serves the Barnes-Hut force pass,
+// collision broad phase (box overlaps) and mouse picking (ray casts).
+class LBVH {
+public:
+	// Builds over axis aligned boxes, optionally carrying masses for Barnes-Hut (mass may be null)
+	void Build(const glm::dvec3* boxMin, const glm::dvec3* boxMax, const double* mass, size_t count,
+		ThreadPool& pool = ThreadPool::Global());
+
+	// Builds over the bodies, every leaf box is the sphere of the given radius (radius may be null for points)
+	void BuildFromBodies(const BodyState& bodies, const double* radius, ThreadPool& pool = ThreadPool::Global());
+
+	// Barnes-Hut accelerations (monopole) of bodies at the positions the tree was built from.
+	// The same traversal can fill `potentialEnergy` with m_i phi_i / 2 per body.
+	void ComputeAccelerations(const BodyState& bodies, double theta, std::vector<glm::dvec3>& accel,
+		ThreadPool& pool = ThreadPool::Global(), std::vector<double>* potentialEnergy = nullptr) const;
+
+	// All pairs (a < b) of objects whose boxes overlap
+	void FindOverlappingPairs(std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool = ThreadPool::Global()) const;
+
+	// Objects whose boxes overlap [lo, hi]
+	void QueryBox(const glm::dvec3& lo, const glm::dvec3& hi, std::vector<uint32_t>& out) const;
+
+	// Closest sphere hit by the ray origin + t * dir (t >= 0). Returns false when nothing is hit.
+	bool Raycast(const glm::dvec3& origin, const glm::dvec3& dir, const glm::dvec3* centers, const double* radii,
+		uint32_t& hitObject, double& hitT) const;
+
+	size_t LeafCount() const { return m_leafCount; }
+	const std::vector<LBVHNode>& Nodes() const { return m_nodes; }
+	int32_t Root() const { return m_leafCount > 1 ? 0 : (m_leafCount == 1 ? 0 : -1); }
+
+private:
+	void buildHierarchy(ThreadPool& pool);
+	void refitBottomUp(const glm::dvec3* boxMin, const glm::dvec3* boxMax, const double* mass, ThreadPool& pool);
+	int delta(int64_t i, int64_t j) const;
+
+	size_t m_leafCount = 0;
+	std::vector<LBVHNode> m_nodes;
+	std::vector<uint64_t> m_keys;
+	std::vector<uint32_t> m_sortedObjects;
+	std::vector<glm::dvec3> m_centers;
+	std::vector<glm::dvec3> m_boxMin, m_boxMax;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_visits;
+	size_t m_visitsSize = 0;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <ThreadPool.h>
+
+// 63-bit Morton (Z-order) keys, 21 bits per axis
+uint64_t MortonEncode(uint32_t x, uint32_t y, uint32_t z);
+
+// Quantizes the positions to the 2^21 grid spanning [lo, hi] and computes their Morton keys (parallel, SSE2 where available)
+void ComputeMortonKeys(const glm::dvec3* positions, size_t count, const glm::dvec3& lo, const glm::dvec3& hi, std::vector<uint64_t>& keys,
+	ThreadPool& pool = ThreadPool::Global());
+
+// Stable parallel LSD radix sort of keys with a payload, 8 bits per pass.
+// Passes whose digit is identical for all keys are skipped.
+void RadixSortPairs(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int keyBits = 63,
+	ThreadPool& pool = ThreadPool::Global());
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Double precision body state used by the physics code.
+// Kept free of any rendering state so integrators can run on copies of the scene.
+struct BodyState {
+	std::vector<double> mass;
+	std::vector<glm::dvec3> position;
+	std::vector<glm::dvec3> velocity;
+
+	size_t Size() const { return mass.size(); }
+
+	void Resize(size_t count) {
+		mass.resize(count);
+		position.resize(count);
+		velocity.resize(count);
+	}
+};
+
+// Direct summation of the Newtonian accelerations of all bodies (O(N^2)).
+// When `potentialEnergy` is given the same pair loop fills it with one share of the potential
+// energy per body (the pairs with the bodies after it), the shares add up to the total.
+void ComputeAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel, std::vector<double>* potentialEnergy = nullptr);
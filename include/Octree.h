@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <NBody.h>
+
+// Node of the Barnes-Hut octree. Nodes live in one pool and link to each other by index.
+struct OctreeNode {
+	// Cell geometry assigned at build time
+	glm::dvec3 center;
+	double halfSize;
+
+	// Tight bounds, mass and centre of mass, refit every step
+	glm::dvec3 boundsMin;
+	glm::dvec3 boundsMax;
+	glm::dvec3 com;
+	double mass;
+
+	int32_t parent;
+	int32_t firstChild;  // Children are stored contiguously, -1 for leaves
+	uint32_t childCount;
+	uint32_t firstBody;  // Range into the body index list
+	uint32_t bodyCount;
+	uint32_t depth;
+};
+
+// Persistent Barnes-Hut octree.
+// The topology is kept between steps and only the node bounds and monopoles are refit
+// bottom-up (level by level, in parallel). The tree is rebuilt when too many bodies have
+// left the cell they were sorted into or when the refit leaf bounds overlap too much.
+class Octree {
+public:
+	// Refits the tree to the new positions, rebuilding it if needed
+	void Update(const BodyState& bodies);
+
+	// Forces a rebuild on the next Update (bodies added, removed or reordered)
+	void Invalidate();
+
+	// Barnes-Hut accelerations of all bodies (monopole approximation). The same traversal can fill
+	// `potentialEnergy` with m_i phi_i / 2 per body, which add up to the total potential energy.
+	void ComputeAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel, std::vector<double>* potentialEnergy = nullptr) const;
+
+	const std::vector<OctreeNode>& Nodes() const { return m_nodes; }
+
+	double theta = 0.5;                  // Opening angle
+	uint32_t leafSize = 8;               // Maximum bodies per leaf
+	double rebuildEscapeFraction = 0.1;  // Rebuild when this fraction of bodies left their leaf cell
+	double rebuildOverlapRatio = 2.0;    // Rebuild when the summed leaf volume exceeds this times the root volume
+
+	// Statistics
+	size_t rebuildCount = 0;
+	size_t refitCount = 0;
+	double lastEscapeFraction = 0.0;
+	double lastOverlapRatio = 0.0;
+
+private:
+	void build(const BodyState& bodies);
+	void refit(const BodyState& bodies);
+	void subdivide(const BodyState& bodies, int32_t nodeIndex);
+
+	std::vector<OctreeNode> m_nodes;          // Node pool, capacity is reused between builds
+	std::vector<uint32_t> m_bodyIndex;        // Bodies sorted by leaf
+	std::vector<uint32_t> m_scratch;
+	std::vector<std::vector<int32_t>> m_levels; // Node indices per depth, for the bottom-up refit
+	std::vector<uint32_t> m_leafEscaped;      // Escaped body count per node (leaves only)
+	std::vector<double> m_leafVolume;
+	size_t m_bodyCount = 0;
+	bool m_valid = false;
+};
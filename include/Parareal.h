@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <NBody.h>
+
+// Parareal parallel-in-time integration (Lions, Maday & Turinici 2001).
+// The interval is split into time slices; a cheap coarse propagator (leapfrog, few steps) runs
+// serially across the slices while the accurate fine propagator (4th order Yoshida, many steps)
+// runs on all slices in parallel. The predictor-corrector
+//     U[n+1] = G(U_new[n]) + F(U_old[n]) - G(U_old[n])
+// is iterated until the slice boundaries stop changing. Meant for small N, where parallelizing
+// over bodies gains nothing.
+class Parareal {
+public:
+	void Integrate(BodyState& bodies, double totalTime);
+
+	size_t slices = 0;                 // Time slices, 0 = one per thread
+	size_t coarseStepsPerSlice = 1;
+	size_t fineStepsPerSlice = 100;
+	size_t maxIterations = 0;          // 0 = up to the slice count (then the result equals the serial fine run)
+	double tolerance = 1e-10;          // Relative change of the slice boundaries that counts as converged
+
+	// Statistics of the last call to Integrate
+	size_t lastIterations = 0;
+	double lastCorrection = 0.0;
+	double lastWallSeconds = 0.0;
+	double lastFineSliceSeconds = 0.0;  // Average cost of one fine slice
+	// Serial fine time estimated from the measured slice cost, over the parallel wall time
+	double EstimatedSpeedup() const;
+
+	// The propagators, exposed for benchmarking against the serial fine integrator
+	static void Coarse(BodyState& bodies, double dt, size_t steps);
+	static void Fine(BodyState& bodies, double dt, size_t steps);
+
+private:
+	std::vector<BodyState> m_u;       // Slice boundary states
+	std::vector<BodyState> m_fine;    // F(U_old[n])
+	std::vector<BodyState> m_coarse;  // G(U_old[n])
+	std::vector<double> m_fineSeconds;
+	size_t m_usedSlices = 0;
+};
+
+// Command line entry point for --parareal: compares against the serial fine integrator
+int RunPararealCommand(int argc, char* argv[]);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <ThreadPool.h>
+
+// Hardware cache miss counter summed over the threads of a pool, the caller included.
+// Uses one perf_event_open counter per thread on Linux; elsewhere (or without permission)
+// Available() is false and Stop() returns 0.
+class CacheMissCounter {
+public:
+	explicit CacheMissCounter(ThreadPool& pool = ThreadPool::Global());
+	~CacheMissCounter();
+
+	CacheMissCounter(const CacheMissCounter&) = delete;
+	CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+	bool Available() const { return !m_fds.empty(); }
+
+	void Start();
+	// Returns the number of cache misses since Start
+	uint64_t Stop();
+
+private:
+	uint64_t read() const;
+
+	std::vector<int> m_fds;
+	uint64_t m_start = 0;
+};
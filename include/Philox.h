@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Philox4x32-10 counter-based random numbers (Salmon et al. 2011, Random123).
+// The output is a pure function of (key, counter), so every body can draw its own numbers
+// from its index and the result does not depend on how the work is split across threads.
+inline void Philox4x32(const uint32_t counter[4], uint32_t k0, uint32_t k1, uint32_t out[4]) {
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	for (int round = 0; round < 10; ++round) {
+		uint64_t p0 = uint64_t(0xD2511F53u) * c0;
+		uint64_t p1 = uint64_t(0xCD9E8D57u) * c2;
+		uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+		uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+		c1 = uint32_t(p1);
+		c3 = uint32_t(p0);
+		c0 = n0;
+		c2 = n2;
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+	out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// Stream of numbers for one item: counter = (index, stream, block)
+class PhiloxStream {
+public:
+	PhiloxStream(uint64_t seed, uint64_t index, uint32_t stream)
+		: m_k0(uint32_t(seed)), m_k1(uint32_t(seed >> 32)) {
+		m_counter[0] = uint32_t(index);
+		m_counter[1] = uint32_t(index >> 32);
+		m_counter[2] = stream;
+		m_counter[3] = 0;
+	}
+
+	uint32_t Next() {
+		if (m_used == 4) {
+			Philox4x32(m_counter, m_k0, m_k1, m_buffer);
+			++m_counter[3];
+			m_used = 0;
+		}
+		return m_buffer[m_used++];
+	}
+
+	// Uniform in (0, 1), never exactly 0 or 1
+	double Uniform() {
+		return (double(Next()) + 0.5) * (1.0 / 4294967296.0);
+	}
+
+	// Standard normal (Box-Muller)
+	double Normal() {
+		if (m_hasSpare) {
+			m_hasSpare = false;
+			return m_spare;
+		}
+		double r = std::sqrt(-2.0 * std::log(Uniform()));
+		double phi = 6.283185307179586 * Uniform();
+		m_spare = r * std::sin(phi);
+		m_hasSpare = true;
+		return r * std::cos(phi);
+	}
+
+private:
+	uint32_t m_k0, m_k1;
+	uint32_t m_counter[4];
+	uint32_t m_buffer[4] = {};
+	int m_used = 4;
+	double m_spare = 0.0;
+	bool m_hasSpare = false;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <NBody.h>
+
+// r-RESPA multiple timestep integrator (Tuckerman, Berne & Martyna 1992).
+// Gravity is split by pair distance into a near part that is integrated every substep and
+// a slowly varying far part that is only re-evaluated every farInterval substeps.
+// The split uses a smooth switch between (cutoff - switchWidth) and cutoff so that both
+// parts stay continuous and the scheme remains symplectic.
+class RespaIntegrator {
+public:
+	// Advances the bodies by totalTime in substeps of at most innerStep, rounded up to a
+	// whole number of outer (far-field) steps.
+	void Integrate(BodyState& bodies, double totalTime, double innerStep);
+
+	// Drops the cached far-field accelerations. Must be called whenever bodies are added,
+	// removed, reordered, or their masses / positions are edited outside the integrator.
+	void Invalidate();
+
+	double cutoff = 1.0;       // Near/far split distance (game units)
+	double switchWidth = 0.2;  // Width of the smooth switching region (fraction of cutoff)
+	int farInterval = 4;       // Substeps between far-field evaluations (k)
+
+	// Statistics of the last call to Integrate
+	size_t lastNearEvaluations = 0;
+	size_t lastFarEvaluations = 0;
+
+private:
+	double switchFunction(double dist) const;
+	void computeNear(const BodyState& bodies, std::vector<glm::dvec3>& accel);
+	void computeFar(const BodyState& bodies, std::vector<glm::dvec3>& accel);
+	void buildCells(const BodyState& bodies);
+
+	// Cached accelerations, valid for the positions left by the last Integrate call
+	std::vector<glm::dvec3> m_farAccel;
+	std::vector<glm::dvec3> m_nearAccel;
+	bool m_cacheValid = false;
+	double m_cacheCutoff = 0.0;
+	double m_cacheSwitchWidth = 0.0;
+
+	// Uniform grid with cell size = cutoff for the near-field pair search
+	std::vector<uint32_t> m_cellOrder;      // Body indices sorted by cell
+	std::vector<uint64_t> m_cellKeys;       // Cell key of every body
+	std::vector<uint64_t> m_cellStartKeys;  // Sorted unique cell keys
+	std::vector<uint32_t> m_cellStart;      // First entry in m_cellOrder of each unique cell
+};
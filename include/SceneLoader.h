@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ThreadPool.h>
+
+// Body as written in a scene file, in the display units of the Add Planet menu
+struct SceneBody {
+	char name[16];
+	double mass;         // [kg]
+	double radius;       // [km]
+	float position[3];   // [10^3 km]
+	float velocity[3];   // [km/s]
+	float color[3];      // [0, 1], white when not given
+};
+
+// Loads a JSON or CSV scene (picked by the first non-blank character: '[' or '{' is JSON).
+// The file is memory mapped and tokenized in place; the bodies are split into chunks that are
+// parsed in parallel straight into their final slots of `bodies`.
+//
+// CSV: one body per line, name,mass,radius,x,y,z,vx,vy,vz[,r,g,b]. A first line that does not
+// parse as a body is taken as the column header; blank lines and lines starting with '#' are skipped.
+// JSON: an array of bodies, or an object with a "bodies" array. A body is an object with
+//     "name", "mass", "radius", "position": [x, y, z], "velocity": [x, y, z], "color": [r, g, b]
+bool LoadScene(const std::string& path, std::vector<SceneBody>& bodies, std::string& error, ThreadPool& pool = ThreadPool::Global());
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_USE_SSE2 1
+#endif
+
+// Thin wrappers over one register of float or double values, so kernels can be written once as
+// templates over the operations. ScalarOps handles one value and is also used for loop tails.
+// The compiler does not vectorize std::sqrt on its own as long as it may set errno, which is why
+// the kernels use these instead of relying on auto-vectorization.
+template <typename Real>
+struct ScalarOps {
+	using T = Real;
+	using V = Real;
+	using Mask = bool;
+	static constexpr size_t Width = 1;
+	static V Set(Real x) { return x; }
+	static V Load(const Real* p) { return *p; }
+	static void Store(Real* p, V a) { *p = a; }
+	static V Add(V a, V b) { return a + b; }
+	static V Sub(V a, V b) { return a - b; }
+	static V Mul(V a, V b) { return a * b; }
+	static V Div(V a, V b) { return a / b; }
+	static V Sqrt(V a) { return std::sqrt(a); }
+	static V Log(V a) { return std::log(a); }
+	static Mask Greater(V a, V b) { return a > b; }
+	static Mask Less(V a, V b) { return a < b; }
+	static Mask LessEqual(V a, V b) { return a <= b; }
+	static Mask Equal(V a, V b) { return a == b; }
+	static Mask And(Mask a, Mask b) { return a && b; }
+	static V Select(Mask m, V a, V b) { return m ? a : b; }
+	static V Abs(V a) { return std::abs(a); }
+	static V Round(V a) { return std::nearbyint(a); }
+	static double Sum(V a) { return double(a); }
+	static double MaxLane(V a) { return double(a); }
+};
+
+// Falls back to one value at a time without SSE2
+template <typename Real>
+struct SimdOps : ScalarOps<Real> {};
+
+#ifdef SIMD_USE_SSE2
+template <>
+struct SimdOps<float> {
+	using T = float;
+	using V = __m128;
+	using Mask = __m128;
+	static constexpr size_t Width = 4;
+	static V Set(float x) { return _mm_set1_ps(x); }
+	static V Load(const float* p) { return _mm_loadu_ps(p); }
+	static void Store(float* p, V a) { _mm_storeu_ps(p, a); }
+	static V Add(V a, V b) { return _mm_add_ps(a, b); }
+	static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V Div(V a, V b) { return _mm_div_ps(a, b); }
+	static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+	static Mask Greater(V a, V b) { return _mm_cmpgt_ps(a, b); }
+	static Mask Less(V a, V b) { return _mm_cmplt_ps(a, b); }
+	static Mask LessEqual(V a, V b) { return _mm_cmple_ps(a, b); }
+	static Mask Equal(V a, V b) { return _mm_cmpeq_ps(a, b); }
+	static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+	static V Select(Mask m, V a, V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	static V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	// Nearest integer for |a| < 2^22, SSE2 has no rounding instruction
+	static V Round(V a) { return _mm_sub_ps(_mm_add_ps(a, _mm_set1_ps(12582912.0f)), _mm_set1_ps(12582912.0f)); }
+	static double Sum(V a) {
+		alignas(16) float lanes[4];
+		_mm_store_ps(lanes, a);
+		return (double(lanes[0]) + double(lanes[1])) + (double(lanes[2]) + double(lanes[3]));
+	}
+	static double MaxLane(V a) {
+		alignas(16) float lanes[4];
+		_mm_store_ps(lanes, a);
+		return double(std::fmax(std::fmax(lanes[0], lanes[1]), std::fmax(lanes[2], lanes[3])));
+	}
+};
+
+template <>
+struct SimdOps<double> {
+	using T = double;
+	using V = __m128d;
+	using Mask = __m128d;
+	static constexpr size_t Width = 2;
+	static V Set(double x) { return _mm_set1_pd(x); }
+	static V Load(const double* p) { return _mm_loadu_pd(p); }
+	static void Store(double* p, V a) { _mm_storeu_pd(p, a); }
+	static V Add(V a, V b) { return _mm_add_pd(a, b); }
+	static V Sub(V a, V b) { return _mm_sub_pd(a, b); }
+	static V Mul(V a, V b) { return _mm_mul_pd(a, b); }
+	static V Div(V a, V b) { return _mm_div_pd(a, b); }
+	static V Sqrt(V a) { return _mm_sqrt_pd(a); }
+	static Mask Greater(V a, V b) { return _mm_cmpgt_pd(a, b); }
+	static Mask Less(V a, V b) { return _mm_cmplt_pd(a, b); }
+	static Mask LessEqual(V a, V b) { return _mm_cmple_pd(a, b); }
+	static Mask Equal(V a, V b) { return _mm_cmpeq_pd(a, b); }
+	static Mask And(Mask a, Mask b) { return _mm_and_pd(a, b); }
+	static V Select(Mask m, V a, V b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+	static V Abs(V a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+	// Nearest integer for |a| < 2^51, SSE2 has no rounding instruction
+	static V Round(V a) { return _mm_sub_pd(_mm_add_pd(a, _mm_set1_pd(6755399441055744.0)), _mm_set1_pd(6755399441055744.0)); }
+	static double Sum(V a) {
+		alignas(16) double lanes[2];
+		_mm_store_pd(lanes, a);
+		return lanes[0] + lanes[1];
+	}
+	static double MaxLane(V a) {
+		alignas(16) double lanes[2];
+		_mm_store_pd(lanes, a);
+		return std::fmax(lanes[0], lanes[1]);
+	}
+
+	// Natural log of positive normal numbers to about 1 ulp. x = m 2^e with m in [sqrt(1/2), sqrt(2)),
+	// log m from the atanh series of f = (m - 1) / (m + 1), |f| < 0.172.
+	static V Log(V x) {
+		const __m128i bits = _mm_castpd_si128(x);
+		__m128i exponent = _mm_sub_epi64(_mm_srli_epi64(bits, 52), _mm_set1_epi64x(1023));
+		V e = _mm_cvtepi32_pd(_mm_shuffle_epi32(exponent, _MM_SHUFFLE(3, 3, 2, 0)));
+		V m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi64x(0x000fffffffffffffLL)),
+			_mm_set1_epi64x(0x3ff0000000000000LL)));
+		Mask high = _mm_cmpgt_pd(m, _mm_set1_pd(1.4142135623730951));
+		m = Select(high, _mm_mul_pd(m, _mm_set1_pd(0.5)), m);
+		e = Select(high, _mm_add_pd(e, _mm_set1_pd(1.0)), e);
+
+		V f = _mm_div_pd(_mm_sub_pd(m, _mm_set1_pd(1.0)), _mm_add_pd(m, _mm_set1_pd(1.0)));
+		V f2 = _mm_mul_pd(f, f);
+		V series = _mm_set1_pd(1.0 / 21.0);
+		for (int k = 9; k >= 0; --k)
+			series = _mm_add_pd(_mm_set1_pd(1.0 / (2 * k + 1)), _mm_mul_pd(f2, series));
+		return _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(0.6931471805599453)), _mm_mul_pd(_mm_add_pd(f, f), series));
+	}
+};
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free ring buffer for one producer and one consumer thread.
+// Slots are constructed once and reused, so a producer that fills a slot's containers in place
+// stops allocating once they have grown to size. One slot is kept free to tell full from empty.
+template<typename T>
+class SpscRing {
+public:
+	explicit SpscRing(size_t capacity) : m_slots(capacity + 1) {}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// Producer: slot to fill, or nullptr when the ring is full. Publish it with EndPush.
+	T* BeginPush() {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (next(tail) == m_head.load(std::memory_order_acquire)) return nullptr;
+		return &m_slots[tail];
+	}
+	void EndPush() {
+		m_tail.store(next(m_tail.load(std::memory_order_relaxed)), std::memory_order_release);
+	}
+
+	// Consumer: oldest published slot, or nullptr when empty. Release it with EndPop.
+	T* BeginPop() {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) return nullptr;
+		return &m_slots[head];
+	}
+	void EndPop() {
+		m_head.store(next(m_head.load(std::memory_order_relaxed)), std::memory_order_release);
+	}
+
+	// Approximate when called while the other side is running
+	size_t Size() const {
+		size_t head = m_head.load(std::memory_order_acquire), tail = m_tail.load(std::memory_order_acquire);
+		return tail >= head ? tail - head : tail + m_slots.size() - head;
+	}
+	size_t Capacity() const { return m_slots.size() - 1; }
+
+private:
+	size_t next(size_t index) const { return index + 1 == m_slots.size() ? 0 : index + 1; }
+
+	std::vector<T> m_slots;
+	alignas(64) std::atomic<size_t> m_head{ 0 }; // Written by the consumer
+	alignas(64) std::atomic<size_t> m_tail{ 0 }; // Written by the producer
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for data parallel loops in the physics code.
+// ParallelFor splits [0, count) into chunks of `grain` items that are handed out
+// dynamically to the workers and the calling thread, and returns when all are done.
+class ThreadPool {
+public:
+	// threadCount = 0 uses all hardware threads. The calling thread counts as one of them.
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& fn);
+
+	// Calls fn exactly once on every thread of the pool, with indices 0 .. ThreadCount() - 1.
+	// Nested calls from inside the pool only run on the calling thread.
+	void RunOnEachThread(const std::function<void(size_t thread)>& fn);
+
+	// Total number of threads taking part in ParallelFor (workers + caller)
+	size_t ThreadCount() const { return m_workers.size() + 1; }
+
+	// Pool shared by the simulation
+	static ThreadPool& Global();
+
+	// Thread count of the global pool, only has an effect before its first use
+	static void SetGlobalThreadCount(size_t threadCount);
+
+private:
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	// Current job
+	const std::function<void(size_t, size_t)>* m_job = nullptr;
+	size_t m_count = 0;
+	size_t m_grain = 1;
+	std::atomic<size_t> m_next{ 0 };
+	size_t m_busyWorkers = 0;
+	uint64_t m_generation = 0;
+	bool m_stop = false;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// In-memory history of the scene for scrubbing back in time.
+// Every step is stored as a frame inside a segment: the first frame of a segment is a full
+// keyframe, the following ones store each field as the varint of its bit pattern XORed with the
+// previous frame (lossless, slowly moving values only differ in the low mantissa bits).
+// Seeking decodes one keyframe plus at most keyframeInterval - 1 deltas. When the segments outgrow
+// the memory budget the oldest ones are moved to a spill file and read back on demand.
+struct TimelineFrame {
+	uint64_t step = 0;
+	double time = 0.0;
+	std::vector<uint32_t> ids;
+	std::vector<double> mass;
+	std::vector<double> radius;
+	std::vector<glm::vec3> position;
+	std::vector<glm::vec3> velocity;
+};
+
+// Display data of a planet, kept once per ID so planets that merged away can be restored
+struct TimelineBodyInfo {
+	char name[16];
+	glm::vec3 color;
+};
+
+class Timeline {
+public:
+	~Timeline();
+
+	void Clear();
+	void Record(const TimelineFrame& frame);
+	// Returns the latest frame at or before step
+	bool Seek(uint64_t step, TimelineFrame& frame);
+	// Forgets everything after step, used when the simulation resumes from a past frame
+	void TruncateAfter(uint64_t step);
+
+	void SetBodyInfo(uint32_t id, const char name[16], const glm::vec3& color);
+	const TimelineBodyInfo* BodyInfo(uint32_t id) const;
+
+	bool Empty() const { return m_segments.empty(); }
+	uint64_t FirstStep() const { return m_segments.empty() ? 0 : m_segments.front().firstStep; }
+	uint64_t LastStep() const { return m_segments.empty() ? 0 : m_segments.back().lastStep; }
+	size_t SegmentCount() const { return m_segments.size(); }
+	size_t MemoryUsed() const { return m_memoryUsed; }
+	uint64_t SpilledBytes() const { return m_spilledBytes; }
+
+	size_t keyframeInterval = 64;               // Frames per segment (K)
+	size_t memoryBudget = size_t(256) << 20;    // Bytes of segment data kept in memory
+	std::string spillPath = "timeline.spill";
+
+private:
+	struct Segment {
+		uint64_t firstStep = 0;
+		uint64_t lastStep = 0;
+		std::vector<uint8_t> bytes;
+		std::vector<uint32_t> frameOffsets; // Byte offset and step of every frame, for truncation
+		std::vector<uint64_t> frameSteps;
+		bool spilled = false;
+		uint64_t spillOffset = 0;
+		uint64_t spillSize = 0;
+	};
+
+	void encodeKeyframe(std::vector<uint8_t>& out, const TimelineFrame& frame) const;
+	void encodeDelta(std::vector<uint8_t>& out, const TimelineFrame& frame) const;
+	bool decode(const std::vector<uint8_t>& bytes, uint64_t step, TimelineFrame& frame) const;
+	bool loadSegment(const Segment& segment, std::vector<uint8_t>& bytes);
+	void enforceBudget();
+	void clearFrames();
+
+	std::vector<Segment> m_segments;
+	bool m_segmentOpen = false;       // The last segment accepts delta frames
+	TimelineFrame m_previous;         // Last recorded frame, the delta reference
+	size_t m_memoryUsed = 0;
+	uint64_t m_spilledBytes = 0;
+
+	std::fstream m_spill;
+	uint64_t m_spillEnd = 0;
+	std::vector<uint8_t> m_loadBuffer;
+
+	std::vector<TimelineBodyInfo> m_bodyInfo;
+	std::vector<uint8_t> m_hasBodyInfo;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include <NBody.h>
+#include <Diagnostics.h>
+#include <MappedFile.h>
+#include <SpscRing.h>
+
+// Streaming trajectory files.
+// Layout (little-endian): header, chunks of frames, chunk index, footer. The first frame of every
+// chunk is stored raw so chunks decode independently; with DeltaQuantized the following frames
+// store positions and velocities snapped to a fixed quantum as zigzag varint differences to the
+// previous frame. The error stays below half a quantum and does not accumulate.
+// Version 2 frames may carry the conserved quantities of the whole system at that step.
+constexpr char TRAJECTORY_MAGIC[8] = { 'G', 'S', 'T', 'R', 'A', 'J', '\0', '\0' };
+constexpr char TRAJECTORY_INDEX_MAGIC[8] = { 'G', 'S', 'T', 'R', 'I', 'D', 'X', '\0' };
+constexpr uint32_t TRAJECTORY_VERSION = 2;
+
+enum class TrajectoryCompression : uint32_t {
+	None = 0,
+	DeltaQuantized = 1,
+};
+
+// What the simulation does when the writer falls behind and the ring fills up
+enum class TrajectoryOverflow : uint32_t {
+	Drop = 0,     // Skip frames until there is room again
+	Throttle = 1, // Record less often while the ring is filling up, drop only if it is still full
+};
+
+struct TrajectoryOptions {
+	uint32_t everyKSteps = 1;
+	std::vector<uint32_t> bodyIds;  // Empty records every body
+	TrajectoryCompression compression = TrajectoryCompression::DeltaQuantized;
+	double positionQuantum = 1.0e-9; // [game length]
+	double velocityQuantum = 1.0e-9; // [game length / game time]
+	uint32_t framesPerChunk = 64;
+	size_t ringCapacity = 64;        // Frames buffered between the simulation and the writer
+	TrajectoryOverflow overflow = TrajectoryOverflow::Throttle;
+};
+
+struct TrajectoryFrame {
+	uint64_t step = 0;
+	double time = 0.0;
+	std::vector<uint32_t> ids;
+	std::vector<glm::dvec3> position;
+	std::vector<glm::dvec3> velocity;
+	bool hasConservation = false;
+	Conservation conservation;        // Of all bodies, not only the recorded ones
+};
+
+struct TrajectoryChunkInfo {
+	uint64_t offset;     // File offset of the chunk header
+	uint64_t firstStep;
+	uint32_t frameCount;
+};
+
+class TrajectoryRecorder {
+public:
+	TrajectoryRecorder() = default;
+	~TrajectoryRecorder();
+
+	TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+	TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+	bool Start(const std::string& path, const TrajectoryOptions& options);
+	// Writes the remaining frames and the index, then closes the file
+	void Stop();
+	bool Recording() const { return m_writer.joinable(); }
+
+	// Called from the simulation thread every step; copies the frame when one is due and never blocks
+	void Record(uint64_t step, double time, const BodyState& bodies, const uint32_t* ids,
+		const Conservation* conservation = nullptr);
+
+	uint64_t FramesRecorded() const { return m_framesRecorded; }
+	uint64_t FramesDropped() const { return m_framesDropped; }
+	uint64_t BytesWritten() const { return m_bytesWritten.load(std::memory_order_relaxed); }
+	bool WriteFailed() const { return m_writeFailed.load(std::memory_order_relaxed); }
+	uint32_t CurrentInterval() const { return m_interval; }
+	size_t QueueDepth() const { return m_ring ? m_ring->Size() : 0; }
+
+private:
+	void writerLoop();
+	void encodeFrame(const TrajectoryFrame& frame);
+	void flushChunk();
+	void write(const std::vector<uint8_t>& bytes);
+
+	TrajectoryOptions m_options;
+	std::vector<uint32_t> m_recordIds; // Sorted planet ID subset, empty records every body
+	std::unique_ptr<SpscRing<TrajectoryFrame>> m_ring;
+	std::thread m_writer;
+	std::atomic<bool> m_stop{ false };
+
+	// Simulation thread state
+	uint32_t m_interval = 1;
+	uint32_t m_stepsSinceFrame = 0;
+	uint64_t m_framesRecorded = 0;
+	uint64_t m_framesDropped = 0;
+
+	// Writer thread state
+	std::ofstream m_file;
+	uint64_t m_fileOffset = 0;
+	std::vector<uint8_t> m_chunk;
+	uint32_t m_chunkFrames = 0;
+	uint64_t m_chunkFirstStep = 0;
+	std::vector<TrajectoryChunkInfo> m_index;
+	std::vector<uint32_t> m_previousIds;
+	std::vector<int64_t> m_previousQuantized; // Position then velocity components of the previous frame
+	std::atomic<uint64_t> m_bytesWritten{ 0 };
+	std::atomic<bool> m_writeFailed{ false };
+};
+
+// Reads trajectory files chunk by chunk from a memory mapping
+class TrajectoryReader {
+public:
+	bool Open(const std::string& path);
+
+	const std::vector<TrajectoryChunkInfo>& Chunks() const { return m_index; }
+	bool ReadChunk(size_t chunk, std::vector<TrajectoryFrame>& frames) const;
+	const std::string& Error() const { return m_error; }
+
+private:
+	bool fail(const char* message);
+
+	MappedFile m_file;
+	TrajectoryCompression m_compression = TrajectoryCompression::None;
+	double m_positionQuantum = 0.0;
+	double m_velocityQuantum = 0.0;
+	std::vector<TrajectoryChunkInfo> m_index;
+	std::string m_error;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#define KG_TO_GMASS 	1.0e-6
+#define METER_TO_GLEN	1.0e-9
+#define KM_TO_GLEN		(1000.0 * METER_TO_GLEN)
+#define SEC_TO_GSEC 	1.0e-6
+
+// DISPLAYED Units:
+// MASS: m [kg]
+// RADIUS: r [km]
+// POSITION: P [10^3 km]
+// VELOCITY: V [km/s]
+
+// Conversion To Game Units:
+// MASS: m [kg] -> m [kg] * kg2gm [gm = Game Mass Unit]
+// LENGTH: r [km] -> (r * 1000)[m] * meter2gl [gl = Game Length Unit]
+// TIME: [s] -> [s] * sec2gs [gs = Game Time Unit]
+// POSITION: P [10^3 km]-> (P * 10^3 * 10^3)[m] * meter2gl [gl]
+// VELOCITY: V [km/s] -> (V * 10^3 [m] * meter2gl) / ([s] * sec2gs) [gl/gs]
+
+
+// G in game units will be = G * meter2gl^3 / (kg2gm * sec2gs^2)
+constexpr double G = (6.67430e-11 * METER_TO_GLEN * METER_TO_GLEN * METER_TO_GLEN) / (KM_TO_GLEN * SEC_TO_GSEC * SEC_TO_GSEC);// In Game Units
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <NBody.h>
+
+// Wisdom-Holman mixed-variable symplectic integrator in Jacobi coordinates
+// (Wisdom & Holman 1991, with the WHFast improvements of Rein & Tamayo 2015).
+// The Keplerian motion around the dominant body is solved analytically, so the
+// step only has to resolve the planet-planet interactions (~1/20 of the innermost orbit).
+class WHFast {
+public:
+	// Advances the bodies by totalTime in steps no larger than maxStep.
+	// The most massive body is used as the central object.
+	void Integrate(BodyState& bodies, double totalTime, double maxStep);
+
+	// Timestep of orbitFraction times the shortest orbital period around the central body
+	static double SuggestTimestep(const BodyState& bodies, double orbitFraction);
+
+	// Third order symplectic corrector (Wisdom, Holman & Touma 1996)
+	bool useCorrector = true;
+
+	// Number of steps taken by the last call to Integrate
+	size_t lastStepCount = 0;
+
+private:
+	void buildOrdering(const BodyState& bodies);
+	void inertialToJacobi(const BodyState& bodies);
+	void jacobiToInertial(BodyState& bodies);
+	void jacobiToInertialPositions();
+
+	void keplerStep(double dt);
+	void interactionStep(double dt);
+	void applyCorrector(double inv, double dt);
+	void correctorZ(double a, double b);
+
+	// Body indices sorted by distance from the central body (central body first)
+	std::vector<size_t> m_order;
+	// Interior masses, eta[i] = m[0] + ... + m[i] in Jacobi order
+	std::vector<double> m_eta;
+	std::vector<double> m_gm;
+
+	// Jacobi coordinates (index 0 holds the centre of mass)
+	std::vector<double> m_x, m_y, m_z;
+	std::vector<double> m_vx, m_vy, m_vz;
+
+	// Scratch inertial state used by the interaction step
+	BodyState m_inertial;
+	std::vector<glm::dvec3> m_accel;
+};
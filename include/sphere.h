@@ -1,6 +1,8 @@
 ﻿#pragma once
 
+#include <map>
 #include <memory>
+#include <utility>
 #include <glm/glm.hpp>
 
 #include <VAO.h>
@@ -22,9 +24,9 @@ public:
 
 	void Draw()
 	{
-		p_vertexArray->Bind();
-		glDrawElements(GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, 0);
-		p_vertexArray->Unbind();
+		p_mesh->vertexArray->Bind();
+		glDrawElements(GL_TRIANGLES, p_mesh->indicesCount, GL_UNSIGNED_INT, 0);
+		p_mesh->vertexArray->Unbind();
 	}
 
 	void SetRadius(double _radius) {
@@ -51,7 +53,26 @@ public:
 	}
 
 private:
+	// GPU buffers of the unit sphere, shared by every Sphere with the same tessellation
+	struct Mesh {
+		std::unique_ptr<VAO> vertexArray;
+		std::unique_ptr<VBO> vertexBuffer;
+		std::unique_ptr<EBO> indicesBuffer;
+		size_t indicesCount = 0;
+	};
+
 	void Init( GLuint latDiv = 50, GLuint lonDiv = 50) {
+		// Reuse the mesh while any sphere still holds it, creating buffers per planet does not scale
+		static std::map<std::pair<GLuint, GLuint>, std::weak_ptr<Mesh>> meshCache;
+		std::weak_ptr<Mesh>& cached = meshCache[{ latDiv, lonDiv }];
+		p_mesh = cached.lock();
+		if (!p_mesh) {
+			p_mesh = createMesh(latDiv, lonDiv);
+			cached = p_mesh;
+		}
+	}
+
+	static std::shared_ptr<Mesh> createMesh(GLuint latDiv, GLuint lonDiv) {
 		const float r = 1.0f; // Unit Parameters
 
 		std::vector<glm::vec3> vertex;
@@ -97,23 +118,23 @@ private:
 			}
 		}
 
-		p_vertexArray = std::make_unique<VAO>();
-		if (p_vertexArray == nullptr)
+		auto mesh = std::make_shared<Mesh>();
+		mesh->vertexArray = std::make_unique<VAO>();
+		if (mesh->vertexArray == nullptr)
 			throw;
-		p_vertexArray->Bind();
+		mesh->vertexArray->Bind();
 
-		p_vertexBuffer = std::make_unique<VBO>(vertex.data(), vertex.size() * sizeof(vertex[0]));
-		p_indicesBuffer = std::make_unique<EBO>(indices);
+		mesh->vertexBuffer = std::make_unique<VBO>(vertex.data(), vertex.size() * sizeof(vertex[0]));
+		mesh->indicesBuffer = std::make_unique<EBO>(indices);
 
-		p_vertexArray->LinkAttrib(*p_vertexBuffer, 0, 3, GL_FLOAT, sizeof(glm::vec3), (void*)0);
-		p_vertexArray->Unbind();
+		mesh->vertexArray->LinkAttrib(*mesh->vertexBuffer, 0, 3, GL_FLOAT, sizeof(glm::vec3), (void*)0);
+		mesh->vertexArray->Unbind();
 
-		indicesCount = indices.size();
+		mesh->indicesCount = indices.size();
+		return mesh;
 	}
 
-	std::unique_ptr<VAO> p_vertexArray;
-	std::unique_ptr<VBO> p_vertexBuffer;
-	std::unique_ptr<EBO> p_indicesBuffer;
+	std::shared_ptr<Mesh> p_mesh;
 
 	double radius;
 	glm::mat4 modelMat = glm::mat4(1.0f);
@@ -0,0 +1,143 @@
+#include "Benchmarks.h"
+#include "DirectKernel.h"
+#include "LBVH.h"
+#include "ThreadPool.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+namespace {
+	// Gaussian blob, roughly what a galaxy scene looks like to the tree builder
+	BodyState makeBenchmarkBodies(size_t count) {
+		std::mt19937_64 rng(12345);
+		std::normal_distribution<double> normal(0.0, 1.0);
+
+		BodyState bodies;
+		bodies.Resize(count);
+		for (size_t i = 0; i < count; ++i) {
+			bodies.mass[i] = 1.0;
+			bodies.position[i] = glm::dvec3(normal(rng), normal(rng), normal(rng));
+		}
+		return bodies;
+	}
+
+	template <typename Fn>
+	double medianMilliseconds(int repeats, Fn&& fn) {
+		std::vector<double> times;
+		for (int r = 0; r < repeats; ++r) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	// What a plain float port of the direct kernel does: absolute positions and sums in float
+	void floatAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel, ThreadPool& pool) {
+		const size_t count = bodies.Size();
+		std::vector<glm::vec3> position(count);
+		std::vector<float> gm(count);
+		for (size_t i = 0; i < count; ++i) {
+			position[i] = glm::vec3(bodies.position[i]);
+			gm[i] = float(G * bodies.mass[i]);
+		}
+		accel.assign(count, glm::dvec3(0.0));
+		pool.ParallelFor(count, 64, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				glm::vec3 sum(0.0f);
+				for (size_t j = 0; j < count; ++j) {
+					glm::vec3 d = position[j] - position[i];
+					float dist2 = glm::dot(d, d);
+					if (!(dist2 > 1e-20f)) continue;
+					float invDist = 1.0f / std::sqrt(dist2);
+					sum += d * (gm[j] * invDist * invDist * invDist);
+				}
+				accel[i] = glm::dvec3(sum);
+			}
+		});
+	}
+
+	// Median and maximum of |a - ref| / |ref| over all bodies
+	void relativeErrors(const std::vector<glm::dvec3>& accel, const std::vector<glm::dvec3>& reference,
+		double& median, double& maximum) {
+		std::vector<double> errors(accel.size());
+		for (size_t i = 0; i < accel.size(); ++i) {
+			double scale = glm::length(reference[i]);
+			errors[i] = scale > 0.0 ? glm::length(accel[i] - reference[i]) / scale : 0.0;
+		}
+		std::sort(errors.begin(), errors.end());
+		median = errors[errors.size() / 2];
+		maximum = errors.back();
+	}
+}
+
+int RunLBVHBenchmark() {
+	const size_t sizes[] = { 10000, 100000, 1000000, 4000000 };
+	const size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<size_t> threadCounts;
+	for (size_t t = 1; t < hardwareThreads; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(hardwareThreads);
+
+	printf("LBVH build time [ms] (median of 5)\n");
+	printf("%10s", "N");
+	for (size_t threads : threadCounts)
+		printf(" %9zu T", threads);
+	printf("\n");
+
+	for (size_t count : sizes) {
+		BodyState bodies = makeBenchmarkBodies(count);
+		printf("%10zu", count);
+		for (size_t threads : threadCounts) {
+			ThreadPool pool(threads);
+			LBVH tree;
+			double ms = medianMilliseconds(5, [&] { tree.BuildFromBodies(bodies, nullptr, pool); });
+			printf(" %11.2f", ms);
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+	return 0;
+}
+
+int RunPrecisionBenchmark() {
+	const size_t sizes[] = { 4096, 16384 };
+	const double offsets[] = { 0.0, 1e4 };   // Scene centre in units of its radius
+
+	printf("Direct summation: time [ms] (median of 3) and relative force error vs. serial double\n");
+	printf("%8s %8s %-8s %10s %12s %12s\n", "N", "offset", "kernel", "time", "median err", "max err");
+
+	for (size_t count : sizes) {
+		for (double offset : offsets) {
+			BodyState bodies = makeBenchmarkBodies(count);
+			for (glm::dvec3& position : bodies.position)
+				position += glm::dvec3(offset, 0.5 * offset, 0.0);
+
+			std::vector<glm::dvec3> reference, accel;
+			double ms = medianMilliseconds(3, [&] { ComputeAccelerations(bodies, reference); });
+			printf("%8zu %8.0e %-8s %10.2f %12s %12s\n", count, offset, "serial", ms, "-", "-");
+
+			auto report = [&](const char* name, double time) {
+				double median, maximum;
+				relativeErrors(accel, reference, median, maximum);
+				printf("%8zu %8.0e %-8s %10.2f %12.2e %12.2e\n", count, offset, name, time, median, maximum);
+			};
+
+			DirectKernel kernel;
+			kernel.precision = KernelPrecision::Double;
+			report("double", medianMilliseconds(3, [&] { kernel.ComputeAccelerations(bodies, accel); }));
+			kernel.precision = KernelPrecision::Mixed;
+			report("mixed", medianMilliseconds(3, [&] { kernel.ComputeAccelerations(bodies, accel); }));
+			report("float", medianMilliseconds(3, [&] { floatAccelerations(bodies, accel, ThreadPool::Global()); }));
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
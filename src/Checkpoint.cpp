@@ -0,0 +1,132 @@
+#include "Checkpoint.h"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+	bool hostIsLittleEndian() {
+		const uint32_t probe = 1;
+		uint8_t first;
+		std::memcpy(&first, &probe, 1);
+		return first == 1;
+	}
+
+	uint64_t alignUp(uint64_t offset) {
+		return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+	}
+
+	struct Block {
+		uint64_t CheckpointHeader::* offset;
+		size_t elementSize;
+		uint32_t version;   // First version with the block
+	};
+
+	const Block BLOCKS[] = {
+		{ &CheckpointHeader::idOffset, sizeof(uint32_t), 1 },
+		{ &CheckpointHeader::positionOffset, sizeof(glm::vec3), 1 },
+		{ &CheckpointHeader::velocityOffset, sizeof(glm::vec3), 1 },
+		{ &CheckpointHeader::massOffset, sizeof(double), 1 },
+		{ &CheckpointHeader::radiusOffset, sizeof(double), 1 },
+		{ &CheckpointHeader::colorOffset, sizeof(glm::vec3), 1 },
+		{ &CheckpointHeader::nameOffset, CHECKPOINT_NAME_LENGTH, 1 },
+		{ &CheckpointHeader::railsPrimaryOffset, sizeof(uint32_t), 2 },
+		{ &CheckpointHeader::railsPositionOffset, sizeof(glm::dvec3), 2 },
+		{ &CheckpointHeader::railsVelocityOffset, sizeof(glm::dvec3), 2 },
+	};
+}
+
+bool WriteCheckpoint(const std::string& path, CheckpointHeader header, const CheckpointArrays& arrays) {
+	// The blocks are raw memory, only a little-endian host writes them in the file's byte order
+	if (!hostIsLittleEndian()) return false;
+
+	std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.headerSize = uint32_t(sizeof(CheckpointHeader));
+	header.bodyCount = arrays.count;
+
+	uint64_t offset = alignUp(sizeof(CheckpointHeader));
+	for (const Block& block : BLOCKS) {
+		header.*block.offset = offset;
+		offset = alignUp(offset + arrays.count * block.elementSize);
+	}
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out) return false;
+
+	const void* data[] = { arrays.id, arrays.position, arrays.velocity, arrays.mass, arrays.radius, arrays.color, arrays.name,
+		arrays.railsPrimary, arrays.railsPosition, arrays.railsVelocity };
+	static const char padding[CHECKPOINT_ALIGNMENT] = {};
+	uint64_t written = sizeof(CheckpointHeader);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (size_t b = 0; b < std::size(BLOCKS); ++b) {
+		uint64_t start = header.*BLOCKS[b].offset;
+		out.write(padding, std::streamsize(start - written));
+		size_t bytes = arrays.count * BLOCKS[b].elementSize;
+		if (bytes) out.write(static_cast<const char*>(data[b]), std::streamsize(bytes));
+		written = start + bytes;
+	}
+	return bool(out);
+}
+
+bool Checkpoint::fail(const char* message) {
+	m_error = message;
+	m_file.Close();
+	m_header = {};
+	m_arrays = {};
+	return false;
+}
+
+bool Checkpoint::Open(const std::string& path) {
+	Close();
+	if (!hostIsLittleEndian())
+		return fail("Checkpoints can only be mapped on little-endian hosts");
+	if (!m_file.Open(path))
+		return fail("Could not open file");
+	if (m_file.Size() < sizeof(CheckpointHeader))
+		return fail("File is too small to be a checkpoint");
+
+	// Older headers are a prefix of the current one, the fields they lack stay zero
+	std::memcpy(&m_header, m_file.Data(), CHECKPOINT_V1_HEADER_SIZE);
+	if (std::memcmp(m_header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+		return fail("Not a checkpoint file");
+	const bool current = m_header.version == CHECKPOINT_VERSION && m_header.headerSize == sizeof(CheckpointHeader);
+	const bool v1 = m_header.version == 1 && m_header.headerSize == CHECKPOINT_V1_HEADER_SIZE;
+	if (!current && !v1)
+		return fail("Unsupported checkpoint version");
+	if (current)
+		std::memcpy(&m_header, m_file.Data(), sizeof(CheckpointHeader));
+
+	// Every block has to lie inside the file and be aligned for in-place use
+	const uint64_t fileSize = m_file.Size();
+	const uint64_t count = m_header.bodyCount;
+	for (const Block& block : BLOCKS) {
+		if (block.version > m_header.version) continue;
+		uint64_t offset = m_header.*block.offset;
+		if (offset % CHECKPOINT_ALIGNMENT != 0 || offset > fileSize || count > (fileSize - offset) / block.elementSize)
+			return fail("Checkpoint is truncated or corrupt");
+	}
+
+	const uint8_t* base = m_file.Data();
+	m_arrays.count = size_t(count);
+	m_arrays.id = reinterpret_cast<const uint32_t*>(base + m_header.idOffset);
+	m_arrays.position = reinterpret_cast<const glm::vec3*>(base + m_header.positionOffset);
+	m_arrays.velocity = reinterpret_cast<const glm::vec3*>(base + m_header.velocityOffset);
+	m_arrays.mass = reinterpret_cast<const double*>(base + m_header.massOffset);
+	m_arrays.radius = reinterpret_cast<const double*>(base + m_header.radiusOffset);
+	m_arrays.color = reinterpret_cast<const glm::vec3*>(base + m_header.colorOffset);
+	m_arrays.name = reinterpret_cast<const char*>(base + m_header.nameOffset);
+	if (current) {
+		m_arrays.railsPrimary = reinterpret_cast<const uint32_t*>(base + m_header.railsPrimaryOffset);
+		m_arrays.railsPosition = reinterpret_cast<const glm::dvec3*>(base + m_header.railsPositionOffset);
+		m_arrays.railsVelocity = reinterpret_cast<const glm::dvec3*>(base + m_header.railsVelocityOffset);
+	}
+	return true;
+}
+
+void Checkpoint::Close() {
+	m_file.Close();
+	m_header = {};
+	m_arrays = {};
+	m_error.clear();
+}
@@ -0,0 +1,337 @@
+#include "Collision.h"
+#include "Morton.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace {
+	// Levels of the spatial hash, every level takes at least 95% of the bodies left for it
+	constexpr size_t HASH_MAX_LEVELS = 8;
+
+	inline int64_t cellCoord(double p, double invCell) {
+		return int64_t(std::floor(p * invCell));
+	}
+
+	inline bool spheresTouch(const BodyState& bodies, const std::vector<double>& radius, uint32_t a, uint32_t b) {
+		glm::dvec3 d = bodies.position[b] - bodies.position[a];
+		double r = radius[a] + radius[b];
+		return glm::dot(d, d) < r * r;
+	}
+
+	uint32_t findRoot(std::vector<uint32_t>& parent, uint32_t i) {
+		while (parent[i] != i) {
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+}
+
+uint32_t SpatialHash::hashCell(int64_t x, int64_t y, int64_t z, uint32_t level) const {
+	// Teschner et al. 2003, with the level as a fourth coordinate
+	uint64_t h = (uint64_t(x) * 73856093ull) ^ (uint64_t(y) * 19349663ull) ^ (uint64_t(z) * 83492791ull) ^ (uint64_t(level) * 50331653ull);
+	return uint32_t(h) & m_tableMask;
+}
+
+void SpatialHash::Build(const BodyState& bodies, const std::vector<double>& radius, ThreadPool& pool) {
+	size_t count = bodies.Size();
+	m_levelCellSize.clear();
+	m_hashes.clear();
+	m_sortedBodies.clear();
+	if (count == 0) return;
+
+	// Cells of every level fit the 95th percentile of the bodies too large for the finer levels,
+	// the last level fits all that are left
+	m_level.assign(count, 0);
+	std::vector<uint32_t> remaining(count);
+	for (size_t i = 0; i < count; ++i) remaining[i] = uint32_t(i);
+	std::vector<double> sortedRadius;
+	while (!remaining.empty()) {
+		sortedRadius.clear();
+		for (uint32_t i : remaining) sortedRadius.push_back(radius[i]);
+		size_t percentile = sortedRadius.size() - 1;
+		if (m_levelCellSize.size() + 1 < HASH_MAX_LEVELS)
+			percentile = std::min(percentile, sortedRadius.size() * 95 / 100);
+		std::nth_element(sortedRadius.begin(), sortedRadius.begin() + percentile, sortedRadius.end());
+		const double cellSize = std::max(2.0 * sortedRadius[percentile], 1e-12);
+
+		const uint8_t level = uint8_t(m_levelCellSize.size());
+		m_levelCellSize.push_back(cellSize);
+		size_t kept = 0;
+		for (uint32_t i : remaining) {
+			if (2.0 * radius[i] > cellSize) remaining[kept++] = i;
+			else m_level[i] = level;
+		}
+		remaining.resize(kept);
+	}
+
+	uint32_t tableSize = 1;
+	while (tableSize < 2 * count) tableSize <<= 1;
+	m_tableMask = tableSize - 1;
+
+	m_hashes.resize(count);
+	m_sortedBodies.resize(count);
+	pool.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const glm::dvec3& p = bodies.position[i];
+			const double invCell = 1.0 / m_levelCellSize[m_level[i]];
+			m_hashes[i] = hashCell(cellCoord(p.x, invCell), cellCoord(p.y, invCell), cellCoord(p.z, invCell), m_level[i]);
+			m_sortedBodies[i] = uint32_t(i);
+		}
+	});
+
+	int hashBits = 1;
+	while ((uint64_t(1) << hashBits) < tableSize) ++hashBits;
+	RadixSortPairs(m_hashes, m_sortedBodies, hashBits, pool);
+
+	// Bucket ranges from the boundaries of the sorted hashes
+	m_cellStart.assign(tableSize, 0);
+	m_cellEnd.assign(tableSize, 0);
+	pool.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			uint32_t h = uint32_t(m_hashes[i]);
+			if (i == 0 || m_hashes[i - 1] != h) m_cellStart[h] = uint32_t(i);
+			if (i + 1 == count || m_hashes[i + 1] != h) m_cellEnd[h] = uint32_t(i + 1);
+		}
+	});
+}
+
+void SpatialHash::FindContacts(const BodyState& bodies, const std::vector<double>& radius, std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+	ThreadPool& pool) const {
+	contacts.clear();
+	size_t count = m_sortedBodies.size();
+	if (count < 2) return;
+
+	const uint32_t levels = uint32_t(m_levelCellSize.size());
+	std::mutex mergeMutex;
+	pool.ParallelFor(count, 1024, [&](size_t begin, size_t end) {
+		std::vector<std::pair<uint32_t, uint32_t>> local;
+		uint32_t visited[27];
+
+		for (size_t i = begin; i < end; ++i) {
+			const glm::dvec3& p = bodies.position[i];
+
+			// Two bodies touch closer than half of each cell size, so the larger cell's neighbours
+			// cover the pair. It is found once, from the body on the finer level (or the lower index).
+			for (uint32_t level = m_level[i]; level < levels; ++level) {
+				const double invCell = 1.0 / m_levelCellSize[level];
+				int64_t cx = cellCoord(p.x, invCell), cy = cellCoord(p.y, invCell), cz = cellCoord(p.z, invCell);
+				int visitedCount = 0;
+
+				for (int64_t dz = -1; dz <= 1; ++dz)
+				for (int64_t dy = -1; dy <= 1; ++dy)
+				for (int64_t dx = -1; dx <= 1; ++dx) {
+					// Different cells can share a bucket, scan each bucket once
+					uint32_t h = hashCell(cx + dx, cy + dy, cz + dz, level);
+					if (std::find(visited, visited + visitedCount, h) != visited + visitedCount) continue;
+					visited[visitedCount++] = h;
+
+					for (uint32_t k = m_cellStart[h]; k < m_cellEnd[h]; ++k) {
+						uint32_t j = m_sortedBodies[k];
+						if (m_level[j] != level || (level == m_level[i] && j <= i)) continue;
+						if (spheresTouch(bodies, radius, uint32_t(i), j))
+							local.emplace_back(std::min(uint32_t(i), j), std::max(uint32_t(i), j));
+					}
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		contacts.insert(contacts.end(), local.begin(), local.end());
+	});
+}
+
+void MergeContacts(BodyState& bodies, std::vector<double>& radius, const std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+	std::vector<uint8_t>& dead, std::vector<uint32_t>& survivor) {
+	size_t count = bodies.Size();
+	dead.assign(count, 0);
+	survivor.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		survivor[i] = uint32_t(i);
+	if (contacts.empty()) return;
+
+	// Union-find over the contact graph, so chains of touching bodies merge in one go
+	std::vector<uint32_t> parent(survivor);
+	for (const auto& contact : contacts) {
+		uint32_t a = findRoot(parent, contact.first);
+		uint32_t b = findRoot(parent, contact.second);
+		if (a == b) continue;
+		// The heavier body stays the root
+		if (bodies.mass[b] > bodies.mass[a]) std::swap(a, b);
+		parent[b] = a;
+	}
+
+	std::vector<double> groupMass(count, 0.0), groupVolume(count, 0.0);
+	std::vector<glm::dvec3> groupPos(count, glm::dvec3(0.0)), groupMomentum(count, glm::dvec3(0.0));
+	std::vector<uint8_t> touched(count, 0);
+	for (const auto& contact : contacts) {
+		touched[contact.first] = 1;
+		touched[contact.second] = 1;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		if (!touched[i]) continue;
+		uint32_t root = findRoot(parent, uint32_t(i));
+		survivor[i] = root;
+		groupMass[root] += bodies.mass[i];
+		groupPos[root] += bodies.mass[i] * bodies.position[i];
+		groupMomentum[root] += bodies.mass[i] * bodies.velocity[i];
+		groupVolume[root] += radius[i] * radius[i] * radius[i];
+		if (root != i) dead[i] = 1;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		if (!touched[i] || survivor[i] != i) continue;
+		double m = groupMass[i];
+		if (m > 0.0) {
+			bodies.position[i] = groupPos[i] / m;
+			bodies.velocity[i] = groupMomentum[i] / m;
+		}
+		bodies.mass[i] = m;
+		radius[i] = std::cbrt(groupVolume[i]);
+	}
+}
+
+void BounceContacts(BodyState& bodies, const std::vector<double>& radius, const std::vector<std::pair<uint32_t, uint32_t>>& contacts,
+	double restitution) {
+	for (const auto& contact : contacts) {
+		uint32_t a = contact.first, b = contact.second;
+		glm::dvec3 d = bodies.position[b] - bodies.position[a];
+		double dist = glm::length(d);
+		if (dist <= 0.0) continue;
+		glm::dvec3 n = d / dist;
+
+		double invMassA = bodies.mass[a] > 0.0 ? 1.0 / bodies.mass[a] : 0.0;
+		double invMassB = bodies.mass[b] > 0.0 ? 1.0 / bodies.mass[b] : 0.0;
+		double invMassSum = invMassA + invMassB;
+		if (invMassSum <= 0.0) continue;
+
+		// Impulse only while approaching
+		double approach = glm::dot(bodies.velocity[b] - bodies.velocity[a], n);
+		if (approach < 0.0) {
+			double j = -(1.0 + restitution) * approach / invMassSum;
+			bodies.velocity[a] -= (j * invMassA) * n;
+			bodies.velocity[b] += (j * invMassB) * n;
+		}
+
+		// Separate the overlap in proportion to the inverse masses (keeps the centre of mass fixed)
+		double overlap = radius[a] + radius[b] - dist;
+		if (overlap > 0.0) {
+			bodies.position[a] -= (overlap * invMassA / invMassSum) * n;
+			bodies.position[b] += (overlap * invMassB / invMassSum) * n;
+		}
+	}
+}
+
+double SphereTimeOfImpact(const glm::dvec3& d0, const glm::dvec3& dd, double r) {
+	double c = glm::dot(d0, d0) - r * r;
+	if (c <= 0.0) return -1.0;
+	double b = glm::dot(d0, dd);
+	if (b >= 0.0) return -1.0; // Moving apart
+	double a = glm::dot(dd, dd);
+	double disc = b * b - a * c;
+	if (disc < 0.0) return -1.0;
+
+	// Numerically stable smaller root of a t^2 + 2 b t + c = 0
+	double t = c / (-b + std::sqrt(disc));
+	return t <= 1.0 ? t : -1.0;
+}
+
+void FindSweptContacts(const std::vector<glm::dvec3>& start, const BodyState& bodies, const std::vector<double>& radius,
+	LBVH& tree, std::vector<SweptContact>& contacts, ThreadPool& pool) {
+	contacts.clear();
+	size_t count = bodies.Size();
+	if (count < 2) return;
+
+	std::vector<glm::dvec3> boxMin(count), boxMax(count);
+	pool.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			glm::dvec3 r(radius[i]);
+			boxMin[i] = glm::min(start[i], bodies.position[i]) - r;
+			boxMax[i] = glm::max(start[i], bodies.position[i]) + r;
+		}
+	});
+	tree.Build(boxMin.data(), boxMax.data(), nullptr, count, pool);
+
+	std::vector<std::pair<uint32_t, uint32_t>> candidates;
+	tree.FindOverlappingPairs(candidates, pool);
+
+	for (const auto& pair : candidates) {
+		uint32_t a = pair.first, b = pair.second;
+		glm::dvec3 d0 = start[b] - start[a];
+		glm::dvec3 dd = (bodies.position[b] - start[b]) - (bodies.position[a] - start[a]);
+		double toi = SphereTimeOfImpact(d0, dd, radius[a] + radius[b]);
+		if (toi >= 0.0)
+			contacts.push_back({ a, b, toi });
+	}
+	std::sort(contacts.begin(), contacts.end(), [](const SweptContact& x, const SweptContact& y) {
+		return x.toi < y.toi || (x.toi == y.toi && (x.a < y.a || (x.a == y.a && x.b < y.b)));
+	});
+}
+
+void ResolveSweptContacts(const std::vector<glm::dvec3>& start, BodyState& bodies, std::vector<double>& radius,
+	const std::vector<SweptContact>& contacts, bool merge, double restitution, double stepTime,
+	std::vector<uint8_t>& dead, std::vector<uint32_t>& survivor) {
+	size_t count = bodies.Size();
+	dead.assign(count, 0);
+	survivor.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		survivor[i] = uint32_t(i);
+
+	// Only the first impact of every body is resolved in this step, later ones are found next step
+	std::vector<uint8_t> handled(count, 0);
+	for (const SweptContact& contact : contacts) {
+		uint32_t a = contact.a, b = contact.b;
+		if (handled[a] || handled[b]) continue;
+		handled[a] = handled[b] = 1;
+
+		double t = contact.toi;
+		glm::dvec3 moveA = bodies.position[a] - start[a];
+		glm::dvec3 moveB = bodies.position[b] - start[b];
+		glm::dvec3 hitA = start[a] + t * moveA;
+		glm::dvec3 hitB = start[b] + t * moveB;
+		double ma = bodies.mass[a], mb = bodies.mass[b];
+
+		if (merge) {
+			if (mb > ma) {
+				std::swap(a, b);
+				std::swap(ma, mb);
+				std::swap(moveA, moveB);
+				std::swap(hitA, hitB);
+			}
+			double m = ma + mb;
+			if (m <= 0.0) continue;
+
+			glm::dvec3 hit = (ma * hitA + mb * hitB) / m;
+			glm::dvec3 move = (ma * moveA + mb * moveB) / m;
+			bodies.velocity[a] = (ma * bodies.velocity[a] + mb * bodies.velocity[b]) / m;
+			bodies.position[a] = hit + (1.0 - t) * move;
+			bodies.mass[a] = m;
+			radius[a] = std::cbrt(radius[a] * radius[a] * radius[a] + radius[b] * radius[b] * radius[b]);
+			dead[b] = 1;
+			survivor[b] = a;
+			continue;
+		}
+
+		glm::dvec3 n = hitB - hitA;
+		double dist = glm::length(n);
+		if (dist <= 0.0) continue;
+		n /= dist;
+
+		double invMassA = ma > 0.0 ? 1.0 / ma : 0.0;
+		double invMassB = mb > 0.0 ? 1.0 / mb : 0.0;
+		double invMassSum = invMassA + invMassB;
+		double approach = glm::dot(bodies.velocity[b] - bodies.velocity[a], n);
+		glm::dvec3 dvA(0.0), dvB(0.0);
+		if (invMassSum > 0.0 && approach < 0.0) {
+			double j = -(1.0 + restitution) * approach / invMassSum;
+			dvA = -(j * invMassA) * n;
+			dvB = (j * invMassB) * n;
+		}
+		bodies.velocity[a] += dvA;
+		bodies.velocity[b] += dvB;
+		bodies.position[a] = hitA + (1.0 - t) * (moveA + dvA * stepTime);
+		bodies.position[b] = hitB + (1.0 - t) * (moveB + dvB * stepTime);
+	}
+}
@@ -0,0 +1,259 @@
+#include "Determinism.h"
+#include "Collision.h"
+#include "InitialConditions.h"
+#include "LBVH.h"
+#include "Octree.h"
+#include "SceneLoader.h"
+#include "Units.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+	constexpr size_t HASH_BLOCK = 4096;
+	constexpr uint64_t GOLDEN = 0x9E3779B97F4A7C15ull;
+
+	// SplitMix64 finalizer
+	inline uint64_t mix64(uint64_t x) {
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	inline uint64_t hashWord(uint64_t h, double value) {
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		h ^= bits;
+		return ((h << 27) | (h >> 37)) * GOLDEN;
+	}
+
+	enum Solver { SOLVER_DIRECT, SOLVER_OCTREE, SOLVER_LBVH };
+
+	// Headless reference step, a kick with the forces of the current positions and a drift, all in double.
+	// It shares the force solvers and contact code with the game but not Game::stepEuler itself, which
+	// keeps float planets and scales the kick by the time multiplier, so its logs check these shared
+	// parts only. The game's own step is hashed by "Hash State Every Step" and its hash log.
+	struct HeadlessRun {
+		BodyState bodies;
+		std::vector<double> radius;
+		Solver solver = SOLVER_DIRECT;
+		double theta = 0.5;
+		bool collisions = false;
+		double restitution = 0.8;
+
+		Octree octree;
+		LBVH lbvh;
+		SpatialHash spatialHash;
+		std::vector<glm::dvec3> accel;
+		std::vector<std::pair<uint32_t, uint32_t>> contacts;
+
+		void Step(double dt) {
+			switch (solver) {
+			case SOLVER_OCTREE:
+				octree.theta = theta;
+				octree.Update(bodies);
+				octree.ComputeAccelerations(bodies, accel);
+				break;
+			case SOLVER_LBVH:
+				lbvh.BuildFromBodies(bodies, nullptr);
+				lbvh.ComputeAccelerations(bodies, theta, accel);
+				break;
+			default:
+				ComputeAccelerations(bodies, accel);
+				break;
+			}
+			for (size_t i = 0; i < bodies.Size(); ++i) {
+				bodies.velocity[i] += dt * accel[i];
+				bodies.position[i] += dt * bodies.velocity[i];
+			}
+
+			if (collisions && bodies.Size() > 1) {
+				spatialHash.Build(bodies, radius);
+				spatialHash.FindContacts(bodies, radius, contacts);
+				std::sort(contacts.begin(), contacts.end());
+				BounceContacts(bodies, radius, contacts, restitution);
+			}
+		}
+	};
+
+	bool loadSceneBodies(const std::string& path, BodyState& bodies, std::vector<double>& radius, std::string& error) {
+		std::vector<SceneBody> scene;
+		if (!LoadScene(path, scene, error)) return false;
+		bodies.Resize(scene.size());
+		radius.resize(scene.size());
+		for (size_t i = 0; i < scene.size(); ++i) {
+			const SceneBody& body = scene[i];
+			bodies.mass[i] = body.mass * KG_TO_GMASS;
+			radius[i] = body.radius * KM_TO_GLEN;
+			for (int c = 0; c < 3; ++c) {
+				bodies.position[i][c] = body.position[c] * 1000.0 * KM_TO_GLEN;
+				bodies.velocity[i][c] = body.velocity[c] * KM_TO_GLEN / SEC_TO_GSEC;
+			}
+		}
+		return true;
+	}
+
+	// A thousandth of the dynamical time sqrt(r^3 / G M) of the system's rms radius
+	double defaultStep(const BodyState& bodies) {
+		double mass = 0.0, r2 = 0.0;
+		glm::dvec3 com(0.0);
+		for (size_t i = 0; i < bodies.Size(); ++i) {
+			mass += bodies.mass[i];
+			com += bodies.mass[i] * bodies.position[i];
+		}
+		if (mass <= 0.0) return 1.0;
+		com /= mass;
+		for (size_t i = 0; i < bodies.Size(); ++i)
+			r2 += bodies.mass[i] * glm::dot(bodies.position[i] - com, bodies.position[i] - com);
+		double r = std::sqrt(r2 / mass);
+		return r > 0.0 ? 1.0e-3 * std::sqrt(r * r * r / (G * mass)) : 1.0;
+	}
+}
+
+uint64_t HashBodyState(const BodyState& bodies, ThreadPool& pool) {
+	const size_t count = bodies.Size();
+	uint64_t hash = DeterministicReduce<uint64_t>(count, HASH_BLOCK, 0,
+		[&](size_t begin, size_t end) {
+			uint64_t h = mix64(begin + GOLDEN);
+			for (size_t i = begin; i < end; ++i) {
+				h = hashWord(h, bodies.mass[i]);
+				for (int c = 0; c < 3; ++c) h = hashWord(h, bodies.position[i][c]);
+				for (int c = 0; c < 3; ++c) h = hashWord(h, bodies.velocity[i][c]);
+			}
+			return mix64(h);
+		},
+		[](uint64_t a, uint64_t b) { return mix64(a ^ (b + GOLDEN + (a << 6) + (a >> 2))); },
+		pool);
+	return mix64(hash ^ uint64_t(count));
+}
+
+bool ReadHashLog(const std::string& path, std::vector<std::pair<uint64_t, uint64_t>>& entries, std::string& error) {
+	std::ifstream file(path);
+	if (!file) {
+		error = "Could not open " + path;
+		return false;
+	}
+
+	entries.clear();
+	std::string line;
+	for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream fields(line);
+		uint64_t step, hash;
+		if (!(fields >> step >> std::hex >> hash)) {
+			error = path + ":" + std::to_string(lineNumber) + ": expected \"step hash\"";
+			return false;
+		}
+		entries.emplace_back(step, hash);
+	}
+	return true;
+}
+
+int RunHashLogCommand(int argc, char* argv[]) {
+	HeadlessRun run;
+	std::string outputPath, scenePath;
+	size_t steps = 1000, plummerCount = 4096;
+	uint64_t seed = 1;
+	double dt = 0.0;
+	for (int i = 1; i < argc; ++i) {
+		auto next = [&](double fallback) { return i + 1 < argc ? std::atof(argv[++i]) : fallback; };
+		if (strcmp(argv[i], "--hash-log") == 0 && i + 1 < argc) outputPath = argv[++i];
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) scenePath = argv[++i];
+		else if (strcmp(argv[i], "--plummer") == 0) plummerCount = size_t(next(double(plummerCount)));
+		else if (strcmp(argv[i], "--seed") == 0) seed = uint64_t(next(double(seed)));
+		else if (strcmp(argv[i], "--steps") == 0) steps = size_t(next(double(steps)));
+		else if (strcmp(argv[i], "--dt") == 0) dt = next(0.0) * SEC_TO_GSEC;
+		else if (strcmp(argv[i], "--theta") == 0) run.theta = next(run.theta);
+		else if (strcmp(argv[i], "--collisions") == 0) run.collisions = true;
+		else if (strcmp(argv[i], "--solver") == 0 && i + 1 < argc) {
+			const char* name = argv[++i];
+			run.solver = strcmp(name, "octree") == 0 ? SOLVER_OCTREE : strcmp(name, "lbvh") == 0 ? SOLVER_LBVH : SOLVER_DIRECT;
+		}
+	}
+	if (outputPath.empty()) {
+		printf("Usage: --hash-log <out> [--scene <file> | --plummer <bodies>] [--seed <n>] [--steps <n>] [--dt <seconds>]\n"
+			"       [--solver direct|octree|lbvh] [--theta <angle>] [--collisions] [--threads <n>]\n"
+			"Steps a double precision reference integrator, not the game's own Euler step.\n");
+		return 1;
+	}
+
+	if (!scenePath.empty()) {
+		std::string error;
+		if (!loadSceneBodies(scenePath, run.bodies, run.radius, error)) {
+			printf("%s\n", error.c_str());
+			return 1;
+		}
+	}
+	else {
+		// Plummer sphere of 10^31 kg with a scale radius of 10^8 km, bodies of 10^4 km
+		GeneratePlummer(run.bodies, plummerCount, 1.0e31 * KG_TO_GMASS, 1.0e8 * KM_TO_GLEN, seed);
+		run.radius.assign(run.bodies.Size(), 1.0e4 * KM_TO_GLEN);
+	}
+	if (dt <= 0.0) dt = defaultStep(run.bodies);
+
+	std::ofstream log(outputPath);
+	if (!log) {
+		printf("Could not write %s\n", outputPath.c_str());
+		return 1;
+	}
+
+	printf("Hash log: %zu bodies, %zu steps of %.3e s, %zu threads\n", run.bodies.Size(), steps, dt / SEC_TO_GSEC,
+		ThreadPool::Global().ThreadCount());
+	auto start = std::chrono::steady_clock::now();
+	char line[64];
+	uint64_t hash = HashBodyState(run.bodies);
+	for (size_t step = 0; ; ++step) {
+		snprintf(line, sizeof(line), "%zu %016" PRIx64 "\n", step, hash);
+		log << line;
+		if (step == steps) break;
+		run.Step(dt);
+		hash = HashBodyState(run.bodies);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Final hash %016" PRIx64 " after %.2f s, written to %s\n", hash, seconds, outputPath.c_str());
+	return log ? 0 : 1;
+}
+
+int RunCompareHashesCommand(int argc, char* argv[]) {
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--compare-hashes") == 0) {
+			for (int k = i + 1; k < argc && k <= i + 2; ++k) paths.push_back(argv[k]);
+			break;
+		}
+	}
+	if (paths.size() != 2) {
+		printf("Usage: --compare-hashes <log a> <log b>\n");
+		return 2;
+	}
+
+	std::vector<std::pair<uint64_t, uint64_t>> a, b;
+	std::string error;
+	if (!ReadHashLog(paths[0], a, error) || !ReadHashLog(paths[1], b, error)) {
+		printf("%s\n", error.c_str());
+		return 2;
+	}
+
+	size_t common = std::min(a.size(), b.size());
+	for (size_t i = 0; i < common; ++i) {
+		if (a[i] != b[i]) {
+			if (a[i].first != b[i].first)
+				printf("Logs are out of step at line %zu: step %" PRIu64 " vs %" PRIu64 "\n", i + 1, a[i].first, b[i].first);
+			else
+				printf("First divergence at step %" PRIu64 ": %016" PRIx64 " vs %016" PRIx64 "\n", a[i].first, a[i].second, b[i].second);
+			return 1;
+		}
+	}
+	if (a.size() != b.size())
+		printf("Identical for the %zu common steps, the logs have %zu and %zu steps\n", common, a.size(), b.size());
+	else
+		printf("Identical for all %zu steps\n", common);
+	return 0;
+}
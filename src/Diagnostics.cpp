@@ -0,0 +1,78 @@
+#include "Diagnostics.h"
+#include "Determinism.h"
+
+namespace {
+	constexpr size_t MEASURE_BLOCK = 4096;
+}
+
+ConservationDrift RelativeDrift(const Conservation& reference, const Conservation& current) {
+	ConservationDrift drift;
+	double energyScale = std::abs(reference.Energy());
+	if (energyScale == 0.0) energyScale = reference.kinetic + std::abs(reference.potential);
+	if (energyScale > 0.0)
+		drift.energy = std::abs(current.Energy() - reference.Energy()) / energyScale;
+	if (reference.momentumScale > 0.0)
+		drift.momentum = glm::length(current.momentum - reference.momentum) / reference.momentumScale;
+	if (reference.angularMomentumScale > 0.0)
+		drift.angularMomentum = glm::length(current.angularMomentum - reference.angularMomentum) / reference.angularMomentumScale;
+	return drift;
+}
+
+void ConservationAccumulator::Reset() {
+	*this = ConservationAccumulator();
+}
+
+void ConservationAccumulator::AddBody(double mass, const glm::dvec3& position, const glm::dvec3& velocity) {
+	glm::dvec3 p = mass * velocity;
+	glm::dvec3 l = glm::cross(position, p);
+	m_kinetic.Add(0.5 * glm::dot(p, velocity));
+	for (int c = 0; c < 3; ++c) {
+		m_momentum[c].Add(p[c]);
+		m_angularMomentum[c].Add(l[c]);
+	}
+	m_momentumScale.Add(glm::length(p));
+	m_angularMomentumScale.Add(glm::length(l));
+}
+
+Conservation ConservationAccumulator::Result() const {
+	Conservation result;
+	result.kinetic = m_kinetic.Value();
+	result.potential = m_potential.Value();
+	for (int c = 0; c < 3; ++c) {
+		result.momentum[c] = m_momentum[c].Value();
+		result.angularMomentum[c] = m_angularMomentum[c].Value();
+	}
+	result.momentumScale = m_momentumScale.Value();
+	result.angularMomentumScale = m_angularMomentumScale.Value();
+	return result;
+}
+
+void ConservationAccumulator::Merge(const ConservationAccumulator& other) {
+	m_kinetic.Add(other.m_kinetic);
+	m_potential.Add(other.m_potential);
+	for (int c = 0; c < 3; ++c) {
+		m_momentum[c].Add(other.m_momentum[c]);
+		m_angularMomentum[c].Add(other.m_angularMomentum[c]);
+	}
+	m_momentumScale.Add(other.m_momentumScale);
+	m_angularMomentumScale.Add(other.m_angularMomentumScale);
+}
+
+Conservation MeasureConservation(const BodyState& bodies, const std::vector<double>& potentialEnergy, ThreadPool& pool) {
+	ConservationAccumulator sum = DeterministicReduce(bodies.Size(), MEASURE_BLOCK, ConservationAccumulator(),
+		[&](size_t begin, size_t end) {
+			ConservationAccumulator block;
+			for (size_t i = begin; i < end; ++i) {
+				block.AddBody(bodies.mass[i], bodies.position[i], bodies.velocity[i]);
+				if (i < potentialEnergy.size())
+					block.AddPotential(potentialEnergy[i]);
+			}
+			return block;
+		},
+		[](ConservationAccumulator a, const ConservationAccumulator& b) {
+			a.Merge(b);
+			return a;
+		},
+		pool);
+	return sum.Result();
+}
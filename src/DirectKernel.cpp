@@ -0,0 +1,219 @@
+#include "DirectKernel.h"
+#include "Morton.h"
+#include "Units.h"
+
+#include "SimdOps.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	constexpr size_t TILE = 64;   // Targets sharing one origin
+	constexpr size_t CHUNK = 256; // Sources summed in pair precision before going into the double accumulators
+
+	// Same guard as the double kernel, pairs closer than this are skipped
+	constexpr double MIN_DIST2 = 1e-20;
+
+	// Gadget-2 spline: the kernel reaches zero at 2.8 times the equivalent Plummer length
+	constexpr double SPLINE_SCALE = 2.8;
+
+	// Softening models. Given r^2 they return the force factor f and potential factor p of one
+	// pair, so that the source adds G m f d to the acceleration and -G m p to the potential.
+	template <typename S>
+	struct NoSoftening {
+		using V = typename S::V;
+		explicit NoSoftening(double) {}
+
+		void operator()(V dist2, V& force, V& potential) const {
+			potential = S::Div(S::Set(1), S::Sqrt(dist2));
+			force = S::Mul(potential, S::Mul(potential, potential));
+		}
+	};
+
+	template <typename S>
+	struct PlummerSoftening {
+		using V = typename S::V;
+		V eps2;
+		explicit PlummerSoftening(double eps) : eps2(S::Set(typename S::T(eps * eps))) {}
+
+		void operator()(V dist2, V& force, V& potential) const {
+			potential = S::Div(S::Set(1), S::Sqrt(S::Add(dist2, eps2)));
+			force = S::Mul(potential, S::Mul(potential, potential));
+		}
+	};
+
+	template <typename S>
+	struct SplineSoftening {
+		using T = typename S::T;
+		using V = typename S::V;
+		V h, hInv, hInv3;
+		explicit SplineSoftening(double eps)
+			: h(S::Set(T(SPLINE_SCALE * eps))), hInv(S::Set(T(1.0 / (SPLINE_SCALE * eps)))),
+			hInv3(S::Set(T(std::pow(SPLINE_SCALE * eps, -3.0)))) {}
+
+		// Both branches of the kernel are evaluated and blended, lanes past h get the Newtonian terms
+		void operator()(V dist2, V& force, V& potential) const {
+			const V invDist = S::Div(S::Set(1), S::Sqrt(dist2));
+			const V u = S::Mul(S::Mul(dist2, invDist), hInv);
+			const V u2 = S::Mul(u, u), u3 = S::Mul(u2, u);
+			const V uInv = S::Mul(invDist, h), uInv3 = S::Mul(uInv, S::Mul(uInv, uInv));   // No more divisions
+
+			// u < 0.5
+			V innerForce = S::Add(S::Set(T(10.666666666667)), S::Mul(u2, S::Sub(S::Mul(S::Set(T(32.0)), u), S::Set(T(38.4)))));
+			V innerPotential = S::Sub(S::Set(T(2.8)), S::Mul(u2, S::Add(S::Set(T(5.333333333333)),
+				S::Mul(u2, S::Sub(S::Mul(S::Set(T(6.4)), u), S::Set(T(9.6)))))));
+			// 0.5 <= u < 1
+			V outerForce = S::Sub(S::Add(S::Sub(S::Set(T(21.333333333333)), S::Mul(S::Set(T(48.0)), u)),
+				S::Mul(S::Set(T(38.4)), u2)), S::Add(S::Mul(S::Set(T(10.666666666667)), u3), S::Mul(S::Set(T(0.066666666667)), uInv3)));
+			V outerPotential = S::Sub(S::Sub(S::Set(T(3.2)), S::Mul(S::Set(T(0.066666666667)), uInv)),
+				S::Mul(u2, S::Add(S::Set(T(10.666666666667)), S::Mul(u, S::Add(S::Set(T(-16.0)),
+					S::Mul(u, S::Sub(S::Set(T(9.6)), S::Mul(S::Set(T(2.133333333333)), u))))))));
+
+			const typename S::Mask inner = S::Less(u, S::Set(T(0.5)));
+			const typename S::Mask softened = S::Less(u, S::Set(T(1)));
+			force = S::Select(softened, S::Mul(hInv3, S::Select(inner, innerForce, outerForce)),
+				S::Mul(invDist, S::Mul(invDist, invDist)));
+			potential = S::Select(softened, S::Mul(hInv, S::Select(inner, innerPotential, outerPotential)), invDist);
+		}
+	};
+
+	// Pair terms of the sources [begin, end) on one target, S::Width at a time, added to the
+	// double accumulators. Returns the first source that did not fill a whole register.
+	template <typename S, typename Softening>
+	size_t sumPairs(const typename S::T* sx, const typename S::T* sy, const typename S::T* sz, const typename S::T* sgm,
+		size_t begin, size_t end, typename S::T xi, typename S::T yi, typename S::T zi, const Softening& softening,
+		double& ax, double& ay, double& az, double& phi) {
+		using V = typename S::V;
+		const V x = S::Set(xi), y = S::Set(yi), z = S::Set(zi), zero = S::Set(0);
+		const V minDist2 = S::Set(typename S::T(MIN_DIST2));
+		V fx = zero, fy = zero, fz = zero, fphi = zero;
+
+		size_t j = begin;
+		for (; j + S::Width <= end; j += S::Width) {
+			V dx = S::Sub(S::Load(sx + j), x), dy = S::Sub(S::Load(sy + j), y), dz = S::Sub(S::Load(sz + j), z);
+			V dist2 = S::Add(S::Add(S::Mul(dx, dx), S::Mul(dy, dy)), S::Mul(dz, dz));
+			V force, potential;
+			softening(dist2, force, potential);
+
+			// Drops the body itself
+			typename S::Mask keep = S::Greater(dist2, minDist2);
+			V gm = S::Load(sgm + j);
+			V weight = S::Select(keep, S::Mul(gm, force), zero);
+			fx = S::Add(fx, S::Mul(weight, dx));
+			fy = S::Add(fy, S::Mul(weight, dy));
+			fz = S::Add(fz, S::Mul(weight, dz));
+			fphi = S::Add(fphi, S::Select(keep, S::Mul(gm, potential), zero));
+		}
+		ax += S::Sum(fx);
+		ay += S::Sum(fy);
+		az += S::Sum(fz);
+		phi -= S::Sum(fphi);
+		return j;
+	}
+}
+
+void DirectKernel::ComputeAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel,
+	std::vector<double>* potentialEnergy, ThreadPool& pool) {
+	const size_t count = bodies.Size();
+	accel.assign(count, glm::dvec3(0.0));
+	if (potentialEnergy) potentialEnergy->assign(count, 0.0);
+	const size_t targets = std::min(targetCount, count);
+	if (targets == 0) return;
+
+	// Only the targets are tiled, the sources past them follow in their own order
+	glm::dvec3 lo = bodies.position[0], hi = bodies.position[0];
+	for (size_t i = 0; i < targets; ++i) {
+		lo = glm::min(lo, bodies.position[i]);
+		hi = glm::max(hi, bodies.position[i]);
+	}
+	ComputeMortonKeys(bodies.position.data(), targets, lo, hi, m_keys, pool);
+	m_order.resize(targets);
+	for (size_t i = 0; i < targets; ++i)
+		m_order[i] = uint32_t(i);
+	RadixSortPairs(m_keys, m_order, 63, pool);
+	for (size_t i = targets; i < count; ++i)
+		m_order.push_back(uint32_t(i));
+
+	m_x.resize(count);
+	m_y.resize(count);
+	m_z.resize(count);
+	m_gm.resize(count);
+	for (size_t k = 0; k < count; ++k) {
+		uint32_t i = m_order[k];
+		m_x[k] = bodies.position[i].x;
+		m_y[k] = bodies.position[i].y;
+		m_z[k] = bodies.position[i].z;
+		m_gm[k] = G * bodies.mass[i];
+	}
+
+	// Every variant is compiled once, indexed by [precision][softening][external]
+	using RunFn = void (DirectKernel::*)(size_t, size_t, std::vector<glm::dvec3>&, std::vector<double>*, ThreadPool&);
+	static const RunFn variants[2][3][2] = {
+		{
+			{ &DirectKernel::run<double, NoSoftening, false>, &DirectKernel::run<double, NoSoftening, true> },
+			{ &DirectKernel::run<double, PlummerSoftening, false>, &DirectKernel::run<double, PlummerSoftening, true> },
+			{ &DirectKernel::run<double, SplineSoftening, false>, &DirectKernel::run<double, SplineSoftening, true> },
+		},
+		{
+			{ &DirectKernel::run<float, NoSoftening, false>, &DirectKernel::run<float, NoSoftening, true> },
+			{ &DirectKernel::run<float, PlummerSoftening, false>, &DirectKernel::run<float, PlummerSoftening, true> },
+			{ &DirectKernel::run<float, SplineSoftening, false>, &DirectKernel::run<float, SplineSoftening, true> },
+		},
+	};
+	size_t softeningIndex = softeningLength > 0.0 ? size_t(softening) : size_t(SofteningModel::None);
+	size_t externalIndex = (external && !external->Empty()) ? 1 : 0;
+	(this->*variants[size_t(precision)][softeningIndex][externalIndex])(count, targets, accel, potentialEnergy, pool);
+
+	if (potentialEnergy) {
+		for (size_t i = 0; i < count; ++i)
+			(*potentialEnergy)[i] *= bodies.mass[i];
+	}
+}
+
+template <typename Real, template <typename> class Softening, bool WithExternal>
+void DirectKernel::run(size_t count, size_t targets, std::vector<glm::dvec3>& accel, std::vector<double>* potentialEnergy, ThreadPool& pool) {
+	const Softening<SimdOps<Real>> simdSoftening(softeningLength);
+	const Softening<ScalarOps<Real>> scalarSoftening(softeningLength);
+	const size_t tileCount = (targets + TILE - 1) / TILE;
+	const size_t grain = std::max<size_t>(1, tileCount / (4 * pool.ThreadCount()));
+
+	pool.ParallelFor(tileCount, grain, [&](size_t tileBegin, size_t tileEnd) {
+		// Sources relative to the current tile's origin, reused by all tiles of this chunk
+		std::vector<Real> sx(count), sy(count), sz(count), sgm(count);
+		for (size_t k = 0; k < count; ++k)
+			sgm[k] = Real(m_gm[k]);
+
+		for (size_t tile = tileBegin; tile < tileEnd; ++tile) {
+			const size_t first = tile * TILE, last = std::min(first + TILE, targets);
+			const double ox = m_x[first], oy = m_y[first], oz = m_z[first];
+			for (size_t k = 0; k < count; ++k) {
+				sx[k] = Real(m_x[k] - ox);
+				sy[k] = Real(m_y[k] - oy);
+				sz[k] = Real(m_z[k] - oz);
+			}
+
+			double ax[TILE] = {}, ay[TILE] = {}, az[TILE] = {}, phi[TILE] = {}, externalPhi[TILE] = {};
+			for (size_t t = first; t < last; ++t) {
+				const Real xi = sx[t], yi = sy[t], zi = sz[t];
+				const size_t k = t - first;
+				for (size_t chunk = 0; chunk < count; chunk += CHUNK) {
+					const size_t chunkEnd = std::min(chunk + CHUNK, count);
+					size_t j = sumPairs<SimdOps<Real>>(sx.data(), sy.data(), sz.data(), sgm.data(), chunk, chunkEnd,
+						xi, yi, zi, simdSoftening, ax[k], ay[k], az[k], phi[k]);
+					sumPairs<ScalarOps<Real>>(sx.data(), sy.data(), sz.data(), sgm.data(), j, chunkEnd,
+						xi, yi, zi, scalarSoftening, ax[k], ay[k], az[k], phi[k]);
+				}
+			}
+			if constexpr (WithExternal)
+				external->Evaluate(&m_x[first], &m_y[first], &m_z[first], last - first, ax, ay, az, externalPhi);
+
+			for (size_t t = first; t < last; ++t) {
+				const size_t k = t - first;
+				uint32_t body = m_order[t];
+				accel[body] = glm::dvec3(ax[k], ay[k], az[k]);
+				// Pair energies are shared between both bodies, the field's belongs to the body alone
+				if (potentialEnergy) (*potentialEnergy)[body] = 0.5 * phi[k] + externalPhi[k];
+			}
+		}
+	});
+}
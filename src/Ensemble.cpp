@@ -0,0 +1,326 @@
+#include "Ensemble.h"
+#include "ThreadPool.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+	// Members per batch, one per SIMD lane (two AVX-512 registers of doubles)
+	constexpr size_t ENSEMBLE_LANES = 16;
+
+	constexpr char ENSEMBLE_MAGIC[8] = { 'G', 'S', 'E', 'N', 'S', 'M', 'B', 'L' };
+	constexpr uint32_t ENSEMBLE_VERSION = 1;
+
+	uint64_t splitMix64(uint64_t& state) {
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// Standard normal deviate (Box-Muller), the stream only depends on the member's seed
+	double gaussian(uint64_t& state) {
+		double u1 = (double(splitMix64(state) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+		double u2 = double(splitMix64(state) >> 11) * (1.0 / 9007199254740992.0);
+		return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * glm::pi<double>() * u2);
+	}
+
+	// One batch of members, [body][lane] layout so every loop over lanes vectorizes
+	struct EnsembleBatch {
+		size_t bodies;
+		std::vector<double> mass;                 // [body * LANES + lane]
+		std::vector<double> x, y, z, vx, vy, vz;
+		std::vector<double> ax, ay, az;
+
+		explicit EnsembleBatch(size_t bodyCount) : bodies(bodyCount) {
+			size_t n = bodyCount * ENSEMBLE_LANES;
+			for (auto* v : { &mass, &x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az })
+				v->assign(n, 0.0);
+		}
+
+		void accelerations() {
+			std::fill(ax.begin(), ax.end(), 0.0);
+			std::fill(ay.begin(), ay.end(), 0.0);
+			std::fill(az.begin(), az.end(), 0.0);
+			for (size_t i = 0; i < bodies; ++i) {
+				for (size_t j = i + 1; j < bodies; ++j) {
+					const size_t bi = i * ENSEMBLE_LANES, bj = j * ENSEMBLE_LANES;
+					for (size_t l = 0; l < ENSEMBLE_LANES; ++l) {
+						double dx = x[bj + l] - x[bi + l];
+						double dy = y[bj + l] - y[bi + l];
+						double dz = z[bj + l] - z[bi + l];
+						double r2 = dx * dx + dy * dy + dz * dz;
+						double inv = 1.0 / (r2 * std::sqrt(r2));
+						double fi = G * mass[bj + l] * inv;
+						double fj = G * mass[bi + l] * inv;
+						ax[bi + l] += fi * dx; ay[bi + l] += fi * dy; az[bi + l] += fi * dz;
+						ax[bj + l] -= fj * dx; ay[bj + l] -= fj * dy; az[bj + l] -= fj * dz;
+					}
+				}
+			}
+		}
+
+		void kick(double dt) {
+			for (size_t k = 0; k < vx.size(); ++k) {
+				vx[k] += dt * ax[k];
+				vy[k] += dt * ay[k];
+				vz[k] += dt * az[k];
+			}
+		}
+
+		void drift(double dt) {
+			for (size_t k = 0; k < x.size(); ++k) {
+				x[k] += dt * vx[k];
+				y[k] += dt * vy[k];
+				z[k] += dt * vz[k];
+			}
+		}
+
+		double energy(size_t l) const {
+			double e = 0.0;
+			for (size_t i = 0; i < bodies; ++i) {
+				size_t bi = i * ENSEMBLE_LANES + l;
+				e += 0.5 * mass[bi] * (vx[bi] * vx[bi] + vy[bi] * vy[bi] + vz[bi] * vz[bi]);
+				for (size_t j = i + 1; j < bodies; ++j) {
+					size_t bj = j * ENSEMBLE_LANES + l;
+					double dx = x[bj] - x[bi], dy = y[bj] - y[bi], dz = z[bj] - z[bi];
+					e -= G * mass[bi] * mass[bj] / std::sqrt(dx * dx + dy * dy + dz * dz);
+				}
+			}
+			return e;
+		}
+	};
+
+	void runBatch(const BodyState& base, const EnsembleConfig& config, size_t firstMember, size_t memberCount,
+		double escapeRadius, EnsembleMemberResult* results) {
+		const size_t bodies = base.Size();
+		EnsembleBatch batch(bodies);
+
+		// Perturbed initial conditions; unused lanes duplicate the base system
+		for (size_t l = 0; l < ENSEMBLE_LANES; ++l) {
+			uint64_t state = config.seed ^ (0x5851f42d4c957f2dull * (firstMember + l + 1));
+			for (size_t i = 0; i < bodies; ++i) {
+				size_t k = i * ENSEMBLE_LANES + l;
+				double rScale = config.positionJitter * glm::length(base.position[i]);
+				double vScale = config.velocityJitter * glm::length(base.velocity[i]);
+				bool perturb = l < memberCount && i > 0;
+				batch.mass[k] = base.mass[i];
+				batch.x[k] = base.position[i].x + (perturb ? rScale * gaussian(state) : 0.0);
+				batch.y[k] = base.position[i].y + (perturb ? rScale * gaussian(state) : 0.0);
+				batch.z[k] = base.position[i].z + (perturb ? rScale * gaussian(state) : 0.0);
+				batch.vx[k] = base.velocity[i].x + (perturb ? vScale * gaussian(state) : 0.0);
+				batch.vy[k] = base.velocity[i].y + (perturb ? vScale * gaussian(state) : 0.0);
+				batch.vz[k] = base.velocity[i].z + (perturb ? vScale * gaussian(state) : 0.0);
+			}
+		}
+
+		double initialEnergy[ENSEMBLE_LANES];
+		for (size_t l = 0; l < ENSEMBLE_LANES; ++l) {
+			initialEnergy[l] = batch.energy(l);
+			results[l] = { float(config.duration), 0.0f, 0.0f, 1 };
+		}
+
+		size_t steps = size_t(std::ceil(config.duration / config.dt));
+		double dt = config.duration / double(std::max<size_t>(steps, 1));
+		size_t check = std::max<size_t>(config.checkInterval, 1);
+		const double escape2 = escapeRadius * escapeRadius;
+
+		batch.accelerations();
+		for (size_t step = 1; step <= steps; ++step) {
+			batch.kick(0.5 * dt);
+			batch.drift(dt);
+			batch.accelerations();
+			batch.kick(0.5 * dt);
+
+			if (step % check != 0 && step != steps) continue;
+
+			bool anyStable = false;
+			for (size_t l = 0; l < memberCount; ++l) {
+				EnsembleMemberResult& r = results[l];
+				if (!r.stable) continue;
+
+				// Eccentricities around the central body, escapes beyond the escape radius
+				bool escaped = false;
+				for (size_t i = 1; i < bodies; ++i) {
+					size_t c = l, k = i * ENSEMBLE_LANES + l;
+					glm::dvec3 rel(batch.x[k] - batch.x[c], batch.y[k] - batch.y[c], batch.z[k] - batch.z[c]);
+					glm::dvec3 vel(batch.vx[k] - batch.vx[c], batch.vy[k] - batch.vy[c], batch.vz[k] - batch.vz[c]);
+					double mu = G * (batch.mass[c] + batch.mass[k]);
+					double dist = glm::length(rel);
+					glm::dvec3 eVec = ((glm::dot(vel, vel) - mu / dist) * rel - glm::dot(rel, vel) * vel) / mu;
+					double ecc = glm::length(eVec);
+					r.maxEccentricity = std::max(r.maxEccentricity, float(ecc));
+					if (dist * dist > escape2 || ecc >= 1.0) escaped = true;
+				}
+
+				r.energyError = float(std::abs((batch.energy(l) - initialEnergy[l]) / initialEnergy[l]));
+				if (escaped) {
+					r.stable = 0;
+					r.survivalTime = float(step * dt);
+				}
+				anyStable |= r.stable != 0;
+			}
+			if (!anyStable) break;
+		}
+	}
+}
+
+BodyState MakeOuterSolarSystem() {
+	// name, mass [kg], orbit radius [km]
+	const double sunMass = 1.989e30;
+	const double planets[][2] = {
+		{ 1.898e27, 7.785e8 },  // Jupiter
+		{ 5.683e26, 1.4335e9 }, // Saturn
+		{ 8.681e25, 2.8725e9 }, // Uranus
+		{ 1.024e26, 4.4951e9 }, // Neptune
+	};
+
+	BodyState bodies;
+	bodies.Resize(5);
+	bodies.mass[0] = sunMass * KG_TO_GMASS;
+	for (size_t i = 0; i < 4; ++i) {
+		double m = planets[i][0] * KG_TO_GMASS;
+		double r = planets[i][1] * KM_TO_GLEN;
+		double angle = 1.3 * double(i); // Spread the planets around the sun
+		double v = std::sqrt(G * (bodies.mass[0] + m) / r);
+		bodies.mass[i + 1] = m;
+		bodies.position[i + 1] = glm::dvec3(r * std::cos(angle), 0.0, r * std::sin(angle));
+		bodies.velocity[i + 1] = glm::dvec3(-v * std::sin(angle), 0.0, v * std::cos(angle));
+	}
+
+	// Move to the barycentre frame
+	glm::dvec3 com(0.0), momentum(0.0);
+	double total = 0.0;
+	for (size_t i = 0; i < bodies.Size(); ++i) {
+		com += bodies.mass[i] * bodies.position[i];
+		momentum += bodies.mass[i] * bodies.velocity[i];
+		total += bodies.mass[i];
+	}
+	for (size_t i = 0; i < bodies.Size(); ++i) {
+		bodies.position[i] -= com / total;
+		bodies.velocity[i] -= momentum / total;
+	}
+	return bodies;
+}
+
+void RunEnsemble(const BodyState& base, const EnsembleConfig& config, std::vector<EnsembleMemberResult>& results, EnsembleSummary& summary) {
+	results.assign(config.members, EnsembleMemberResult{});
+	summary = EnsembleSummary{};
+	summary.members = config.members;
+	if (config.members == 0 || base.Size() < 2 || config.dt <= 0.0) return;
+
+	double outermost = 0.0;
+	for (const glm::dvec3& p : base.position)
+		outermost = std::max(outermost, glm::length(p - base.position[0]));
+	double escapeRadius = config.escapeFactor * outermost;
+
+	size_t batchCount = (config.members + ENSEMBLE_LANES - 1) / ENSEMBLE_LANES;
+	ThreadPool::Global().ParallelFor(batchCount, 1, [&](size_t begin, size_t end) {
+		EnsembleMemberResult batchResults[ENSEMBLE_LANES];
+		for (size_t b = begin; b < end; ++b) {
+			size_t first = b * ENSEMBLE_LANES;
+			size_t count = std::min(ENSEMBLE_LANES, config.members - first);
+			runBatch(base, config, first, count, escapeRadius, batchResults);
+			std::copy(batchResults, batchResults + count, results.begin() + first);
+		}
+	});
+
+	// Reduce into summary statistics
+	std::vector<float> survival;
+	survival.reserve(results.size());
+	for (const auto& r : results) {
+		summary.stableMembers += r.stable;
+		summary.meanEnergyError += r.energyError;
+		summary.meanMaxEccentricity += r.maxEccentricity;
+		survival.push_back(r.survivalTime);
+	}
+	double n = double(results.size());
+	summary.meanEnergyError /= n;
+	summary.meanMaxEccentricity /= n;
+	for (const auto& r : results)
+		summary.stdEnergyError += (r.energyError - summary.meanEnergyError) * (r.energyError - summary.meanEnergyError);
+	summary.stdEnergyError = std::sqrt(summary.stdEnergyError / n);
+	std::nth_element(survival.begin(), survival.begin() + survival.size() / 2, survival.end());
+	summary.medianSurvivalTime = survival[survival.size() / 2];
+}
+
+bool WriteEnsembleResults(const std::string& path, const EnsembleConfig& config, size_t bodyCount,
+	const std::vector<EnsembleMemberResult>& results, const EnsembleSummary& summary) {
+	std::ofstream out(path, std::ios::binary);
+	if (!out) return false;
+
+	// Little-endian, fixed-width fields
+	auto write = [&](const auto& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+	out.write(ENSEMBLE_MAGIC, sizeof(ENSEMBLE_MAGIC));
+	write(ENSEMBLE_VERSION);
+	write(uint32_t(bodyCount));
+	write(uint64_t(results.size()));
+	write(config.seed);
+	write(config.duration);
+	write(config.dt);
+	write(config.positionJitter);
+	write(config.velocityJitter);
+
+	write(uint64_t(summary.stableMembers));
+	write(summary.meanEnergyError);
+	write(summary.stdEnergyError);
+	write(summary.medianSurvivalTime);
+	write(summary.meanMaxEccentricity);
+
+	for (const auto& r : results) {
+		write(r.survivalTime);
+		write(r.energyError);
+		write(r.maxEccentricity);
+		write(r.stable);
+	}
+	return bool(out);
+}
+
+int RunEnsembleCommand(int argc, char* argv[]) {
+	EnsembleConfig config;
+	BodyState base = MakeOuterSolarSystem();
+
+	// Defaults: 10^4 Jupiter years at 100 steps per Jupiter orbit
+	double jupiterPeriod = 2.0 * glm::pi<double>() * std::sqrt(std::pow(glm::length(base.position[1] - base.position[0]), 3.0) / (G * base.mass[0]));
+	double orbits = 1.0e4;
+	double stepsPerOrbit = 100.0;
+
+	for (int i = 1; i < argc; ++i) {
+		auto next = [&](double fallback) { return i + 1 < argc ? std::atof(argv[++i]) : fallback; };
+		if (strcmp(argv[i], "--members") == 0) config.members = size_t(next(double(config.members)));
+		else if (strcmp(argv[i], "--orbits") == 0) orbits = next(orbits);
+		else if (strcmp(argv[i], "--steps-per-orbit") == 0) stepsPerOrbit = next(stepsPerOrbit);
+		else if (strcmp(argv[i], "--jitter") == 0) config.positionJitter = config.velocityJitter = next(config.positionJitter);
+		else if (strcmp(argv[i], "--seed") == 0) config.seed = uint64_t(next(double(config.seed)));
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) config.outputPath = argv[++i];
+	}
+	config.duration = orbits * jupiterPeriod;
+	config.dt = jupiterPeriod / stepsPerOrbit;
+
+	printf("Ensemble: %zu members, %zu bodies, %.0f orbits, %zu threads\n",
+		config.members, base.Size(), orbits, ThreadPool::Global().ThreadCount());
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<EnsembleMemberResult> results;
+	EnsembleSummary summary;
+	RunEnsemble(base, config, results, summary);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Stable: %zu / %zu\n", summary.stableMembers, summary.members);
+	printf("Energy error: mean %.3e, std %.3e\n", summary.meanEnergyError, summary.stdEnergyError);
+	printf("Median survival: %.3f orbits, mean max eccentricity %.4f\n", summary.medianSurvivalTime / jupiterPeriod, summary.meanMaxEccentricity);
+	printf("Finished in %.2f s\n", seconds);
+
+	if (!WriteEnsembleResults(config.outputPath, config, base.Size(), results, summary)) {
+		printf("Could not write %s\n", config.outputPath.c_str());
+		return 1;
+	}
+	printf("Results written to %s\n", config.outputPath.c_str());
+	return 0;
+}
@@ -0,0 +1,408 @@
+#include "Ephemeris.h"
+#include "SimdOps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace {
+	constexpr uint32_t NO_SLOT = UINT32_MAX;
+	constexpr uint32_t MAX_DEGREE = 32;
+	constexpr uint64_t MAX_ID_GAP = 1u << 24;   // Planet IDs above the slot count a file may use, they size m_slotOfId
+	constexpr size_t BODY_GRAIN = 4096;   // Bodies per ParallelFor task while recording
+
+	bool hostIsLittleEndian() {
+		const uint32_t probe = 1;
+		uint8_t first;
+		std::memcpy(&first, &probe, 1);
+		return first == 1;
+	}
+
+	uint64_t alignUp(uint64_t offset) {
+		return (offset + EPHEMERIS_ALIGNMENT - 1) / EPHEMERIS_ALIGNMENT * EPHEMERIS_ALIGNMENT;
+	}
+
+	// T_0(tau) ... T_degree(tau)
+	void chebyshev(double tau, size_t terms, double* t) {
+		t[0] = 1.0;
+		if (terms > 1) t[1] = tau;
+		for (size_t k = 2; k < terms; ++k)
+			t[k] = 2.0 * tau * t[k - 1] - t[k - 2];
+	}
+
+	// Clenshaw's recurrence for S::Width consecutive slots of one axis, c points at coefficient 0
+	// of the first slot and the coefficients of one slot are stride apart
+	template <typename S>
+	typename S::V clenshaw(const double* c, size_t stride, size_t terms, typename S::V tau) {
+		using V = typename S::V;
+		const V twoTau = S::Add(tau, tau);
+		V b1 = S::Set(0.0), b2 = S::Set(0.0);
+		for (size_t k = terms - 1; k >= 1; --k) {
+			V b = S::Add(S::Sub(S::Mul(twoTau, b1), b2), S::Load(c + k * stride));
+			b2 = b1;
+			b1 = b;
+		}
+		return S::Add(S::Sub(S::Mul(tau, b1), b2), S::Load(c));
+	}
+
+	// Positions of the slots [begin, slots) S::Width at a time, returns where it stopped
+	template <typename S>
+	size_t evaluateLanes(const double* segment, size_t slots, size_t terms, double tau, size_t begin,
+		double* x, double* y, double* z) {
+		const typename S::V t = S::Set(tau);
+		const size_t stride = 3 * slots;
+		for (; begin + S::Width <= slots; begin += S::Width) {
+			S::Store(x + begin, clenshaw<S>(segment + begin, stride, terms, t));
+			S::Store(y + begin, clenshaw<S>(segment + slots + begin, stride, terms, t));
+			S::Store(z + begin, clenshaw<S>(segment + 2 * slots + begin, stride, terms, t));
+		}
+		return begin;
+	}
+
+	// In-place Cholesky factor of the leading m x m block of a row-major matrix with the given stride
+	bool cholesky(double* a, size_t m, size_t stride) {
+		for (size_t j = 0; j < m; ++j) {
+			double d = a[j * stride + j];
+			for (size_t k = 0; k < j; ++k)
+				d -= a[j * stride + k] * a[j * stride + k];
+			if (!(d > 0.0)) return false;
+			a[j * stride + j] = std::sqrt(d);
+			for (size_t i = j + 1; i < m; ++i) {
+				double s = a[i * stride + j];
+				for (size_t k = 0; k < j; ++k)
+					s -= a[i * stride + k] * a[j * stride + k];
+				a[i * stride + j] = s / a[j * stride + j];
+			}
+		}
+		return true;
+	}
+
+	// Solves L L^T c = b in place
+	void choleskySolve(const double* l, size_t m, size_t stride, double* b) {
+		for (size_t i = 0; i < m; ++i) {
+			for (size_t k = 0; k < i; ++k)
+				b[i] -= l[i * stride + k] * b[k];
+			b[i] /= l[i * stride + i];
+		}
+		for (size_t i = m; i-- > 0;) {
+			for (size_t k = i + 1; k < m; ++k)
+				b[i] -= l[k * stride + i] * b[k];
+			b[i] /= l[i * stride + i];
+		}
+	}
+}
+
+void Ephemeris::Clear() {
+	m_file.Close();
+	m_mappedIds = nullptr;
+	m_mappedCoefficients = nullptr;
+	m_startTime = 0.0;
+	m_segmentSpan = 0.0;
+	m_slotCount = 0;
+	m_segmentCount = 0;
+	m_sampleCount = 0;
+	m_table.clear();
+	m_slotIds.clear();
+	m_slotOfId.clear();
+	m_rhs.clear();
+	m_slotSamples.clear();
+	m_windowSamples = 0;
+	m_hasLast = false;
+	m_lastIds.clear();
+	m_lastPosition.clear();
+	m_error.clear();
+}
+
+void Ephemeris::Begin(double startTime, double segmentSpan, uint32_t degree) {
+	Clear();
+	m_startTime = startTime;
+	m_segmentSpan = segmentSpan;
+	m_degree = std::min(degree, MAX_DEGREE);
+	m_normal.assign((size_t(m_degree) + 1) * (m_degree + 1), 0.0);
+}
+
+uint32_t Ephemeris::findSlot(uint32_t id) const {
+	return id < m_slotOfId.size() ? m_slotOfId[id] : NO_SLOT;
+}
+
+uint32_t Ephemeris::slotOf(uint32_t id) {
+	if (id >= m_slotOfId.size())
+		m_slotOfId.resize(size_t(id) + 1, NO_SLOT);
+	if (m_slotOfId[id] == NO_SLOT) {
+		// Joins with no samples in the open segment, so it is fitted from the next segment on
+		m_slotOfId[id] = uint32_t(m_slotIds.size());
+		m_slotIds.push_back(id);
+		m_rhs.resize(m_rhs.size() + 3 * (size_t(m_degree) + 1), 0.0);
+		m_slotSamples.push_back(0);
+	}
+	return m_slotOfId[id];
+}
+
+void Ephemeris::Record(double time, const uint32_t* ids, const glm::dvec3* position, size_t count, ThreadPool& pool) {
+	if (!Recording()) return;
+	if (m_hasLast && time <= m_lastTime) {
+		// Paused, nothing new to fit
+		if (time == m_lastTime) return;
+		truncateAfter(time, pool);
+	}
+	else if (time < m_startTime) {
+		truncateAfter(time, pool);
+	}
+
+	for (size_t i = 0; i < count; ++i)
+		slotOf(ids[i]);
+
+	accumulate(windowTau(time), ids, position, count, pool);
+	// The first sample past a segment closes it and, with the one before it, opens the next
+	while (time >= m_startTime + (m_segmentCount + 1) * m_segmentSpan) {
+		fitWindow(pool);
+		resetWindow();
+		if (m_hasLast)
+			accumulate(windowTau(m_lastTime), m_lastIds.data(), m_lastPosition.data(), m_lastIds.size(), pool);
+		accumulate(windowTau(time), ids, position, count, pool);
+	}
+
+	m_lastTime = time;
+	m_lastIds.assign(ids, ids + count);
+	m_lastPosition.assign(position, position + count);
+	m_hasLast = true;
+	m_sampleCount += count;
+}
+
+double Ephemeris::windowTau(double time) const {
+	return 2.0 * (time - m_startTime - m_segmentCount * m_segmentSpan) / m_segmentSpan - 1.0;
+}
+
+void Ephemeris::accumulate(double tau, const uint32_t* ids, const glm::dvec3* position, size_t count, ThreadPool& pool) {
+	const size_t terms = size_t(m_degree) + 1;
+	double t[MAX_DEGREE + 1];
+	chebyshev(tau, terms, t);
+
+	for (size_t i = 0; i < terms; ++i)
+		for (size_t j = 0; j < terms; ++j)
+			m_normal[i * terms + j] += t[i] * t[j];
+	m_windowSamples++;
+
+	// Every body has its own slot, the tasks never share one
+	pool.ParallelFor(count, BODY_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const uint32_t slot = m_slotOfId[ids[i]];
+			double* rhs = &m_rhs[size_t(slot) * 3 * terms];
+			for (int axis = 0; axis < 3; ++axis)
+				for (size_t k = 0; k < terms; ++k)
+					rhs[axis * terms + k] += t[k] * position[i][axis];
+			m_slotSamples[slot]++;
+		}
+	});
+}
+
+void Ephemeris::resetWindow() {
+	std::fill(m_normal.begin(), m_normal.end(), 0.0);
+	std::fill(m_rhs.begin(), m_rhs.end(), 0.0);
+	std::fill(m_slotSamples.begin(), m_slotSamples.end(), 0u);
+	m_windowSamples = 0;
+}
+
+void Ephemeris::restride() {
+	// Rare: only when planets were added since the last segment
+	const size_t terms = size_t(m_degree) + 1, slots = m_slotIds.size();
+	std::vector<double> table(m_segmentCount * terms * 3 * slots, std::numeric_limits<double>::quiet_NaN());
+	for (size_t segment = 0; segment < m_segmentCount; ++segment) {
+		for (size_t row = 0; row < terms * 3; ++row) {
+			const double* from = &m_table[(segment * terms * 3 + row) * m_slotCount];
+			std::copy(from, from + m_slotCount, &table[(segment * terms * 3 + row) * slots]);
+		}
+	}
+	m_table.swap(table);
+	m_slotCount = slots;
+}
+
+void Ephemeris::fitWindow(ThreadPool& pool) {
+	if (m_slotIds.size() > m_slotCount)
+		restride();
+
+	// Fewer samples than coefficients fit a lower degree, the leading block of the normal equations
+	const size_t terms = size_t(m_degree) + 1;
+	size_t fitted = std::min<size_t>(terms, m_windowSamples);
+	std::vector<double> factor(m_normal);
+	while (fitted > 0 && !cholesky(factor.data(), fitted, terms)) {
+		factor = m_normal;
+		fitted--;
+	}
+
+	const size_t stride = segmentStride(), slots = m_slotCount;
+	m_table.resize((m_segmentCount + 1) * stride);
+	double* segment = &m_table[m_segmentCount * stride];
+	pool.ParallelFor(slots, BODY_GRAIN, [&](size_t begin, size_t end) {
+		double c[MAX_DEGREE + 1];
+		for (size_t slot = begin; slot < end; ++slot) {
+			// Planets that came or went inside the segment have no fit for it
+			const bool present = fitted > 0 && m_slotSamples[slot] == m_windowSamples;
+			for (int axis = 0; axis < 3; ++axis) {
+				if (present) {
+					std::copy_n(&m_rhs[(slot * 3 + axis) * terms], fitted, c);
+					choleskySolve(factor.data(), fitted, terms, c);
+				}
+				for (size_t k = 0; k < terms; ++k)
+					segment[(k * 3 + axis) * slots + slot] = !present ? std::numeric_limits<double>::quiet_NaN() : k < fitted ? c[k] : 0.0;
+			}
+		}
+	});
+	m_segmentCount++;
+}
+
+void Ephemeris::truncateAfter(double time, ThreadPool& pool) {
+	m_hasLast = false;
+	if (time < m_startTime) {
+		m_startTime = time;
+		m_segmentCount = 0;
+		m_table.clear();
+		resetWindow();
+		return;
+	}
+
+	// The segment holding time has to be fitted again from time on. Its part before time is
+	// still valid, so it goes back in as samples of the old fit; the open segment is fitted first
+	const size_t segment = size_t((time - m_startTime) / m_segmentSpan);
+	if (segment >= m_segmentCount && m_windowSamples > 0)
+		fitWindow(pool);
+	resetWindow();
+	if (segment < m_segmentCount) {
+		const double segmentStart = m_startTime + segment * m_segmentSpan;
+		const size_t terms = size_t(m_degree) + 1;
+		std::vector<double> x(m_slotCount), y(m_slotCount), z(m_slotCount);
+		std::vector<uint32_t> ids;
+		std::vector<glm::dvec3> position;
+		for (size_t j = 0; j < terms && time > segmentStart; ++j) {
+			const double sampleTime = segmentStart + (time - segmentStart) * j / terms;
+			Positions(sampleTime, x.data(), y.data(), z.data());
+			ids.clear();
+			position.clear();
+			for (size_t slot = 0; slot < m_slotCount; ++slot) {
+				if (std::isnan(x[slot])) continue;
+				ids.push_back(m_slotIds[slot]);
+				position.emplace_back(x[slot], y[slot], z[slot]);
+			}
+			accumulate(2.0 * (sampleTime - segmentStart) / m_segmentSpan - 1.0, ids.data(), position.data(), ids.size(), pool);
+		}
+		m_segmentCount = segment;
+	}
+	m_table.resize(m_segmentCount * segmentStride());
+}
+
+bool Ephemeris::locate(double time, size_t& segment, double& tau) const {
+	if (m_segmentCount == 0 || !(time >= m_startTime) || time > EndTime()) return false;
+	segment = std::min(size_t((time - m_startTime) / m_segmentSpan), m_segmentCount - 1);
+	tau = std::clamp(2.0 * (time - m_startTime - segment * m_segmentSpan) / m_segmentSpan - 1.0, -1.0, 1.0);
+	return true;
+}
+
+bool Ephemeris::Position(uint32_t id, double time, glm::dvec3& position) const {
+	const uint32_t slot = findSlot(id);
+	size_t segment;
+	double tau;
+	if (slot >= m_slotCount || !locate(time, segment, tau)) return false;
+
+	const size_t terms = size_t(m_degree) + 1;
+	const double* c = coefficients() + segment * segmentStride() + slot;
+	for (int axis = 0; axis < 3; ++axis)
+		position[axis] = clenshaw<ScalarOps<double>>(c + axis * m_slotCount, 3 * m_slotCount, terms, tau);
+	return !std::isnan(position.x);
+}
+
+bool Ephemeris::Positions(double time, double* x, double* y, double* z) const {
+	size_t segment;
+	double tau;
+	if (!locate(time, segment, tau)) return false;
+
+	const size_t terms = size_t(m_degree) + 1;
+	const double* c = coefficients() + segment * segmentStride();
+	size_t slot = evaluateLanes<SimdOps<double>>(c, m_slotCount, terms, tau, 0, x, y, z);
+	evaluateLanes<ScalarOps<double>>(c, m_slotCount, terms, tau, slot, x, y, z);
+	return true;
+}
+
+bool Ephemeris::Save(const std::string& path) const {
+	// The blocks are raw memory, only a little-endian host writes them in the file's byte order
+	if (!hostIsLittleEndian()) return false;
+
+	EphemerisHeader header = {};
+	std::memcpy(header.magic, EPHEMERIS_MAGIC, sizeof(header.magic));
+	header.version = EPHEMERIS_VERSION;
+	header.headerSize = uint32_t(sizeof(EphemerisHeader));
+	header.startTime = m_startTime;
+	header.segmentSpan = m_segmentSpan;
+	header.degree = m_degree;
+	header.slotCount = uint32_t(m_slotCount);
+	header.segmentCount = m_segmentCount;
+	header.idOffset = alignUp(sizeof(EphemerisHeader));
+	header.coefficientOffset = alignUp(header.idOffset + m_slotCount * sizeof(uint32_t));
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out) return false;
+
+	static const char padding[EPHEMERIS_ALIGNMENT] = {};
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(padding, std::streamsize(header.idOffset - sizeof(header)));
+	out.write(reinterpret_cast<const char*>(SlotIds()), std::streamsize(m_slotCount * sizeof(uint32_t)));
+	out.write(padding, std::streamsize(header.coefficientOffset - header.idOffset - m_slotCount * sizeof(uint32_t)));
+	out.write(reinterpret_cast<const char*>(coefficients()), std::streamsize(TableBytes()));
+	return bool(out);
+}
+
+bool Ephemeris::fail(const char* message) {
+	Clear();
+	m_error = message;
+	return false;
+}
+
+bool Ephemeris::Open(const std::string& path) {
+	Clear();
+	if (!hostIsLittleEndian())
+		return fail("Ephemerides can only be mapped on little-endian hosts");
+	if (!m_file.Open(path))
+		return fail("Could not open file");
+	if (m_file.Size() < sizeof(EphemerisHeader))
+		return fail("File is too small to be an ephemeris");
+
+	EphemerisHeader header;
+	std::memcpy(&header, m_file.Data(), sizeof(EphemerisHeader));
+	if (std::memcmp(header.magic, EPHEMERIS_MAGIC, sizeof(EPHEMERIS_MAGIC)) != 0)
+		return fail("Not an ephemeris file");
+	if (header.version != EPHEMERIS_VERSION || header.headerSize != sizeof(EphemerisHeader))
+		return fail("Unsupported ephemeris version");
+	if (!(header.segmentSpan > 0.0) || !std::isfinite(header.segmentSpan) || !std::isfinite(header.startTime) || header.degree > MAX_DEGREE)
+		return fail("Ephemeris header is corrupt");
+
+	// Both blocks have to lie inside the file and be aligned for in-place use
+	const uint64_t fileSize = m_file.Size();
+	const uint64_t stride = (uint64_t(header.degree) + 1) * 3 * header.slotCount;
+	if (header.idOffset % EPHEMERIS_ALIGNMENT != 0 || header.coefficientOffset % EPHEMERIS_ALIGNMENT != 0 ||
+		header.idOffset > fileSize || header.slotCount > (fileSize - header.idOffset) / sizeof(uint32_t) ||
+		header.coefficientOffset > fileSize ||
+		(stride != 0 && header.segmentCount > (fileSize - header.coefficientOffset) / sizeof(double) / stride))
+		return fail("Ephemeris is truncated or corrupt");
+
+	m_startTime = header.startTime;
+	m_segmentSpan = header.segmentSpan;
+	m_degree = header.degree;
+	m_slotCount = header.slotCount;
+	m_segmentCount = size_t(header.segmentCount);
+	m_mappedIds = reinterpret_cast<const uint32_t*>(m_file.Data() + header.idOffset);
+	m_mappedCoefficients = reinterpret_cast<const double*>(m_file.Data() + header.coefficientOffset);
+
+	// IDs index m_slotOfId, a corrupt one must not size it to gigabytes
+	for (size_t slot = 0; slot < m_slotCount; ++slot) {
+		const uint32_t id = m_mappedIds[slot];
+		if (id >= m_slotCount + MAX_ID_GAP)
+			return fail("Ephemeris planet IDs are corrupt");
+		if (id >= m_slotOfId.size())
+			m_slotOfId.resize(size_t(id) + 1, NO_SLOT);
+		if (m_slotOfId[id] != NO_SLOT)
+			return fail("Ephemeris planet IDs are corrupt");
+		m_slotOfId[id] = uint32_t(slot);
+	}
+	return true;
+}
@@ -0,0 +1,148 @@
+#include "ExternalField.h"
+#include "SimdOps.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	constexpr size_t BLOCK = 1024;   // Bodies copied to structure-of-arrays at a time
+
+	// Below this r / rs the NFW enclosed mass comes from its series, the closed form cancels
+	constexpr double NFW_SERIES_LIMIT = 0.05;
+
+	// Every term adds a(x, y, z) and phi(x, y, z) of its component to the accumulators
+	struct PointMassTerm {
+		const PointMassField& field;
+
+		template <typename S>
+		void Add(typename S::V x, typename S::V y, typename S::V z,
+			typename S::V& ax, typename S::V& ay, typename S::V& az, typename S::V& phi) const {
+			using V = typename S::V;
+			const V gm = S::Set(G * field.mass), zero = S::Set(0.0);
+			V dx = S::Sub(S::Set(field.position.x), x), dy = S::Sub(S::Set(field.position.y), y), dz = S::Sub(S::Set(field.position.z), z);
+			V dist2 = S::Add(S::Add(S::Mul(dx, dx), S::Mul(dy, dy)), S::Mul(dz, dz));
+			typename S::Mask keep = S::Greater(dist2, S::Set(1e-20));
+			V invDist = S::Select(keep, S::Div(S::Set(1.0), S::Sqrt(dist2)), zero);
+			V weight = S::Mul(gm, S::Mul(invDist, S::Mul(invDist, invDist)));
+			ax = S::Add(ax, S::Mul(weight, dx));
+			ay = S::Add(ay, S::Mul(weight, dy));
+			az = S::Add(az, S::Mul(weight, dz));
+			phi = S::Sub(phi, S::Mul(gm, invDist));
+		}
+	};
+
+	struct NFWTerm {
+		const NFWHalo& halo;
+
+		template <typename S>
+		void Add(typename S::V x, typename S::V y, typename S::V z,
+			typename S::V& ax, typename S::V& ay, typename S::V& az, typename S::V& phi) const {
+			using V = typename S::V;
+			const V one = S::Set(1.0), zero = S::Set(0.0);
+			const V gm = S::Set(G * halo.mass), rsInv = S::Set(1.0 / halo.scaleRadius);
+			V dx = S::Sub(S::Set(halo.center.x), x), dy = S::Sub(S::Set(halo.center.y), y), dz = S::Sub(S::Set(halo.center.z), z);
+			V dist2 = S::Add(S::Add(S::Mul(dx, dx), S::Mul(dy, dy)), S::Mul(dz, dz));
+			typename S::Mask keep = S::Greater(dist2, S::Set(1e-40));
+			V dist = S::Sqrt(dist2);
+			V invDist = S::Select(keep, S::Div(one, dist), zero);
+			V r = S::Mul(dist, rsInv);   // x = r / rs
+			V u = S::Add(one, r);
+
+			// ln(1 + x) / x, exact for tiny x where 1 + x rounds to 1
+			typename S::Mask rounded = S::Equal(u, one);
+			V logRatio = S::Select(rounded, one, S::Div(S::Log(u), S::Select(rounded, one, S::Sub(u, one))));
+
+			// ln(1 + x) - x / (1 + x), from its series x^2 / 2 - 2 x^3 / 3 + 3 x^4 / 4 ... near the centre
+			V closed = S::Sub(S::Mul(r, logRatio), S::Div(r, u));
+			V series = S::Set(-12.0 / 13.0);
+			for (int n = 11; n >= 1; --n)
+				series = S::Add(S::Set((n % 2 ? 1.0 : -1.0) * n / (n + 1.0)), S::Mul(r, series));
+			series = S::Mul(S::Mul(r, r), series);
+			V enclosed = S::Select(S::Less(r, S::Set(NFW_SERIES_LIMIT)), series, closed);
+
+			V weight = S::Mul(gm, S::Mul(enclosed, S::Mul(invDist, S::Mul(invDist, invDist))));
+			ax = S::Add(ax, S::Mul(weight, dx));
+			ay = S::Add(ay, S::Mul(weight, dy));
+			az = S::Add(az, S::Mul(weight, dz));
+			phi = S::Sub(phi, S::Mul(S::Mul(gm, rsInv), logRatio));
+		}
+	};
+
+	struct MiyamotoNagaiTerm {
+		const MiyamotoNagaiDisk& disk;
+
+		template <typename S>
+		void Add(typename S::V x, typename S::V y, typename S::V z,
+			typename S::V& ax, typename S::V& ay, typename S::V& az, typename S::V& phi) const {
+			using V = typename S::V;
+			const V gm = S::Set(G * disk.mass), a = S::Set(disk.scaleLength);
+			const V b2 = S::Set(std::max(disk.scaleHeight * disk.scaleHeight, 1e-40));
+			V dx = S::Sub(S::Set(disk.center.x), x), dy = S::Sub(S::Set(disk.center.y), y), dz = S::Sub(S::Set(disk.center.z), z);
+			V zeta = S::Sqrt(S::Add(S::Mul(dz, dz), b2));
+			V s = S::Add(a, zeta);
+			V invD = S::Div(S::Set(1.0), S::Sqrt(S::Add(S::Add(S::Mul(dx, dx), S::Mul(dy, dy)), S::Mul(s, s))));
+			V weight = S::Mul(gm, S::Mul(invD, S::Mul(invD, invD)));
+			ax = S::Add(ax, S::Mul(weight, dx));
+			ay = S::Add(ay, S::Mul(weight, dy));
+			az = S::Add(az, S::Mul(S::Mul(weight, dz), S::Div(s, zeta)));
+			phi = S::Sub(phi, S::Mul(gm, invD));
+		}
+	};
+
+	// Runs a term over [begin, count) S::Width bodies at a time, returns where it stopped
+	template <typename S, typename Term>
+	size_t addLanes(const Term& term, size_t begin, size_t count, const double* x, const double* y, const double* z,
+		double* ax, double* ay, double* az, double* phi) {
+		for (; begin + S::Width <= count; begin += S::Width) {
+			typename S::V fx = S::Load(ax + begin), fy = S::Load(ay + begin), fz = S::Load(az + begin), fphi = S::Load(phi + begin);
+			term.template Add<S>(S::Load(x + begin), S::Load(y + begin), S::Load(z + begin), fx, fy, fz, fphi);
+			S::Store(ax + begin, fx);
+			S::Store(ay + begin, fy);
+			S::Store(az + begin, fz);
+			S::Store(phi + begin, fphi);
+		}
+		return begin;
+	}
+
+	template <typename Term>
+	void addTerm(const Term& term, const double* x, const double* y, const double* z, size_t count,
+		double* ax, double* ay, double* az, double* phi) {
+		size_t i = addLanes<SimdOps<double>>(term, 0, count, x, y, z, ax, ay, az, phi);
+		addLanes<ScalarOps<double>>(term, i, count, x, y, z, ax, ay, az, phi);
+	}
+}
+
+void ExternalField::Evaluate(const double* x, const double* y, const double* z, size_t count,
+	double* ax, double* ay, double* az, double* phi) const {
+	for (const PointMassField& point : pointMasses)
+		addTerm(PointMassTerm{ point }, x, y, z, count, ax, ay, az, phi);
+	for (const NFWHalo& halo : halos)
+		addTerm(NFWTerm{ halo }, x, y, z, count, ax, ay, az, phi);
+	for (const MiyamotoNagaiDisk& disk : disks)
+		addTerm(MiyamotoNagaiTerm{ disk }, x, y, z, count, ax, ay, az, phi);
+}
+
+void ExternalField::AddAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel,
+	std::vector<double>* potentialEnergy, ThreadPool& pool) const {
+	const size_t count = bodies.Size();
+	const size_t blocks = (count + BLOCK - 1) / BLOCK;
+	pool.ParallelFor(blocks, 1, [&](size_t blockBegin, size_t blockEnd) {
+		double x[BLOCK], y[BLOCK], z[BLOCK], ax[BLOCK], ay[BLOCK], az[BLOCK], phi[BLOCK];
+		for (size_t block = blockBegin; block < blockEnd; ++block) {
+			const size_t first = block * BLOCK, n = std::min(BLOCK, count - first);
+			for (size_t k = 0; k < n; ++k) {
+				const glm::dvec3& p = bodies.position[first + k];
+				x[k] = p.x;
+				y[k] = p.y;
+				z[k] = p.z;
+				ax[k] = ay[k] = az[k] = phi[k] = 0.0;
+			}
+			Evaluate(x, y, z, n, ax, ay, az, phi);
+			for (size_t k = 0; k < n; ++k) {
+				accel[first + k] += glm::dvec3(ax[k], ay[k], az[k]);
+				if (potentialEnergy) (*potentialEnergy)[first + k] += bodies.mass[first + k] * phi[k];
+			}
+		}
+	});
+}
@@ -0,0 +1,86 @@
+#include "FFT.h"
+
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+FFT1D::FFT1D(size_t n) : m_n(n), m_twiddles(n / 2), m_bitReverse(n) {
+	for (size_t k = 0; k < n / 2; ++k) {
+		double angle = -2.0 * glm::pi<double>() * double(k) / double(n);
+		m_twiddles[k] = std::complex<float>(float(std::cos(angle)), float(std::sin(angle)));
+	}
+
+	size_t bits = 0;
+	while ((size_t(1) << bits) < n) ++bits;
+	for (size_t i = 0; i < n; ++i) {
+		size_t r = 0;
+		for (size_t b = 0; b < bits; ++b)
+			if (i & (size_t(1) << b)) r |= size_t(1) << (bits - 1 - b);
+		m_bitReverse[i] = r;
+	}
+}
+
+void FFT1D::Transform(std::complex<float>* data, int sign) const {
+	for (size_t i = 0; i < m_n; ++i)
+		if (i < m_bitReverse[i]) std::swap(data[i], data[m_bitReverse[i]]);
+
+	for (size_t length = 2; length <= m_n; length <<= 1) {
+		size_t half = length / 2, stride = m_n / length;
+		for (size_t start = 0; start < m_n; start += length) {
+			for (size_t k = 0; k < half; ++k) {
+				std::complex<float> w = m_twiddles[k * stride];
+				if (sign > 0) w = std::conj(w);
+				std::complex<float> odd = w * data[start + k + half];
+				data[start + k + half] = data[start + k] - odd;
+				data[start + k] += odd;
+			}
+		}
+	}
+}
+
+void InverseRealFFT3D(float* data, size_t n, ThreadPool& pool) {
+	const size_t modes = n / 2 + 1;
+	const size_t rowFloats = n + 2;
+	std::complex<float>* grid = reinterpret_cast<std::complex<float>*>(data);
+	auto at = [&](size_t x, size_t y, size_t kz) -> std::complex<float>& { return grid[(x * n + y) * modes + kz]; };
+
+	FFT1D full(n), half(n / 2);
+
+	// Complex transforms along x and y, one column at a time through a scratch buffer
+	for (int axis = 0; axis < 2; ++axis) {
+		pool.ParallelFor(n * modes, 16, [&](size_t begin, size_t end) {
+			std::vector<std::complex<float>> column(n);
+			for (size_t c = begin; c < end; ++c) {
+				size_t other = c / modes, kz = c % modes;
+				for (size_t i = 0; i < n; ++i)
+					column[i] = axis == 0 ? at(i, other, kz) : at(other, i, kz);
+				full.Transform(column.data(), +1);
+				for (size_t i = 0; i < n; ++i)
+					(axis == 0 ? at(i, other, kz) : at(other, i, kz)) = column[i];
+			}
+		});
+	}
+
+	// Hermitian rows along z to reals: pack even/odd samples into one complex transform of size n/2
+	//     Z[k] = (X[k] + conj(X[m-k])) + i (X[k] - conj(X[m-k])) e^(2 pi i k / n),  z[j] = x[2j] + i x[2j+1]
+	const size_t m = n / 2;
+	std::vector<std::complex<float>> rotation(m);
+	for (size_t k = 0; k < m; ++k) {
+		double angle = 2.0 * glm::pi<double>() * double(k) / double(n);
+		rotation[k] = std::complex<float>(float(std::cos(angle)), float(std::sin(angle)));
+	}
+	const std::complex<float> i(0.0f, 1.0f);
+	pool.ParallelFor(n * n, 64, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; ++row) {
+			std::complex<float>* X = reinterpret_cast<std::complex<float>*>(data + row * rowFloats);
+			for (size_t k = 0; k <= m / 2; ++k) {
+				size_t mirror = m - k;
+				std::complex<float> a = X[k], b = X[mirror];
+				std::complex<float> zk = (a + std::conj(b)) + i * (a - std::conj(b)) * rotation[k];
+				if (mirror < m && mirror != k)
+					X[mirror] = (b + std::conj(a)) + i * (b - std::conj(a)) * rotation[mirror];
+				X[k] = zk;
+			}
+			half.Transform(X, +1);
+		}
+	});
+}
@@ -0,0 +1,273 @@
+#include "Gadget.h"
+#include "MappedFile.h"
+#include "Units.h"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+namespace {
+	constexpr uint32_t HEADER_SIZE = 256;
+	constexpr uint32_t FORMAT2_LABEL_SIZE = 8;
+	constexpr size_t CONVERT_GRAIN = 16384;
+
+	uint32_t byteSwap(uint32_t v) {
+		return (v >> 24) | ((v >> 8) & 0xFF00u) | ((v << 8) & 0xFF0000u) | (v << 24);
+	}
+
+	uint64_t byteSwap(uint64_t v) {
+		return (uint64_t(byteSwap(uint32_t(v))) << 32) | byteSwap(uint32_t(v >> 32));
+	}
+
+	template<typename T>
+	T load(const uint8_t* p, bool swap) {
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		if (swap) {
+			if constexpr (sizeof(T) == 4) {
+				uint32_t bits;
+				std::memcpy(&bits, &value, 4);
+				bits = byteSwap(bits);
+				std::memcpy(&value, &bits, 4);
+			}
+			else {
+				uint64_t bits;
+				std::memcpy(&bits, &value, 8);
+				bits = byteSwap(bits);
+				std::memcpy(&value, &bits, 8);
+			}
+		}
+		return value;
+	}
+
+	struct Block {
+		char label[4];
+		const uint8_t* data;
+		uint64_t size;
+	};
+
+	struct SnapshotFile {
+		MappedFile file;
+		bool swap = false;
+		GadgetHeader header = {};
+		std::vector<Block> blocks;
+
+		const Block* Find(const char* label) const {
+			for (const Block& block : blocks)
+				if (std::memcmp(block.label, label, 4) == 0) return &block;
+			return nullptr;
+		}
+	};
+
+	// One Fortran record: size marker, payload, size marker
+	bool readRecord(const uint8_t*& p, const uint8_t* end, bool swap, Block& block) {
+		if (end - p < 4) return false;
+		uint32_t size = load<uint32_t>(p, swap);
+		if (uint64_t(end - p) < uint64_t(size) + 8 || load<uint32_t>(p + 4 + size, swap) != size) return false;
+		block.data = p + 4;
+		block.size = size;
+		p += size + 8;
+		return true;
+	}
+
+	bool readBlocks(SnapshotFile& snap, std::string& error) {
+		const uint8_t* p = snap.file.Data();
+		const uint8_t* end = p + snap.file.Size();
+
+		if (end - p < 4) {
+			error = "Not a Gadget-2 snapshot";
+			return false;
+		}
+
+		// The first marker is 256 (header record, format 1) or 8 (label record, format 2) in the file's byte order
+		uint32_t first = load<uint32_t>(p, false);
+		bool format2;
+		if (first == HEADER_SIZE || first == FORMAT2_LABEL_SIZE) snap.swap = false;
+		else if (byteSwap(first) == HEADER_SIZE || byteSwap(first) == FORMAT2_LABEL_SIZE) snap.swap = true;
+		else {
+			error = "Not a Gadget-2 snapshot";
+			return false;
+		}
+		format2 = load<uint32_t>(p, snap.swap) == FORMAT2_LABEL_SIZE;
+
+		// Format 1 has no labels, the blocks come in this order
+		static const char* const format1Order[] = { "HEAD", "POS ", "VEL ", "ID  ", "MASS" };
+		size_t index = 0;
+		while (p < end) {
+			Block block;
+			if (format2) {
+				Block label;
+				if (!readRecord(p, end, snap.swap, label) || label.size != FORMAT2_LABEL_SIZE) break;
+				std::memcpy(block.label, label.data, 4);
+			}
+			else std::memcpy(block.label, index < 5 ? format1Order[index] : "????", 4);
+			if (!readRecord(p, end, snap.swap, block)) break;
+			snap.blocks.push_back(block);
+			++index;
+		}
+
+		const Block* head = snap.Find("HEAD");
+		if (!head || head->size != HEADER_SIZE) {
+			error = "Snapshot header is missing or corrupt";
+			return false;
+		}
+
+		const uint8_t* h = head->data;
+		GadgetHeader& header = snap.header;
+		auto next32 = [&](auto& value) { value = load<std::remove_reference_t<decltype(value)>>(h, snap.swap); h += 4; };
+		auto next64 = [&](double& value) { value = load<double>(h, snap.swap); h += 8; };
+		for (uint32_t& n : header.npart) next32(n);
+		for (double& m : header.massTable) next64(m);
+		next64(header.time);
+		next64(header.redshift);
+		next32(header.flagSfr);
+		next32(header.flagFeedback);
+		for (uint32_t& n : header.npartTotal) next32(n);
+		next32(header.flagCooling);
+		next32(header.numFiles);
+		next64(header.boxSize);
+		next64(header.omega0);
+		next64(header.omegaLambda);
+		next64(header.hubbleParam);
+		next32(header.flagStellarAge);
+		next32(header.flagMetals);
+		for (uint32_t& n : header.npartTotalHighWord) next32(n);
+		return true;
+	}
+
+	// Vectors of float or double components, byte swapped and scaled into the output
+	template<typename T>
+	void convertVectors(const uint8_t* src, size_t begin, size_t end, bool swap, double scale, glm::dvec3* out) {
+		const uint8_t* p = src + begin * 3 * sizeof(T);
+		if (!swap) {
+			for (size_t i = begin; i < end; ++i, p += 3 * sizeof(T)) {
+				T v[3];
+				std::memcpy(v, p, sizeof(v));
+				out[i] = glm::dvec3(double(v[0]) * scale, double(v[1]) * scale, double(v[2]) * scale);
+			}
+			return;
+		}
+		for (size_t i = begin; i < end; ++i, p += 3 * sizeof(T))
+			out[i] = glm::dvec3(double(load<T>(p, true)), double(load<T>(p + sizeof(T), true)), double(load<T>(p + 2 * sizeof(T), true))) * scale;
+	}
+
+	void convertVectors(const Block& block, size_t elementSize, size_t first, size_t count, bool swap, double scale, glm::dvec3* out, ThreadPool& pool) {
+		const uint8_t* src = block.data + first * 3 * elementSize;
+		pool.ParallelFor(count, CONVERT_GRAIN, [&](size_t begin, size_t end) {
+			if (elementSize == sizeof(float)) convertVectors<float>(src, begin, end, swap, scale, out);
+			else convertVectors<double>(src, begin, end, swap, scale, out);
+		});
+	}
+}
+
+bool LoadGadget(const std::string& path, const GadgetImportOptions& options, GadgetSnapshot& snapshot, std::string& error, ThreadPool& pool) {
+	snapshot = GadgetSnapshot();
+
+	std::vector<std::unique_ptr<SnapshotFile>> files;
+	files.push_back(std::make_unique<SnapshotFile>());
+	if (!files[0]->file.Open(path)) {
+		error = "Could not open " + path;
+		return false;
+	}
+	if (!readBlocks(*files[0], error)) return false;
+
+	// Multi-file snapshot: path.0, path.1, ...
+	int numFiles = files[0]->header.numFiles;
+	if (numFiles > 1) {
+		if (path.size() < 2 || path.compare(path.size() - 2, 2, ".0") != 0) {
+			error = "Snapshot is split into " + std::to_string(numFiles) + " files, open the one ending in .0";
+			return false;
+		}
+		std::string base = path.substr(0, path.size() - 1);
+		for (int f = 1; f < numFiles; ++f) {
+			files.push_back(std::make_unique<SnapshotFile>());
+			std::string part = base + std::to_string(f);
+			if (!files.back()->file.Open(part)) {
+				error = "Could not open " + part;
+				return false;
+			}
+			if (!readBlocks(*files.back(), error)) return false;
+		}
+	}
+
+	const GadgetHeader& header = files[0]->header;
+	snapshot.header = header;
+	double h = options.hubbleParam > 0.0 ? options.hubbleParam : (header.hubbleParam > 0.0 ? header.hubbleParam : 1.0);
+	double a = options.physical && header.time > 0.0 ? header.time : 1.0;
+
+	// Internal units -> SI -> game units; comoving positions scale with a, Gadget velocities with sqrt(a)
+	const double lengthScale = options.unitLengthInCm * 0.01 * METER_TO_GLEN / h * a;
+	const double velocityScale = options.unitVelocityInCmPerS * 0.01 * METER_TO_GLEN / SEC_TO_GSEC * std::sqrt(a);
+	const double massScale = options.unitMassInG * 0.001 * KG_TO_GMASS / h;
+
+	size_t total = 0;
+	for (const auto& file : files)
+		for (int t = 0; t < GADGET_TYPE_COUNT; ++t)
+			if (options.typeMask & (1u << t)) total += file->header.npart[t];
+	snapshot.bodies.Resize(total);
+	snapshot.type.resize(total);
+	snapshot.id.resize(total);
+
+	size_t out = 0;
+	for (size_t f = 0; f < files.size(); ++f) {
+		const SnapshotFile& file = *files[f];
+		std::string where = files.size() > 1 ? " in file " + std::to_string(f) : "";
+
+		size_t fileCount = 0, variableMassCount = 0;
+		for (int t = 0; t < GADGET_TYPE_COUNT; ++t) {
+			fileCount += file.header.npart[t];
+			if (file.header.massTable[t] == 0.0) variableMassCount += file.header.npart[t];
+		}
+		if (fileCount == 0) continue;
+
+		// Block sizes tell the precision: float or double vectors, 32 or 64 bit IDs
+		const Block* pos = file.Find("POS ");
+		const Block* vel = file.Find("VEL ");
+		const Block* ids = file.Find("ID  ");
+		const Block* mass = file.Find("MASS");
+		size_t vectorSize = pos ? size_t(pos->size / (3 * fileCount)) : 0;
+		size_t idSize = ids ? size_t(ids->size / fileCount) : 0;
+		size_t massSize = mass && variableMassCount ? size_t(mass->size / variableMassCount) : 0;
+		if (!pos || !vel || (vectorSize != 4 && vectorSize != 8) || pos->size != vel->size || pos->size != 3 * fileCount * vectorSize) {
+			error = "POS/VEL blocks do not match the particle count" + where;
+			return false;
+		}
+		if (ids && ((idSize != 4 && idSize != 8) || ids->size != fileCount * idSize)) {
+			error = "ID block does not match the particle count" + where;
+			return false;
+		}
+		if (variableMassCount && (!mass || (massSize != 4 && massSize != 8) || mass->size != variableMassCount * massSize)) {
+			error = "MASS block does not match the mass table" + where;
+			return false;
+		}
+
+		size_t first = 0, massFirst = 0;
+		for (int t = 0; t < GADGET_TYPE_COUNT; ++t) {
+			size_t count = file.header.npart[t];
+			bool variableMass = file.header.massTable[t] == 0.0;
+			if (count && (options.typeMask & (1u << t))) {
+				convertVectors(*pos, vectorSize, first, count, file.swap, lengthScale, snapshot.bodies.position.data() + out, pool);
+				convertVectors(*vel, vectorSize, first, count, file.swap, velocityScale, snapshot.bodies.velocity.data() + out, pool);
+
+				double* masses = snapshot.bodies.mass.data() + out;
+				uint64_t* outIds = snapshot.id.data() + out;
+				pool.ParallelFor(count, CONVERT_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						if (!variableMass) masses[i] = file.header.massTable[t] * massScale;
+						else if (massSize == 4) masses[i] = load<float>(mass->data + (massFirst + i) * 4, file.swap) * massScale;
+						else masses[i] = load<double>(mass->data + (massFirst + i) * 8, file.swap) * massScale;
+
+						if (!ids) outIds[i] = first + i;
+						else if (idSize == 4) outIds[i] = load<uint32_t>(ids->data + (first + i) * 4, file.swap);
+						else outIds[i] = load<uint64_t>(ids->data + (first + i) * 8, file.swap);
+					}
+				});
+				std::fill(snapshot.type.begin() + out, snapshot.type.begin() + out + count, uint8_t(t));
+				out += count;
+			}
+			first += count;
+			if (variableMass) massFirst += count;
+		}
+	}
+	return true;
+}
@@ -57,6 +57,11 @@ void Game::PollEvents() {
 		case SDL_EVENT_MOUSE_MOTION:
 			handleMouseEvent(event);
 			break;
+		case SDL_EVENT_MOUSE_BUTTON_DOWN:
+			// Click to select a planet while the cursor is free and not over the UI
+			if (event.button.button == SDL_BUTTON_LEFT && !m_lookMode && !m_pIO->WantCaptureMouse)
+				pickPlanet(event.button.x, event.button.y);
+			break;
 		case SDL_EVENT_WINDOW_FOCUS_GAINED:
 			m_windowFocused = true;
 			break;
@@ -80,16 +85,74 @@ bool Game::GameLoop() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_DEPTH_TEST);
 	
-	if(m_runSim) {
-		// Apply Gravity
-		size_t planetsCount = m_vPlanets.size();
-		if (planetsCount > 1) {
-			for (size_t i = 0; i < planetsCount - 1; ++i) {
-				for (size_t j = i + 1; j < planetsCount; ++j) {
-					ApplyGravity(m_vPlanets[i], m_vPlanets[j]);
-				}
-			}
+	if (m_runSim) {
+		// Deterministic runs advance by a fixed frame time so they do not depend on the frame rate
+		m_frameTime = m_deterministic ? DETERMINISTIC_FRAME_TIME : deltaTime;
+
+		// Initial state of the history
+		if (m_timelineEnabled && m_timeline.Empty())
+			recordTimeline();
+		if (m_ephemerisEnabled && !m_ephemeris.Recording())
+			recordEphemeris();
+
+		if (m_collisions && m_continuousCollisions) {
+			m_stepStart.resize(m_vPlanets.size());
+			for (size_t i = 0; i < m_vPlanets.size(); ++i)
+				m_stepStart[i] = m_vPlanets[i].position;
+		}
+
+		m_conservationValid = false;
+		switch (m_integrator) {
+		case INTEGRATOR_WHFAST:
+			stepWHFast();
+			break;
+		case INTEGRATOR_RESPA:
+			stepRespa();
+			break;
+		case INTEGRATOR_PARAREAL:
+			stepParareal();
+			break;
+		case INTEGRATOR_HIERARCHICAL:
+			stepHierarchical();
+			break;
+		default:
+			stepEuler();
+			break;
+		}
+		// Euler kicks with G per simulated time but drifts over the frame time, the rails follow the same scaling
+		if (m_integrator == INTEGRATOR_EULER)
+			propagateRails(G * m_timeMultiplier, m_frameTime);
+		else
+			propagateRails(G, m_frameTime * m_timeMultiplier);
+		// The hierarchical integrator ends the frame early when its step budget runs out
+		const bool shortFrame = m_integrator == INTEGRATOR_HIERARCHICAL && m_hierarchy.lastCapped;
+		m_simTime += shortFrame ? m_hierarchy.lastTime : m_frameTime * m_timeMultiplier;
+		if (m_diagnosticsEnabled)
+			updateConservation();
+
+		if (m_collisions) {
+			// Euler moves the planets by velocity * frame time, the other integrators by the simulated time
+			if (m_continuousCollisions)
+				handleSweptCollisions(m_integrator == INTEGRATOR_EULER ? m_frameTime : m_frameTime * m_timeMultiplier);
+			handleCollisions();
+		}
+
+		// Keep spatially close bodies close in memory
+		if (m_mortonReorder && ++m_framesSinceReorder >= m_reorderInterval) {
+			m_cacheMissesBeforeReorder = m_lastForceCacheMisses;
+			m_measureAfterReorder = true;
+			reorderBodies();
 		}
+
+		++m_stepCount;
+		if (m_hashEveryStep)
+			hashState();
+		if (m_recorder.Recording())
+			recordTrajectory();
+		if (m_timelineEnabled)
+			recordTimeline();
+		if (m_ephemerisEnabled)
+			recordEphemeris();
 	}
 	
 	// Active Main Shader
@@ -103,11 +166,7 @@ bool Game::GameLoop() {
 	m_mainShader.SetUniformMatrix4fv("view", m_view);
 
 	for (auto& planet : m_vPlanets) {
-		if (m_runSim) {
-			// Apply Movement to Planets Before Drawing only if sim is running
-			planet.position += planet.velocity * float(deltaTime);
-			planet.renderer.SetPosition(planet.position);
-		}
+		planet.renderer.SetPosition(planet.position);
 
 		m_mainShader.SetUniformMatrix4fv("model", planet.renderer.GetModelMatrix());
 		m_mainShader.SetUniform3fv("material", planet.material);
@@ -151,13 +210,374 @@ void Game::RenderUI() {
 	}
 
 	ImGui::Checkbox("Run Simulation", &m_runSim);
+	ImGui::Text("Simulated Time: %.1f s", m_simTime / SEC_TO_GSEC);
 	ImGui::DragFloat("Simulation Speed", &m_timeMultiplier, 10.0f, 0.0f, 10000.0f);
 	if (ImGui::IsItemHovered())
 		ImGui::SetTooltip("Controls simulation speed.\nIncreasing this value speeds up the simulation but may reduce numerical accuracy.");
+
+	const char* integrators[] = { "Euler", "Wisdom-Holman (WHFast)", "r-RESPA (near/far split)", "Parareal (parallel in time)", "Hierarchical subsystems" };
+	if (ImGui::Combo("Integrator", &m_integrator, integrators, IM_ARRAYSIZE(integrators)))
+		onBodiesChanged(); // Other integrators moved the bodies, cached forces are stale
+	if (m_integrator == INTEGRATOR_WHFAST) {
+		ImGui::SliderFloat("Step (orbit fraction)", &m_whOrbitFraction, 0.001f, 0.1f, "%.3f", ImGuiSliderFlags_Logarithmic);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Timestep as a fraction of the innermost orbital period around the most massive body.");
+		ImGui::Checkbox("Symplectic Corrector", &m_whFast.useCorrector);
+		ImGui::Text("Steps last frame: %zu", m_whFast.lastStepCount);
+	}
+	if (m_integrator == INTEGRATOR_RESPA) {
+		ImGui::SliderInt("Substeps per frame", &m_respaSubsteps, 1, 256);
+		ImGui::DragFloat("Near-field cutoff (10^3 km)", &m_respaCutoff, 1.0f, 0.001f, 1.0e6f);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Pairs closer than this are integrated every substep, the rest every k substeps.");
+		ImGui::SliderInt("Far-field interval (k)", &m_respa.farInterval, 1, 64);
+		ImGui::Text("Force evaluations last frame: near %zu, far %zu", m_respa.lastNearEvaluations, m_respa.lastFarEvaluations);
+	}
+	if (m_integrator == INTEGRATOR_PARAREAL) {
+		int slices = int(m_parareal.slices), fineSteps = int(m_parareal.fineStepsPerSlice), coarseSteps = int(m_parareal.coarseStepsPerSlice);
+		if (ImGui::SliderInt("Time slices", &slices, 0, 256))
+			m_parareal.slices = size_t(slices);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("0 uses one slice per worker thread.");
+		if (ImGui::SliderInt("Fine steps per slice", &fineSteps, 1, 1000))
+			m_parareal.fineStepsPerSlice = size_t(fineSteps);
+		if (ImGui::SliderInt("Coarse steps per slice", &coarseSteps, 1, 100))
+			m_parareal.coarseStepsPerSlice = size_t(coarseSteps);
+		ImGui::InputDouble("Tolerance", &m_parareal.tolerance, 0.0, 0.0, "%.1e");
+		ImGui::Text("Iterations last frame: %zu (correction %.2e)", m_parareal.lastIterations, m_parareal.lastCorrection);
+		ImGui::Text("Estimated speedup vs serial fine: %.2fx", m_parareal.EstimatedSpeedup());
+	}
+	if (m_integrator == INTEGRATOR_HIERARCHICAL) {
+		float orbitFraction = float(m_hierarchy.orbitFraction), isolation = float(m_hierarchy.isolationFactor), tidal = float(m_hierarchy.tidalTolerance);
+		if (ImGui::SliderFloat("Step (orbit fraction)##hierarchy", &orbitFraction, 0.001f, 0.1f, "%.3f", ImGuiSliderFlags_Logarithmic))
+			m_hierarchy.orbitFraction = orbitFraction;
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Every subsystem steps at this fraction of its own orbital period.");
+		if (ImGui::SliderFloat("Isolation Factor", &isolation, 2.0f, 10.0f))
+			m_hierarchy.isolationFactor = isolation;
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("A bound pair becomes a subsystem if its neighbours are this many apocentre distances away\nand its pericentre is this many times the size of its own subsystems.");
+		if (ImGui::SliderFloat("Tidal Tolerance", &tidal, 1e-4f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic))
+			m_hierarchy.tidalTolerance = tidal;
+		ImGui::Text("Subsystems: %zu, depth %zu", m_hierarchy.lastSubsystemCount, m_hierarchy.lastDepth);
+		ImGui::Text("Top-level steps last frame: %zu, Kepler drifts: %zu", m_hierarchy.lastTopSteps, m_hierarchy.lastKeplerDrifts);
+		if (m_hierarchy.lastSmallestStep > 0.0)
+			ImGui::Text("Top-level step %.0fx the fastest subsystem's", m_hierarchy.lastTopStep / m_hierarchy.lastSmallestStep);
+		if (m_hierarchy.lastRefused)
+			ImGui::Text("More than %zu bodies, the scene is not integrated", m_hierarchy.maxBodies);
+		else if (m_hierarchy.lastCapped)
+			ImGui::Text("Step budget of %zu per frame used up, the frame covered %.0f%% of its time", m_hierarchy.maxSteps,
+				100.0 * m_hierarchy.lastTime / std::max(double(m_frameTime * m_timeMultiplier), 1e-300));
+	}
+	if (m_integrator == INTEGRATOR_EULER) {
+		const char* solvers[] = { "Direct (all pairs)", "Barnes-Hut (octree)", "Barnes-Hut (LBVH)", "Direct (tiled SIMD)" };
+		ImGui::Combo("Force Solver", &m_forceSolver, solvers, IM_ARRAYSIZE(solvers));
+		if (m_forceSolver == FORCE_OCTREE || m_forceSolver == FORCE_LBVH)
+			ImGui::SliderFloat("Opening Angle", &m_openingAngle, 0.1f, 1.5f);
+		if (m_forceSolver == FORCE_OCTREE) {
+			ImGui::Text("Tree: %zu nodes, %zu rebuilds, %zu refits", m_octree.Nodes().size(), m_octree.rebuildCount, m_octree.refitCount);
+			ImGui::Text("Escaped: %.1f%%, Leaf overlap: %.2f", m_octree.lastEscapeFraction * 100.0, m_octree.lastOverlapRatio);
+		}
+		if (m_forceSolver == FORCE_TILED) {
+			const char* precisions[] = { "Double", "Mixed (float pairs, double sums)" };
+			ImGui::Combo("Precision", &m_kernelPrecision, precisions, IM_ARRAYSIZE(precisions));
+			const char* softenings[] = { "None", "Plummer", "Spline" };
+			ImGui::Combo("Softening", &m_softeningModel, softenings, IM_ARRAYSIZE(softenings));
+			if (m_softeningModel != int(SofteningModel::None))
+				ImGui::DragFloat("Softening length (10^3 km)", &m_softeningLength, 0.1f, 0.001f, 1.0e6f);
+		}
+		ImGui::Checkbox("Regularize Close Pairs", &m_regularize);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Pairs closer than the threshold follow their relative orbit in regularized time,\nso hard binaries and close encounters keep their accuracy at the frame step.\nNot applied with a softened kernel.");
+		if (m_regularize) {
+			ImGui::DragFloat("Pair Threshold (10^3 km)", &m_regularizeThreshold, 10.0f, 0.001f, 1.0e7f);
+			ImGui::SliderInt("Steps per Orbit", &m_regularizer.stepsPerOrbit, 8, 512);
+			ImGui::Text("Regularized pairs: %zu (%zu regularized steps last frame)", m_regularizer.Pairs().size(), m_regularizer.lastSteps);
+		}
+	}
+
+	ImGui::Checkbox("Collisions", &m_collisions);
+	if (m_collisions) {
+		const char* responses[] = { "Merge", "Bounce" };
+		ImGui::Combo("Collision Response", &m_collisionResponse, responses, IM_ARRAYSIZE(responses));
+		if (m_collisionResponse == COLLISION_BOUNCE)
+			ImGui::SliderFloat("Restitution", &m_restitution, 0.0f, 1.0f);
+		ImGui::Checkbox("Continuous Collisions", &m_continuousCollisions);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Sweeps every body along its motion over the frame so fast bodies cannot tunnel through each other.");
+		ImGui::Text("Contacts last frame: %zu (+%zu swept), merged so far: %zu", m_lastContactCount, m_lastSweptContactCount, m_totalMerged);
+	}
+
+	ImGui::Checkbox("Deterministic Mode", &m_deterministic);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Fixed frame time of 1/60 s and contacts in a fixed order, so a run repeats bit for bit on any thread count.");
+	ImGui::Checkbox("Hash State Every Step", &m_hashEveryStep);
+	if (m_hashEveryStep) {
+		ImGui::Text("Step %llu: %016llx", (unsigned long long)m_stepCount, (unsigned long long)m_stateHash);
+		bool logging = m_hashLog.is_open();
+		if (logging) ImGui::BeginDisabled();
+		ImGui::InputText("Hash Log", m_hashLogPath, sizeof(m_hashLogPath));
+		if (logging) ImGui::EndDisabled();
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Compare two logs with --compare-hashes <a> <b>.");
+		if (ImGui::Button(logging ? "Stop Hash Log" : "Start Hash Log")) {
+			if (logging) m_hashLog.close();
+			else m_hashLog.open(m_hashLogPath);
+		}
+	}
+
+	ImGui::Checkbox("Morton Reordering", &m_mortonReorder);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Periodically sorts the bodies along a Z-order curve so that neighbours in space are neighbours in memory.");
+	if (m_mortonReorder) {
+		ImGui::SliderInt("Reorder Interval (frames)", &m_reorderInterval, 1, 1000);
+		if (m_cacheMissCounter.Available())
+			ImGui::Text("Force pass cache misses: %llu before, %llu after reorder",
+				(unsigned long long)m_cacheMissesBeforeReorder, (unsigned long long)m_cacheMissesAfterReorder);
+		else
+			ImGui::Text("Force pass cache misses: perf counters unavailable");
+	}
+	ImGui::InputText("Checkpoint File", m_checkpointPath, sizeof(m_checkpointPath));
+	if (ImGui::Button("Save Scene")) {
+		std::string path = m_checkpointPath;
+		m_checkpointStatus = saveCheckpoint(path) ? "Saved " + path : "Could not write " + path;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Load Scene"))
+		loadCheckpoint(m_checkpointPath);
+	if (!m_checkpointStatus.empty())
+		ImGui::TextUnformatted(m_checkpointStatus.c_str());
+
+	if (ImGui::CollapsingHeader("External Field")) {
+		ImGui::TextDisabled("Fixed background potentials, used by the Euler integrator");
+		ImGui::Checkbox("Self-Gravity", &m_selfGravity);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Turn off to move the bodies as test particles in the field alone, e.g. for orbit studies of many stars.");
+		ImGui::InputFloat3("Field Center (in 10^3 km)", m_fieldCenter);
+		ImGui::Checkbox("NFW Halo", &m_haloEnabled);
+		if (m_haloEnabled) {
+			ImGui::InputDouble("Halo Mass 4 pi rho0 rs^3 (in kg)", &m_haloMass, 0.0, 0.0, "%.3e");
+			ImGui::InputFloat("Halo Scale Radius (in 10^3 km)", &m_haloScaleRadius, 0.0f, 0.0f, "%.3e");
+		}
+		ImGui::Checkbox("Miyamoto-Nagai Disk", &m_diskEnabled);
+		if (m_diskEnabled) {
+			ImGui::InputDouble("Disk Mass (in kg)##field", &m_diskMass, 0.0, 0.0, "%.3e");
+			ImGui::InputFloat("Disk Scale Length a (in 10^3 km)", &m_diskScaleLength, 0.0f, 0.0f, "%.3e");
+			ImGui::InputFloat("Disk Scale Height b (in 10^3 km)", &m_diskScaleHeight, 0.0f, 0.0f, "%.3e");
+		}
+		ImGui::Checkbox("Central Point Mass", &m_centralMassEnabled);
+		if (m_centralMassEnabled)
+			ImGui::InputDouble("Central Mass (in kg)", &m_centralMass, 0.0, 0.0, "%.3e");
+		m_haloScaleRadius = std::max(m_haloScaleRadius, 1e-3f);
+		m_diskScaleHeight = std::max(m_diskScaleHeight, 1e-3f);
+
+		if (ImGui::Button("Milky Way Preset")) {
+			// Halo, disk and bulge in the proportions of a Milky Way model, scaled to the disk generator
+			m_haloEnabled = m_diskEnabled = m_centralMassEnabled = true;
+			m_diskMass = m_generatorMass;
+			m_diskScaleLength = m_generatorScale;
+			m_diskScaleHeight = 0.093f * m_generatorScale;
+			m_haloMass = 6.4 * m_generatorMass;
+			m_haloScaleRadius = 5.3f * m_generatorScale;
+			m_centralMass = 0.074 * m_generatorMass;
+		}
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("NFW halo (rs = 16 kpc), Miyamoto-Nagai disk (a = 3 kpc, b = 0.28 kpc) and a point mass bulge,\nwith the disk mass and scale length of the galaxy generator.");
+	}
+
+	if (ImGui::CollapsingHeader("On-Rails Bodies")) {
+		ImGui::TextDisabled("Kepler orbits around their primary, sources of the Euler force pass only");
+		ImGui::Text("On Rails: %zu of %zu", m_vPlanets.size() - m_railsBegin, m_vPlanets.size());
+		// The other integrators do not take sources outside their own bodies
+		const bool railsAvailable = m_integrator == INTEGRATOR_EULER;
+		if (!railsAvailable) ImGui::BeginDisabled();
+		ImGui::SliderFloat("Rails Mass Ratio", &m_railsMassRatio, 1e-6f, 1e-1f, "%.0e", ImGuiSliderFlags_Logarithmic);
+		if (ImGui::Button("Put Light Bodies On Rails"))
+			putLightBodiesOnRails();
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Every body lighter than the mass ratio times the body pulling hardest on it follows\na two-body orbit around that body instead of being integrated.");
+		if (!railsAvailable) ImGui::EndDisabled();
+		ImGui::SameLine();
+		if (ImGui::Button("Release All")) {
+			for (Planet& planet : m_vPlanets)
+				releaseFromRails(planet);
+			onBodiesChanged();
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Conservation Diagnostics")) {
+		ImGui::Checkbox("Measure Every Step", &m_diagnosticsEnabled);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Energy, momentum and angular momentum from the force pass, drifts relative to the state when the bodies last changed.");
+		if (m_integrator != INTEGRATOR_EULER)
+			ImGui::TextDisabled("Measured by the Euler force pass only, paused for this integrator");
+		if (m_hasConservationReference) {
+			ImGui::Text("Energy: %.6e (kinetic %.3e, potential %.3e)", m_conservation.Energy(), m_conservation.kinetic, m_conservation.potential);
+			const char* labels[3] = { "Energy Drift", "Momentum Drift", "Angular Momentum Drift" };
+			const double drifts[3] = { m_drift.energy, m_drift.momentum, m_drift.angularMomentum };
+			for (int q = 0; q < 3; ++q) {
+				char overlay[32];
+				snprintf(overlay, sizeof(overlay), "%.2e", drifts[q]);
+				int offset = m_driftHistoryCount < DRIFT_HISTORY ? 0 : m_driftHistoryOffset;
+				ImGui::PlotLines(labels[q], m_driftHistory[q], m_driftHistoryCount, offset, overlay, -16.0f, 0.0f, ImVec2(0.0f, 50.0f));
+			}
+			ImGui::TextDisabled("Plots show log10 of the relative drift");
+			if (ImGui::Button("Reset Reference"))
+				resetConservation();
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Trajectory Recorder")) {
+		bool recording = m_recorder.Recording();
+		if (recording) ImGui::BeginDisabled();
+		ImGui::InputText("Trajectory File", m_trajectoryPath, sizeof(m_trajectoryPath));
+		ImGui::SliderInt("Record Every k Steps", &m_trajectoryInterval, 1, 1000);
+		ImGui::InputText("Planet IDs", m_trajectoryBodies, sizeof(m_trajectoryBodies));
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Comma separated planet IDs to record, leave empty to record every planet.");
+		ImGui::Checkbox("Delta + Quantization Compression", &m_trajectoryCompress);
+		if (m_trajectoryCompress) {
+			ImGui::DragFloat("Position Resolution (km)", &m_trajectoryPositionResolution, 0.1f, 0.001f, 1.0e6f, "%.3f", ImGuiSliderFlags_Logarithmic);
+			ImGui::DragFloat("Velocity Resolution (m/s)", &m_trajectoryVelocityResolution, 0.1f, 0.001f, 1.0e6f, "%.3f", ImGuiSliderFlags_Logarithmic);
+		}
+		const char* overflowPolicies[] = { "Drop frames", "Throttle recording rate" };
+		ImGui::Combo("When Disk Falls Behind", &m_trajectoryOverflow, overflowPolicies, IM_ARRAYSIZE(overflowPolicies));
+		if (recording) ImGui::EndDisabled();
+
+		if (ImGui::Button(recording ? "Stop Recording" : "Start Recording")) {
+			if (recording) {
+				m_recorder.Stop();
+				m_trajectoryStatus = m_recorder.WriteFailed() ? "Write error, the trajectory is incomplete" : "Saved " + std::string(m_trajectoryPath);
+			}
+			else startRecording();
+		}
+		if (m_recorder.Recording() || m_recorder.FramesRecorded() > 0)
+			ImGui::Text("Frames: %llu recorded, %llu dropped, %.1f MB, every %u steps, queue %zu",
+				(unsigned long long)m_recorder.FramesRecorded(), (unsigned long long)m_recorder.FramesDropped(),
+				m_recorder.BytesWritten() / (1024.0 * 1024.0), m_recorder.CurrentInterval(), m_recorder.QueueDepth());
+		if (!m_trajectoryStatus.empty())
+			ImGui::TextUnformatted(m_trajectoryStatus.c_str());
+	}
+
 	ImGui::DragFloat("Camera Speed", &cameraSpeed, 1.0f, 1.0f, 100.0f);
 	ImGui::DragFloat("Mouse Sensitivity", &m_cameraSensitivity, 1.0f, 1.0f, 100.0f);
 	ImGui::End();
 
+	// Timeline UI
+	ImGui::Begin("Timeline");
+	ImGui::Checkbox("Record History", &m_timelineEnabled);
+	if (!m_timeline.Empty()) {
+		uint64_t first = m_timeline.FirstStep(), last = m_timeline.LastStep();
+		uint64_t cursor = std::min(std::max(m_stepCount, first), last);
+		if (ImGui::SliderScalar("Step", ImGuiDataType_U64, &cursor, &first, &last)) {
+			// Scrubbing pauses the simulation, resuming continues from the shown step
+			m_runSim = false;
+			seekTimeline(cursor);
+		}
+		ImGui::Text("%zu segments, %.1f MB in memory, %.1f MB spilled to disk", m_timeline.SegmentCount(),
+			m_timeline.MemoryUsed() / (1024.0 * 1024.0), m_timeline.SpilledBytes() / (1024.0 * 1024.0));
+	}
+	if (ImGui::SliderInt("Keyframe Interval (steps)", &m_timelineKeyframeInterval, 1, 1024))
+		m_timeline.keyframeInterval = size_t(m_timelineKeyframeInterval);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Seeking decodes one keyframe and at most this many deltas.");
+	if (ImGui::SliderInt("Memory Budget (MB)", &m_timelineBudgetMB, 16, 16384))
+		m_timeline.memoryBudget = size_t(m_timelineBudgetMB) << 20;
+	if (ImGui::Button("Clear History"))
+		m_timeline.Clear();
+
+	if (ImGui::CollapsingHeader("Chebyshev Ephemeris")) {
+		ImGui::TextDisabled("Piecewise polynomial fit of every trajectory, positions at any past time");
+		ImGui::Checkbox("Record Ephemeris", &m_ephemerisEnabled);
+		ImGui::SliderInt("Degree", &m_ephemerisDegree, 2, 20);
+		ImGui::SliderInt("Segment Length (steps)", &m_ephemerisSegmentSteps, 4, 1024);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Degree and segment length apply from the next Clear. Longer segments are smaller,\nthe degree has to follow the motion within one segment.");
+		if (!m_ephemeris.Empty()) {
+			double first = m_ephemeris.StartTime(), last = m_ephemeris.EndTime();
+			ImGui::Text("%zu segments of %u bodies, %.1f MB (%.1f MB as raw float positions)", m_ephemeris.SegmentCount(),
+				unsigned(m_ephemeris.SlotCount()), m_ephemeris.TableBytes() / (1024.0 * 1024.0),
+				m_ephemeris.SampleCount() * sizeof(glm::vec3) / (1024.0 * 1024.0));
+			m_ephemerisQueryTime = std::clamp(m_ephemerisQueryTime, first, last);
+			ImGui::SliderScalar("Query Time", ImGuiDataType_Double, &m_ephemerisQueryTime, &first, &last, "%.4f");
+			glm::dvec3 position;
+			if (m_selectedPlanetId != INVALID_PLANET_ID && m_ephemeris.Position(m_selectedPlanetId, m_ephemerisQueryTime, position))
+				ImGui::Text("Selected Planet At Query Time: (%f, %f, %f)", position.x, position.y, position.z);
+			else
+				ImGui::TextDisabled("Select a planet recorded at that time to see its position");
+		}
+		ImGui::Checkbox("Show Trail", &m_showTrail);
+		ImGui::SameLine();
+		ImGui::SliderInt("Trail Length (segments)", &m_trailSegments, 1, 256);
+		if (ImGui::Button("Clear Ephemeris"))
+			m_ephemeris.Clear();
+
+		char path[256];
+		snprintf(path, sizeof(path), "%s", m_ephemerisPath.c_str());
+		if (ImGui::InputText("Ephemeris File", path, sizeof(path)))
+			m_ephemerisPath = path;
+		if (ImGui::Button("Save Ephemeris"))
+			m_ephemerisStatus = m_ephemeris.Save(m_ephemerisPath) ? "Saved " + m_ephemerisPath : "Could not write " + m_ephemerisPath;
+		ImGui::SameLine();
+		if (ImGui::Button("Open Ephemeris")) {
+			// A mapped table is read-only, recording would replace it
+			m_ephemerisEnabled = false;
+			m_ephemerisStatus = m_ephemeris.Open(m_ephemerisPath) ? "Mapped " + m_ephemerisPath : m_ephemeris.Error();
+		}
+		if (!m_ephemerisStatus.empty())
+			ImGui::TextUnformatted(m_ephemerisStatus.c_str());
+	}
+	ImGui::End();
+
+	// Generators UI
+	ImGui::Begin("Generators");
+	ImGui::Text("Generate large scenes in equilibrium");
+	const char* generators[] = { "Plummer Sphere", "Hernquist Bulge", "Exponential Disk Galaxy", "Galaxy Collision", "Cosmological Box (Zel'dovich)" };
+	ImGui::Combo("Model", &m_generatorType, generators, IM_ARRAYSIZE(generators));
+	bool galaxy = m_generatorType == GENERATOR_DISK || m_generatorType == GENERATOR_COLLISION;
+	if (m_generatorType == GENERATOR_ZELDOVICH) {
+		ImGui::SliderInt("Bodies per Side (2^n)", &m_generatorGridLog2, 2, 9);
+		ImGui::InputDouble("Total Mass (in kg)", &m_generatorMass, 0.0, 0.0, "%.3e");
+		ImGui::InputFloat("Box Size (in 10^3 km)", &m_generatorScale);
+		ImGui::SliderFloat("Spectral Index", &m_generatorSpectralIndex, -3.0f, 1.0f);
+		ImGui::InputText("Power Spectrum Table", m_generatorSpectrumPath, sizeof(m_generatorSpectrumPath));
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Lines of \"k P(k)\" with k in 1 / 10^3 km, replaces the power law. Leave empty for P(k) ~ k^n.");
+		ImGui::SliderFloat("RMS Displacement (cells)", &m_generatorRmsDisplacement, 0.01f, 2.0f);
+		ImGui::InputInt("Memory Budget (MB)", &m_generatorBudgetMB);
+		ZeldovichModel model;
+		model.gridSize = size_t(1) << m_generatorGridLog2;
+		ImGui::Text("%zu bodies, %zu MB to generate, %zu MB as planets", model.Count(), model.MemoryRequired() >> 20,
+			(model.Count() * sizeof(Planet)) >> 20);
+	}
+	else {
+		ImGui::InputInt(galaxy ? "Disk Bodies" : "Bodies", &m_generatorCount);
+		ImGui::InputDouble(galaxy ? "Disk Mass (in kg)" : "Total Mass (in kg)", &m_generatorMass, 0.0, 0.0, "%.3e");
+		ImGui::InputFloat(galaxy ? "Disk Scale Length (in 10^3 km)" : "Scale Radius (in 10^3 km)", &m_generatorScale);
+	}
+	if (galaxy) {
+		ImGui::SliderFloat("Scale Height (of scale length)", &m_generatorScaleHeight, 0.01f, 0.5f);
+		ImGui::SliderFloat("Toomre Q", &m_generatorToomreQ, 0.5f, 3.0f);
+		ImGui::SliderFloat("Bulge (bodies and mass, of disk)", &m_generatorBulgeFraction, 0.0f, 1.0f);
+		ImGui::SliderFloat("Halo Bodies (of disk)", &m_generatorHaloFraction, 0.0f, 5.0f);
+		ImGui::SliderFloat("Halo Mass (of disk)", &m_generatorHaloMassRatio, 0.0f, 20.0f);
+	}
+	if (m_generatorType == GENERATOR_COLLISION) {
+		ImGui::SliderFloat("Separation (scale lengths)", &m_generatorSeparation, 2.0f, 100.0f);
+		ImGui::SliderFloat("Pericentre (scale lengths)", &m_generatorPericentre, 0.0f, 20.0f);
+		ImGui::SliderFloat("Inclination (deg)", &m_generatorInclination, 0.0f, 180.0f);
+	}
+	ImGui::InputDouble("Body Radius (in km)", &m_generatorBodyRadius);
+	ImGui::InputScalar("Seed", ImGuiDataType_U64, &m_generatorSeed);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("The same seed gives the same bodies on any number of threads.");
+	ImGui::Checkbox("Replace Current Scene##Generators", &m_generatorReplace);
+	if (ImGui::Button("Generate"))
+		generateBodies();
+	if (!m_generatorStatus.empty())
+		ImGui::TextUnformatted(m_generatorStatus.c_str());
+	ImGui::End();
+
 	// Add Planet Menu UI
 	ImGui::Begin("Add Planet Menu");
 	ImGui::Text("Add Planets to Scene!");
@@ -194,20 +614,57 @@ void Game::RenderUI() {
 		m_vPlanets.emplace_back(m_uiInputMass * KG_TO_GMASS, m_uiInputRadius * KM_TO_GLEN, convertedPos, convertedVel, m_uiInputCol, m_uiInputName);
 		Planet& planet = m_vPlanets.back();
 
+		planet.id = m_nextPlanetId++;
 		planet.renderer.SetPosition(planet.position);
+		onBodiesChanged();
+	}
+
+	ImGui::Separator();
+	ImGui::Text("Load many planets from a JSON or CSV file (same units as above)");
+	ImGui::InputText("Scene File", m_scenePath, sizeof(m_scenePath));
+	ImGui::Checkbox("Replace Current Scene", &m_sceneReplace);
+	if (ImGui::Button("Load Scene File"))
+		loadScene(m_scenePath, m_sceneReplace);
+
+	if (ImGui::TreeNode("Gadget-2 Snapshot")) {
+		ImGui::InputText("Snapshot File", m_gadgetPath, sizeof(m_gadgetPath));
+		const char* typeNames[GADGET_TYPE_COUNT] = { "Gas", "Halo", "Disk", "Bulge", "Stars", "Boundary" };
+		for (int t = 0; t < GADGET_TYPE_COUNT; ++t) {
+			if (t % 3) ImGui::SameLine();
+			ImGui::Checkbox(typeNames[t], &m_gadgetTypes[t]);
+		}
+		ImGui::InputDouble("Hubble Parameter h", &m_gadgetHubble);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Removes the h factors of the Gadget units, 0 takes the value from the snapshot header.");
+		ImGui::Checkbox("Comoving to Physical", &m_gadgetPhysical);
+		ImGui::InputDouble("Particle Radius (km)", &m_gadgetParticleRadius);
+		if (ImGui::Button("Import Snapshot"))
+			importGadget(m_gadgetPath, m_sceneReplace);
+		ImGui::TreePop();
 	}
+	if (!m_sceneStatus.empty())
+		ImGui::TextUnformatted(m_sceneStatus.c_str());
 	ImGui::End();
 
 	// TODO: Convert Displayed Units from Game Units to Units of interest
 	ImGui::Begin("Plane Info");
 	ImGui::Text("Planets in Scene: %d", m_vPlanets.size());
+	Planet* selected = findPlanet(m_selectedPlanetId);
+	ImGui::Text("Selected Planet: %s", selected ? selected->name : "None");
 	ImGui::Text("Planet's Information: ");
+	size_t removeIndex = m_vPlanets.size();
+	bool railsChanged = false;
 	for (size_t i = 0; i < m_vPlanets.size(); ++i) {
 		Planet& planet = m_vPlanets[i];
-		ImGui::PushID(i);
+		// Widgets are keyed on the stable ID so their state survives Morton reorders
+		ImGui::PushID(int(planet.id));
 		
-		ImGui::Text("Planet Name(ID): %s(%d)", planet.name, i);
-		ImGui::InputDouble("Planet Mass:", &planet.mass);
+		char label[48];
+		snprintf(label, sizeof(label), "Planet Name(ID): %s(%u)", planet.name, planet.id);
+		if (ImGui::Selectable(label, planet.id == m_selectedPlanetId))
+			m_selectedPlanetId = planet.id;
+		if (ImGui::InputDouble("Planet Mass:", &planet.mass))
+			onBodiesChanged();
 		if (ImGui::InputDouble("Planet Radius:", &planet.radius)) {
 			// We need to update two planets one for the planet's radius and other for planet's renderer's radius
 			// If the value has changed then update it
@@ -216,11 +673,39 @@ void Game::RenderUI() {
 		ImGui::Text("Planet Position: (%f, %f, %f)", planet.position.x, planet.position.y, planet.position.z);
 		ImGui::Text("Planet Velocity: (%f, %f, %f)", planet.velocity.x, planet.velocity.y, planet.velocity.z);
 		ImGui::Text("Planet Material: (%f, %f, %f)", planet.material.x, planet.material.y, planet.material.z);
+		bool onRails = planet.OnRails();
+		if (m_integrator != INTEGRATOR_EULER) ImGui::BeginDisabled();
+		if (ImGui::Checkbox("On Rails", &onRails)) {
+			if (onRails) railsChanged |= putOnRails(planet);
+			else { releaseFromRails(planet); railsChanged = true; }
+		}
+		if (m_integrator != INTEGRATOR_EULER) ImGui::EndDisabled();
+		if (planet.OnRails()) {
+			const Planet* primary = findPlanet(planet.railsPrimary);
+			ImGui::SameLine();
+			ImGui::Text("around %s", primary ? primary->name : "?");
+		}
+		if (ImGui::Button("Remove Planet"))
+			removeIndex = i;
 
 		ImGui::PopID();
 	}
 	ImGui::End();
 
+	// Remove after the loop so the indices above stay valid for this frame
+	if (removeIndex < m_vPlanets.size()) {
+		if (m_vPlanets[removeIndex].id == m_selectedPlanetId)
+			m_selectedPlanetId = INVALID_PLANET_ID;
+		m_vPlanets.erase(m_vPlanets.begin() + removeIndex);
+		onBodiesChanged();
+	}
+	else if (railsChanged) {
+		onBodiesChanged();
+	}
+
+	if (m_showTrail)
+		drawEphemerisTrail();
+
 	// Render ImGui
 	ImGui::Render();
 
@@ -236,10 +721,12 @@ void Game::RenderUI() {
 	}
 }
 
-void Game::ApplyGravity(Planet& pl1, Planet& pl2) {
+// Returns the potential energy of the pair
+double Game::ApplyGravity(Planet& pl1, Planet& pl2) {
 	glm::f64vec3 r12 = pl2.position - pl1.position; // Point from pl1 towards pl2
 
-	if(r12.length() < 1e-10) return; // Prevent Division by Zero (Avoiding NaNs) (within when 0.1m range)
+	double distance = glm::length(r12);
+	if(distance < 1e-10) return 0.0; // Prevent Division by Zero (Avoiding NaNs) (within when 0.1m range)
 	
 	double Force = (G * pl1.mass * pl2.mass) / (glm::dot(r12, r12)); // G / r^2
 	r12 = glm::normalize(r12); // Normalize r12
@@ -248,8 +735,975 @@ void Game::ApplyGravity(Planet& pl1, Planet& pl2) {
 	glm::f64vec3 accel2 = Force / pl2.mass * -r12;
 	
 	// Now apply acceleration to the bodies
-	pl1.velocity += accel1 * (deltaTime * m_timeMultiplier);
-	pl2.velocity += accel2 * (deltaTime * m_timeMultiplier);
+	pl1.velocity += accel1 * (m_frameTime * m_timeMultiplier);
+	pl2.velocity += accel2 * (m_frameTime * m_timeMultiplier);
+	return -Force * distance;
+}
+
+void Game::stepEuler() {
+	m_cacheMissCounter.Start();
+
+	// Apply Gravity
+	size_t planetsCount = m_vPlanets.size();
+	updateExternalField();
+	const bool external = !m_externalField.Empty();
+
+	// Close pairs leave the global step, their relative orbits are regularized after the drift.
+	// The pair force taken out is the Newtonian one, so softened kernels keep their pairs.
+	const bool softened = m_forceSolver == FORCE_TILED && SofteningModel(m_softeningModel) != SofteningModel::None;
+	if (m_regularize && m_selfGravity && !softened) {
+		gatherBodies(m_pairState, m_railsBegin);
+		m_regularizer.FindPairs(m_pairState, m_railsBegin, m_regularizeThreshold * 1000.0 * KM_TO_GLEN);
+	}
+	else
+		m_regularizer.Clear();
+
+	if (m_forceSolver != FORCE_DIRECT || !m_selfGravity || external) {
+		gatherBodies(m_bodyState);
+		std::vector<double>* potentialEnergy = m_diagnosticsEnabled ? &m_potentialEnergy : nullptr;
+		if (!m_selfGravity) {
+			// Test particles, only the background field acts
+			m_accel.assign(planetsCount, glm::dvec3(0.0));
+			if (potentialEnergy) potentialEnergy->assign(planetsCount, 0.0);
+		}
+		else if (m_forceSolver == FORCE_DIRECT) {
+			// Same pairs as ApplyGravity, on the double state so the field can be added
+			ComputeAccelerations(m_bodyState, m_accel, potentialEnergy);
+		}
+		else if (m_forceSolver == FORCE_OCTREE) {
+			// Barnes-Hut on the persistent tree, refit in place unless it degraded too much
+			m_octree.theta = m_openingAngle;
+			m_octree.Update(m_bodyState);
+			m_octree.ComputeAccelerations(m_bodyState, m_accel, potentialEnergy);
+		}
+		else if (m_forceSolver == FORCE_LBVH) {
+			// Barnes-Hut on a linear BVH rebuilt from scratch every step
+			m_lbvh.BuildFromBodies(m_bodyState, nullptr);
+			m_lbvh.ComputeAccelerations(m_bodyState, m_openingAngle, m_accel, ThreadPool::Global(), potentialEnergy);
+		}
+		else {
+			// All pairs relative to a per-tile origin, the variant is picked from the settings
+			m_directKernel.precision = KernelPrecision(m_kernelPrecision);
+			m_directKernel.softening = SofteningModel(m_softeningModel);
+			m_directKernel.softeningLength = m_softeningLength * 1000.0 * KM_TO_GLEN;
+			m_directKernel.external = &m_externalField;
+			// On-rails planets only act as sources, unless their share of the potential is measured
+			m_directKernel.targetCount = m_diagnosticsEnabled ? SIZE_MAX : m_railsBegin;
+			m_directKernel.ComputeAccelerations(m_bodyState, m_accel, potentialEnergy);
+		}
+		// The tiled kernel adds the field inside its own pass
+		if (external && !(m_selfGravity && m_forceSolver == FORCE_TILED))
+			m_externalField.AddAccelerations(m_bodyState, m_accel, potentialEnergy);
+		if (m_diagnosticsEnabled) {
+			m_conservation = MeasureConservation(m_bodyState, m_potentialEnergy);
+			m_conservationValid = true;
+		}
+		m_regularizer.RemovePairForces(m_bodyState, m_accel);
+		for (size_t i = 0; i < m_railsBegin; ++i)
+			m_vPlanets[i].velocity += m_accel[i] * (m_frameTime * m_timeMultiplier);
+	}
+	else if (planetsCount > 1) {
+		// Conserved quantities of the state before the kick, the potential comes from the pair loop
+		ConservationAccumulator conservation;
+		if (m_diagnosticsEnabled)
+			for (const Planet& planet : m_vPlanets)
+				conservation.AddBody(planet.mass, planet.position, planet.velocity);
+
+		// Every pair with at least one integrated planet, on-rails ones come last
+		for (size_t i = 0; i < std::min(m_railsBegin, planetsCount - 1); ++i) {
+			double rowPotential = 0.0;
+			const uint32_t partner = m_regularizer.Partner(i);
+			for (size_t j = i + 1; j < planetsCount; ++j) {
+				if (j == partner) {
+					// Regularized pair, only its potential counts here
+					double distance = glm::length(glm::dvec3(m_vPlanets[j].position - m_vPlanets[i].position));
+					if (distance >= 1e-10)
+						rowPotential -= G * m_vPlanets[i].mass * m_vPlanets[j].mass / distance;
+					continue;
+				}
+				rowPotential += ApplyGravity(m_vPlanets[i], m_vPlanets[j]);
+			}
+			conservation.AddPotential(rowPotential);
+		}
+
+		if (m_diagnosticsEnabled) {
+			// Pairs of on-rails planets exert no force on each other but still count in the potential
+			for (size_t i = m_railsBegin; i + 1 < planetsCount; ++i) {
+				double rowPotential = 0.0;
+				for (size_t j = i + 1; j < planetsCount; ++j) {
+					double distance = glm::length(glm::dvec3(m_vPlanets[j].position - m_vPlanets[i].position));
+					if (distance >= 1e-10)
+						rowPotential -= G * m_vPlanets[i].mass * m_vPlanets[j].mass / distance;
+				}
+				conservation.AddPotential(rowPotential);
+			}
+			m_conservation = conservation.Result();
+			m_conservationValid = true;
+		}
+	}
+
+	m_lastForceCacheMisses = m_cacheMissCounter.Stop();
+	if (m_measureAfterReorder) {
+		m_cacheMissesAfterReorder = m_lastForceCacheMisses;
+		m_measureAfterReorder = false;
+	}
+
+	// Apply Movement to Planets, the on-rails ones are moved by propagateRails
+	for (size_t i = 0; i < m_railsBegin; ++i)
+		m_vPlanets[i].position += m_vPlanets[i].velocity * float(m_frameTime);
+
+	// The pairs moved with their external kicks only, replace them by their regularized orbits.
+	// Same time scaling as the kick above: velocities per frame time, G per simulated time.
+	if (!m_regularizer.Pairs().empty()) {
+		gatherBodies(m_pairState, m_railsBegin);
+		m_regularizer.AdvancePairs(m_pairState, G * m_timeMultiplier, m_frameTime);
+		for (const auto& pair : m_regularizer.Pairs()) {
+			for (uint32_t i : { pair.first, pair.second }) {
+				m_vPlanets[i].position = m_pairState.position[i];
+				m_vPlanets[i].velocity = m_pairState.velocity[i];
+			}
+		}
+	}
+}
+
+void Game::updateExternalField() {
+	const double lengthScale = 1000.0 * KM_TO_GLEN;
+	const glm::dvec3 center = glm::dvec3(m_fieldCenter[0], m_fieldCenter[1], m_fieldCenter[2]) * lengthScale;
+
+	m_externalField.halos.clear();
+	m_externalField.disks.clear();
+	m_externalField.pointMasses.clear();
+	if (m_haloEnabled)
+		m_externalField.halos.push_back({ center, m_haloMass * KG_TO_GMASS, m_haloScaleRadius * lengthScale });
+	if (m_diskEnabled)
+		m_externalField.disks.push_back({ center, m_diskMass * KG_TO_GMASS, m_diskScaleLength * lengthScale, m_diskScaleHeight * lengthScale });
+	if (m_centralMassEnabled)
+		m_externalField.pointMasses.push_back({ center, m_centralMass * KG_TO_GMASS });
+}
+
+void Game::stepWHFast() {
+	if (m_railsBegin < 2) return;
+
+	gatherBodies(m_bodyState, m_railsBegin);
+
+	// Integrate in double precision, the step is bound by the innermost orbit instead of the frame time
+	double simTime = m_frameTime * m_timeMultiplier;
+	double maxStep = WHFast::SuggestTimestep(m_bodyState, m_whOrbitFraction);
+	if (maxStep <= 0.0) maxStep = simTime;
+	m_whFast.Integrate(m_bodyState, simTime, maxStep);
+
+	scatterBodies(m_bodyState);
+}
+
+void Game::stepRespa() {
+	if (m_railsBegin == 0) return;
+
+	gatherBodies(m_bodyState, m_railsBegin);
+
+	double simTime = m_frameTime * m_timeMultiplier;
+	m_respa.cutoff = m_respaCutoff * 1000.0 * KM_TO_GLEN;
+	m_respa.Integrate(m_bodyState, simTime, simTime / std::max(m_respaSubsteps, 1));
+
+	scatterBodies(m_bodyState);
+}
+
+void Game::stepParareal() {
+	if (m_railsBegin < 2) return;
+
+	gatherBodies(m_bodyState, m_railsBegin);
+	m_parareal.Integrate(m_bodyState, m_frameTime * m_timeMultiplier);
+	scatterBodies(m_bodyState);
+}
+
+void Game::stepHierarchical() {
+	// Also without planets, so the statistics of the last call do not linger
+	gatherBodies(m_bodyState, m_railsBegin);
+	m_hierarchy.Integrate(m_bodyState, m_frameTime * m_timeMultiplier);
+	scatterBodies(m_bodyState);
+}
+
+void Game::updateConservation() {
+	// The Euler force pass measures the system on the way. The other integrators evaluate their forces
+	// inside their own steps, a separate pass here would double their cost, so they are not measured.
+	if (!m_conservationValid) return;
+
+	if (!m_hasConservationReference) {
+		m_conservationReference = m_conservation;
+		m_hasConservationReference = true;
+	}
+	m_drift = RelativeDrift(m_conservationReference, m_conservation);
+
+	const double drifts[3] = { m_drift.energy, m_drift.momentum, m_drift.angularMomentum };
+	for (int q = 0; q < 3; ++q)
+		m_driftHistory[q][m_driftHistoryOffset] = float(std::log10(std::max(drifts[q], 1.0e-16)));
+	m_driftHistoryOffset = (m_driftHistoryOffset + 1) % DRIFT_HISTORY;
+	m_driftHistoryCount = std::min(m_driftHistoryCount + 1, DRIFT_HISTORY);
+}
+
+void Game::hashState() {
+	gatherBodies(m_bodyState);
+	m_stateHash = HashBodyState(m_bodyState);
+	if (m_hashLog.is_open()) {
+		char line[64];
+		snprintf(line, sizeof(line), "%llu %016llx\n", (unsigned long long)m_stepCount, (unsigned long long)m_stateHash);
+		m_hashLog << line;
+	}
+}
+
+void Game::resetConservation() {
+	m_hasConservationReference = false;
+	m_conservationValid = false;
+	m_drift = ConservationDrift();
+	m_driftHistoryCount = 0;
+	m_driftHistoryOffset = 0;
+}
+
+bool Game::saveCheckpoint(const std::string& path) {
+	// Planets are stored as an array of structs, split them into the file's blocks
+	size_t count = m_vPlanets.size();
+	std::vector<uint32_t> ids(count);
+	std::vector<glm::vec3> positions(count), velocities(count), colors(count);
+	std::vector<double> masses(count), radii(count);
+	std::vector<char> names(count * CHECKPOINT_NAME_LENGTH);
+	std::vector<uint32_t> railsPrimaries(count);
+	std::vector<glm::dvec3> railsPositions(count), railsVelocities(count);
+	for (size_t i = 0; i < count; ++i) {
+		const Planet& planet = m_vPlanets[i];
+		ids[i] = planet.id;
+		railsPrimaries[i] = planet.OnRails() ? planet.railsPrimary : CHECKPOINT_NOT_ON_RAILS;
+		railsPositions[i] = planet.railsPosition;
+		railsVelocities[i] = planet.railsVelocity;
+		positions[i] = planet.position;
+		velocities[i] = planet.velocity;
+		colors[i] = planet.material;
+		masses[i] = planet.mass;
+		radii[i] = planet.radius;
+		memcpy(&names[i * CHECKPOINT_NAME_LENGTH], planet.name, CHECKPOINT_NAME_LENGTH);
+	}
+
+	CheckpointArrays arrays;
+	arrays.count = count;
+	arrays.id = ids.data();
+	arrays.position = positions.data();
+	arrays.velocity = velocities.data();
+	arrays.mass = masses.data();
+	arrays.radius = radii.data();
+	arrays.color = colors.data();
+	arrays.name = names.data();
+	arrays.railsPrimary = railsPrimaries.data();
+	arrays.railsPosition = railsPositions.data();
+	arrays.railsVelocity = railsVelocities.data();
+
+	CheckpointHeader header = {};
+	header.simTime = m_simTime;
+	header.timeMultiplier = m_timeMultiplier;
+	header.integrator = m_integrator;
+	header.forceSolver = m_forceSolver;
+	header.openingAngle = m_openingAngle;
+	header.nextPlanetId = m_nextPlanetId;
+	return WriteCheckpoint(path, header, arrays);
+}
+
+bool Game::loadCheckpoint(const std::string& path) {
+	Checkpoint checkpoint;
+	if (!checkpoint.Open(path)) {
+		m_checkpointStatus = "Could not load " + path + ": " + checkpoint.Error();
+		return false;
+	}
+	const CheckpointHeader& header = checkpoint.Header();
+	const CheckpointArrays& arrays = checkpoint.Arrays();
+
+	// IDs index m_planetIndexById, so they must be unique and below a next ID of sane size.
+	// A file that breaks this gets fresh IDs, nothing recorded refers to the old ones after a load.
+	bool validIds = arrays.count < INVALID_PLANET_ID && header.nextPlanetId >= arrays.count &&
+		header.nextPlanetId <= uint64_t(arrays.count) + CHECKPOINT_MAX_ID_GAP;
+	if (validIds) {
+		std::vector<uint32_t> ids(arrays.id, arrays.id + arrays.count);
+		std::sort(ids.begin(), ids.end());
+		validIds = std::adjacent_find(ids.begin(), ids.end()) == ids.end() && (ids.empty() || ids.back() < header.nextPlanetId);
+	}
+
+	// The planets are built straight from the mapped arrays
+	m_vPlanets.clear();
+	m_vPlanets.reserve(arrays.count);
+	uint32_t nextId = validIds ? header.nextPlanetId : uint32_t(arrays.count);
+	for (size_t i = 0; i < arrays.count; ++i) {
+		float position[3] = { arrays.position[i].x, arrays.position[i].y, arrays.position[i].z };
+		float velocity[3] = { arrays.velocity[i].x, arrays.velocity[i].y, arrays.velocity[i].z };
+		float color[3] = { arrays.color[i].x, arrays.color[i].y, arrays.color[i].z };
+		char name[CHECKPOINT_NAME_LENGTH];
+		memcpy(name, &arrays.name[i * CHECKPOINT_NAME_LENGTH], CHECKPOINT_NAME_LENGTH);
+		name[CHECKPOINT_NAME_LENGTH - 1] = '\0';
+
+		m_vPlanets.emplace_back(arrays.mass[i], arrays.radius[i], position, velocity, color, name);
+		Planet& planet = m_vPlanets.back();
+		planet.id = validIds ? arrays.id[i] : uint32_t(i);
+
+		// Primaries are planet IDs, renumbered files have lost them. onBodiesChanged releases
+		// planets whose primary is missing or on rails itself.
+		if (validIds && arrays.railsPrimary && arrays.railsPrimary[i] != CHECKPOINT_NOT_ON_RAILS) {
+			const glm::dvec3 railsPosition = arrays.railsPosition[i], railsVelocity = arrays.railsVelocity[i];
+			if (std::isfinite(glm::dot(railsPosition, railsPosition)) && std::isfinite(glm::dot(railsVelocity, railsVelocity))) {
+				planet.railsPrimary = arrays.railsPrimary[i];
+				planet.railsPosition = railsPosition;
+				planet.railsVelocity = railsVelocity;
+			}
+		}
+	}
+	m_nextPlanetId = nextId;
+	m_selectedPlanetId = INVALID_PLANET_ID;
+
+	// A different scene, the old history no longer applies
+	m_timeline.Clear();
+	m_ephemeris.Clear();
+	m_stepCount = 0;
+	// Settings out of the UI ranges keep their current values, like unknown integrators
+	m_simTime = std::isfinite(header.simTime) ? header.simTime : 0.0;
+	if (header.timeMultiplier >= 0.0f && header.timeMultiplier <= 10000.0f)
+		m_timeMultiplier = header.timeMultiplier;
+	if (header.integrator >= INTEGRATOR_EULER && header.integrator <= INTEGRATOR_HIERARCHICAL)
+		m_integrator = header.integrator;
+	if (header.forceSolver >= FORCE_DIRECT && header.forceSolver <= FORCE_TILED)
+		m_forceSolver = header.forceSolver;
+	if (header.openingAngle >= 0.1f && header.openingAngle <= 1.5f)
+		m_openingAngle = header.openingAngle;
+
+	onBodiesChanged();
+	m_checkpointStatus = "Loaded " + std::to_string(arrays.count) + " planets from " + path;
+	if (!validIds)
+		m_checkpointStatus += " (invalid planet IDs, renumbered)";
+	return true;
+}
+
+bool Game::loadScene(const std::string& path, bool replace) {
+	std::string error;
+	std::vector<SceneBody> bodies;
+	auto start = std::chrono::steady_clock::now();
+	if (!LoadScene(path, bodies, error)) {
+		m_sceneStatus = error;
+		return false;
+	}
+
+	if (replace) {
+		m_vPlanets.clear();
+		m_selectedPlanetId = INVALID_PLANET_ID;
+		m_timeline.Clear();
+		m_ephemeris.Clear();
+	}
+
+	// One allocation for the whole file, converted like the Add Planet inputs
+	m_vPlanets.reserve(m_vPlanets.size() + bodies.size());
+	for (const SceneBody& body : bodies) {
+		float convertedPos[3], convertedVel[3], color[3];
+		for (int c = 0; c < 3; ++c) {
+			convertedPos[c] = float(body.position[c] * 1000.0 * KM_TO_GLEN);
+			convertedVel[c] = float(body.velocity[c] * KM_TO_GLEN / SEC_TO_GSEC);
+			color[c] = body.color[c];
+		}
+		m_vPlanets.emplace_back(body.mass * KG_TO_GMASS, body.radius * KM_TO_GLEN, convertedPos, convertedVel, color, body.name);
+		m_vPlanets.back().id = m_nextPlanetId++;
+	}
+	onBodiesChanged();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_sceneStatus = "Loaded " + std::to_string(bodies.size()) + " planets in " + std::to_string(int(seconds * 1000.0)) + " ms";
+	return true;
+}
+
+void Game::appendPlanets(const BodyState& bodies, const uint8_t* group, const uint64_t* labels,
+	const char* const* groupNames, const float (*groupColors)[3], double radius, bool replace) {
+	if (replace) {
+		m_vPlanets.clear();
+		m_selectedPlanetId = INVALID_PLANET_ID;
+		m_timeline.Clear();
+		m_ephemeris.Clear();
+	}
+
+	m_vPlanets.reserve(m_vPlanets.size() + bodies.Size());
+	for (size_t i = 0; i < bodies.Size(); ++i) {
+		float position[3] = { float(bodies.position[i].x), float(bodies.position[i].y), float(bodies.position[i].z) };
+		float velocity[3] = { float(bodies.velocity[i].x), float(bodies.velocity[i].y), float(bodies.velocity[i].z) };
+		float color[3] = { groupColors[group[i]][0], groupColors[group[i]][1], groupColors[group[i]][2] };
+		char name[16];
+		snprintf(name, sizeof(name), "%s %llu", groupNames[group[i]], (unsigned long long)(labels ? labels[i] : i));
+		m_vPlanets.emplace_back(bodies.mass[i], radius, position, velocity, color, name);
+		m_vPlanets.back().id = m_nextPlanetId++;
+	}
+	onBodiesChanged();
+}
+
+void Game::generateBodies() {
+	BodyState bodies;
+	std::vector<uint8_t> group;
+	double mass = m_generatorMass * KG_TO_GMASS;
+	double scale = m_generatorScale * 1000.0 * KM_TO_GLEN;
+	size_t count = size_t(std::max(m_generatorCount, 1));
+
+	// Disk galaxy: the counts and masses of bulge and halo are given relative to the disk
+	GalaxyModel model;
+	model.diskCount = count;
+	model.bulgeCount = size_t(count * m_generatorBulgeFraction);
+	model.haloCount = size_t(count * m_generatorHaloFraction);
+	model.diskMass = mass;
+	model.bulgeMass = mass * m_generatorBulgeFraction;
+	model.haloMass = mass * m_generatorHaloMassRatio;
+	model.diskScaleLength = scale;
+	model.diskScaleHeight = scale * m_generatorScaleHeight;
+	model.bulgeScaleRadius = scale * 0.2;
+	model.haloScaleRadius = scale * 5.0;
+	model.toomreQ = m_generatorToomreQ;
+
+	// Cosmological box: the scale is the box size
+	ZeldovichModel cosmology;
+	cosmology.gridSize = size_t(1) << m_generatorGridLog2;
+	cosmology.boxSize = scale;
+	cosmology.mass = mass;
+	cosmology.spectralIndex = m_generatorSpectralIndex;
+	cosmology.rmsDisplacement = m_generatorRmsDisplacement;
+	cosmology.memoryBudget = size_t(std::max(m_generatorBudgetMB, 1)) << 20;
+	if (m_generatorType == GENERATOR_ZELDOVICH && m_generatorSpectrumPath[0] != '\0') {
+		std::string error;
+		if (!LoadPowerSpectrum(m_generatorSpectrumPath, cosmology.spectrum, error)) {
+			m_generatorStatus = error;
+			return;
+		}
+		for (auto& point : cosmology.spectrum)
+			point.first /= 1000.0 * KM_TO_GLEN;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	switch (m_generatorType) {
+	case GENERATOR_PLUMMER:
+		GeneratePlummer(bodies, count, mass, scale, m_generatorSeed);
+		break;
+	case GENERATOR_HERNQUIST:
+		GenerateHernquist(bodies, count, mass, scale, m_generatorSeed);
+		break;
+	case GENERATOR_DISK:
+		GenerateGalaxy(bodies, group, model, m_generatorSeed);
+		break;
+	case GENERATOR_ZELDOVICH: {
+		std::string error;
+		if (!GenerateZeldovich(bodies, cosmology, m_generatorSeed, error)) {
+			m_generatorStatus = error;
+			return;
+		}
+		break;
+	}
+	default:
+		GenerateGalaxyCollision(bodies, group, model, scale * m_generatorSeparation, scale * m_generatorPericentre,
+			glm::radians(double(m_generatorInclination)), m_generatorSeed);
+		break;
+	}
+	if (group.empty()) group.assign(bodies.Size(), GALAXY_DISK);
+
+	static const char* componentNames[] = { "Star", "Bulge", "Halo" };
+	static const float componentColors[][3] = { { 0.8f, 0.9f, 1.0f }, { 1.0f, 0.8f, 0.5f }, { 0.4f, 0.4f, 0.5f } };
+	static const char* particleNames[] = { "Particle" };
+	static const float particleColors[][3] = { { 0.6f, 0.7f, 1.0f } };
+	bool particles = m_generatorType == GENERATOR_ZELDOVICH;
+	appendPlanets(bodies, group.data(), nullptr, particles ? particleNames : componentNames, particles ? particleColors : componentColors,
+		m_generatorBodyRadius * KM_TO_GLEN, m_generatorReplace);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_generatorStatus = "Generated " + std::to_string(bodies.Size()) + " bodies in " + std::to_string(int(seconds * 1000.0)) + " ms";
+}
+
+bool Game::importGadget(const std::string& path, bool replace) {
+	GadgetImportOptions options;
+	options.hubbleParam = m_gadgetHubble;
+	options.physical = m_gadgetPhysical;
+	options.typeMask = 0;
+	for (int t = 0; t < GADGET_TYPE_COUNT; ++t)
+		if (m_gadgetTypes[t]) options.typeMask |= uint8_t(1u << t);
+
+	GadgetSnapshot snapshot;
+	std::string error;
+	auto start = std::chrono::steady_clock::now();
+	if (!LoadGadget(path, options, snapshot, error)) {
+		m_sceneStatus = error;
+		return false;
+	}
+
+	// Already in game units, only the display attributes come from the particle type
+	static const char* typeNames[GADGET_TYPE_COUNT] = { "Gas", "Halo", "Disk", "Bulge", "Star", "Bndry" };
+	static const float typeColors[GADGET_TYPE_COUNT][3] = {
+		{ 0.4f, 0.6f, 1.0f }, { 0.6f, 0.6f, 0.6f }, { 1.0f, 1.0f, 1.0f },
+		{ 1.0f, 0.8f, 0.4f }, { 1.0f, 1.0f, 0.6f }, { 1.0f, 0.3f, 0.3f },
+	};
+	const BodyState& bodies = snapshot.bodies;
+	appendPlanets(bodies, snapshot.type.data(), snapshot.id.data(), typeNames, typeColors, m_gadgetParticleRadius * KM_TO_GLEN, replace);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_sceneStatus = "Imported " + std::to_string(bodies.Size()) + " particles (z = " + std::to_string(snapshot.header.redshift)
+		+ ") in " + std::to_string(int(seconds * 1000.0)) + " ms";
+	return true;
+}
+
+void Game::startRecording() {
+	TrajectoryOptions options;
+	options.everyKSteps = uint32_t(std::max(m_trajectoryInterval, 1));
+	options.compression = m_trajectoryCompress ? TrajectoryCompression::DeltaQuantized : TrajectoryCompression::None;
+	options.positionQuantum = m_trajectoryPositionResolution * KM_TO_GLEN;
+	options.velocityQuantum = m_trajectoryVelocityResolution * METER_TO_GLEN / SEC_TO_GSEC;
+	options.overflow = TrajectoryOverflow(m_trajectoryOverflow);
+
+	// Planet ID subset, IDs that were never handed out are skipped
+	size_t unknownIds = 0;
+	for (const char* c = m_trajectoryBodies; *c;) {
+		char* end;
+		unsigned long long id = strtoull(c, &end, 10);
+		if (end == c) {
+			++c;
+			continue;
+		}
+		if (id < m_nextPlanetId) options.bodyIds.push_back(uint32_t(id));
+		else ++unknownIds;
+		c = end;
+	}
+	// An empty subset records every planet, which is not what a list of unknown IDs asked for
+	if (unknownIds > 0 && options.bodyIds.empty()) {
+		m_trajectoryStatus = "None of the planet IDs exist";
+		return;
+	}
+
+	std::string path = m_trajectoryPath;
+	m_trajectoryStatus = m_recorder.Start(path, options) ? "Recording to " + path : "Could not write " + path;
+}
+
+void Game::recordTrajectory() {
+	gatherBodies(m_bodyState);
+	m_recordIds.resize(m_vPlanets.size());
+	for (size_t i = 0; i < m_vPlanets.size(); ++i)
+		m_recordIds[i] = m_vPlanets[i].id;
+	m_recorder.Record(m_stepCount, m_simTime, m_bodyState, m_recordIds.data(), m_conservationValid ? &m_conservation : nullptr);
+}
+
+void Game::recordTimeline() {
+	TimelineFrame& frame = m_timelineFrame;
+	size_t count = m_vPlanets.size();
+	frame.step = m_stepCount;
+	frame.time = m_simTime;
+	frame.ids.resize(count);
+	frame.mass.resize(count);
+	frame.radius.resize(count);
+	frame.position.resize(count);
+	frame.velocity.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		const Planet& planet = m_vPlanets[i];
+		if (!m_timeline.BodyInfo(planet.id))
+			m_timeline.SetBodyInfo(planet.id, planet.name, planet.material);
+		frame.ids[i] = planet.id;
+		frame.mass[i] = planet.mass;
+		frame.radius[i] = planet.radius;
+		frame.position[i] = planet.position;
+		frame.velocity[i] = planet.velocity;
+	}
+	m_timeline.Record(frame);
+}
+
+void Game::recordEphemeris() {
+	// Segments span a fixed number of steps at the step length the recording started with
+	if (!m_ephemeris.Recording()) {
+		const double span = m_ephemerisSegmentSteps * m_frameTime * m_timeMultiplier;
+		if (!(span > 0.0)) return;
+		m_ephemeris.Begin(m_simTime, span, uint32_t(m_ephemerisDegree));
+	}
+
+	gatherBodies(m_bodyState);
+	m_ephemerisIds.resize(m_vPlanets.size());
+	for (size_t i = 0; i < m_vPlanets.size(); ++i)
+		m_ephemerisIds[i] = m_vPlanets[i].id;
+	m_ephemeris.Record(m_simTime, m_ephemerisIds.data(), m_bodyState.position.data(), m_vPlanets.size());
+}
+
+void Game::drawEphemerisTrail() {
+	const Planet* selected = findPlanet(m_selectedPlanetId);
+	if (!selected || m_ephemeris.Empty()) return;
+
+	// Sampled from the fit and projected onto the main viewport, drawn behind the UI
+	constexpr int TRAIL_POINTS = 256;
+	const double end = std::min(m_simTime, m_ephemeris.EndTime());
+	const double begin = std::max(m_ephemeris.StartTime(), end - m_trailSegments * m_ephemeris.SegmentSpan());
+	if (!(end > begin)) return;
+
+	const glm::mat4 viewProjection = m_projection * m_view;
+	ImGuiViewport* viewport = ImGui::GetMainViewport();
+	ImDrawList* drawList = ImGui::GetBackgroundDrawList(viewport);
+	const ImU32 color = ImGui::ColorConvertFloat4ToU32(ImVec4(selected->material.x, selected->material.y, selected->material.z, 0.8f));
+	auto flush = [&]() {
+		if (m_trailPoints.size() >= 2)
+			drawList->AddPolyline(m_trailPoints.data(), int(m_trailPoints.size()), color, ImDrawFlags_None, 1.5f);
+		m_trailPoints.clear();
+	};
+
+	m_trailPoints.clear();
+	for (int j = 0; j <= TRAIL_POINTS; ++j) {
+		glm::dvec3 position;
+		if (!m_ephemeris.Position(selected->id, begin + (end - begin) * j / TRAIL_POINTS, position)) {
+			flush();
+			continue;
+		}
+		glm::vec4 clip = viewProjection * glm::vec4(glm::vec3(position), 1.0f);
+		if (clip.w <= 0.0f) {
+			flush();
+			continue;
+		}
+		m_trailPoints.emplace_back(viewport->Pos.x + (0.5f + 0.5f * clip.x / clip.w) * viewport->Size.x,
+			viewport->Pos.y + (0.5f - 0.5f * clip.y / clip.w) * viewport->Size.y);
+	}
+	flush();
+}
+
+void Game::seekTimeline(uint64_t step) {
+	TimelineFrame& frame = m_timelineFrame;
+	if (!m_timeline.Seek(step, frame)) return;
+
+	// Same planets as on screen: update in place, otherwise rebuild the ones that merged away
+	bool samePlanets = frame.ids.size() == m_vPlanets.size();
+	for (size_t i = 0; samePlanets && i < m_vPlanets.size(); ++i)
+		samePlanets = m_vPlanets[i].id == frame.ids[i];
+
+	if (!samePlanets) {
+		// Built next to the current planets so the ones still there keep their rails primary,
+		// rebaseRails below derives the relative orbit from the frame
+		std::vector<Planet> planets;
+		planets.reserve(frame.ids.size());
+		for (size_t i = 0; i < frame.ids.size(); ++i) {
+			const TimelineBodyInfo* info = m_timeline.BodyInfo(frame.ids[i]);
+			float zero[3] = { 0.0f, 0.0f, 0.0f };
+			float color[3] = { 1.0f, 1.0f, 1.0f };
+			char name[16] = "";
+			if (info) {
+				color[0] = info->color.r; color[1] = info->color.g; color[2] = info->color.b;
+				memcpy(name, info->name, sizeof(name));
+			}
+			planets.emplace_back(frame.mass[i], frame.radius[i], zero, zero, color, name);
+			planets.back().id = frame.ids[i];
+			if (const Planet* current = findPlanet(frame.ids[i]))
+				planets.back().railsPrimary = current->railsPrimary;
+		}
+		m_vPlanets.swap(planets);
+	}
+
+	for (size_t i = 0; i < m_vPlanets.size(); ++i) {
+		Planet& planet = m_vPlanets[i];
+		planet.mass = frame.mass[i];
+		if (planet.radius != frame.radius[i]) {
+			planet.radius = frame.radius[i];
+			planet.renderer.SetRadius(planet.radius);
+		}
+		planet.position = frame.position[i];
+		planet.velocity = frame.velocity[i];
+	}
+
+	m_stepCount = frame.step;
+	m_simTime = frame.time;
+	onBodiesChanged();
+	rebaseRails();
+	if (!findPlanet(m_selectedPlanetId))
+		m_selectedPlanetId = INVALID_PLANET_ID;
+}
+
+void Game::onBodiesChanged() {
+	// Anything that caches per body data indexed by position in m_vPlanets has to be reset here
+	m_respa.Invalidate();
+	m_octree.Invalidate();
+	resetConservation();
+
+	m_planetIndexById.assign(m_nextPlanetId, INVALID_PLANET_ID);
+	for (size_t i = 0; i < m_vPlanets.size(); ++i)
+		m_planetIndexById[m_vPlanets[i].id] = uint32_t(i);
+
+	// Planets whose primary is gone or went on rails itself fall back to integration, and so does
+	// every on-rails planet under the integrators that only see their own bodies as sources
+	for (Planet& planet : m_vPlanets) {
+		if (!planet.OnRails()) continue;
+		const Planet* primary = findPlanet(planet.railsPrimary);
+		if (!primary || primary->OnRails() || m_integrator != INTEGRATOR_EULER)
+			releaseFromRails(planet);
+	}
+
+	// Integrated planets first, so the integrators and force targets are a prefix of m_vPlanets
+	auto railsBegin = std::stable_partition(m_vPlanets.begin(), m_vPlanets.end(), [](const Planet& planet) { return !planet.OnRails(); });
+	m_railsBegin = size_t(railsBegin - m_vPlanets.begin());
+	for (size_t i = 0; i < m_vPlanets.size(); ++i)
+		m_planetIndexById[m_vPlanets[i].id] = uint32_t(i);
+}
+
+void Game::propagateRails(double gravity, double stepTime) {
+	const size_t count = m_vPlanets.size() - m_railsBegin;
+	if (count == 0) return;
+
+	// Relative orbits as structure of arrays for the batched universal-variable solver
+	m_railsGm.resize(count);
+	m_railsX.resize(count);
+	m_railsY.resize(count);
+	m_railsZ.resize(count);
+	m_railsVx.resize(count);
+	m_railsVy.resize(count);
+	m_railsVz.resize(count);
+	for (size_t k = 0; k < count; ++k) {
+		const Planet& planet = m_vPlanets[m_railsBegin + k];
+		const Planet* primary = findPlanet(planet.railsPrimary);
+		m_railsGm[k] = gravity * (planet.mass + (primary ? primary->mass : 0.0));
+		m_railsX[k] = planet.railsPosition.x;
+		m_railsY[k] = planet.railsPosition.y;
+		m_railsZ[k] = planet.railsPosition.z;
+		m_railsVx[k] = planet.railsVelocity.x;
+		m_railsVy[k] = planet.railsVelocity.y;
+		m_railsVz[k] = planet.railsVelocity.z;
+	}
+	KeplerDriftBatch(m_railsGm.data(), m_railsX.data(), m_railsY.data(), m_railsZ.data(),
+		m_railsVx.data(), m_railsVy.data(), m_railsVz.data(), count, stepTime);
+
+	// The primaries have already moved this frame
+	for (size_t k = 0; k < count; ++k) {
+		Planet& planet = m_vPlanets[m_railsBegin + k];
+		const Planet* primary = findPlanet(planet.railsPrimary);
+		planet.railsPosition = glm::dvec3(m_railsX[k], m_railsY[k], m_railsZ[k]);
+		planet.railsVelocity = glm::dvec3(m_railsVx[k], m_railsVy[k], m_railsVz[k]);
+		if (!primary) continue;
+		planet.position = glm::dvec3(primary->position) + planet.railsPosition;
+		planet.velocity = glm::dvec3(primary->velocity) + planet.railsVelocity;
+	}
+}
+
+bool Game::putOnRails(Planet& planet) {
+	// The primary is the integrated planet that pulls hardest
+	const Planet* primary = nullptr;
+	double strongest = 0.0;
+	for (size_t i = 0; i < m_railsBegin; ++i) {
+		const Planet& other = m_vPlanets[i];
+		if (other.id == planet.id) continue;
+		glm::dvec3 d = glm::dvec3(other.position) - glm::dvec3(planet.position);
+		double dist2 = glm::dot(d, d);
+		if (dist2 <= 0.0) continue;
+		double pull = other.mass / dist2;
+		if (pull > strongest) {
+			strongest = pull;
+			primary = &other;
+		}
+	}
+	if (!primary) return false;
+
+	// Satellites of this planet would chain on rails, they go back to integration
+	for (Planet& other : m_vPlanets)
+		if (other.railsPrimary == planet.id)
+			releaseFromRails(other);
+
+	planet.railsPrimary = primary->id;
+	planet.railsPosition = glm::dvec3(planet.position) - glm::dvec3(primary->position);
+	planet.railsVelocity = glm::dvec3(planet.velocity) - glm::dvec3(primary->velocity);
+	return true;
+}
+
+void Game::releaseFromRails(Planet& planet) {
+	// position and velocity are kept up to date in absolute terms, integration picks up from there
+	planet.railsPrimary = INVALID_PLANET_ID;
+}
+
+void Game::rebaseRails() {
+	// The absolute state was written from outside, propagateRails would restore the old relative orbit
+	for (size_t i = m_railsBegin; i < m_vPlanets.size(); ++i) {
+		Planet& planet = m_vPlanets[i];
+		const Planet* primary = findPlanet(planet.railsPrimary);
+		if (!primary) continue;
+		planet.railsPosition = glm::dvec3(planet.position) - glm::dvec3(primary->position);
+		planet.railsVelocity = glm::dvec3(planet.velocity) - glm::dvec3(primary->velocity);
+	}
+}
+
+bool Game::releaseCollidedFromRails(uint32_t index) {
+	// A collision breaks the Kepler orbit, the body is integrated from its new state
+	if (index >= m_vPlanets.size() || !m_vPlanets[index].OnRails()) return false;
+	releaseFromRails(m_vPlanets[index]);
+	return true;
+}
+
+void Game::putLightBodiesOnRails() {
+	// One-off O(N^2) scan over the integrated planets: every planet lighter than the mass ratio times
+	// its strongest attractor goes on rails, unless that attractor goes on rails itself
+	std::vector<uint32_t> primaries(m_railsBegin, INVALID_PLANET_ID);
+	for (size_t i = 0; i < m_railsBegin; ++i) {
+		const Planet& planet = m_vPlanets[i];
+		double strongest = 0.0;
+		size_t best = m_railsBegin;
+		for (size_t j = 0; j < m_railsBegin; ++j) {
+			if (j == i) continue;
+			glm::dvec3 d = glm::dvec3(m_vPlanets[j].position) - glm::dvec3(planet.position);
+			double dist2 = glm::dot(d, d);
+			if (dist2 <= 0.0) continue;
+			double pull = m_vPlanets[j].mass / dist2;
+			if (pull > strongest) {
+				strongest = pull;
+				best = j;
+			}
+		}
+		if (best < m_railsBegin && planet.mass < m_railsMassRatio * m_vPlanets[best].mass)
+			primaries[i] = uint32_t(best);
+	}
+
+	for (size_t i = 0; i < primaries.size(); ++i) {
+		if (primaries[i] == INVALID_PLANET_ID || primaries[primaries[i]] != INVALID_PLANET_ID) continue;
+		Planet& planet = m_vPlanets[i];
+		const Planet& primary = m_vPlanets[primaries[i]];
+		planet.railsPrimary = primary.id;
+		planet.railsPosition = glm::dvec3(planet.position) - glm::dvec3(primary.position);
+		planet.railsVelocity = glm::dvec3(planet.velocity) - glm::dvec3(primary.velocity);
+	}
+	onBodiesChanged();
+}
+
+void Game::handleCollisions() {
+	m_lastContactCount = 0;
+	size_t count = m_vPlanets.size();
+	if (count < 2) return;
+
+	gatherBodies(m_bodyState);
+	m_radii.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		m_radii[i] = m_vPlanets[i].radius;
+
+	// Broad phase on the spatial hash, exact sphere tests in the narrow phase
+	m_spatialHash.Build(m_bodyState, m_radii);
+	m_spatialHash.FindContacts(m_bodyState, m_radii, m_contacts);
+	// The threads append their contacts in the order they finish, the responses depend on the order
+	if (m_deterministic)
+		std::sort(m_contacts.begin(), m_contacts.end());
+	m_lastContactCount = m_contacts.size();
+	if (m_contacts.empty()) return;
+
+	if (m_collisionResponse == COLLISION_BOUNCE) {
+		BounceContacts(m_bodyState, m_radii, m_contacts, m_restitution);
+		scatterBodies(m_bodyState);
+		m_respa.Invalidate();
+		bool released = false;
+		for (const auto& contact : m_contacts)
+			released |= releaseCollidedFromRails(contact.first) | releaseCollidedFromRails(contact.second);
+		if (released)
+			onBodiesChanged();
+		return;
+	}
+
+	MergeContacts(m_bodyState, m_radii, m_contacts, m_deadFlags, m_survivors);
+	scatterBodies(m_bodyState);
+	for (const auto& contact : m_contacts) {
+		releaseCollidedFromRails(contact.first);
+		releaseCollidedFromRails(contact.second);
+	}
+	applyMergeResult(m_deadFlags, m_survivors);
+}
+
+void Game::handleSweptCollisions(double stepTime) {
+	m_lastSweptContactCount = 0;
+	size_t count = m_vPlanets.size();
+	if (count < 2 || m_stepStart.size() != count) return;
+
+	gatherBodies(m_bodyState);
+	m_radii.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		m_radii[i] = m_vPlanets[i].radius;
+
+	FindSweptContacts(m_stepStart, m_bodyState, m_radii, m_sweptTree, m_sweptContacts);
+	m_lastSweptContactCount = m_sweptContacts.size();
+	if (m_sweptContacts.empty()) return;
+
+	bool merge = m_collisionResponse == COLLISION_MERGE;
+	ResolveSweptContacts(m_stepStart, m_bodyState, m_radii, m_sweptContacts, merge, m_restitution, stepTime, m_deadFlags, m_survivors);
+	scatterBodies(m_bodyState);
+	bool released = false;
+	for (const SweptContact& contact : m_sweptContacts)
+		released |= releaseCollidedFromRails(contact.a) | releaseCollidedFromRails(contact.b);
+	if (merge)
+		applyMergeResult(m_deadFlags, m_survivors);
+	else {
+		m_respa.Invalidate();
+		if (released)
+			onBodiesChanged();
+	}
+}
+
+void Game::applyMergeResult(const std::vector<uint8_t>& dead, const std::vector<uint32_t>& survivor) {
+	for (size_t i = 0; i < m_vPlanets.size(); ++i) {
+		Planet& planet = m_vPlanets[i];
+		if (dead[i]) {
+			// Keep the selection on whatever swallowed the selected planet
+			if (planet.id == m_selectedPlanetId)
+				m_selectedPlanetId = m_vPlanets[survivor[i]].id;
+			m_totalMerged++;
+			continue;
+		}
+		planet.mass = m_bodyState.mass[i];
+		if (planet.radius != m_radii[i]) {
+			planet.radius = m_radii[i];
+			planet.renderer.SetRadius(planet.radius);
+		}
+	}
+
+	compactPlanets(dead);
+	onBodiesChanged();
+}
+
+void Game::compactPlanets(const std::vector<uint8_t>& dead) {
+	// One pass over all planets, no matter how many were removed
+	size_t write = 0;
+	for (size_t read = 0; read < m_vPlanets.size(); ++read) {
+		if (dead[read]) continue;
+		if (write != read)
+			m_vPlanets[write] = std::move(m_vPlanets[read]);
+		write++;
+	}
+	m_vPlanets.erase(m_vPlanets.begin() + write, m_vPlanets.end());
+}
+
+void Game::reorderBodies() {
+	m_framesSinceReorder = 0;
+	size_t count = m_vPlanets.size();
+	if (count < 2) return;
+
+	gatherBodies(m_bodyState);
+	glm::dvec3 lo = m_bodyState.position[0], hi = m_bodyState.position[0];
+	for (const glm::dvec3& p : m_bodyState.position) {
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+
+	ComputeMortonKeys(m_bodyState.position.data(), count, lo, hi, m_mortonKeys);
+	m_mortonOrder.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		m_mortonOrder[i] = uint32_t(i);
+	RadixSortPairs(m_mortonKeys, m_mortonOrder);
+
+	std::vector<Planet> sorted;
+	sorted.reserve(m_vPlanets.capacity());
+	for (uint32_t index : m_mortonOrder)
+		sorted.emplace_back(std::move(m_vPlanets[index]));
+	m_vPlanets.swap(sorted);
+
+	onBodiesChanged();
+}
+
+Planet* Game::findPlanet(uint32_t id) {
+	if (id >= m_planetIndexById.size() || m_planetIndexById[id] == INVALID_PLANET_ID) return nullptr;
+	return &m_vPlanets[m_planetIndexById[id]];
+}
+
+void Game::gatherBodies(BodyState& bodies, size_t count) {
+	count = std::min(count, m_vPlanets.size());
+	bodies.Resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		bodies.mass[i] = m_vPlanets[i].mass;
+		bodies.position[i] = m_vPlanets[i].position;
+		bodies.velocity[i] = m_vPlanets[i].velocity;
+	}
+}
+
+void Game::scatterBodies(const BodyState& bodies) {
+	for (size_t i = 0; i < bodies.Size(); ++i) {
+		m_vPlanets[i].position = bodies.position[i];
+		m_vPlanets[i].velocity = bodies.velocity[i];
+	}
 }
 
 void Game::handleMouseEvent(SDL_Event& event) {
@@ -286,6 +1740,33 @@ void Game::handleMouseEvent(SDL_Event& event) {
 	m_cameraFront = glm::normalize(direction);
 }
 
+void Game::pickPlanet(float mouseX, float mouseY) {
+	if (m_vPlanets.empty()) return;
+
+	// Mouse coordinates are in window units, the projection uses the pixel size
+	int windowWidth = 1, windowHeight = 1;
+	SDL_GetWindowSize(m_pWindow, &windowWidth, &windowHeight);
+	float ndcX = 2.0f * mouseX / windowWidth - 1.0f;
+	float ndcY = 1.0f - 2.0f * mouseY / windowHeight;
+
+	glm::mat4 inverseViewProj = glm::inverse(m_projection * m_view);
+	glm::vec4 nearPoint = inverseViewProj * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProj * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	glm::dvec3 origin = glm::dvec3(nearPoint) / double(nearPoint.w);
+	glm::dvec3 direction = glm::dvec3(farPoint) / double(farPoint.w) - origin;
+
+	gatherBodies(m_bodyState);
+	m_pickRadii.resize(m_vPlanets.size());
+	for (size_t i = 0; i < m_vPlanets.size(); ++i)
+		m_pickRadii[i] = m_vPlanets[i].radius;
+
+	m_lbvh.BuildFromBodies(m_bodyState, m_pickRadii.data());
+	uint32_t hit;
+	double t;
+	if (m_lbvh.Raycast(origin, direction, m_bodyState.position.data(), m_pickRadii.data(), hit, t))
+		m_selectedPlanetId = m_vPlanets[hit].id;
+}
+
 void Game::handleKeyboard() {
 	if (!m_windowFocused) return;
 	if (ImGui::GetIO().WantCaptureKeyboard) return;
@@ -337,6 +1818,7 @@ Game::~Game() {
 }
 
 void Game::Shutdown() {
+	m_recorder.Stop();
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplSDL3_Shutdown();
 	ImGui::DestroyContext();
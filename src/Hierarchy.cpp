@@ -0,0 +1,544 @@
+#include "Hierarchy.h"
+#include "Kepler.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+	// Candidate pair of the detection pass, strongest first
+	struct Candidate {
+		double strength;   // (m_a + m_b) / d^3, the pair's own tidal field
+		uint32_t a, b;
+	};
+
+	// Orbital period of a relative orbit, the dynamical time at the current distance if unbound
+	double orbitPeriod(double gm, const glm::dvec3& r, const glm::dvec3& v) {
+		double dist = glm::length(r);
+		if (dist <= 0.0 || gm <= 0.0) return INFINITY;
+		double invA = 2.0 / dist - glm::dot(v, v) / gm;
+		double a = invA > 0.0 ? 1.0 / invA : dist;
+		return 2.0 * glm::pi<double>() * std::sqrt(a * a * a / gm);
+	}
+
+	// Steps of at most the given length over dt, rounded up to a power of two so the steps of nested
+	// levels stay commensurate and all of them halve together with the orbit fraction
+	size_t stepCount(double dt, double step) {
+		if (!std::isfinite(step) || step <= 0.0) return 1;
+		const double wanted = dt / step;
+		size_t steps = 1;
+		while (double(steps) < wanted && steps < (size_t(1) << 62))
+			steps <<= 1;
+		return steps;
+	}
+
+	// Shares out a substep budget: every part gets what it wants plus an even part of the rest while the
+	// budget covers all of them, otherwise a share in proportion to what it wants
+	void splitBudget(size_t budget, const double* want, size_t* share, size_t count) {
+		double total = 0.0;
+		for (size_t k = 0; k < count; ++k) total += want[k];
+		for (size_t k = 0; k < count; ++k) {
+			if (total <= double(budget))
+				share[k] = size_t(want[k]) + (budget - size_t(total)) / count;
+			else
+				share[k] = size_t(double(budget) * (want[k] / total));
+		}
+	}
+}
+
+void HierarchicalIntegrator::build(const BodyState& bodies) {
+	const size_t count = bodies.Size();
+	m_nodes.assign(count, Node());
+	std::vector<uint32_t> active(count);
+	for (size_t i = 0; i < count; ++i) {
+		Node& leaf = m_nodes[i];
+		leaf.body = uint32_t(i);
+		leaf.mass = bodies.mass[i];
+		leaf.position = bodies.position[i];
+		leaf.velocity = bodies.velocity[i];
+		active[i] = uint32_t(i);
+	}
+
+	// Every pass pairs each node with the one whose field dominates it, tightest pairs first
+	std::vector<Candidate> candidates;
+	std::vector<uint8_t> used;
+	for (bool merged = true; merged && active.size() > 1;) {
+		merged = false;
+		candidates.clear();
+		for (size_t i = 0; i < active.size(); ++i) {
+			const Node& a = m_nodes[active[i]];
+			double best = 0.0;
+			uint32_t partner = NO_NODE;
+			for (size_t j = 0; j < active.size(); ++j) {
+				if (j == i) continue;
+				const Node& b = m_nodes[active[j]];
+				glm::dvec3 d = b.position - a.position;
+				double dist2 = glm::dot(d, d);
+				if (dist2 <= 0.0) continue;
+				double strength = (a.mass + b.mass) / (dist2 * std::sqrt(dist2));
+				if (strength > best) {
+					best = strength;
+					partner = active[j];
+				}
+			}
+			if (partner != NO_NODE && active[i] < partner)
+				candidates.push_back({ best, active[i], partner });
+			else if (partner != NO_NODE)
+				candidates.push_back({ best, partner, active[i] });
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& x, const Candidate& y) {
+			return x.strength > y.strength || (x.strength == y.strength && (x.a < y.a || (x.a == y.a && x.b < y.b)));
+		});
+
+		used.assign(m_nodes.size() + candidates.size(), 0);
+		const size_t firstNew = m_nodes.size();
+		for (const Candidate& candidate : candidates) {
+			if (used[candidate.a] || used[candidate.b]) continue;
+			if (!tryMerge(candidate.a, candidate.b, active)) continue;
+			used[candidate.a] = used[candidate.b] = 1;
+			merged = true;
+		}
+
+		std::vector<uint32_t> next;
+		for (uint32_t node : active)
+			if (!used[node]) next.push_back(node);
+		for (size_t node = firstNew; node < m_nodes.size(); ++node)
+			next.push_back(uint32_t(node));
+		active.swap(next);
+	}
+
+	m_roots = active;
+	std::sort(m_roots.begin(), m_roots.end());
+	m_mass.resize(count);
+	m_x.resize(count);
+	m_v.resize(count);
+	m_rootOf.resize(count);
+	uint32_t next = 0;
+	for (size_t r = 0; r < m_roots.size(); ++r) {
+		uint32_t begin = next;
+		assignLeaves(m_roots[r], next);
+		std::fill(m_rootOf.begin() + begin, m_rootOf.begin() + next, uint32_t(r));
+	}
+	for (const Node& node : m_nodes) {
+		if (node.body == NO_NODE) continue;
+		m_mass[node.begin] = bodies.mass[node.body];
+		m_x[node.begin] = bodies.position[node.body];
+		m_v[node.begin] = bodies.velocity[node.body];
+	}
+}
+
+bool HierarchicalIntegrator::tryMerge(uint32_t a, uint32_t b, const std::vector<uint32_t>& active) {
+	const Node& first = m_nodes[a];
+	const Node& second = m_nodes[b];
+	const double mass = first.mass + second.mass, gm = G * mass;
+	const glm::dvec3 r = second.position - first.position, v = second.velocity - first.velocity;
+	const double dist = glm::length(r);
+	if (gm <= 0.0 || dist <= 0.0) return false;
+
+	// Bound, and the children have to look like points to each other all along the orbit
+	double energy = 0.5 * glm::dot(v, v) - gm / dist;
+	if (energy >= 0.0) return false;
+	double semiMajor = -gm / (2.0 * energy);
+	glm::dvec3 h = glm::cross(r, v);
+	double eccentricity = std::sqrt(std::max(0.0, 1.0 - glm::dot(h, h) / (gm * semiMajor)));
+	double apocentre = semiMajor * (1.0 + eccentricity), pericentre = semiMajor * (1.0 - eccentricity);
+	if (pericentre < isolationFactor * (first.size + second.size)) return false;
+
+	// Nobody else close by or pulling harder than a small tide
+	const glm::dvec3 center = (first.mass * first.position + second.mass * second.position) / mass;
+	const double ownField = mass / (apocentre * apocentre * apocentre);
+	for (uint32_t other : active) {
+		if (other == a || other == b) continue;
+		const Node& node = m_nodes[other];
+		double distance = glm::length(node.position - center);
+		if (distance < isolationFactor * apocentre + node.size) return false;
+		if (node.mass / (distance * distance * distance) > tidalTolerance * ownField) return false;
+	}
+
+	Node composite;
+	composite.child[0] = a;
+	composite.child[1] = b;
+	composite.mass = mass;
+	composite.depth = 1 + std::max(first.depth, second.depth);
+	composite.size = std::max(first.size + second.mass / mass * apocentre, second.size + first.mass / mass * apocentre);
+	composite.position = center;
+	composite.velocity = (first.mass * first.velocity + second.mass * second.velocity) / mass;
+	m_nodes.push_back(composite);
+	return true;
+}
+
+void HierarchicalIntegrator::assignLeaves(uint32_t index, uint32_t& next) {
+	Node& node = m_nodes[index];
+	node.begin = next;
+	if (node.body != NO_NODE) {
+		next++;
+	}
+	else {
+		assignLeaves(node.child[0], next);
+		assignLeaves(node.child[1], next);
+	}
+	m_nodes[index].end = next;
+}
+
+void HierarchicalIntegrator::centerOfMass(const Node& node, glm::dvec3& position, glm::dvec3& velocity) const {
+	position = velocity = glm::dvec3(0.0);
+	double mass = 0.0;
+	for (uint32_t i = node.begin; i < node.end; ++i) {
+		position += m_mass[i] * m_x[i];
+		velocity += m_mass[i] * m_v[i];
+		mass += m_mass[i];
+	}
+	if (mass > 0.0) {
+		position /= mass;
+		velocity /= mass;
+	}
+	else {
+		position = m_x[node.begin];
+		velocity = m_v[node.begin];
+	}
+}
+
+double HierarchicalIntegrator::period(const Node& node) const {
+	glm::dvec3 xa, va, xb, vb;
+	centerOfMass(m_nodes[node.child[0]], xa, va);
+	centerOfMass(m_nodes[node.child[1]], xb, vb);
+	return orbitPeriod(G * node.mass, xb - xa, vb - va);
+}
+
+double HierarchicalIntegrator::substeps(const Node& node, double dt) const {
+	if (node.body != NO_NODE) return 0.0;
+	const double steps = double(stepCount(dt, orbitFraction * period(node)));
+	const double h = dt / steps;
+	return steps * (1.0 + substeps(m_nodes[node.child[0]], h) + substeps(m_nodes[node.child[1]], h));
+}
+
+void HierarchicalIntegrator::keplerDrift(const Node& node, double dt) {
+	const Node& first = m_nodes[node.child[0]];
+	const Node& second = m_nodes[node.child[1]];
+	glm::dvec3 xa, va, xb, vb;
+	centerOfMass(first, xa, va);
+	centerOfMass(second, xb, vb);
+	glm::dvec3 r = xb - xa, v = vb - va;
+	const glm::dvec3 r0 = r, v0 = v;
+	if (node.mass > 0.0)
+		KeplerDrift(G * node.mass, r, v, dt);
+	else
+		r += v * dt;
+	lastKeplerDrifts++;
+
+	// Both children move rigidly, the centre of mass of the node stays put
+	const glm::dvec3 dr = r - r0, dv = v - v0;
+	const double shareA = node.mass > 0.0 ? second.mass / node.mass : 0.5;
+	for (uint32_t i = first.begin; i < first.end; ++i) {
+		m_x[i] -= shareA * dr;
+		m_v[i] -= shareA * dv;
+	}
+	for (uint32_t i = second.begin; i < second.end; ++i) {
+		m_x[i] += (1.0 - shareA) * dr;
+		m_v[i] += (1.0 - shareA) * dv;
+	}
+}
+
+void HierarchicalIntegrator::tidalKick(const Node& node, double dt) {
+	const Node& first = m_nodes[node.child[0]];
+	const Node& second = m_nodes[node.child[1]];
+	// Between two single bodies the Kepler drift is the whole interaction
+	if (first.end - first.begin == 1 && second.end - second.begin == 1) return;
+
+	// Pull of all leaves of one child on the centre of mass of the other, minus the point mass pull
+	// the drift already applied. What the children feel across their insides is left to externalTide.
+	glm::dvec3 xa, va, xb, vb;
+	centerOfMass(first, xa, va);
+	centerOfMass(second, xb, vb);
+	const glm::dvec3 separation = xb - xa;
+	const double dist = glm::length(separation);
+	const glm::dvec3 kepler = separation * (G / (dist * dist * dist));
+
+	glm::dvec3 force(0.0);   // On the first child
+	for (uint32_t i = first.begin; i < first.end; ++i) {
+		for (uint32_t j = second.begin; j < second.end; ++j) {
+			glm::dvec3 d = m_x[j] - m_x[i];
+			double dist2 = glm::dot(d, d);
+			force += d * (G * m_mass[i] * m_mass[j] / (dist2 * std::sqrt(dist2)));
+		}
+	}
+	force -= first.mass * second.mass * kepler;
+	if (first.mass > 0.0) {
+		for (uint32_t i = first.begin; i < first.end; ++i)
+			m_v[i] += force * (dt / first.mass);
+	}
+	if (second.mass > 0.0) {
+		for (uint32_t j = second.begin; j < second.end; ++j)
+			m_v[j] -= force * (dt / second.mass);
+	}
+}
+
+void HierarchicalIntegrator::externalTide(const Node& node, uint32_t parentBegin, uint32_t parentEnd, double dt) {
+	// The rest of the parent's subtree pulls on the leaves of this node, only the difference to the pull on
+	// its centre of mass changes the inner orbits, at the node's own step
+	const uint32_t count = node.end - node.begin;
+	if (count < 2 || node.mass <= 0.0 || parentEnd - parentBegin == count) return;
+
+	m_tide.assign(count, glm::dvec3(0.0));
+	glm::dvec3 mean(0.0);
+	for (uint32_t i = node.begin; i < node.end; ++i) {
+		glm::dvec3 accel(0.0);
+		for (uint32_t j = parentBegin; j < parentEnd; ++j) {
+			if (j == node.begin) {
+				j = node.end - 1;
+				continue;
+			}
+			glm::dvec3 d = m_x[j] - m_x[i];
+			double dist2 = glm::dot(d, d);
+			accel += d * (G * m_mass[j] / (dist2 * std::sqrt(dist2)));
+		}
+		m_tide[i - node.begin] = accel;
+		mean += m_mass[i] * accel;
+	}
+	mean /= node.mass;
+	for (uint32_t i = node.begin; i < node.end; ++i)
+		m_v[i] += (m_tide[i - node.begin] - mean) * dt;
+}
+
+size_t HierarchicalIntegrator::evolve(uint32_t index, uint32_t parentBegin, uint32_t parentEnd, double dt, size_t budget) {
+	const Node& node = m_nodes[index];
+	if (node.body != NO_NODE) return 0;
+
+	// Own step from its own period, the children subdivide it further if they are faster.
+	// The relative orbit has to cover dt, so even an exhausted budget pays for one step.
+	size_t steps = stepCount(dt, orbitFraction * period(node));
+	if (steps > budget) {
+		steps = std::max<size_t>(budget, 1);
+		lastCapped = true;
+	}
+	const double h = dt / double(steps);
+	lastSmallestStep = std::min(lastSmallestStep, h);
+
+	const double want[2] = { substeps(m_nodes[node.child[0]], h), substeps(m_nodes[node.child[1]], h) };
+	size_t used = 0;
+	for (size_t s = 0; s < steps; ++s) {
+		// Every step gets an even part of what is left, the children share it after this node's own step
+		const size_t share = (budget > used ? budget - used : 0) / (steps - s);
+		size_t childBudget[2];
+		splitBudget(share > 1 ? share - 1 : 0, want, childBudget, 2);
+		++used;
+
+		externalTide(node, parentBegin, parentEnd, 0.5 * h);
+		tidalKick(node, 0.5 * h);
+		// The children see the tide of their sibling at the middle of the step. The tide from outside
+		// this node already reached all of its leaves above, passing the root range again would apply it twice
+		keplerDrift(node, 0.5 * h);
+		used += evolve(node.child[0], node.begin, node.end, h, childBudget[0]);
+		used += evolve(node.child[1], node.begin, node.end, h, childBudget[1]);
+		keplerDrift(node, 0.5 * h);
+		tidalKick(node, 0.5 * h);
+		externalTide(node, parentBegin, parentEnd, 0.5 * h);
+	}
+	return used;
+}
+
+void HierarchicalIntegrator::computeTopAccelerations() {
+	m_accel.assign(m_x.size(), glm::dvec3(0.0));
+	if (m_roots.size() < 2) return;
+
+	// Every root as seen from outside: mass, centre and traceless quadrupole sum m (3 d d^T - d^2 I)
+	for (size_t r = 0; r < m_roots.size(); ++r) {
+		const Node& source = m_nodes[m_roots[r]];
+		glm::dvec3 center, velocity;
+		centerOfMass(source, center, velocity);
+		glm::dmat3 quadrupole(0.0);
+		for (uint32_t i = source.begin; i < source.end && source.end - source.begin > 1; ++i) {
+			glm::dvec3 d = m_x[i] - center;
+			quadrupole += m_mass[i] * (3.0 * glm::outerProduct(d, d) - glm::dot(d, d) * glm::dmat3(1.0));
+		}
+
+		for (size_t i = 0; i < m_x.size(); ++i) {
+			if (m_rootOf[i] == r) continue;
+			glm::dvec3 d = m_x[i] - center;
+			double dist2 = glm::dot(d, d);
+			double invDist = 1.0 / std::sqrt(dist2);
+			double invDist2 = invDist * invDist, invDist3 = invDist2 * invDist, invDist5 = invDist3 * invDist2;
+			glm::dvec3 qd = quadrupole * d;
+			m_accel[i] += G * (-source.mass * invDist3 * d + invDist5 * qd - 2.5 * glm::dot(d, qd) * invDist5 * invDist2 * d);
+		}
+	}
+}
+
+double HierarchicalIntegrator::topTimestep() const {
+	// Dynamical or crossing time of the closest pair of roots, whichever is shorter
+	double shortest = INFINITY;
+	std::vector<glm::dvec3> center(m_roots.size()), velocity(m_roots.size());
+	for (size_t r = 0; r < m_roots.size(); ++r)
+		centerOfMass(m_nodes[m_roots[r]], center[r], velocity[r]);
+	for (size_t a = 0; a < m_roots.size(); ++a) {
+		for (size_t b = a + 1; b < m_roots.size(); ++b) {
+			glm::dvec3 r = center[b] - center[a], v = velocity[b] - velocity[a];
+			double gm = G * (m_nodes[m_roots[a]].mass + m_nodes[m_roots[b]].mass);
+			shortest = std::min(shortest, orbitPeriod(gm, r, v));
+			double speed = glm::length(v);
+			if (speed > 0.0)
+				shortest = std::min(shortest, 2.0 * glm::pi<double>() * glm::length(r) / speed);
+		}
+	}
+	return orbitFraction * shortest;
+}
+
+void HierarchicalIntegrator::Integrate(BodyState& bodies, double totalTime) {
+	lastTopSteps = lastKeplerDrifts = 0;
+	lastSmallestStep = totalTime;
+	lastTime = 0.0;
+	lastCapped = false;
+	lastRefused = bodies.Size() > maxBodies;
+	if (bodies.Size() == 0 || totalTime <= 0.0 || lastRefused) return;
+
+	build(bodies);
+	lastSubsystemCount = m_nodes.size() - bodies.Size();
+	lastDepth = 0;
+	for (uint32_t root : m_roots)
+		lastDepth = std::max<size_t>(lastDepth, m_nodes[root].depth);
+
+	lastTopSteps = stepCount(totalTime, topTimestep());
+	double h = totalTime / double(lastTopSteps);
+
+	// One budget for the whole call. If the steps do not fit, the call covers fewer top-level steps,
+	// halved in length while not even one fits, rather than taking longer steps on every level.
+	std::vector<double> want(m_roots.size());
+	auto stepCost = [&](double dt) {
+		double cost = 1.0;
+		for (size_t r = 0; r < m_roots.size(); ++r) {
+			want[r] = substeps(m_nodes[m_roots[r]], dt);
+			cost += want[r];
+		}
+		return cost;
+	};
+	double perStep = stepCost(h);
+	if (double(lastTopSteps) * perStep > double(maxSteps)) {
+		lastCapped = true;
+		for (int halvings = 0; perStep > double(maxSteps) && halvings < 60; ++halvings) {
+			h *= 0.5;
+			lastTopSteps *= 2;
+			perStep = stepCost(h);
+		}
+		lastTopSteps = std::max<size_t>(1, std::min(lastTopSteps, size_t(double(maxSteps) / perStep)));
+	}
+	lastTime = h * double(lastTopSteps);
+	lastTopStep = h;
+	lastSmallestStep = h;
+
+	// Leapfrog of the roots, every drift moves a root as a whole and evolves its insides
+	std::vector<size_t> rootBudget(m_roots.size());
+	size_t used = 0;
+	computeTopAccelerations();
+	for (size_t s = 0; s < lastTopSteps; ++s) {
+		const size_t share = (maxSteps > used ? maxSteps - used : 0) / (lastTopSteps - s);
+		splitBudget(share > 1 ? share - 1 : 0, want.data(), rootBudget.data(), m_roots.size());
+		++used;
+
+		for (size_t i = 0; i < m_v.size(); ++i)
+			m_v[i] += m_accel[i] * (0.5 * h);
+		for (size_t r = 0; r < m_roots.size(); ++r) {
+			const Node& node = m_nodes[m_roots[r]];
+			glm::dvec3 center, velocity;
+			centerOfMass(node, center, velocity);
+			for (uint32_t i = node.begin; i < node.end; ++i)
+				m_x[i] += velocity * h;
+			used += evolve(m_roots[r], node.begin, node.end, h, rootBudget[r]);
+		}
+		computeTopAccelerations();
+		for (size_t i = 0; i < m_v.size(); ++i)
+			m_v[i] += m_accel[i] * (0.5 * h);
+	}
+
+	for (const Node& node : m_nodes) {
+		if (node.body == NO_NODE) continue;
+		bodies.position[node.body] = m_x[node.begin];
+		bodies.velocity[node.body] = m_v[node.begin];
+	}
+}
+
+int RunHierarchyConvergenceCheck() {
+	// Masses in units of 1 / G and unit inner separation: a binary, a third body on a wider orbit
+	// around it and a heavy fourth body further out, each orbit circular around the inner ones
+	BodyState scene;
+	scene.Resize(4);
+	const double masses[4] = { 1.0, 0.5, 0.2, 10.0 };
+	const double separations[3] = { 1.0, 8.0, 100.0 };
+	const glm::dvec3 axes[3][2] = { { glm::dvec3(1, 0, 0), glm::dvec3(0, 1, 0) },
+		{ glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1) }, { glm::dvec3(0, 1, 0), glm::dvec3(-1, 0, 0) } };
+	double inner = masses[0];
+	scene.mass[0] = masses[0] / G;
+	for (int k = 1; k < 4; ++k) {
+		// Body k on a circular orbit around the centre of mass of bodies 0..k-1, which sits at the origin
+		const double total = inner + masses[k];
+		const double speed = std::sqrt(total / separations[k - 1]);
+		const glm::dvec3 shift = -axes[k - 1][0] * (separations[k - 1] * masses[k] / total);
+		const glm::dvec3 kick = -axes[k - 1][1] * (speed * masses[k] / total);
+		for (int i = 0; i < k; ++i) {
+			scene.position[i] += shift;
+			scene.velocity[i] += kick;
+		}
+		scene.mass[k] = masses[k] / G;
+		scene.position[k] = axes[k - 1][0] * (separations[k - 1] * inner / total);
+		scene.velocity[k] = axes[k - 1][1] * (speed * inner / total);
+		inner = total;
+	}
+	const double duration = 60.0;   // About ten inner orbits
+
+	// Reference: the same integrator, so the same tide and multipole model, far below the checked steps
+	const double fractions[3] = { 0.0008, 0.0004, 0.0002 };
+	BodyState reference = scene;
+	HierarchicalIntegrator fine;
+	fine.orbitFraction = fractions[2] / 16.0;
+	fine.maxSteps = SIZE_MAX;
+	fine.Integrate(reference, duration);
+	const glm::dvec3 referenceSeparation = reference.position[1] - reference.position[0];
+
+	// That model has to converge to Newtonian gravity: a direct kick-drift-kick leapfrog at two step
+	// lengths, extrapolated to fourth order since its error is even in the step
+	glm::dvec3 direct[2];
+	std::vector<glm::dvec3> accel;
+	for (int run = 0; run < 2; ++run) {
+		BodyState bodies = scene;
+		const size_t steps = size_t(200000) << run;
+		const double dt = duration / double(steps);
+		ComputeAccelerations(bodies, accel);
+		for (size_t s = 0; s < steps; ++s) {
+			for (size_t i = 0; i < bodies.Size(); ++i) {
+				bodies.velocity[i] += accel[i] * (0.5 * dt);
+				bodies.position[i] += bodies.velocity[i] * dt;
+			}
+			ComputeAccelerations(bodies, accel);
+			for (size_t i = 0; i < bodies.Size(); ++i)
+				bodies.velocity[i] += accel[i] * (0.5 * dt);
+		}
+		direct[run] = bodies.position[1] - bodies.position[0];
+	}
+	const double modelError = glm::length(referenceSeparation - (4.0 * direct[1] - direct[0]) / 3.0);
+
+	double errors[3];
+	bool passed = true;
+	for (int k = 0; k < 3; ++k) {
+		BodyState bodies = scene;
+		HierarchicalIntegrator hierarchy;
+		hierarchy.orbitFraction = fractions[k];
+		hierarchy.maxSteps = SIZE_MAX;
+		hierarchy.Integrate(bodies, duration);
+		errors[k] = glm::length(bodies.position[1] - bodies.position[0] - referenceSeparation);
+		printf("Orbit fraction %.4f: %zu subsystems, depth %zu, A-B separation error %.3e", fractions[k],
+			hierarchy.lastSubsystemCount, hierarchy.lastDepth, errors[k]);
+		if (k > 0) {
+			// Second order gives 2, anything that stops converging gives about 0
+			const double order = std::log2(errors[k - 1] / errors[k]);
+			printf(", order %.2f", order);
+			passed = passed && order > 1.8;
+		}
+		printf("\n");
+		passed = passed && hierarchy.lastDepth == 4;
+	}
+	printf("Reference against the direct leapfrog: %.3e\n", modelError);
+	passed = passed && modelError < 0.1 * errors[2];
+	printf(passed ? "Hierarchy convergence: passed\n" : "Hierarchy convergence: FAILED\n");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,502 @@
+#include "InitialConditions.h"
+#include "FFT.h"
+#include "Philox.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <sstream>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+	constexpr size_t GENERATE_GRAIN = 4096;
+	constexpr size_t TABLE_SIZE = 1024;
+
+	// Mass fraction limits of the samplers, keep the outermost bodies at a sensible radius
+	constexpr double PLUMMER_MAX_FRACTION = 0.999;   // ~39 scale radii
+	constexpr double HERNQUIST_MAX_FRACTION = 0.99;  // ~200 scale radii
+	constexpr double DISK_MAX_SCALE_LENGTHS = 10.0;
+
+	// Streams keep the numbers of different components independent
+	enum Stream : uint32_t {
+		STREAM_PLUMMER = 1,
+		STREAM_HERNQUIST = 2,
+		STREAM_DISK = 3,
+		STREAM_BULGE = 4,
+		STREAM_HALO = 5,
+		STREAM_ZELDOVICH = 6,
+	};
+
+	struct Profile {
+		enum Kind { PLUMMER, HERNQUIST, EXPONENTIAL_DISK } kind;
+		double mass;
+		double scale;
+
+		// Disk mass is treated as spherically distributed
+		double EnclosedMass(double r) const {
+			double x = r / scale;
+			switch (kind) {
+			case PLUMMER: return mass * x * x * x / std::pow(1.0 + x * x, 1.5);
+			case HERNQUIST: return mass * x * x / ((1.0 + x) * (1.0 + x));
+			default: return mass * (1.0 - (1.0 + x) * std::exp(-x));
+			}
+		}
+
+		double Density(double r) const {
+			double x = r / scale;
+			switch (kind) {
+			case PLUMMER: return 3.0 * mass / (4.0 * glm::pi<double>() * scale * scale * scale) * std::pow(1.0 + x * x, -2.5);
+			case HERNQUIST: return mass / (2.0 * glm::pi<double>() * scale * scale * scale) / (x * (1.0 + x) * (1.0 + x) * (1.0 + x));
+			default: return 0.0;
+			}
+		}
+	};
+
+	// Potential and isotropic Jeans dispersion of one tracer on a log-spaced radial grid:
+	//     sigma^2(r) = 1 / rho(r) * Integral_r^inf rho G M(r') / r'^2 dr'
+	class RadialTable {
+	public:
+		RadialTable(const std::vector<Profile>& profiles, const Profile& tracer) : m_profiles(profiles) {
+			double minScale = tracer.scale, maxScale = tracer.scale, totalMass = 0.0;
+			for (const Profile& p : profiles) {
+				minScale = std::min(minScale, p.scale);
+				maxScale = std::max(maxScale, p.scale);
+				totalMass += p.mass;
+			}
+			m_logMin = std::log(1.0e-4 * minScale);
+			m_logStep = (std::log(1.0e4 * maxScale) - m_logMin) / double(TABLE_SIZE - 1);
+			m_potential.resize(TABLE_SIZE);
+			m_dispersion2.resize(TABLE_SIZE);
+
+			// Integrate inwards from the outer edge, trapezoid rule in ln r
+			double rMax = std::exp(m_logMin + m_logStep * double(TABLE_SIZE - 1));
+			double potential = -G * totalMass / rMax, pressure = 0.0;
+			double prevForce = 0.0, prevPressure = 0.0;
+			for (size_t i = TABLE_SIZE; i-- > 0;) {
+				double r = std::exp(m_logMin + m_logStep * double(i));
+				double force = G * EnclosedMass(r) / (r * r) * r;   // dPhi/dln r
+				double rho = tracer.Density(r);
+				double pressureTerm = rho * force;
+				if (i + 1 < TABLE_SIZE) {
+					potential -= 0.5 * (force + prevForce) * m_logStep;
+					pressure += 0.5 * (pressureTerm + prevPressure) * m_logStep;
+				}
+				m_potential[i] = potential;
+				m_dispersion2[i] = rho > 0.0 ? pressure / rho : 0.0;
+				prevForce = force;
+				prevPressure = pressureTerm;
+			}
+		}
+
+		double EnclosedMass(double r) const {
+			double m = 0.0;
+			for (const Profile& p : m_profiles) m += p.EnclosedMass(r);
+			return m;
+		}
+
+		double Potential(double r) const { return interpolate(m_potential, r); }
+		double Dispersion2(double r) const { return interpolate(m_dispersion2, r); }
+
+	private:
+		double interpolate(const std::vector<double>& table, double r) const {
+			double t = (std::log(r) - m_logMin) / m_logStep;
+			t = std::clamp(t, 0.0, double(TABLE_SIZE - 1) - 1e-9);
+			size_t i = size_t(t);
+			double f = t - double(i);
+			return table[i] * (1.0 - f) + table[i + 1] * f;
+		}
+
+		std::vector<Profile> m_profiles;
+		double m_logMin, m_logStep;
+		std::vector<double> m_potential;
+		std::vector<double> m_dispersion2;
+	};
+
+	glm::dvec3 isotropic(PhiloxStream& rng, double length) {
+		double cosTheta = 2.0 * rng.Uniform() - 1.0;
+		double sinTheta = std::sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+		double phi = 2.0 * glm::pi<double>() * rng.Uniform();
+		return length * glm::dvec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+	}
+
+	// Gaussian velocity with the local dispersion, bound to the system
+	glm::dvec3 jeansVelocity(PhiloxStream& rng, const RadialTable& table, double r) {
+		double sigma = std::sqrt(std::max(table.Dispersion2(r), 0.0));
+		double maxSpeed = 0.95 * std::sqrt(-2.0 * table.Potential(r));
+		for (int attempt = 0; attempt < 64; ++attempt) {
+			glm::dvec3 v(rng.Normal() * sigma, rng.Normal() * sigma, rng.Normal() * sigma);
+			if (glm::length(v) < maxSpeed) return v;
+		}
+		return glm::dvec3(0.0);
+	}
+
+	void generateSpherical(BodyState& bodies, size_t first, size_t count, const Profile& profile, const RadialTable& table,
+		uint64_t seed, uint32_t stream, ThreadPool& pool) {
+		double bodyMass = profile.mass / double(count);
+		pool.ParallelFor(count, GENERATE_GRAIN, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				PhiloxStream rng(seed, i, stream);
+				double r;
+				if (profile.kind == Profile::PLUMMER) {
+					double u = rng.Uniform() * PLUMMER_MAX_FRACTION;
+					r = profile.scale / std::sqrt(std::pow(u, -2.0 / 3.0) - 1.0);
+				}
+				else {
+					double s = std::sqrt(rng.Uniform() * HERNQUIST_MAX_FRACTION);
+					r = profile.scale * s / (1.0 - s);
+				}
+
+				glm::dvec3 velocity;
+				if (profile.kind == Profile::PLUMMER) {
+					// Aarseth, Henon & Wielen (1974): q = v / v_esc from g(q) = q^2 (1 - q^2)^3.5
+					double q;
+					do {
+						q = rng.Uniform();
+					} while (0.1 * rng.Uniform() > q * q * std::pow(1.0 - q * q, 3.5));
+					double escape = std::sqrt(2.0 * G * profile.mass / std::sqrt(r * r + profile.scale * profile.scale));
+					velocity = isotropic(rng, q * escape);
+				}
+				else velocity = jeansVelocity(rng, table, r);
+
+				size_t index = first + i;
+				bodies.mass[index] = bodyMass;
+				bodies.position[index] = isotropic(rng, r);
+				bodies.velocity[index] = velocity;
+			}
+		});
+	}
+
+	void generateDisk(BodyState& bodies, size_t first, const GalaxyModel& model, const RadialTable& table, uint64_t seed, ThreadPool& pool) {
+		const double rd = model.diskScaleLength, z0 = model.diskScaleHeight;
+		const double bodyMass = model.diskMass / double(model.diskCount);
+		const double centralSurfaceDensity = model.diskMass / (2.0 * glm::pi<double>() * rd * rd);
+
+		pool.ParallelFor(model.diskCount, GENERATE_GRAIN, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				PhiloxStream rng(seed, i, STREAM_DISK);
+
+				// Surface density ~ exp(-R/Rd) makes R/Rd Gamma(2) distributed; sech^2 vertical profile
+				double x;
+				do {
+					x = -std::log(rng.Uniform() * rng.Uniform());
+				} while (x > DISK_MAX_SCALE_LENGTHS);
+				double radius = x * rd;
+				double z = z0 * std::atanh(2.0 * rng.Uniform() - 1.0);
+				double phi = 2.0 * glm::pi<double>() * rng.Uniform();
+
+				// Rotation curve and epicyclic frequency of the whole galaxy
+				double h = 1.0e-3 * radius;
+				auto omega2 = [&](double r) { return G * table.EnclosedMass(r) / (r * r * r); };
+				double vc2 = omega2(radius) * radius * radius;
+				double dOmega2 = (omega2(radius + h) - omega2(radius - h)) / (2.0 * h);
+				double kappa2 = std::max(radius * dOmega2 + 4.0 * omega2(radius), 1.0e-30);
+				double kappaRatio = kappa2 / (4.0 * omega2(radius));
+
+				// Dispersions: isothermal sheet vertically, Toomre Q radially, epicycle approximation azimuthally
+				double sigma = centralSurfaceDensity * std::exp(-x);
+				double sigmaZ = std::sqrt(glm::pi<double>() * G * sigma * z0);
+				double sigmaR = model.toomreQ * 3.36 * G * sigma / std::sqrt(kappa2);
+				double sigmaPhi = sigmaR * std::sqrt(kappaRatio);
+				// Asymmetric drift lowers the mean rotation
+				double meanPhi = std::sqrt(std::max(vc2 + sigmaR * sigmaR * (1.0 - kappaRatio - 2.0 * x), 0.0));
+
+				double vR = rng.Normal() * sigmaR;
+				double vPhi = meanPhi + rng.Normal() * sigmaPhi;
+				double vZ = rng.Normal() * sigmaZ;
+
+				double c = std::cos(phi), s = std::sin(phi);
+				size_t index = first + i;
+				bodies.mass[index] = bodyMass;
+				bodies.position[index] = glm::dvec3(radius * c, radius * s, z);
+				bodies.velocity[index] = glm::dvec3(vR * c - vPhi * s, vR * s + vPhi * c, vZ);
+			}
+		});
+	}
+
+	// Moves the bodies in [first, first + count) to their centre of mass frame
+	void centre(BodyState& bodies, size_t first, size_t count) {
+		glm::dvec3 position(0.0), velocity(0.0);
+		double mass = 0.0;
+		for (size_t i = first; i < first + count; ++i) {
+			position += bodies.mass[i] * bodies.position[i];
+			velocity += bodies.mass[i] * bodies.velocity[i];
+			mass += bodies.mass[i];
+		}
+		if (mass <= 0.0) return;
+		position /= mass;
+		velocity /= mass;
+		for (size_t i = first; i < first + count; ++i) {
+			bodies.position[i] -= position;
+			bodies.velocity[i] -= velocity;
+		}
+	}
+
+	void generateGalaxy(BodyState& bodies, std::vector<uint8_t>& component, size_t first, const GalaxyModel& model, uint64_t seed, ThreadPool& pool) {
+		std::vector<Profile> profiles;
+		Profile disk{ Profile::EXPONENTIAL_DISK, model.diskMass, model.diskScaleLength };
+		Profile bulge{ Profile::HERNQUIST, model.bulgeMass, model.bulgeScaleRadius };
+		Profile halo{ Profile::HERNQUIST, model.haloMass, model.haloScaleRadius };
+		if (model.diskCount && model.diskMass > 0.0) profiles.push_back(disk);
+		if (model.bulgeCount && model.bulgeMass > 0.0) profiles.push_back(bulge);
+		if (model.haloCount && model.haloMass > 0.0) profiles.push_back(halo);
+
+		size_t offset = first;
+		if (model.diskCount) {
+			generateDisk(bodies, offset, model, RadialTable(profiles, disk), seed, pool);
+			std::fill(component.begin() + offset, component.begin() + offset + model.diskCount, GALAXY_DISK);
+			offset += model.diskCount;
+		}
+		if (model.bulgeCount) {
+			generateSpherical(bodies, offset, model.bulgeCount, bulge, RadialTable(profiles, bulge), seed, STREAM_BULGE, pool);
+			std::fill(component.begin() + offset, component.begin() + offset + model.bulgeCount, GALAXY_BULGE);
+			offset += model.bulgeCount;
+		}
+		if (model.haloCount) {
+			generateSpherical(bodies, offset, model.haloCount, halo, RadialTable(profiles, halo), seed, STREAM_HALO, pool);
+			std::fill(component.begin() + offset, component.begin() + offset + model.haloCount, GALAXY_HALO);
+		}
+		centre(bodies, first, model.Count());
+	}
+}
+
+void GeneratePlummer(BodyState& bodies, size_t count, double mass, double scaleRadius, uint64_t seed, ThreadPool& pool) {
+	bodies.Resize(count);
+	Profile profile{ Profile::PLUMMER, mass, scaleRadius };
+	generateSpherical(bodies, 0, count, profile, RadialTable({ profile }, profile), seed, STREAM_PLUMMER, pool);
+	centre(bodies, 0, count);
+}
+
+void GenerateHernquist(BodyState& bodies, size_t count, double mass, double scaleRadius, uint64_t seed, ThreadPool& pool) {
+	bodies.Resize(count);
+	Profile profile{ Profile::HERNQUIST, mass, scaleRadius };
+	generateSpherical(bodies, 0, count, profile, RadialTable({ profile }, profile), seed, STREAM_HERNQUIST, pool);
+	centre(bodies, 0, count);
+}
+
+void GenerateGalaxy(BodyState& bodies, std::vector<uint8_t>& component, const GalaxyModel& model, uint64_t seed, ThreadPool& pool) {
+	bodies.Resize(model.Count());
+	component.resize(model.Count());
+	generateGalaxy(bodies, component, 0, model, seed, pool);
+}
+
+void GenerateGalaxyCollision(BodyState& bodies, std::vector<uint8_t>& component, const GalaxyModel& model,
+	double separation, double pericentre, double inclination, uint64_t seed, ThreadPool& pool) {
+	size_t count = model.Count();
+	bodies.Resize(2 * count);
+	component.resize(2 * count);
+	generateGalaxy(bodies, component, 0, model, seed, pool);
+	generateGalaxy(bodies, component, count, model, seed + 1, pool);
+
+	// Parabolic relative orbit: v^2 = 2 G M / d, angular momentum^2 = 2 G M q
+	double totalMass = 2.0 * model.Mass();
+	pericentre = std::min(pericentre, separation);
+	double speed = std::sqrt(2.0 * G * totalMass / separation);
+	double tangential = std::sqrt(2.0 * G * totalMass * pericentre) / separation;
+	double radial = std::sqrt(std::max(speed * speed - tangential * tangential, 0.0));
+	glm::dvec3 relativePosition(separation, 0.0, 0.0);
+	glm::dvec3 relativeVelocity(-radial, tangential, 0.0);
+
+	double c = std::cos(inclination), s = std::sin(inclination);
+	pool.ParallelFor(count, GENERATE_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			bodies.position[i] -= 0.5 * relativePosition;
+			bodies.velocity[i] -= 0.5 * relativeVelocity;
+
+			// Tilt the second disk about the x axis
+			size_t j = count + i;
+			glm::dvec3& p = bodies.position[j];
+			glm::dvec3& v = bodies.velocity[j];
+			p = glm::dvec3(p.x, c * p.y - s * p.z, s * p.y + c * p.z) + 0.5 * relativePosition;
+			v = glm::dvec3(v.x, c * v.y - s * v.z, s * v.y + c * v.z) + 0.5 * relativeVelocity;
+		}
+	});
+}
+
+namespace {
+	// P(k) of a Zel'dovich model, a power law or a log-log interpolated table extrapolated by its end segments
+	class PowerSpectrum {
+	public:
+		explicit PowerSpectrum(const ZeldovichModel& model) : m_index(model.spectralIndex) {
+			for (const auto& [k, p] : model.spectrum) {
+				m_logK.push_back(std::log(k));
+				m_logP.push_back(std::log(p));
+			}
+		}
+
+		double operator()(double k) const {
+			if (m_logK.empty()) return std::pow(k, m_index);
+			double logK = std::log(k);
+			size_t i = size_t(std::upper_bound(m_logK.begin(), m_logK.end(), logK) - m_logK.begin());
+			i = std::min(std::max(i, size_t(1)), m_logK.size() - 1);
+			double t = (logK - m_logK[i - 1]) / (m_logK[i] - m_logK[i - 1]);
+			return std::exp(m_logP[i - 1] + t * (m_logP[i] - m_logP[i - 1]));
+		}
+
+	private:
+		double m_index;
+		std::vector<double> m_logK, m_logP;
+	};
+
+	// Signed wavenumber of a grid index in units of the fundamental mode
+	inline long Frequency(size_t index, size_t n) {
+		return index < n / 2 ? long(index) : long(index) - long(n);
+	}
+
+	// delta(k) / (amplitude sqrt(P(k))) of one mode of the half spectrum kz = 0..n/2. Modes on the kz = 0 plane
+	// are drawn for the lower of the indices of k and -k and conjugated for the other, so the field is real.
+	// Nyquist modes have no Hermitian partner and stay empty, like the mean.
+	inline std::complex<double> ModeNoise(size_t ix, size_t iy, size_t iz, size_t n, uint64_t seed) {
+		if (ix == n / 2 || iy == n / 2 || iz == n / 2 || (ix == 0 && iy == 0 && iz == 0))
+			return 0.0;
+
+		bool conjugate = false;
+		if (iz == 0) {
+			size_t mx = (n - ix) % n, my = (n - iy) % n;
+			if (mx * n + my < ix * n + iy) {
+				ix = mx;
+				iy = my;
+				conjugate = true;
+			}
+		}
+		PhiloxStream rng(seed, (uint64_t(ix) * n + iy) * n + iz, STREAM_ZELDOVICH);
+		double re = rng.Normal(), im = rng.Normal();
+		std::complex<double> noise(re * glm::one_over_root_two<double>(), im * glm::one_over_root_two<double>());
+		return conjugate ? std::conj(noise) : noise;
+	}
+}
+
+size_t ZeldovichModel::MemoryRequired() const {
+	size_t grid = gridSize * gridSize * (gridSize + 2) * sizeof(float);
+	size_t body = sizeof(double) + 2 * sizeof(glm::dvec3);
+	return grid + Count() * body;
+}
+
+bool GenerateZeldovich(BodyState& bodies, const ZeldovichModel& model, uint64_t seed, std::string& error, ThreadPool& pool) {
+	const size_t n = model.gridSize;
+	if (!IsPowerOfTwo(n) || n < 4) {
+		error = "Grid size must be a power of two of at least 4";
+		return false;
+	}
+	if (model.boxSize <= 0.0 || model.mass <= 0.0) {
+		error = "Box size and mass must be positive";
+		return false;
+	}
+	if (model.spectrum.size() == 1) {
+		error = "A tabulated power spectrum needs at least two points";
+		return false;
+	}
+	if (model.MemoryRequired() > model.memoryBudget) {
+		error = "Needs " + std::to_string(model.MemoryRequired() >> 20) + " MB, over the budget of "
+			+ std::to_string(model.memoryBudget >> 20) + " MB";
+		return false;
+	}
+
+	const PowerSpectrum spectrum(model);
+	const double fundamental = 2.0 * glm::pi<double>() / model.boxSize;
+	const double cell = model.boxSize / double(n);
+
+	// Expected displacement variance for unit amplitude, sum over the full spectrum of P(k) / k^2.
+	// Summed per plane and then in order, so it does not depend on the thread count.
+	std::vector<double> planeVariance(n, 0.0);
+	pool.ParallelFor(n, 1, [&](size_t begin, size_t end) {
+		for (size_t ix = begin; ix < end; ++ix) {
+			if (ix == n / 2) continue;
+			double sum = 0.0;
+			for (size_t iy = 0; iy < n; ++iy) {
+				if (iy == n / 2) continue;
+				for (size_t iz = 0; iz < n; ++iz) {
+					if (iz == n / 2 || (ix == 0 && iy == 0 && iz == 0)) continue;
+					glm::dvec3 k = fundamental * glm::dvec3(Frequency(ix, n), Frequency(iy, n), Frequency(iz, n));
+					double k2 = glm::dot(k, k);
+					sum += spectrum(std::sqrt(k2)) / k2;
+				}
+			}
+			planeVariance[ix] = sum;
+		}
+	});
+	double variance = 0.0;
+	for (double v : planeVariance) variance += v;
+	const double amplitude = model.rmsDisplacement * cell / std::sqrt(variance);
+
+	bodies.Resize(model.Count());
+	const double bodyMass = model.mass / double(model.Count());
+	std::fill(bodies.mass.begin(), bodies.mass.end(), bodyMass);
+
+	// Growing mode of a uniform static medium
+	const double density = model.mass / (model.boxSize * model.boxSize * model.boxSize);
+	const double growthRate = std::sqrt(4.0 * glm::pi<double>() * G * density);
+
+	// One grid holds one displacement component at a time: psi_d(k) = i k_d / k^2 delta(k)
+	const size_t modes = n / 2 + 1, rowFloats = n + 2;
+	std::vector<float> grid(n * n * rowFloats);
+	std::complex<float>* spectral = reinterpret_cast<std::complex<float>*>(grid.data());
+	for (int axis = 0; axis < 3; ++axis) {
+		pool.ParallelFor(n, 1, [&](size_t begin, size_t end) {
+			for (size_t ix = begin; ix < end; ++ix) {
+				for (size_t iy = 0; iy < n; ++iy) {
+					for (size_t iz = 0; iz < modes; ++iz) {
+						std::complex<double> noise = ModeNoise(ix, iy, iz, n, seed);
+						std::complex<float> value = 0.0f;
+						if (noise != 0.0) {
+							glm::dvec3 k = fundamental * glm::dvec3(Frequency(ix, n), Frequency(iy, n), double(iz));
+							double k2 = glm::dot(k, k);
+							double delta = amplitude * std::sqrt(spectrum(std::sqrt(k2)));
+							value = std::complex<float>(std::complex<double>(0.0, k[axis] / k2) * delta * noise);
+						}
+						spectral[(ix * n + iy) * modes + iz] = value;
+					}
+				}
+			}
+		});
+
+		InverseRealFFT3D(grid.data(), n, pool);
+
+		pool.ParallelFor(n, 1, [&](size_t begin, size_t end) {
+			for (size_t ix = begin; ix < end; ++ix) {
+				for (size_t iy = 0; iy < n; ++iy) {
+					const float* row = grid.data() + (ix * n + iy) * rowFloats;
+					for (size_t iz = 0; iz < n; ++iz) {
+						size_t i = (ix * n + iy) * n + iz;
+						size_t lattice = axis == 0 ? ix : axis == 1 ? iy : iz;
+						double psi = row[iz];
+						bodies.position[i][axis] = (double(lattice) + 0.5) * cell - 0.5 * model.boxSize + psi;
+						bodies.velocity[i][axis] = growthRate * psi;
+					}
+				}
+			}
+		});
+	}
+	return true;
+}
+
+bool LoadPowerSpectrum(const std::string& path, std::vector<std::pair<double, double>>& spectrum, std::string& error) {
+	std::ifstream file(path);
+	if (!file) {
+		error = "Could not open " + path;
+		return false;
+	}
+
+	spectrum.clear();
+	std::string line;
+	for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		double k, p;
+		if (!(fields >> k)) continue;
+		if (!(fields >> p) || k <= 0.0 || p <= 0.0) {
+			error = path + ":" + std::to_string(lineNumber) + ": expected positive k and P(k)";
+			return false;
+		}
+		spectrum.emplace_back(k, p);
+	}
+	std::sort(spectrum.begin(), spectrum.end());
+	spectrum.erase(std::unique(spectrum.begin(), spectrum.end(),
+		[](const auto& a, const auto& b) { return a.first == b.first; }), spectrum.end());
+	if (spectrum.size() < 2) {
+		error = path + ": a power spectrum needs at least two points";
+		return false;
+	}
+	return true;
+}
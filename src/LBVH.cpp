@@ -0,0 +1,341 @@
+#include "LBVH.h"
+#include "Morton.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	constexpr int LBVH_STACK_SIZE = 128;
+
+	// Traversal stack on the program stack, spills to the heap for trees deeper than LBVH_STACK_SIZE
+	// (duplicate Morton keys can make a branch much deeper than the key length)
+	class TraversalStack {
+	public:
+		bool Empty() const { return m_top == 0 && m_spill.empty(); }
+		void Push(int32_t node) {
+			if (m_top < LBVH_STACK_SIZE) m_nodes[m_top++] = node;
+			else m_spill.push_back(node);
+		}
+		int32_t Pop() {
+			if (!m_spill.empty()) {
+				int32_t node = m_spill.back();
+				m_spill.pop_back();
+				return node;
+			}
+			return m_nodes[--m_top];
+		}
+
+	private:
+		int32_t m_nodes[LBVH_STACK_SIZE];
+		int m_top = 0;
+		std::vector<int32_t> m_spill;
+	};
+
+	inline int countLeadingZeros(uint64_t v) {
+		if (v == 0) return 64;
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_clzll(v);
+#elif defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, v);
+		return 63 - int(index);
+#else
+		int n = 0;
+		while (!(v & (uint64_t(1) << 63))) { v <<= 1; ++n; }
+		return n;
+#endif
+	}
+
+	inline bool boxesOverlap(const glm::dvec3& aMin, const glm::dvec3& aMax, const glm::dvec3& bMin, const glm::dvec3& bMax) {
+		return aMin.x <= bMax.x && aMax.x >= bMin.x && aMin.y <= bMax.y && aMax.y >= bMin.y && aMin.z <= bMax.z && aMax.z >= bMin.z;
+	}
+
+	// Slab test, returns the entry distance or INFINITY
+	inline double rayBox(const glm::dvec3& origin, const glm::dvec3& invDir, const glm::dvec3& lo, const glm::dvec3& hi) {
+		glm::dvec3 t0 = (lo - origin) * invDir;
+		glm::dvec3 t1 = (hi - origin) * invDir;
+		glm::dvec3 tMin = glm::min(t0, t1), tMax = glm::max(t0, t1);
+		double enter = std::max({ tMin.x, tMin.y, tMin.z, 0.0 });
+		double exit = std::min({ tMax.x, tMax.y, tMax.z });
+		return enter <= exit ? enter : INFINITY;
+	}
+}
+
+int LBVH::delta(int64_t i, int64_t j) const {
+	if (j < 0 || j >= int64_t(m_leafCount)) return -1;
+	uint64_t a = m_keys[i], b = m_keys[j];
+	// Duplicate keys are disambiguated by their index
+	if (a == b) return 64 + countLeadingZeros(uint64_t(i) ^ uint64_t(j));
+	return countLeadingZeros(a ^ b);
+}
+
+void LBVH::BuildFromBodies(const BodyState& bodies, const double* radius, ThreadPool& pool) {
+	size_t count = bodies.Size();
+	m_boxMin.resize(count);
+	m_boxMax.resize(count);
+	pool.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			glm::dvec3 r(radius ? radius[i] : 0.0);
+			m_boxMin[i] = bodies.position[i] - r;
+			m_boxMax[i] = bodies.position[i] + r;
+		}
+	});
+	Build(m_boxMin.data(), m_boxMax.data(), bodies.mass.data(), count, pool);
+}
+
+void LBVH::Build(const glm::dvec3* boxMin, const glm::dvec3* boxMax, const double* mass, size_t count, ThreadPool& pool) {
+	m_leafCount = count;
+	m_nodes.resize(count ? 2 * count - 1 : 0);
+	if (count == 0) return;
+
+	// Morton keys of the box centres, sorted with their object index
+	m_centers.resize(count);
+	glm::dvec3 lo(INFINITY), hi(-INFINITY);
+	for (size_t i = 0; i < count; ++i) {
+		m_centers[i] = 0.5 * (boxMin[i] + boxMax[i]);
+		lo = glm::min(lo, m_centers[i]);
+		hi = glm::max(hi, m_centers[i]);
+	}
+	ComputeMortonKeys(m_centers.data(), count, lo, hi, m_keys, pool);
+	m_sortedObjects.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		m_sortedObjects[i] = uint32_t(i);
+	RadixSortPairs(m_keys, m_sortedObjects, 63, pool);
+
+	buildHierarchy(pool);
+	refitBottomUp(boxMin, boxMax, mass, pool);
+}
+
+void LBVH::buildHierarchy(ThreadPool& pool) {
+	const int64_t n = int64_t(m_leafCount);
+	const int32_t leafOffset = int32_t(n - 1);
+
+	pool.ParallelFor(size_t(n), 4096, [&](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; ++k) {
+			LBVHNode& leaf = m_nodes[leafOffset + k];
+			leaf.left = leaf.right = -1;
+			leaf.object = m_sortedObjects[k];
+		}
+	});
+	if (n == 1) {
+		m_nodes[0].parent = -1;
+		return;
+	}
+	m_nodes[0].parent = -1;
+
+	// Every internal node finds its key range and split independently
+	pool.ParallelFor(size_t(n - 1), 1024, [&](size_t begin, size_t end) {
+		for (int64_t i = int64_t(begin); i < int64_t(end); ++i) {
+			int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+			int deltaMin = delta(i, i - d);
+
+			int64_t lengthMax = 2;
+			while (delta(i, i + lengthMax * d) > deltaMin)
+				lengthMax *= 2;
+
+			int64_t length = 0;
+			for (int64_t t = lengthMax / 2; t >= 1; t /= 2) {
+				if (delta(i, i + (length + t) * d) > deltaMin)
+					length += t;
+			}
+			int64_t j = i + length * d;
+
+			int deltaNode = delta(i, j);
+			int64_t split = 0;
+			int64_t t = length;
+			do {
+				t = (t + 1) / 2;
+				if (delta(i, i + (split + t) * d) > deltaNode)
+					split += t;
+			} while (t > 1);
+			int64_t gamma = i + split * d + std::min(d, 0);
+
+			LBVHNode& node = m_nodes[i];
+			node.left = std::min(i, j) == gamma ? leafOffset + int32_t(gamma) : int32_t(gamma);
+			node.right = std::max(i, j) == gamma + 1 ? leafOffset + int32_t(gamma + 1) : int32_t(gamma + 1);
+			node.object = 0;
+			m_nodes[node.left].parent = int32_t(i);
+			m_nodes[node.right].parent = int32_t(i);
+		}
+	});
+}
+
+void LBVH::refitBottomUp(const glm::dvec3* boxMin, const glm::dvec3* boxMax, const double* mass, ThreadPool& pool) {
+	const size_t n = m_leafCount;
+	const int32_t leafOffset = int32_t(n - 1);
+
+	if (m_visitsSize < n) {
+		m_visits.reset(new std::atomic<uint32_t>[n]);
+		m_visitsSize = n;
+	}
+	for (size_t i = 0; i + 1 < n; ++i)
+		m_visits[i].store(0, std::memory_order_relaxed);
+
+	// Each leaf walks up; the second thread to reach an internal node combines both children
+	pool.ParallelFor(n, 1024, [&](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; ++k) {
+			LBVHNode& leaf = m_nodes[leafOffset + k];
+			uint32_t obj = leaf.object;
+			leaf.boundsMin = boxMin[obj];
+			leaf.boundsMax = boxMax[obj];
+			leaf.mass = mass ? mass[obj] : 0.0;
+			leaf.com = m_centers[obj];
+
+			int32_t node = leaf.parent;
+			while (node >= 0 && n > 1) {
+				if (m_visits[node].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+
+				LBVHNode& parent = m_nodes[node];
+				const LBVHNode& a = m_nodes[parent.left];
+				const LBVHNode& b = m_nodes[parent.right];
+				parent.boundsMin = glm::min(a.boundsMin, b.boundsMin);
+				parent.boundsMax = glm::max(a.boundsMax, b.boundsMax);
+				parent.mass = a.mass + b.mass;
+				parent.com = parent.mass > 0.0 ? (a.mass * a.com + b.mass * b.com) / parent.mass : 0.5 * (a.com + b.com);
+				node = parent.parent;
+			}
+		}
+	});
+}
+
+void LBVH::ComputeAccelerations(const BodyState& bodies, double theta, std::vector<glm::dvec3>& accel, ThreadPool& pool,
+	std::vector<double>* potentialEnergy) const {
+	size_t count = bodies.Size();
+	accel.assign(count, glm::dvec3(0.0));
+	if (potentialEnergy) potentialEnergy->assign(count, 0.0);
+	if (m_leafCount == 0 || count != m_leafCount) return;
+
+	const double theta2 = theta * theta;
+	pool.ParallelFor(count, 256, [&](size_t begin, size_t end) {
+		TraversalStack stack;
+		for (size_t i = begin; i < end; ++i) {
+			const glm::dvec3 p = bodies.position[i];
+			glm::dvec3 a(0.0);
+			double phi = 0.0;
+			stack.Push(0);
+
+			while (!stack.Empty()) {
+				const LBVHNode& node = m_nodes[stack.Pop()];
+				if (node.mass <= 0.0) continue;
+
+				glm::dvec3 r = node.com - p;
+				double dist2 = glm::dot(r, r);
+				if (node.left < 0) {
+					if (node.object == i || dist2 < 1e-20) continue;
+					double invDist = 1.0 / std::sqrt(dist2);
+					a += (G * node.mass * invDist * invDist * invDist) * r;
+					phi -= G * node.mass * invDist;
+					continue;
+				}
+
+				glm::dvec3 extent = node.boundsMax - node.boundsMin;
+				double size = std::max({ extent.x, extent.y, extent.z });
+				bool inside = glm::all(glm::greaterThanEqual(p, node.boundsMin)) && glm::all(glm::lessThanEqual(p, node.boundsMax));
+				if (inside || size * size > theta2 * dist2) {
+					stack.Push(node.left);
+					stack.Push(node.right);
+					continue;
+				}
+				double invDist = 1.0 / std::sqrt(dist2);
+				a += (G * node.mass * invDist * invDist * invDist) * r;
+				phi -= G * node.mass * invDist;
+			}
+			accel[i] = a;
+			if (potentialEnergy) (*potentialEnergy)[i] = 0.5 * bodies.mass[i] * phi;
+		}
+	});
+}
+
+void LBVH::FindOverlappingPairs(std::vector<std::pair<uint32_t, uint32_t>>& pairs, ThreadPool& pool) const {
+	pairs.clear();
+	if (m_leafCount < 2) return;
+
+	const int32_t leafOffset = int32_t(m_leafCount - 1);
+	std::mutex mergeMutex;
+
+	pool.ParallelFor(m_leafCount, 512, [&](size_t begin, size_t end) {
+		std::vector<std::pair<uint32_t, uint32_t>> local;
+		TraversalStack stack;
+
+		for (size_t k = begin; k < end; ++k) {
+			const LBVHNode& leaf = m_nodes[leafOffset + k];
+			stack.Push(0);
+			while (!stack.Empty()) {
+				int32_t index = stack.Pop();
+				const LBVHNode& node = m_nodes[index];
+				if (!boxesOverlap(leaf.boundsMin, leaf.boundsMax, node.boundsMin, node.boundsMax)) continue;
+
+				if (node.left < 0) {
+					// Report every pair once, from the leaf that comes first in Morton order
+					if (index > leafOffset + int32_t(k))
+						local.emplace_back(std::min(leaf.object, node.object), std::max(leaf.object, node.object));
+					continue;
+				}
+				stack.Push(node.left);
+				stack.Push(node.right);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		pairs.insert(pairs.end(), local.begin(), local.end());
+	});
+}
+
+void LBVH::QueryBox(const glm::dvec3& lo, const glm::dvec3& hi, std::vector<uint32_t>& out) const {
+	out.clear();
+	if (m_leafCount == 0) return;
+
+	TraversalStack stack;
+	stack.Push(0);
+	while (!stack.Empty()) {
+		const LBVHNode& node = m_nodes[stack.Pop()];
+		if (!boxesOverlap(lo, hi, node.boundsMin, node.boundsMax)) continue;
+		if (node.left < 0) {
+			out.push_back(node.object);
+			continue;
+		}
+		stack.Push(node.left);
+		stack.Push(node.right);
+	}
+}
+
+bool LBVH::Raycast(const glm::dvec3& origin, const glm::dvec3& dir, const glm::dvec3* centers, const double* radii,
+	uint32_t& hitObject, double& hitT) const {
+	if (m_leafCount == 0) return false;
+
+	glm::dvec3 invDir = 1.0 / dir;
+	double dirLen2 = glm::dot(dir, dir);
+	hitT = INFINITY;
+
+	TraversalStack stack;
+	stack.Push(0);
+	while (!stack.Empty()) {
+		const LBVHNode& node = m_nodes[stack.Pop()];
+		if (rayBox(origin, invDir, node.boundsMin, node.boundsMax) >= hitT) continue;
+
+		if (node.left < 0) {
+			// Exact ray / sphere intersection
+			glm::dvec3 oc = origin - centers[node.object];
+			double b = glm::dot(oc, dir);
+			double c = glm::dot(oc, oc) - radii[node.object] * radii[node.object];
+			double disc = b * b - dirLen2 * c;
+			if (disc < 0.0) continue;
+			double t = (-b - std::sqrt(disc)) / dirLen2;
+			if (t < 0.0) t = (-b + std::sqrt(disc)) / dirLen2;
+			if (t >= 0.0 && t < hitT) {
+				hitT = t;
+				hitObject = node.object;
+			}
+			continue;
+		}
+		stack.Push(node.left);
+		stack.Push(node.right);
+	}
+	return std::isfinite(hitT);
+}
@@ -0,0 +1,130 @@
+#include "Morton.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MORTON_USE_SSE2 1
+#endif
+
+namespace {
+	// Spreads the lower 21 bits of v so that there are two zero bits between each of them
+	inline uint64_t spreadBits(uint64_t v) {
+		v &= 0x1fffff;
+		v = (v | v << 32) & 0x1f00000000ffffull;
+		v = (v | v << 16) & 0x1f0000ff0000ffull;
+		v = (v | v << 8)  & 0x100f00f00f00f00full;
+		v = (v | v << 4)  & 0x10c30c30c30c30c3ull;
+		v = (v | v << 2)  & 0x1249249249249249ull;
+		return v;
+	}
+
+#ifdef MORTON_USE_SSE2
+	// spreadBits on two 64-bit lanes
+	inline __m128i spreadBits2(__m128i v) {
+		v = _mm_and_si128(v, _mm_set1_epi64x(0x1fffff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 32)), _mm_set1_epi64x(0x1f00000000ffffll));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 16)), _mm_set1_epi64x(0x1f0000ff0000ffll));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 8)),  _mm_set1_epi64x(0x100f00f00f00f00fll));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 4)),  _mm_set1_epi64x(0x10c30c30c30c30c3ll));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi64(v, 2)),  _mm_set1_epi64x(0x1249249249249249ll));
+		return v;
+	}
+
+	// Quantizes one coordinate of two bodies to [0, 2^21 - 1] as two 64-bit lanes
+	inline __m128i quantize2(double a, double b, double lo, double scale, double gridMax) {
+		__m128d q = _mm_mul_pd(_mm_sub_pd(_mm_set_pd(b, a), _mm_set1_pd(lo)), _mm_set1_pd(scale));
+		q = _mm_min_pd(_mm_max_pd(q, _mm_setzero_pd()), _mm_set1_pd(gridMax));
+		return _mm_unpacklo_epi32(_mm_cvttpd_epi32(q), _mm_setzero_si128());
+	}
+#endif
+
+	constexpr int RADIX_BITS = 8;
+	constexpr size_t RADIX_BUCKETS = size_t(1) << RADIX_BITS;
+}
+
+uint64_t MortonEncode(uint32_t x, uint32_t y, uint32_t z) {
+	return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+}
+
+void ComputeMortonKeys(const glm::dvec3* positions, size_t count, const glm::dvec3& lo, const glm::dvec3& hi, std::vector<uint64_t>& keys, ThreadPool& pool) {
+	keys.resize(count);
+	const double gridMax = double((1u << 21) - 1);
+	glm::dvec3 extent = glm::max(hi - lo, glm::dvec3(1e-300));
+	glm::dvec3 scale = gridMax / extent;
+
+	pool.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+		size_t i = begin;
+#ifdef MORTON_USE_SSE2
+		for (; i + 1 < end; i += 2) {
+			const glm::dvec3& a = positions[i];
+			const glm::dvec3& b = positions[i + 1];
+			__m128i x = spreadBits2(quantize2(a.x, b.x, lo.x, scale.x, gridMax));
+			__m128i y = spreadBits2(quantize2(a.y, b.y, lo.y, scale.y, gridMax));
+			__m128i z = spreadBits2(quantize2(a.z, b.z, lo.z, scale.z, gridMax));
+			__m128i key = _mm_or_si128(x, _mm_or_si128(_mm_slli_epi64(y, 1), _mm_slli_epi64(z, 2)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&keys[i]), key);
+		}
+#endif
+		for (; i < end; ++i) {
+			glm::dvec3 q = glm::clamp((positions[i] - lo) * scale, glm::dvec3(0.0), glm::dvec3(gridMax));
+			keys[i] = MortonEncode(uint32_t(q.x), uint32_t(q.y), uint32_t(q.z));
+		}
+	});
+}
+
+void RadixSortPairs(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int keyBits, ThreadPool& pool) {
+	const size_t count = keys.size();
+	if (count < 2) return;
+
+	const size_t blockCount = std::min(pool.ThreadCount() * 4, std::max<size_t>(count / 4096, 1));
+	const size_t blockSize = (count + blockCount - 1) / blockCount;
+
+	std::vector<uint64_t> keysTmp(count);
+	std::vector<uint32_t> valuesTmp(count);
+	std::vector<size_t> histogram(blockCount * RADIX_BUCKETS);
+
+	for (int shift = 0; shift < keyBits; shift += RADIX_BITS) {
+		std::fill(histogram.begin(), histogram.end(), 0);
+
+		// Per block digit histograms
+		pool.ParallelFor(blockCount, 1, [&](size_t begin, size_t end) {
+			for (size_t b = begin; b < end; ++b) {
+				size_t* hist = &histogram[b * RADIX_BUCKETS];
+				size_t last = std::min(count, (b + 1) * blockSize);
+				for (size_t i = b * blockSize; i < last; ++i)
+					hist[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			}
+		});
+
+		// Exclusive prefix sum in digit-major, block-minor order keeps the sort stable
+		size_t running = 0;
+		bool trivialPass = false;
+		for (size_t d = 0; d < RADIX_BUCKETS; ++d) {
+			size_t digitTotal = 0;
+			for (size_t b = 0; b < blockCount; ++b) {
+				size_t c = histogram[b * RADIX_BUCKETS + d];
+				histogram[b * RADIX_BUCKETS + d] = running;
+				running += c;
+				digitTotal += c;
+			}
+			if (digitTotal == count) trivialPass = true;
+		}
+		if (trivialPass) continue;
+
+		pool.ParallelFor(blockCount, 1, [&](size_t begin, size_t end) {
+			for (size_t b = begin; b < end; ++b) {
+				size_t* offset = &histogram[b * RADIX_BUCKETS];
+				size_t last = std::min(count, (b + 1) * blockSize);
+				for (size_t i = b * blockSize; i < last; ++i) {
+					size_t dst = offset[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+					keysTmp[dst] = keys[i];
+					valuesTmp[dst] = values[i];
+				}
+			}
+		});
+		keys.swap(keysTmp);
+		values.swap(valuesTmp);
+	}
+}
@@ -0,0 +1,37 @@
+#include "NBody.h"
+#include "Units.h"
+
+namespace {
+	// Compile-time switch keeps the potential out of the force-only loop
+	template <bool WithPotential>
+	void directSum(const BodyState& bodies, glm::dvec3* accel, double* potentialEnergy) {
+		const size_t count = bodies.Size();
+		for (size_t i = 0; i + 1 < count; ++i) {
+			const glm::dvec3 pi = bodies.position[i];
+			glm::dvec3 ai(0.0);
+			double rowPotential = 0.0;
+			for (size_t j = i + 1; j < count; ++j) {
+				glm::dvec3 r12 = bodies.position[j] - pi;
+				double dist2 = glm::dot(r12, r12);
+				if (dist2 < 1e-20) continue; // Same guard as Game::ApplyGravity
+
+				double invDist3 = 1.0 / (dist2 * std::sqrt(dist2));
+				ai += (G * bodies.mass[j] * invDist3) * r12;
+				accel[j] -= (G * bodies.mass[i] * invDist3) * r12;
+				if constexpr (WithPotential) rowPotential -= bodies.mass[j] * invDist3 * dist2;
+			}
+			accel[i] += ai;
+			if constexpr (WithPotential) potentialEnergy[i] = G * bodies.mass[i] * rowPotential;
+		}
+	}
+}
+
+void ComputeAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel, std::vector<double>* potentialEnergy) {
+	const size_t count = bodies.Size();
+	accel.assign(count, glm::dvec3(0.0));
+	if (potentialEnergy) {
+		potentialEnergy->assign(count, 0.0);
+		directSum<true>(bodies, accel.data(), potentialEnergy->data());
+	}
+	else directSum<false>(bodies, accel.data(), nullptr);
+}
@@ -0,0 +1,240 @@
+#include "Octree.h"
+#include "ThreadPool.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+	constexpr uint32_t OCTREE_MAX_DEPTH = 32;
+
+	inline int octant(const glm::dvec3& p, const glm::dvec3& center) {
+		return (p.x >= center.x ? 1 : 0) | (p.y >= center.y ? 2 : 0) | (p.z >= center.z ? 4 : 0);
+	}
+
+	inline bool insideCell(const glm::dvec3& p, const glm::dvec3& center, double halfSize) {
+		glm::dvec3 d = glm::abs(p - center);
+		return d.x <= halfSize && d.y <= halfSize && d.z <= halfSize;
+	}
+}
+
+void Octree::Invalidate() {
+	m_valid = false;
+}
+
+void Octree::Update(const BodyState& bodies) {
+	if (!m_valid || bodies.Size() != m_bodyCount) {
+		build(bodies);
+		refit(bodies);
+		return;
+	}
+
+	refit(bodies);
+	refitCount++;
+
+	if (lastEscapeFraction > rebuildEscapeFraction || lastOverlapRatio > rebuildOverlapRatio) {
+		build(bodies);
+		refit(bodies);
+	}
+}
+
+void Octree::build(const BodyState& bodies) {
+	size_t count = bodies.Size();
+	m_bodyCount = count;
+	m_nodes.clear();
+	for (auto& level : m_levels) level.clear();
+	m_valid = true;
+	rebuildCount++;
+	if (count == 0) return;
+
+	glm::dvec3 lo = bodies.position[0], hi = bodies.position[0];
+	for (size_t i = 1; i < count; ++i) {
+		lo = glm::min(lo, bodies.position[i]);
+		hi = glm::max(hi, bodies.position[i]);
+	}
+
+	m_bodyIndex.resize(count);
+	std::iota(m_bodyIndex.begin(), m_bodyIndex.end(), 0);
+	m_scratch.resize(count);
+
+	OctreeNode root{};
+	root.center = 0.5 * (lo + hi);
+	root.halfSize = 0.5 * std::max({ hi.x - lo.x, hi.y - lo.y, hi.z - lo.z, 1e-12 }) * 1.0001;
+	root.parent = -1;
+	root.firstChild = -1;
+	root.firstBody = 0;
+	root.bodyCount = uint32_t(count);
+	m_nodes.push_back(root);
+
+	// Breadth first, so every level is contiguous in the pool and children are allocated together
+	for (size_t nodeIndex = 0; nodeIndex < m_nodes.size(); ++nodeIndex)
+		subdivide(bodies, int32_t(nodeIndex));
+
+	for (size_t i = 0; i < m_nodes.size(); ++i) {
+		uint32_t depth = m_nodes[i].depth;
+		if (m_levels.size() <= depth) m_levels.resize(depth + 1);
+		m_levels[depth].push_back(int32_t(i));
+	}
+	m_leafEscaped.assign(m_nodes.size(), 0);
+	m_leafVolume.assign(m_nodes.size(), 0.0);
+}
+
+void Octree::subdivide(const BodyState& bodies, int32_t nodeIndex) {
+	OctreeNode node = m_nodes[nodeIndex];
+	if (node.bodyCount <= leafSize || node.depth >= OCTREE_MAX_DEPTH) return;
+
+	// Counting sort of the node's bodies into the 8 octants
+	uint32_t octantCount[8] = { 0 };
+	uint32_t* indices = &m_bodyIndex[node.firstBody];
+	for (uint32_t i = 0; i < node.bodyCount; ++i)
+		octantCount[octant(bodies.position[indices[i]], node.center)]++;
+
+	uint32_t octantStart[8];
+	uint32_t running = 0;
+	for (int o = 0; o < 8; ++o) {
+		octantStart[o] = running;
+		running += octantCount[o];
+	}
+
+	uint32_t* scratch = &m_scratch[node.firstBody];
+	uint32_t cursor[8];
+	std::copy(octantStart, octantStart + 8, cursor);
+	for (uint32_t i = 0; i < node.bodyCount; ++i)
+		scratch[cursor[octant(bodies.position[indices[i]], node.center)]++] = indices[i];
+	std::copy(scratch, scratch + node.bodyCount, indices);
+
+	m_nodes[nodeIndex].firstChild = int32_t(m_nodes.size());
+	double childHalf = 0.5 * node.halfSize;
+	for (int o = 0; o < 8; ++o) {
+		if (octantCount[o] == 0) continue;
+
+		OctreeNode child{};
+		child.center = node.center + glm::dvec3(o & 1 ? childHalf : -childHalf, o & 2 ? childHalf : -childHalf, o & 4 ? childHalf : -childHalf);
+		child.halfSize = childHalf;
+		child.parent = nodeIndex;
+		child.firstChild = -1;
+		child.firstBody = node.firstBody + octantStart[o];
+		child.bodyCount = octantCount[o];
+		child.depth = node.depth + 1;
+		m_nodes.push_back(child);
+		m_nodes[nodeIndex].childCount++;
+	}
+}
+
+void Octree::refit(const BodyState& bodies) {
+	ThreadPool& pool = ThreadPool::Global();
+
+	// Deepest level first, every node only reads its children which are one level below
+	for (size_t level = m_levels.size(); level-- > 0;) {
+		const std::vector<int32_t>& nodes = m_levels[level];
+		pool.ParallelFor(nodes.size(), 64, [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; ++k) {
+				OctreeNode& node = m_nodes[nodes[k]];
+				glm::dvec3 lo(INFINITY), hi(-INFINITY), weighted(0.0);
+				double mass = 0.0;
+
+				if (node.firstChild < 0) {
+					uint32_t escaped = 0;
+					for (uint32_t i = node.firstBody; i < node.firstBody + node.bodyCount; ++i) {
+						const glm::dvec3& p = bodies.position[m_bodyIndex[i]];
+						double m = bodies.mass[m_bodyIndex[i]];
+						lo = glm::min(lo, p);
+						hi = glm::max(hi, p);
+						weighted += m * p;
+						mass += m;
+						if (!insideCell(p, node.center, node.halfSize)) escaped++;
+					}
+					glm::dvec3 extent = hi - lo;
+					m_leafEscaped[nodes[k]] = escaped;
+					m_leafVolume[nodes[k]] = extent.x * extent.y * extent.z;
+				}
+				else {
+					for (int32_t c = node.firstChild; c < node.firstChild + int32_t(node.childCount); ++c) {
+						const OctreeNode& child = m_nodes[c];
+						lo = glm::min(lo, child.boundsMin);
+						hi = glm::max(hi, child.boundsMax);
+						weighted += child.mass * child.com;
+						mass += child.mass;
+					}
+				}
+
+				node.boundsMin = lo;
+				node.boundsMax = hi;
+				node.mass = mass;
+				node.com = mass > 0.0 ? weighted / mass : 0.5 * (lo + hi);
+			}
+		});
+	}
+
+	// Quality metrics for the rebuild decision
+	uint64_t escaped = 0;
+	double leafVolume = 0.0;
+	for (size_t i = 0; i < m_nodes.size(); ++i) {
+		escaped += m_leafEscaped[i];
+		leafVolume += m_leafVolume[i];
+	}
+	lastEscapeFraction = m_bodyCount ? double(escaped) / double(m_bodyCount) : 0.0;
+	if (!m_nodes.empty()) {
+		glm::dvec3 extent = m_nodes[0].boundsMax - m_nodes[0].boundsMin;
+		double rootVolume = extent.x * extent.y * extent.z;
+		lastOverlapRatio = rootVolume > 0.0 ? leafVolume / rootVolume : 0.0;
+	}
+}
+
+void Octree::ComputeAccelerations(const BodyState& bodies, std::vector<glm::dvec3>& accel, std::vector<double>* potentialEnergy) const {
+	size_t count = bodies.Size();
+	accel.assign(count, glm::dvec3(0.0));
+	if (potentialEnergy) potentialEnergy->assign(count, 0.0);
+	if (m_nodes.empty() || count != m_bodyCount) return;
+
+	const double theta2 = theta * theta;
+	ThreadPool::Global().ParallelFor(count, 256, [&](size_t begin, size_t end) {
+		int32_t stack[8 * OCTREE_MAX_DEPTH + 8];
+
+		for (size_t i = begin; i < end; ++i) {
+			const glm::dvec3 p = bodies.position[i];
+			glm::dvec3 a(0.0);
+			double phi = 0.0;
+			int top = 0;
+			stack[top++] = 0;
+
+			while (top > 0) {
+				const OctreeNode& node = m_nodes[stack[--top]];
+				if (node.mass <= 0.0) continue;
+
+				if (node.firstChild < 0) {
+					for (uint32_t k = node.firstBody; k < node.firstBody + node.bodyCount; ++k) {
+						uint32_t j = m_bodyIndex[k];
+						if (j == i) continue;
+						glm::dvec3 r = bodies.position[j] - p;
+						double dist2 = glm::dot(r, r);
+						if (dist2 < 1e-20) continue;
+						double invDist = 1.0 / std::sqrt(dist2);
+						a += (G * bodies.mass[j] * invDist * invDist * invDist) * r;
+						phi -= G * bodies.mass[j] * invDist;
+					}
+					continue;
+				}
+
+				// Open the node if it is too large as seen from p, or if p lies inside its bounds
+				glm::dvec3 extent = node.boundsMax - node.boundsMin;
+				double size = std::max({ extent.x, extent.y, extent.z });
+				glm::dvec3 r = node.com - p;
+				double dist2 = glm::dot(r, r);
+				bool inside = glm::all(glm::greaterThanEqual(p, node.boundsMin)) && glm::all(glm::lessThanEqual(p, node.boundsMax));
+				if (inside || size * size > theta2 * dist2) {
+					for (int32_t c = node.firstChild; c < node.firstChild + int32_t(node.childCount); ++c)
+						stack[top++] = c;
+					continue;
+				}
+
+				double invDist = 1.0 / std::sqrt(dist2);
+				a += (G * node.mass * invDist * invDist * invDist) * r;
+				phi -= G * node.mass * invDist;
+			}
+			accel[i] = a;
+			if (potentialEnergy) (*potentialEnergy)[i] = 0.5 * bodies.mass[i] * phi;
+		}
+	});
+}
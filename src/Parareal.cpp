@@ -0,0 +1,175 @@
+#include "Parareal.h"
+#include "Ensemble.h"
+#include "ThreadPool.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+	// Yoshida (1990) 4th order composition weights
+	const double YOSHIDA_W1 = 1.0 / (2.0 - std::cbrt(2.0));
+	const double YOSHIDA_W0 = -std::cbrt(2.0) / (2.0 - std::cbrt(2.0));
+
+	void kick(BodyState& bodies, const std::vector<glm::dvec3>& accel, double dt) {
+		for (size_t i = 0; i < bodies.Size(); ++i)
+			bodies.velocity[i] += dt * accel[i];
+	}
+
+	void drift(BodyState& bodies, double dt) {
+		for (size_t i = 0; i < bodies.Size(); ++i)
+			bodies.position[i] += dt * bodies.velocity[i];
+	}
+
+	// Drift-kick-drift leapfrog substep
+	void leapfrog(BodyState& bodies, std::vector<glm::dvec3>& accel, double dt) {
+		drift(bodies, 0.5 * dt);
+		ComputeAccelerations(bodies, accel);
+		kick(bodies, accel, dt);
+		drift(bodies, 0.5 * dt);
+	}
+
+	// Largest change of any boundary position, relative to the system size
+	double relativeChange(const BodyState& a, const BodyState& b) {
+		double change = 0.0, scale = 0.0;
+		for (size_t i = 0; i < a.Size(); ++i) {
+			change = std::max(change, glm::length(a.position[i] - b.position[i]));
+			scale = std::max(scale, glm::length(a.position[i]));
+		}
+		return scale > 0.0 ? change / scale : change;
+	}
+
+	double secondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void Parareal::Coarse(BodyState& bodies, double dt, size_t steps) {
+	std::vector<glm::dvec3> accel;
+	for (size_t s = 0; s < steps; ++s)
+		leapfrog(bodies, accel, dt);
+}
+
+void Parareal::Fine(BodyState& bodies, double dt, size_t steps) {
+	std::vector<glm::dvec3> accel;
+	for (size_t s = 0; s < steps; ++s) {
+		leapfrog(bodies, accel, YOSHIDA_W1 * dt);
+		leapfrog(bodies, accel, YOSHIDA_W0 * dt);
+		leapfrog(bodies, accel, YOSHIDA_W1 * dt);
+	}
+}
+
+double Parareal::EstimatedSpeedup() const {
+	return lastWallSeconds > 0.0 ? lastFineSliceSeconds * double(m_usedSlices) / lastWallSeconds : 0.0;
+}
+
+void Parareal::Integrate(BodyState& bodies, double totalTime) {
+	lastIterations = 0;
+	lastCorrection = 0.0;
+	if (bodies.Size() < 2 || totalTime <= 0.0) return;
+
+	ThreadPool& pool = ThreadPool::Global();
+	const size_t n = slices ? slices : pool.ThreadCount();
+	const size_t iterationLimit = maxIterations ? std::min(maxIterations, n) : n;
+	const double sliceTime = totalTime / double(n);
+	const double coarseDt = sliceTime / double(std::max<size_t>(coarseStepsPerSlice, 1));
+	const double fineDt = sliceTime / double(std::max<size_t>(fineStepsPerSlice, 1));
+	auto start = std::chrono::steady_clock::now();
+	m_usedSlices = n;
+
+	m_u.assign(n + 1, bodies);
+	m_fine.assign(n, bodies);
+	m_coarse.assign(n, bodies);
+	m_fineSeconds.assign(n, 0.0);
+
+	// Initial serial coarse sweep
+	for (size_t i = 0; i < n; ++i) {
+		m_coarse[i] = m_u[i];
+		Coarse(m_coarse[i], coarseDt, coarseStepsPerSlice);
+		m_u[i + 1] = m_coarse[i];
+	}
+
+	BodyState coarseNew;
+	for (size_t k = 0; k < iterationLimit; ++k) {
+		// After k iterations the first k slices are exact, only the rest needs the fine propagator
+		pool.ParallelFor(n - k, 1, [&](size_t begin, size_t end) {
+			for (size_t s = begin; s < end; ++s) {
+				size_t i = k + s;
+				auto sliceStart = std::chrono::steady_clock::now();
+				m_fine[i] = m_u[i];
+				Fine(m_fine[i], fineDt, fineStepsPerSlice);
+				m_fineSeconds[i] = secondsSince(sliceStart);
+			}
+		});
+
+		// Serial correction sweep
+		double correction = 0.0;
+		for (size_t i = k; i < n; ++i) {
+			coarseNew = m_u[i];
+			Coarse(coarseNew, coarseDt, coarseStepsPerSlice);
+
+			BodyState& next = m_u[i + 1];
+			BodyState previous = next;
+			for (size_t b = 0; b < bodies.Size(); ++b) {
+				next.position[b] = coarseNew.position[b] + m_fine[i].position[b] - m_coarse[i].position[b];
+				next.velocity[b] = coarseNew.velocity[b] + m_fine[i].velocity[b] - m_coarse[i].velocity[b];
+			}
+			m_coarse[i] = coarseNew;
+			correction = std::max(correction, relativeChange(next, previous));
+		}
+
+		lastIterations = k + 1;
+		lastCorrection = correction;
+		if (correction < tolerance) break;
+	}
+
+	double fineTotal = 0.0;
+	for (double s : m_fineSeconds) fineTotal += s;
+	lastFineSliceSeconds = fineTotal / double(n);
+	lastWallSeconds = secondsSince(start);
+
+	bodies.position = m_u[n].position;
+	bodies.velocity = m_u[n].velocity;
+}
+
+int RunPararealCommand(int argc, char* argv[]) {
+	BodyState base = MakeOuterSolarSystem();
+	double jupiterPeriod = 2.0 * glm::pi<double>() * std::sqrt(std::pow(glm::length(base.position[1] - base.position[0]), 3.0) / (G * base.mass[0]));
+
+	Parareal parareal;
+	double orbits = 2.0;
+	size_t fineSteps = 0, coarseSteps = 0;
+	for (int i = 1; i < argc; ++i) {
+		auto next = [&](double fallback) { return i + 1 < argc ? std::atof(argv[++i]) : fallback; };
+		if (strcmp(argv[i], "--orbits") == 0) orbits = next(orbits);
+		else if (strcmp(argv[i], "--slices") == 0) parareal.slices = size_t(next(0.0));
+		else if (strcmp(argv[i], "--fine-steps") == 0) fineSteps = size_t(next(0.0));
+		else if (strcmp(argv[i], "--coarse-steps") == 0) coarseSteps = size_t(next(0.0));
+		else if (strcmp(argv[i], "--tolerance") == 0) parareal.tolerance = next(parareal.tolerance);
+	}
+	double duration = orbits * jupiterPeriod;
+	size_t slices = parareal.slices ? parareal.slices : ThreadPool::Global().ThreadCount();
+	// Default resolution per slice: fine at 1000 steps per Jupiter orbit, coarse at 20
+	parareal.fineStepsPerSlice = fineSteps ? fineSteps : std::max<size_t>(1, size_t(1000.0 * orbits / double(slices)));
+	parareal.coarseStepsPerSlice = coarseSteps ? coarseSteps : std::max<size_t>(1, size_t(20.0 * orbits / double(slices)));
+
+	printf("Parareal: %zu bodies, %.1f orbits, %zu slices, %zu threads\n", base.Size(), orbits, slices, ThreadPool::Global().ThreadCount());
+
+	BodyState serial = base;
+	auto start = std::chrono::steady_clock::now();
+	Parareal::Fine(serial, duration / double(slices * parareal.fineStepsPerSlice), slices * parareal.fineStepsPerSlice);
+	double serialSeconds = secondsSince(start);
+
+	BodyState parallel = base;
+	parareal.Integrate(parallel, duration);
+
+	printf("Serial fine:  %.3f s\n", serialSeconds);
+	printf("Parareal:     %.3f s, %zu iterations, last correction %.3e\n", parareal.lastWallSeconds, parareal.lastIterations, parareal.lastCorrection);
+	printf("Speedup:      %.2fx\n", serialSeconds / parareal.lastWallSeconds);
+	printf("Difference to serial fine: %.3e (relative)\n", relativeChange(parallel, serial));
+	return 0;
+}
@@ -0,0 +1,71 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// A counter opened for pid 0 only follows the thread that opened it, and counts of inherited
+// counters only reach the parent when the child exits, so every pool thread opens its own
+CacheMissCounter::CacheMissCounter(ThreadPool& pool) {
+	std::vector<int> fds(pool.ThreadCount(), -1);
+	pool.RunOnEachThread([&](size_t thread) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fds[thread] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+	});
+
+	// A partial sum would be misleading, so one failure makes the whole counter unavailable
+	bool complete = true;
+	for (int fd : fds)
+		complete = complete && fd >= 0;
+	if (complete) {
+		m_fds = fds;
+		return;
+	}
+	for (int fd : fds)
+		if (fd >= 0) close(fd);
+}
+
+CacheMissCounter::~CacheMissCounter() {
+	for (int fd : m_fds)
+		close(fd);
+}
+
+uint64_t CacheMissCounter::read() const {
+	uint64_t total = 0;
+	for (int fd : m_fds) {
+		uint64_t value = 0;
+		if (::read(fd, &value, sizeof(value)) == sizeof(value))
+			total += value;
+	}
+	return total;
+}
+
+// The counters run continuously, Start/Stop take the difference of two sums
+void CacheMissCounter::Start() {
+	if (m_fds.empty()) return;
+	m_start = read();
+}
+
+uint64_t CacheMissCounter::Stop() {
+	if (m_fds.empty()) return 0;
+	return read() - m_start;
+}
+
+#else
+
+CacheMissCounter::CacheMissCounter(ThreadPool&) {}
+CacheMissCounter::~CacheMissCounter() {}
+uint64_t CacheMissCounter::read() const { return 0; }
+void CacheMissCounter::Start() {}
+uint64_t CacheMissCounter::Stop() { return 0; }
+
+#endif
@@ -0,0 +1,238 @@
+#include "Regularization.h"
+#include "Kepler.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+	// Candidate pair of FindPairs, closest first
+	struct Candidate {
+		double dist2;
+		uint32_t a, b;
+	};
+
+	// Energy and eccentricity vector, which fix the shape and orientation of a Kepler orbit
+	void orbitShape(double gm, const glm::dvec3& r, const glm::dvec3& v, double& energy, glm::dvec3& eccentricity) {
+		const double dist = glm::length(r);
+		energy = 0.5 * glm::dot(v, v) - gm / dist;
+		eccentricity = glm::cross(v, glm::cross(r, v)) / gm - r / dist;
+	}
+}
+
+void PairRegularizer::Clear() {
+	m_pairs.clear();
+	m_start.clear();
+	m_partner.clear();
+	lastSteps = 0;
+}
+
+void PairRegularizer::FindPairs(const BodyState& bodies, size_t count, double threshold, ThreadPool& pool) {
+	const size_t size = bodies.Size();
+	count = std::min(count, size);
+	m_pairs.clear();
+	m_start.clear();
+	m_partner.assign(size, NO_PARTNER);
+	if (count < 2 || !(threshold > 0.0)) return;
+
+	// Spheres of half the threshold touch exactly when their centres are closer than it
+	m_radius.assign(size, 0.5 * threshold);
+	m_hash.Build(bodies, m_radius, pool);
+	m_hash.FindContacts(bodies, m_radius, m_contacts, pool);
+
+	std::vector<Candidate> candidates;
+	candidates.reserve(m_contacts.size());
+	for (const auto& contact : m_contacts) {
+		if (contact.first >= count || contact.second >= count) continue;
+		glm::dvec3 d = bodies.position[contact.second] - bodies.position[contact.first];
+		candidates.push_back({ glm::dot(d, d), contact.first, contact.second });
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& l, const Candidate& r) {
+		return l.dist2 < r.dist2 || (l.dist2 == r.dist2 && (l.a < r.a || (l.a == r.a && l.b < r.b)));
+	});
+
+	// Every body joins at most one pair, its closest free neighbour
+	for (const Candidate& candidate : candidates) {
+		if (m_partner[candidate.a] != NO_PARTNER || m_partner[candidate.b] != NO_PARTNER) continue;
+		if (bodies.mass[candidate.a] + bodies.mass[candidate.b] <= 0.0) continue;
+		m_partner[candidate.a] = candidate.b;
+		m_partner[candidate.b] = candidate.a;
+		m_pairs.emplace_back(candidate.a, candidate.b);
+
+		PairState start;
+		start.position[0] = bodies.position[candidate.a];
+		start.position[1] = bodies.position[candidate.b];
+		start.velocity[0] = bodies.velocity[candidate.a];
+		start.velocity[1] = bodies.velocity[candidate.b];
+		m_start.push_back(start);
+	}
+}
+
+void PairRegularizer::RemovePairForces(const BodyState& bodies, std::vector<glm::dvec3>& accel) const {
+	for (const auto& pair : m_pairs) {
+		glm::dvec3 d = bodies.position[pair.second] - bodies.position[pair.first];
+		double dist2 = glm::dot(d, d);
+		if (dist2 < 1e-20) continue; // Same guard as ComputeAccelerations
+		glm::dvec3 pull = d * (G / (dist2 * std::sqrt(dist2)));
+		accel[pair.first] -= pull * bodies.mass[pair.second];
+		accel[pair.second] += pull * bodies.mass[pair.first];
+	}
+}
+
+void PairRegularizer::AdvancePairs(BodyState& bodies, double gravity, double dt) {
+	lastSteps = 0;
+	if (dt <= 0.0) return;
+
+	for (size_t k = 0; k < m_pairs.size(); ++k) {
+		const uint32_t a = m_pairs[k].first, b = m_pairs[k].second;
+		const PairState& start = m_start[k];
+		const double ma = bodies.mass[a], mb = bodies.mass[b], mass = ma + mb;
+
+		// Whatever the bodies gained over the step came from the rest of the system
+		glm::dvec3 kickA = bodies.velocity[a] - start.velocity[0];
+		glm::dvec3 kickB = bodies.velocity[b] - start.velocity[1];
+
+		// The centre of mass takes the same kick and drift as every other body
+		glm::dvec3 comPosition = (ma * start.position[0] + mb * start.position[1]) / mass;
+		glm::dvec3 comVelocity = (ma * (start.velocity[0] + kickA) + mb * (start.velocity[1] + kickB)) / mass;
+		comPosition += comVelocity * dt;
+
+		// The relative orbit feels the difference of the external pulls
+		glm::dvec3 r = start.position[1] - start.position[0];
+		glm::dvec3 v = start.velocity[1] - start.velocity[0];
+		glm::dvec3 f = (kickB - kickA) / dt;
+		lastSteps += Advance(gravity * mass, r, v, f, dt);
+
+		bodies.position[a] = comPosition - r * (mb / mass);
+		bodies.position[b] = comPosition + r * (ma / mass);
+		bodies.velocity[a] = comVelocity - v * (mb / mass);
+		bodies.velocity[b] = comVelocity + v * (ma / mass);
+	}
+}
+
+size_t PairRegularizer::Advance(double gm, glm::dvec3& r, glm::dvec3& v, const glm::dvec3& f, double dt) const {
+	double dist = glm::length(r);
+	if (gm <= 0.0 || dist <= 0.0 || dt <= 0.0) {
+		v += f * dt;
+		r += v * dt;
+		return 0;
+	}
+
+	// Binding energy per reduced mass, kept as its own variable so the drift stays regular at r -> 0
+	double binding = gm / dist - 0.5 * glm::dot(v, v);
+
+	// Regularized time of one orbit is the integral of U dt = 2 pi sqrt(gm a)
+	double invA = 2.0 * binding / gm;
+	double a = invA > 0.0 ? 1.0 / invA : dist;
+	const double ds = 2.0 * glm::pi<double>() * std::sqrt(gm * a) / std::max(stepsPerOrbit, 1);
+
+	double time = 0.0;
+	size_t steps = 0;
+	while (steps < maxSteps) {
+		// Drift - kick - drift in s, on a copy so a step past the end of the frame can be dropped
+		glm::dvec3 r1 = r, v1 = v;
+		double binding1 = binding;
+
+		double kinetic = 0.5 * glm::dot(v1, v1);
+		if (kinetic + binding1 <= 0.0) break; // Perturbation drained more energy than the orbit has
+		double dt1 = 0.5 * ds / (kinetic + binding1);
+		r1 += v1 * dt1;
+
+		double dist1 = glm::length(r1);
+		if (dist1 <= 0.0) break;
+		double dt2 = ds * dist1 / gm;
+		glm::dvec3 dv = (-gm / (dist1 * dist1 * dist1) * r1 + f) * dt2;
+		binding1 -= glm::dot(v1 + 0.5 * dv, f) * dt2;
+		v1 += dv;
+
+		kinetic = 0.5 * glm::dot(v1, v1);
+		if (kinetic + binding1 <= 0.0) break;
+		double dt3 = 0.5 * ds / (kinetic + binding1);
+		r1 += v1 * dt3;
+
+		// Time only advances in the drifts, the kick spans the same interval
+		double stepTime = dt1 + dt3;
+		if (time + stepTime > dt) break;
+		r = r1;
+		v = v1;
+		binding = binding1;
+		time += stepTime;
+		++steps;
+	}
+
+	// The rest of the frame is shorter than a regularized step: kick - exact Kepler drift - kick
+	double rest = dt - time;
+	if (rest > 0.0) {
+		v += f * (0.5 * rest);
+		KeplerDrift(gm, r, v, rest);
+		v += f * (0.5 * rest);
+	}
+	return steps;
+}
+
+int RunRegularizationCheck() {
+	const double gm = 1.0, a = 1.0;
+	const double period = 2.0 * glm::pi<double>() * std::sqrt(a * a * a / gm);
+	const double eccentricities[] = { 0.0, 0.5, 0.9, 0.99 };
+	const double frames[] = { 0.3, 10.25, 2000.4 };   // In orbits, the longest one runs out of steps
+	bool passed = true;
+
+	for (double e : eccentricities) {
+		// Starting at apocentre
+		const double m0 = glm::pi<double>();
+		glm::dvec3 r0, v0;
+		KeplerEllipseState(gm, a, e, m0, r0, v0);
+		double energy0;
+		glm::dvec3 eccentricity0;
+		orbitShape(gm, r0, v0, energy0, eccentricity0);
+
+		for (double frame : frames) {
+			const double dt = frame * period;
+			glm::dvec3 exactR, exactV;
+			KeplerEllipseState(gm, a, e, m0 + 2.0 * glm::pi<double>() * frame, exactR, exactV);
+
+			// Without a perturbation the leapfrog keeps the orbit and only errs in phase
+			PairRegularizer regularizer;
+			glm::dvec3 r = r0, v = v0;
+			const size_t steps = regularizer.Advance(gm, r, v, glm::dvec3(0.0), dt);
+			double energy;
+			glm::dvec3 eccentricity;
+			orbitShape(gm, r, v, energy, eccentricity);
+			const double energyError = std::abs(energy / energy0 - 1.0);
+			const double shapeError = glm::length(eccentricity - eccentricity0);
+			bool ok = energyError < 1e-10 && shapeError < 1e-9;
+
+			// With no steps the whole frame is the closing Kepler drift, which has to be exact
+			PairRegularizer driftOnly;
+			driftOnly.maxSteps = 0;
+			glm::dvec3 driftR = r0, driftV = v0;
+			driftOnly.Advance(gm, driftR, driftV, glm::dvec3(0.0), dt);
+			const double driftError = glm::length(driftR - exactR) / a;
+			ok = ok && driftError < 1e-9;
+
+			// The phase error is second order in the regularized step
+			double phaseErrors[2];
+			for (int k = 0; k < 2; ++k) {
+				PairRegularizer stepped;
+				stepped.stepsPerOrbit = 64 << k;
+				stepped.maxSteps = SIZE_MAX;
+				glm::dvec3 sr = r0, sv = v0;
+				stepped.Advance(gm, sr, sv, glm::dvec3(0.0), std::min(frame, 10.25) * period);
+				glm::dvec3 er, ev;
+				KeplerEllipseState(gm, a, e, m0 + 2.0 * glm::pi<double>() * std::min(frame, 10.25), er, ev);
+				phaseErrors[k] = glm::length(sr - er) / a;
+			}
+			const double order = std::log2(phaseErrors[0] / phaseErrors[1]);
+			ok = ok && order > 1.8;
+
+			printf("e %.2f, %7.2f orbits: %6zu steps, |r| %.4f (exact %.4f), energy error %.1e, shape error %.1e, "
+				"drift error %.1e, phase order %.2f%s\n", e, frame, steps, glm::length(r), glm::length(exactR),
+				energyError, shapeError, driftError, order, ok ? "" : "  FAILED");
+			passed = passed && ok;
+		}
+	}
+	printf(passed ? "Pair regularization: passed\n" : "Pair regularization: FAILED\n");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+#include "Respa.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+	// Packs integer cell coordinates into one key (21 bits per axis, offset to be positive)
+	inline uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+		const int64_t offset = 1 << 20;
+		const uint64_t mask = (1u << 21) - 1;
+		return (uint64_t(x + offset) & mask) | ((uint64_t(y + offset) & mask) << 21) | ((uint64_t(z + offset) & mask) << 42);
+	}
+
+	inline int64_t cellCoord(double p, double invCell) {
+		return int64_t(std::floor(p * invCell));
+	}
+}
+
+void RespaIntegrator::Invalidate() {
+	m_cacheValid = false;
+}
+
+double RespaIntegrator::switchFunction(double dist) const {
+	// 1 inside the near region, 0 outside, C2 continuous (quintic smoothstep) in between
+	double inner = cutoff * (1.0 - switchWidth);
+	if (dist <= inner) return 1.0;
+	if (dist >= cutoff) return 0.0;
+	double x = (dist - inner) / (cutoff - inner);
+	return 1.0 - x * x * x * (x * (x * 6.0 - 15.0) + 10.0);
+}
+
+void RespaIntegrator::buildCells(const BodyState& bodies) {
+	size_t count = bodies.Size();
+	double invCell = 1.0 / cutoff;
+
+	m_cellKeys.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		const glm::dvec3& p = bodies.position[i];
+		m_cellKeys[i] = cellKey(cellCoord(p.x, invCell), cellCoord(p.y, invCell), cellCoord(p.z, invCell));
+	}
+
+	m_cellOrder.resize(count);
+	std::iota(m_cellOrder.begin(), m_cellOrder.end(), 0);
+	std::sort(m_cellOrder.begin(), m_cellOrder.end(), [&](uint32_t a, uint32_t b) { return m_cellKeys[a] < m_cellKeys[b]; });
+
+	m_cellStartKeys.clear();
+	m_cellStart.clear();
+	for (size_t i = 0; i < count; ++i) {
+		uint64_t key = m_cellKeys[m_cellOrder[i]];
+		if (m_cellStartKeys.empty() || m_cellStartKeys.back() != key) {
+			m_cellStartKeys.push_back(key);
+			m_cellStart.push_back(uint32_t(i));
+		}
+	}
+	m_cellStart.push_back(uint32_t(count));
+}
+
+void RespaIntegrator::computeNear(const BodyState& bodies, std::vector<glm::dvec3>& accel) {
+	size_t count = bodies.Size();
+	accel.assign(count, glm::dvec3(0.0));
+	buildCells(bodies);
+
+	double invCell = 1.0 / cutoff;
+	for (size_t i = 0; i < count; ++i) {
+		const glm::dvec3& pi = bodies.position[i];
+		int64_t cx = cellCoord(pi.x, invCell), cy = cellCoord(pi.y, invCell), cz = cellCoord(pi.z, invCell);
+
+		// Cell size equals the cutoff, so all near partners are in the 27 neighbouring cells
+		for (int64_t dz = -1; dz <= 1; ++dz)
+		for (int64_t dy = -1; dy <= 1; ++dy)
+		for (int64_t dx = -1; dx <= 1; ++dx) {
+			uint64_t key = cellKey(cx + dx, cy + dy, cz + dz);
+			auto it = std::lower_bound(m_cellStartKeys.begin(), m_cellStartKeys.end(), key);
+			if (it == m_cellStartKeys.end() || *it != key) continue;
+
+			size_t cell = it - m_cellStartKeys.begin();
+			for (uint32_t k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k) {
+				uint32_t j = m_cellOrder[k];
+				if (j == i) continue;
+
+				glm::dvec3 r = bodies.position[j] - pi;
+				double dist2 = glm::dot(r, r);
+				if (dist2 < 1e-20) continue;
+				double dist = std::sqrt(dist2);
+				double s = switchFunction(dist);
+				if (s == 0.0) continue;
+				accel[i] += (s * G * bodies.mass[j] / (dist2 * dist)) * r;
+			}
+		}
+	}
+}
+
+void RespaIntegrator::computeFar(const BodyState& bodies, std::vector<glm::dvec3>& accel) {
+	size_t count = bodies.Size();
+	accel.assign(count, glm::dvec3(0.0));
+
+	for (size_t i = 0; i + 1 < count; ++i) {
+		for (size_t j = i + 1; j < count; ++j) {
+			glm::dvec3 r = bodies.position[j] - bodies.position[i];
+			double dist2 = glm::dot(r, r);
+			if (dist2 < 1e-20) continue;
+			double dist = std::sqrt(dist2);
+			double s = 1.0 - switchFunction(dist);
+			if (s == 0.0) continue;
+
+			double f = s * G / (dist2 * dist);
+			accel[i] += (f * bodies.mass[j]) * r;
+			accel[j] -= (f * bodies.mass[i]) * r;
+		}
+	}
+}
+
+void RespaIntegrator::Integrate(BodyState& bodies, double totalTime, double innerStep) {
+	lastNearEvaluations = 0;
+	lastFarEvaluations = 0;
+	size_t count = bodies.Size();
+	if (count == 0 || totalTime <= 0.0 || innerStep <= 0.0 || cutoff <= 0.0) return;
+
+	int k = std::max(farInterval, 1);
+	size_t outerSteps = size_t(std::ceil(totalTime / (innerStep * k)));
+	double outerDt = totalTime / double(outerSteps);
+	double innerDt = outerDt / k;
+
+	// The cached forces depend only on the positions and the split, reuse them across frames
+	if (!m_cacheValid || m_farAccel.size() != count || m_cacheCutoff != cutoff || m_cacheSwitchWidth != switchWidth) {
+		computeFar(bodies, m_farAccel);
+		computeNear(bodies, m_nearAccel);
+		lastFarEvaluations++;
+		lastNearEvaluations++;
+		m_cacheCutoff = cutoff;
+		m_cacheSwitchWidth = switchWidth;
+		m_cacheValid = true;
+	}
+
+	for (size_t step = 0; step < outerSteps; ++step) {
+		// Far field impulse, half outer step
+		for (size_t i = 0; i < count; ++i)
+			bodies.velocity[i] += (0.5 * outerDt) * m_farAccel[i];
+
+		// k velocity Verlet substeps with the near field
+		for (int sub = 0; sub < k; ++sub) {
+			for (size_t i = 0; i < count; ++i) {
+				bodies.velocity[i] += (0.5 * innerDt) * m_nearAccel[i];
+				bodies.position[i] += innerDt * bodies.velocity[i];
+			}
+			computeNear(bodies, m_nearAccel);
+			lastNearEvaluations++;
+			for (size_t i = 0; i < count; ++i)
+				bodies.velocity[i] += (0.5 * innerDt) * m_nearAccel[i];
+		}
+
+		computeFar(bodies, m_farAccel);
+		lastFarEvaluations++;
+		for (size_t i = 0; i < count; ++i)
+			bodies.velocity[i] += (0.5 * outerDt) * m_farAccel[i];
+	}
+}
@@ -0,0 +1,381 @@
+#include "SceneLoader.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
+namespace {
+	// Work items per thread, more than one so uneven lines still balance
+	constexpr size_t CHUNKS_PER_THREAD = 8;
+	constexpr size_t MIN_CHUNK_BYTES = 64 * 1024;
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	const char* skipSpace(const char* p, const char* end) {
+		while (p < end && isSpace(*p)) ++p;
+		return p;
+	}
+
+	std::string_view trim(const char* begin, const char* end) {
+		while (begin < end && isSpace(*begin)) ++begin;
+		while (end > begin && isSpace(end[-1])) --end;
+		return std::string_view(begin, size_t(end - begin));
+	}
+
+	bool parseNumber(std::string_view text, double& value) {
+		const char* begin = text.data();
+		const char* end = begin + text.size();
+		if (begin < end && *begin == '+') ++begin;
+		auto result = std::from_chars(begin, end, value);
+		return result.ec == std::errc() && result.ptr == end;
+	}
+
+	// Parses a number at p and moves past it
+	bool readNumber(const char*& p, const char* end, double& value) {
+		if (p < end && *p == '+') ++p;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc()) return false;
+		p = result.ptr;
+		return true;
+	}
+
+	void setName(SceneBody& body, std::string_view name) {
+		if (name.size() >= 2 && name.front() == '"' && name.back() == '"')
+			name = name.substr(1, name.size() - 2);
+		size_t length = std::min(name.size(), sizeof(body.name) - 1);
+		std::memcpy(body.name, name.data(), length);
+		body.name[length] = '\0';
+	}
+
+	void setDefaults(SceneBody& body) {
+		body.name[0] = '\0';
+		body.mass = 0.0;
+		body.radius = 1.0;
+		for (int c = 0; c < 3; ++c) {
+			body.position[c] = 0.0f;
+			body.velocity[c] = 0.0f;
+			body.color[c] = 1.0f;
+		}
+	}
+
+	// Splits [begin, end) into about `count` pieces that start at the beginning of a line
+	std::vector<const char*> splitLines(const char* begin, const char* end, size_t count) {
+		std::vector<const char*> bounds{ begin };
+		size_t size = size_t(end - begin);
+		for (size_t i = 1; i < count; ++i) {
+			const char* p = begin + size * i / count;
+			if (p <= bounds.back()) continue;
+			p = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+			if (!p) break;
+			if (p + 1 > bounds.back()) bounds.push_back(p + 1);
+		}
+		bounds.push_back(end);
+		return bounds;
+	}
+
+	// CSV scenes
+	bool isBodyLine(std::string_view line) {
+		return !line.empty() && line.front() != '#';
+	}
+
+	bool parseCsvLine(std::string_view line, SceneBody& body) {
+		setDefaults(body);
+
+		const char* p = line.data();
+		const char* end = p + line.size();
+		const char* comma = static_cast<const char*>(std::memchr(p, ',', line.size()));
+		if (!comma) return false;
+		setName(body, trim(p, comma));
+		p = comma + 1;
+
+		// mass, radius, position, velocity and the optional color
+		double values[11];
+		int count = 0;
+		while (count < 11) {
+			const char* fieldEnd = static_cast<const char*>(std::memchr(p, ',', size_t(end - p)));
+			if (!fieldEnd) fieldEnd = end;
+			if (!parseNumber(trim(p, fieldEnd), values[count])) return false;
+			++count;
+			if (fieldEnd == end) break;
+			p = fieldEnd + 1;
+		}
+		if (count != 8 && count != 11) return false;
+
+		body.mass = values[0];
+		body.radius = values[1];
+		for (int c = 0; c < 3; ++c) {
+			body.position[c] = float(values[2 + c]);
+			body.velocity[c] = float(values[5 + c]);
+			if (count == 11) body.color[c] = float(values[8 + c]);
+		}
+		return true;
+	}
+
+	template<typename Fn>
+	void forEachLine(const char* begin, const char* end, Fn&& fn) {
+		while (begin < end) {
+			const char* newline = static_cast<const char*>(std::memchr(begin, '\n', size_t(end - begin)));
+			const char* lineEnd = newline ? newline : end;
+			if (!fn(trim(begin, lineEnd))) return;
+			begin = newline ? newline + 1 : end;
+		}
+	}
+
+	bool loadCsv(const char* begin, const char* end, std::vector<SceneBody>& bodies, std::string& error, ThreadPool& pool) {
+		// The first real line is either a body or the column header
+		const char* dataBegin = begin;
+		size_t firstLine = 1;
+		while (dataBegin < end) {
+			const char* newline = static_cast<const char*>(std::memchr(dataBegin, '\n', size_t(end - dataBegin)));
+			std::string_view line = trim(dataBegin, newline ? newline : end);
+			SceneBody probe;
+			if (isBodyLine(line) && parseCsvLine(line, probe)) break;
+			dataBegin = newline ? newline + 1 : end;
+			++firstLine;
+			if (isBodyLine(line)) break;
+		}
+
+		size_t chunkCount = std::max<size_t>(1, std::min(pool.ThreadCount() * CHUNKS_PER_THREAD, size_t(end - dataBegin) / MIN_CHUNK_BYTES));
+		std::vector<const char*> bounds = splitLines(dataBegin, end, chunkCount);
+		chunkCount = bounds.size() - 1;
+
+		// Pass 1: bodies and lines per chunk
+		std::vector<size_t> bodyStart(chunkCount + 1, 0), lineStart(chunkCount + 1, 0);
+		pool.ParallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; ++c) {
+				size_t bodyCount = 0, lineCount = 0;
+				forEachLine(bounds[c], bounds[c + 1], [&](std::string_view line) {
+					++lineCount;
+					if (isBodyLine(line)) ++bodyCount;
+					return true;
+				});
+				bodyStart[c + 1] = bodyCount;
+				lineStart[c + 1] = lineCount;
+			}
+		});
+		lineStart[0] = firstLine;
+		for (size_t c = 0; c < chunkCount; ++c) {
+			bodyStart[c + 1] += bodyStart[c];
+			lineStart[c + 1] += lineStart[c];
+		}
+
+		// Pass 2: parse every chunk into its own range of the output
+		bodies.resize(bodyStart[chunkCount]);
+		std::vector<size_t> badLine(chunkCount, 0);
+		pool.ParallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; ++c) {
+				size_t body = bodyStart[c], lineNumber = lineStart[c];
+				forEachLine(bounds[c], bounds[c + 1], [&](std::string_view line) {
+					if (isBodyLine(line) && !parseCsvLine(line, bodies[body++])) {
+						badLine[c] = lineNumber;
+						return false;
+					}
+					++lineNumber;
+					return true;
+				});
+			}
+		});
+
+		for (size_t line : badLine) {
+			if (line) {
+				error = "Line " + std::to_string(line) + ": expected name,mass,radius,x,y,z,vx,vy,vz[,r,g,b]";
+				bodies.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// JSON scenes
+	// Moves p past one JSON string, p points at the opening quote
+	bool skipString(const char*& p, const char* end) {
+		for (++p; p < end; ++p) {
+			if (*p == '\\') ++p;
+			else if (*p == '"') {
+				++p;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Moves p past one JSON value of any kind
+	bool skipValue(const char*& p, const char* end) {
+		p = skipSpace(p, end);
+		if (p >= end) return false;
+		if (*p == '"') return skipString(p, end);
+		if (*p != '{' && *p != '[') {
+			while (p < end && *p != ',' && *p != '}' && *p != ']' && !isSpace(*p)) ++p;
+			return true;
+		}
+
+		int depth = 0;
+		while (p < end) {
+			char c = *p;
+			if (c == '"') {
+				if (!skipString(p, end)) return false;
+				continue;
+			}
+			if (c == '{' || c == '[') ++depth;
+			else if (c == '}' || c == ']') {
+				if (--depth == 0) {
+					++p;
+					return true;
+				}
+			}
+			++p;
+		}
+		return false;
+	}
+
+	bool readString(const char*& p, const char* end, std::string_view& value) {
+		p = skipSpace(p, end);
+		if (p >= end || *p != '"') return false;
+		const char* begin = p + 1;
+		if (!skipString(p, end)) return false;
+		value = std::string_view(begin, size_t(p - 1 - begin));
+		return true;
+	}
+
+	bool expect(const char*& p, const char* end, char c) {
+		p = skipSpace(p, end);
+		if (p >= end || *p != c) return false;
+		++p;
+		return true;
+	}
+
+	bool readVector(const char*& p, const char* end, float out[3]) {
+		if (!expect(p, end, '[')) return false;
+		for (int c = 0; c < 3; ++c) {
+			double value;
+			p = skipSpace(p, end);
+			if (!readNumber(p, end, value)) return false;
+			out[c] = float(value);
+			if (!expect(p, end, c < 2 ? ',' : ']')) return false;
+		}
+		return true;
+	}
+
+	bool parseJsonBody(const char* p, const char* end, SceneBody& body) {
+		setDefaults(body);
+		if (!expect(p, end, '{')) return false;
+		p = skipSpace(p, end);
+		if (p < end && *p == '}') return true;
+
+		while (true) {
+			std::string_view key;
+			if (!readString(p, end, key) || !expect(p, end, ':')) return false;
+			p = skipSpace(p, end);
+
+			bool ok;
+			if (key == "name") {
+				std::string_view name;
+				ok = readString(p, end, name);
+				setName(body, name);
+			}
+			else if (key == "mass") ok = readNumber(p, end, body.mass);
+			else if (key == "radius") ok = readNumber(p, end, body.radius);
+			else if (key == "position") ok = readVector(p, end, body.position);
+			else if (key == "velocity") ok = readVector(p, end, body.velocity);
+			else if (key == "color") ok = readVector(p, end, body.color);
+			else ok = skipValue(p, end);
+			if (!ok) return false;
+
+			p = skipSpace(p, end);
+			if (p < end && *p == ',') {
+				++p;
+				continue;
+			}
+			return expect(p, end, '}');
+		}
+	}
+
+	bool loadJson(const char* begin, const char* end, std::vector<SceneBody>& bodies, std::string& error, ThreadPool& pool) {
+		const char* p = skipSpace(begin, end);
+
+		// Find the bodies array, either the document itself or the "bodies" member
+		if (p < end && *p == '{') {
+			++p;
+			bool found = false;
+			while (!found) {
+				std::string_view key;
+				if (!readString(p, end, key) || !expect(p, end, ':')) {
+					error = "Expected a \"bodies\" array";
+					return false;
+				}
+				if (key == "bodies") found = true;
+				else if (!skipValue(p, end) || !(expect(p, end, ','))) {
+					error = "Expected a \"bodies\" array";
+					return false;
+				}
+			}
+		}
+		if (!expect(p, end, '[')) {
+			error = "Expected an array of bodies";
+			return false;
+		}
+
+		// Structural pass: only find where each body object starts and ends
+		std::vector<std::pair<const char*, const char*>> objects;
+		p = skipSpace(p, end);
+		if (p < end && *p == ']') ++p;
+		else {
+			while (true) {
+				p = skipSpace(p, end);
+				const char* objectBegin = p;
+				if (p >= end || *p != '{' || !skipValue(p, end)) {
+					error = "Body " + std::to_string(objects.size()) + ": expected an object";
+					return false;
+				}
+				objects.emplace_back(objectBegin, p);
+				p = skipSpace(p, end);
+				if (p < end && *p == ',') {
+					++p;
+					continue;
+				}
+				if (!expect(p, end, ']')) {
+					error = "Unterminated bodies array";
+					return false;
+				}
+				break;
+			}
+		}
+
+		bodies.resize(objects.size());
+		std::vector<uint8_t> bad(objects.size(), 0);
+		pool.ParallelFor(objects.size(), 1024, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i)
+				bad[i] = !parseJsonBody(objects[i].first, objects[i].second, bodies[i]);
+		});
+
+		auto firstBad = std::find(bad.begin(), bad.end(), 1);
+		if (firstBad != bad.end()) {
+			error = "Body " + std::to_string(firstBad - bad.begin()) + ": malformed object";
+			bodies.clear();
+			return false;
+		}
+		return true;
+	}
+}
+
+bool LoadScene(const std::string& path, std::vector<SceneBody>& bodies, std::string& error, ThreadPool& pool) {
+	bodies.clear();
+	MappedFile file;
+	if (!file.Open(path)) {
+		error = "Could not open " + path;
+		return false;
+	}
+
+	const char* begin = reinterpret_cast<const char*>(file.Data());
+	const char* end = begin + file.Size();
+	if (file.Size() >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0) begin += 3;
+
+	const char* first = skipSpace(begin, end);
+	if (first < end && (*first == '[' || *first == '{'))
+		return loadJson(begin, end, bodies, error, pool);
+	return loadCsv(begin, end, bodies, error, pool);
+}
@@ -0,0 +1,110 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace {
+	// Set on worker threads so nested ParallelFor calls run inline instead of deadlocking
+	thread_local bool t_insidePool = false;
+
+	size_t s_globalThreadCount = 0;
+}
+
+ThreadPool::ThreadPool(size_t threadCount) {
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (size_t i = 1; i < threadCount; ++i)
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::Global() {
+	static ThreadPool pool(s_globalThreadCount);
+	return pool;
+}
+
+void ThreadPool::SetGlobalThreadCount(size_t threadCount) {
+	s_globalThreadCount = threadCount;
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+	if (count == 0) return;
+	grain = std::max<size_t>(grain, 1);
+
+	// Small jobs and nested calls are not worth waking the workers for
+	if (m_workers.empty() || count <= grain || t_insidePool) {
+		fn(0, count);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_job = &fn;
+	m_count = count;
+	m_grain = grain;
+	m_next = 0;
+	m_busyWorkers = m_workers.size();
+	m_generation++;
+	lock.unlock();
+	m_wake.notify_all();
+
+	t_insidePool = true;
+	runChunks();
+	t_insidePool = false;
+
+	lock.lock();
+	m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+	m_job = nullptr;
+}
+
+void ThreadPool::RunOnEachThread(const std::function<void(size_t)>& fn) {
+	if (t_insidePool) {
+		fn(0);
+		return;
+	}
+
+	// Every thread holds on to its item until all items are taken, so none can take a second one
+	const size_t threads = ThreadCount();
+	std::atomic<size_t> arrived{ 0 };
+	ParallelFor(threads, 1, [&](size_t begin, size_t) {
+		arrived.fetch_add(1);
+		while (arrived.load() < threads)
+			std::this_thread::yield();
+		fn(begin);
+	});
+}
+
+void ThreadPool::runChunks() {
+	for (;;) {
+		size_t begin = m_next.fetch_add(m_grain);
+		if (begin >= m_count) break;
+		(*m_job)(begin, std::min(begin + m_grain, m_count));
+	}
+}
+
+void ThreadPool::workerLoop() {
+	t_insidePool = true;
+	uint64_t seenGeneration = 0;
+
+	for (;;) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wake.wait(lock, [&] { return m_stop || m_generation != seenGeneration; });
+		if (m_stop) return;
+		seenGeneration = m_generation;
+		lock.unlock();
+
+		runChunks();
+
+		lock.lock();
+		if (--m_busyWorkers == 0)
+			m_done.notify_one();
+	}
+}
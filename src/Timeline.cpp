@@ -0,0 +1,259 @@
+#include "Timeline.h"
+#include "ByteCodec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+	uint32_t bits(float value) {
+		uint32_t result;
+		std::memcpy(&result, &value, sizeof(result));
+		return result;
+	}
+
+	uint64_t bits(double value) {
+		uint64_t result;
+		std::memcpy(&result, &value, sizeof(result));
+		return result;
+	}
+
+	template<typename T, typename U>
+	T fromBits(U value) {
+		T result;
+		std::memcpy(&result, &value, sizeof(result));
+		return result;
+	}
+
+	enum FrameKind : uint8_t {
+		FRAME_KEY = 0,
+		FRAME_DELTA = 1,
+	};
+
+	// Per frame bookkeeping kept in memory even for spilled segments
+	constexpr size_t FRAME_INDEX_SIZE = sizeof(uint32_t) + sizeof(uint64_t);
+}
+
+Timeline::~Timeline() {
+	Clear();
+}
+
+void Timeline::Clear() {
+	clearFrames();
+	// IDs are reused by the next scene, their names and colours go with the history
+	m_bodyInfo.clear();
+	m_hasBodyInfo.clear();
+}
+
+void Timeline::clearFrames() {
+	m_segments.clear();
+	m_segmentOpen = false;
+	m_memoryUsed = 0;
+	m_spilledBytes = 0;
+	if (m_spill.is_open()) {
+		m_spill.close();
+		std::remove(spillPath.c_str());
+	}
+	m_spillEnd = 0;
+}
+
+void Timeline::Record(const TimelineFrame& frame) {
+	// Recording an earlier step again replaces the history from there on
+	if (!m_segments.empty() && frame.step <= LastStep()) {
+		if (frame.step <= FirstStep()) clearFrames(); // Keeps the body info set for this frame
+		else TruncateAfter(frame.step - 1);
+	}
+
+	// A changed body set (merge, add, remove) cannot be expressed as a delta
+	bool delta = m_segmentOpen && m_segments.back().frameSteps.size() < keyframeInterval && frame.ids == m_previous.ids;
+	if (!delta) {
+		m_segments.emplace_back();
+		m_segments.back().firstStep = frame.step;
+		m_segmentOpen = true;
+	}
+
+	Segment& segment = m_segments.back();
+	size_t before = segment.bytes.size();
+	segment.frameOffsets.push_back(uint32_t(before));
+	segment.frameSteps.push_back(frame.step);
+	if (delta) encodeDelta(segment.bytes, frame);
+	else encodeKeyframe(segment.bytes, frame);
+	segment.lastStep = frame.step;
+	m_memoryUsed += segment.bytes.size() - before + FRAME_INDEX_SIZE;
+
+	m_previous = frame;
+	enforceBudget();
+}
+
+void Timeline::encodeKeyframe(std::vector<uint8_t>& out, const TimelineFrame& frame) const {
+	out.push_back(FRAME_KEY);
+	PutRaw(out, frame.step);
+	PutRaw(out, frame.time);
+	PutVarint(out, frame.ids.size());
+	for (uint32_t id : frame.ids) PutRaw(out, id);
+	for (double m : frame.mass) PutRaw(out, m);
+	for (double r : frame.radius) PutRaw(out, r);
+	for (const glm::vec3& p : frame.position) PutRaw(out, p);
+	for (const glm::vec3& v : frame.velocity) PutRaw(out, v);
+}
+
+void Timeline::encodeDelta(std::vector<uint8_t>& out, const TimelineFrame& frame) const {
+	out.push_back(FRAME_DELTA);
+	PutVarint(out, frame.step - m_previous.step);
+	PutRaw(out, frame.time);
+	for (size_t i = 0; i < frame.ids.size(); ++i) {
+		PutVarint(out, bits(frame.mass[i]) ^ bits(m_previous.mass[i]));
+		PutVarint(out, bits(frame.radius[i]) ^ bits(m_previous.radius[i]));
+		for (int c = 0; c < 3; ++c) {
+			PutVarint(out, bits(frame.position[i][c]) ^ bits(m_previous.position[i][c]));
+			PutVarint(out, bits(frame.velocity[i][c]) ^ bits(m_previous.velocity[i][c]));
+		}
+	}
+}
+
+bool Timeline::decode(const std::vector<uint8_t>& bytes, uint64_t step, TimelineFrame& frame) const {
+	const uint8_t* in = bytes.data();
+	const uint8_t* end = in + bytes.size();
+
+	uint8_t kind;
+	uint64_t count;
+	if (!GetRaw(in, end, kind) || kind != FRAME_KEY || !GetRaw(in, end, frame.step) || !GetRaw(in, end, frame.time) || !GetVarint(in, end, count))
+		return false;
+	if (count > uint64_t(end - in) / (sizeof(uint32_t) + 2 * sizeof(double) + 2 * sizeof(glm::vec3))) return false;
+	frame.ids.resize(size_t(count));
+	frame.mass.resize(size_t(count));
+	frame.radius.resize(size_t(count));
+	frame.position.resize(size_t(count));
+	frame.velocity.resize(size_t(count));
+	for (uint32_t& id : frame.ids) GetRaw(in, end, id);
+	for (double& m : frame.mass) GetRaw(in, end, m);
+	for (double& r : frame.radius) GetRaw(in, end, r);
+	for (glm::vec3& p : frame.position) GetRaw(in, end, p);
+	for (glm::vec3& v : frame.velocity) GetRaw(in, end, v);
+
+	// Apply deltas up to the requested step
+	while (in < end) {
+		const uint8_t* frameStart = in;
+		uint64_t stepDelta;
+		if (!GetRaw(in, end, kind) || kind != FRAME_DELTA || !GetVarint(in, end, stepDelta)) return false;
+		if (frame.step + stepDelta > step) {
+			in = frameStart;
+			break;
+		}
+		frame.step += stepDelta;
+		if (!GetRaw(in, end, frame.time)) return false;
+		for (size_t i = 0; i < count; ++i) {
+			uint64_t x;
+			if (!GetVarint(in, end, x)) return false;
+			frame.mass[i] = fromBits<double>(bits(frame.mass[i]) ^ x);
+			if (!GetVarint(in, end, x)) return false;
+			frame.radius[i] = fromBits<double>(bits(frame.radius[i]) ^ x);
+			for (int c = 0; c < 3; ++c) {
+				if (!GetVarint(in, end, x)) return false;
+				frame.position[i][c] = fromBits<float>(bits(frame.position[i][c]) ^ uint32_t(x));
+				if (!GetVarint(in, end, x)) return false;
+				frame.velocity[i][c] = fromBits<float>(bits(frame.velocity[i][c]) ^ uint32_t(x));
+			}
+		}
+	}
+	return true;
+}
+
+bool Timeline::Seek(uint64_t step, TimelineFrame& frame) {
+	if (m_segments.empty() || step < FirstStep()) return false;
+
+	// Last segment starting at or before step
+	auto it = std::upper_bound(m_segments.begin(), m_segments.end(), step,
+		[](uint64_t s, const Segment& segment) { return s < segment.firstStep; });
+	const Segment& segment = *(it - 1);
+	if (!segment.spilled) return decode(segment.bytes, step, frame);
+	return loadSegment(segment, m_loadBuffer) && decode(m_loadBuffer, step, frame);
+}
+
+void Timeline::TruncateAfter(uint64_t step) {
+	while (!m_segments.empty() && m_segments.back().firstStep > step) {
+		Segment& segment = m_segments.back();
+		if (segment.spilled) m_spilledBytes -= segment.spillSize;
+		else m_memoryUsed -= segment.bytes.size();
+		m_memoryUsed -= segment.frameSteps.size() * FRAME_INDEX_SIZE;
+		m_segments.pop_back();
+	}
+	m_segmentOpen = false; // The next frame starts a fresh keyframe
+
+	// Spilled segments form a prefix, later spills reuse the space of the dropped ones
+	m_spillEnd = 0;
+	for (const Segment& segment : m_segments)
+		if (segment.spilled) m_spillEnd = segment.spillOffset + segment.spillSize;
+	if (m_segments.empty() || m_segments.back().lastStep <= step) return;
+
+	// Cut the segment that contains step behind the frame at step
+	Segment& segment = m_segments.back();
+	if (segment.spilled) {
+		if (!loadSegment(segment, segment.bytes)) {
+			m_memoryUsed -= segment.frameSteps.size() * FRAME_INDEX_SIZE;
+			m_spilledBytes -= segment.spillSize;
+			m_segments.pop_back();
+			return;
+		}
+		m_spilledBytes -= segment.spillSize;
+		m_memoryUsed += segment.bytes.size();
+		segment.spilled = false;
+	}
+	size_t keep = size_t(std::upper_bound(segment.frameSteps.begin(), segment.frameSteps.end(), step) - segment.frameSteps.begin());
+	size_t newSize = segment.frameOffsets[keep];
+	m_memoryUsed -= (segment.bytes.size() - newSize) + (segment.frameSteps.size() - keep) * FRAME_INDEX_SIZE;
+	segment.bytes.resize(newSize);
+	segment.frameOffsets.resize(keep);
+	segment.frameSteps.resize(keep);
+	segment.lastStep = segment.frameSteps.back();
+}
+
+void Timeline::enforceBudget() {
+	// Spill the oldest closed segments, the open one keeps growing in memory
+	for (size_t i = 0; i + 1 < m_segments.size() && m_memoryUsed > memoryBudget; ++i) {
+		Segment& segment = m_segments[i];
+		if (segment.spilled) continue;
+
+		if (!m_spill.is_open()) {
+			m_spill.open(spillPath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!m_spill) return;
+			m_spillEnd = 0;
+		}
+		m_spill.seekp(std::streamoff(m_spillEnd));
+		m_spill.write(reinterpret_cast<const char*>(segment.bytes.data()), std::streamsize(segment.bytes.size()));
+		if (!m_spill) return;
+
+		segment.spilled = true;
+		segment.spillOffset = m_spillEnd;
+		segment.spillSize = segment.bytes.size();
+		m_spillEnd += segment.spillSize;
+		m_spilledBytes += segment.spillSize;
+		m_memoryUsed -= segment.bytes.size();
+		std::vector<uint8_t>().swap(segment.bytes);
+	}
+}
+
+bool Timeline::loadSegment(const Segment& segment, std::vector<uint8_t>& bytes) {
+	bytes.resize(size_t(segment.spillSize));
+	m_spill.seekg(std::streamoff(segment.spillOffset));
+	m_spill.read(reinterpret_cast<char*>(bytes.data()), std::streamsize(bytes.size()));
+	if (!m_spill) {
+		m_spill.clear();
+		return false;
+	}
+	return true;
+}
+
+void Timeline::SetBodyInfo(uint32_t id, const char name[16], const glm::vec3& color) {
+	if (id >= m_bodyInfo.size()) {
+		m_bodyInfo.resize(size_t(id) + 1);
+		m_hasBodyInfo.resize(size_t(id) + 1, 0);
+	}
+	std::memcpy(m_bodyInfo[id].name, name, sizeof(m_bodyInfo[id].name));
+	m_bodyInfo[id].color = color;
+	m_hasBodyInfo[id] = 1;
+}
+
+const TimelineBodyInfo* Timeline::BodyInfo(uint32_t id) const {
+	return id < m_hasBodyInfo.size() && m_hasBodyInfo[id] ? &m_bodyInfo[id] : nullptr;
+}
@@ -0,0 +1,365 @@
+#include "Trajectory.h"
+#include "ByteCodec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	enum FrameKind : uint8_t {
+		FRAME_RAW = 0,
+		FRAME_DELTA = 1,
+		FRAME_CONSERVATION = 0x80, // Flag, the conserved quantities follow the frame kind
+	};
+
+	// Throttling doubles the interval at most this many times
+	constexpr uint32_t MAX_THROTTLE_FACTOR = 64;
+
+	int64_t quantize(double value, double quantum) {
+		return int64_t(std::llround(value / quantum));
+	}
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+	Stop();
+}
+
+bool TrajectoryRecorder::Start(const std::string& path, const TrajectoryOptions& options) {
+	Stop();
+
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file) return false;
+
+	m_options = options;
+	m_options.everyKSteps = std::max<uint32_t>(options.everyKSteps, 1);
+	m_options.framesPerChunk = std::max<uint32_t>(options.framesPerChunk, 1);
+	if (m_options.positionQuantum <= 0.0 || m_options.velocityQuantum <= 0.0)
+		m_options.compression = TrajectoryCompression::None;
+
+	// Sorted rather than a table indexed by ID, whose size the largest ID would decide
+	m_recordIds = m_options.bodyIds;
+	std::sort(m_recordIds.begin(), m_recordIds.end());
+	m_recordIds.erase(std::unique(m_recordIds.begin(), m_recordIds.end()), m_recordIds.end());
+
+	m_ring = std::make_unique<SpscRing<TrajectoryFrame>>(std::max<size_t>(options.ringCapacity, 2));
+	m_interval = m_options.everyKSteps;
+	m_stepsSinceFrame = m_interval; // Record the first step
+	m_framesRecorded = 0;
+	m_framesDropped = 0;
+
+	m_fileOffset = 0;
+	m_chunk.clear();
+	m_chunkFrames = 0;
+	m_index.clear();
+	m_previousIds.clear();
+	m_previousQuantized.clear();
+	m_bytesWritten = 0;
+	m_writeFailed = false;
+
+	std::vector<uint8_t> header;
+	header.insert(header.end(), std::begin(TRAJECTORY_MAGIC), std::end(TRAJECTORY_MAGIC));
+	PutRaw(header, TRAJECTORY_VERSION);
+	PutRaw(header, uint32_t(m_options.compression));
+	PutRaw(header, m_options.positionQuantum);
+	PutRaw(header, m_options.velocityQuantum);
+	PutRaw(header, m_options.everyKSteps);
+	PutRaw(header, m_options.framesPerChunk);
+	write(header);
+
+	m_stop = false;
+	m_writer = std::thread(&TrajectoryRecorder::writerLoop, this);
+	return true;
+}
+
+void TrajectoryRecorder::Stop() {
+	if (!m_writer.joinable()) return;
+	m_stop.store(true, std::memory_order_release);
+	m_writer.join();
+	m_file.close();
+}
+
+void TrajectoryRecorder::Record(uint64_t step, double time, const BodyState& bodies, const uint32_t* ids,
+	const Conservation* conservation) {
+	if (!Recording()) return;
+	if (++m_stepsSinceFrame < m_interval) return;
+
+	// Back-pressure: stretch the interval while the writer is behind, relax it once it caught up
+	size_t depth = m_ring->Size(), capacity = m_ring->Capacity();
+	if (m_options.overflow == TrajectoryOverflow::Throttle) {
+		if (depth * 4 >= capacity * 3 && m_interval < m_options.everyKSteps * MAX_THROTTLE_FACTOR)
+			m_interval *= 2;
+		else if (depth * 4 <= capacity && m_interval > m_options.everyKSteps)
+			m_interval /= 2;
+	}
+
+	TrajectoryFrame* frame = m_ring->BeginPush();
+	if (!frame) {
+		++m_framesDropped;
+		return;
+	}
+	m_stepsSinceFrame = 0;
+
+	frame->step = step;
+	frame->time = time;
+	frame->hasConservation = conservation != nullptr;
+	if (conservation) frame->conservation = *conservation;
+	frame->ids.clear();
+	frame->position.clear();
+	frame->velocity.clear();
+	for (size_t i = 0; i < bodies.Size(); ++i) {
+		uint32_t id = ids[i];
+		if (!m_recordIds.empty() && !std::binary_search(m_recordIds.begin(), m_recordIds.end(), id)) continue;
+		frame->ids.push_back(id);
+		frame->position.push_back(bodies.position[i]);
+		frame->velocity.push_back(bodies.velocity[i]);
+	}
+	m_ring->EndPush();
+	++m_framesRecorded;
+}
+
+void TrajectoryRecorder::writerLoop() {
+	while (true) {
+		// Read the flag before popping: frames pushed before Stop are visible once it is set
+		bool stopping = m_stop.load(std::memory_order_acquire);
+		TrajectoryFrame* frame = m_ring->BeginPop();
+		if (!frame) {
+			if (stopping) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		encodeFrame(*frame);
+		m_ring->EndPop();
+		if (m_chunkFrames >= m_options.framesPerChunk)
+			flushChunk();
+	}
+	flushChunk();
+
+	// Index and footer
+	uint64_t indexOffset = m_fileOffset;
+	std::vector<uint8_t> tail;
+	for (const TrajectoryChunkInfo& chunk : m_index) {
+		PutRaw(tail, chunk.offset);
+		PutRaw(tail, chunk.firstStep);
+		PutRaw(tail, chunk.frameCount);
+	}
+	PutRaw(tail, indexOffset);
+	PutRaw(tail, uint64_t(m_index.size()));
+	tail.insert(tail.end(), std::begin(TRAJECTORY_INDEX_MAGIC), std::end(TRAJECTORY_INDEX_MAGIC));
+	write(tail);
+	m_file.flush();
+}
+
+void TrajectoryRecorder::encodeFrame(const TrajectoryFrame& frame) {
+	if (m_chunkFrames == 0) m_chunkFirstStep = frame.step;
+
+	// Deltas need the same bodies in the same order as the previous frame of this chunk
+	size_t count = frame.ids.size();
+	bool delta = m_options.compression == TrajectoryCompression::DeltaQuantized && m_chunkFrames > 0 && frame.ids == m_previousIds;
+
+	PutRaw(m_chunk, frame.step);
+	PutRaw(m_chunk, frame.time);
+	m_chunk.push_back(uint8_t((delta ? FRAME_DELTA : FRAME_RAW) | (frame.hasConservation ? FRAME_CONSERVATION : 0)));
+	if (frame.hasConservation) {
+		const Conservation& c = frame.conservation;
+		PutRaw(m_chunk, c.kinetic);
+		PutRaw(m_chunk, c.potential);
+		PutRaw(m_chunk, c.momentum);
+		PutRaw(m_chunk, c.angularMomentum);
+		PutRaw(m_chunk, c.momentumScale);
+		PutRaw(m_chunk, c.angularMomentumScale);
+	}
+	PutVarint(m_chunk, count);
+
+	if (!delta) {
+		for (uint32_t id : frame.ids) PutRaw(m_chunk, id);
+		for (const glm::dvec3& p : frame.position) PutRaw(m_chunk, p);
+		for (const glm::dvec3& v : frame.velocity) PutRaw(m_chunk, v);
+	}
+
+	if (m_options.compression == TrajectoryCompression::DeltaQuantized) {
+		// Deltas are taken between quantized values, so rounding errors do not add up along the chunk
+		m_previousQuantized.resize(count * 6);
+		int64_t* q = m_previousQuantized.data();
+		for (size_t i = 0; i < count; ++i) {
+			for (int c = 0; c < 3; ++c) {
+				int64_t qp = quantize(frame.position[i][c], m_options.positionQuantum);
+				int64_t qv = quantize(frame.velocity[i][c], m_options.velocityQuantum);
+				if (delta) {
+					PutVarint(m_chunk, ZigZagEncode(qp - q[i * 3 + c]));
+					PutVarint(m_chunk, ZigZagEncode(qv - q[(count + i) * 3 + c]));
+				}
+				q[i * 3 + c] = qp;
+				q[(count + i) * 3 + c] = qv;
+			}
+		}
+		if (!delta) m_previousIds = frame.ids;
+	}
+	++m_chunkFrames;
+}
+
+void TrajectoryRecorder::flushChunk() {
+	if (m_chunkFrames == 0) return;
+
+	m_index.push_back({ m_fileOffset, m_chunkFirstStep, m_chunkFrames });
+	std::vector<uint8_t> header;
+	PutRaw(header, m_chunkFrames);
+	PutRaw(header, uint64_t(m_chunk.size()));
+	write(header);
+	write(m_chunk);
+
+	m_chunk.clear();
+	m_chunkFrames = 0;
+}
+
+void TrajectoryRecorder::write(const std::vector<uint8_t>& bytes) {
+	m_file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+	if (!m_file) m_writeFailed = true;
+	m_fileOffset += bytes.size();
+	m_bytesWritten.fetch_add(bytes.size(), std::memory_order_relaxed);
+}
+
+bool TrajectoryReader::fail(const char* message) {
+	m_error = message;
+	m_index.clear();
+	m_file.Close();
+	return false;
+}
+
+bool TrajectoryReader::Open(const std::string& path) {
+	m_index.clear();
+	m_error.clear();
+	if (!m_file.Open(path)) return fail("Could not open file");
+
+	const uint8_t* begin = m_file.Data();
+	const uint8_t* end = begin + m_file.Size();
+	const uint8_t* in = begin;
+	char magic[8];
+	uint32_t version, compression, everyKSteps, framesPerChunk;
+	if (!GetRaw(in, end, magic) || std::memcmp(magic, TRAJECTORY_MAGIC, sizeof(magic)) != 0)
+		return fail("Not a trajectory file");
+	if (!GetRaw(in, end, version) || version < 1 || version > TRAJECTORY_VERSION)
+		return fail("Unsupported trajectory version");
+	if (!GetRaw(in, end, compression) || !GetRaw(in, end, m_positionQuantum) || !GetRaw(in, end, m_velocityQuantum)
+		|| !GetRaw(in, end, everyKSteps) || !GetRaw(in, end, framesPerChunk))
+		return fail("Trajectory header is truncated");
+	if (compression != uint32_t(TrajectoryCompression::None) && compression != uint32_t(TrajectoryCompression::DeltaQuantized))
+		return fail("Unknown trajectory compression");
+	m_compression = TrajectoryCompression(compression);
+	if (m_compression == TrajectoryCompression::DeltaQuantized &&
+		!(m_positionQuantum > 0.0 && std::isfinite(m_positionQuantum) && m_velocityQuantum > 0.0 && std::isfinite(m_velocityQuantum)))
+		return fail("Trajectory quantum is invalid");
+	const uint64_t headerEnd = uint64_t(in - begin);
+
+	// Footer: index offset, chunk count, magic
+	const size_t footerSize = 2 * sizeof(uint64_t) + sizeof(TRAJECTORY_INDEX_MAGIC);
+	if (size_t(end - in) < footerSize) return fail("Trajectory has no index, the recording was not stopped");
+	const uint8_t* footer = end - footerSize;
+	uint64_t indexOffset, chunkCount;
+	GetRaw(footer, end, indexOffset);
+	GetRaw(footer, end, chunkCount);
+	if (std::memcmp(footer, TRAJECTORY_INDEX_MAGIC, sizeof(TRAJECTORY_INDEX_MAGIC)) != 0)
+		return fail("Trajectory has no index, the recording was not stopped");
+
+	const size_t entrySize = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+	if (indexOffset < headerEnd || indexOffset > m_file.Size() - footerSize || chunkCount > (m_file.Size() - footerSize - indexOffset) / entrySize)
+		return fail("Trajectory index is corrupt");
+	in = begin + indexOffset;
+	m_index.resize(size_t(chunkCount));
+
+	// Every chunk header has to lie between the file header and the index, ReadChunk checks the payload
+	const uint64_t chunkHeaderSize = sizeof(uint32_t) + sizeof(uint64_t);
+	for (TrajectoryChunkInfo& chunk : m_index) {
+		GetRaw(in, end, chunk.offset);
+		GetRaw(in, end, chunk.firstStep);
+		GetRaw(in, end, chunk.frameCount);
+		if (chunk.offset < headerEnd || chunk.offset > indexOffset - chunkHeaderSize)
+			return fail("Trajectory index is corrupt");
+	}
+	return true;
+}
+
+bool TrajectoryReader::ReadChunk(size_t chunk, std::vector<TrajectoryFrame>& frames) const {
+	frames.clear();
+	if (chunk >= m_index.size() || m_index[chunk].offset > m_file.Size()) return false;
+	// A corrupt chunk yields no frames rather than the ones decoded up to the damage
+	auto corrupt = [&frames] {
+		frames.clear();
+		return false;
+	};
+
+	const uint8_t* end = m_file.Data() + m_file.Size();
+	const uint8_t* in = m_file.Data() + m_index[chunk].offset;
+	uint32_t frameCount;
+	uint64_t payloadSize;
+	if (!GetRaw(in, end, frameCount) || !GetRaw(in, end, payloadSize) || payloadSize > uint64_t(end - in)) return false;
+	end = in + payloadSize;
+
+	// Step, time, kind and count take at least this much, which bounds the frame count before allocating
+	const uint64_t minFrameSize = sizeof(uint64_t) + sizeof(double) + 2;
+	if (frameCount > payloadSize / minFrameSize) return false;
+
+	std::vector<int64_t> quantized;
+	frames.resize(frameCount);
+	for (uint32_t f = 0; f < frameCount; ++f) {
+		TrajectoryFrame& frame = frames[f];
+		uint8_t kind;
+		uint64_t count;
+		if (!GetRaw(in, end, frame.step) || !GetRaw(in, end, frame.time) || !GetRaw(in, end, kind))
+			return corrupt();
+		frame.hasConservation = (kind & FRAME_CONSERVATION) != 0;
+		kind &= uint8_t(~FRAME_CONSERVATION);
+		if (kind != FRAME_RAW && kind != FRAME_DELTA)
+			return corrupt();
+		if (frame.hasConservation) {
+			Conservation& c = frame.conservation;
+			if (!GetRaw(in, end, c.kinetic) || !GetRaw(in, end, c.potential) || !GetRaw(in, end, c.momentum)
+				|| !GetRaw(in, end, c.angularMomentum) || !GetRaw(in, end, c.momentumScale) || !GetRaw(in, end, c.angularMomentumScale))
+				return corrupt();
+		}
+		if (!GetVarint(in, end, count))
+			return corrupt();
+
+		if (kind == FRAME_RAW) {
+			if (count > uint64_t(end - in) / (sizeof(uint32_t) + 2 * sizeof(glm::dvec3))) return corrupt();
+			frame.ids.resize(size_t(count));
+			frame.position.resize(size_t(count));
+			frame.velocity.resize(size_t(count));
+			for (uint32_t& id : frame.ids) GetRaw(in, end, id);
+			for (glm::dvec3& p : frame.position) GetRaw(in, end, p);
+			for (glm::dvec3& v : frame.velocity) GetRaw(in, end, v);
+		}
+		else {
+			// Deltas continue the quantized values of the previous frame, which only delta compressed files keep
+			if (m_compression != TrajectoryCompression::DeltaQuantized || f == 0 || count != frames[f - 1].ids.size()
+				|| quantized.size() != size_t(count) * 6)
+				return corrupt();
+			frame.ids = frames[f - 1].ids;
+			frame.position.resize(size_t(count));
+			frame.velocity.resize(size_t(count));
+			for (size_t i = 0; i < count; ++i) {
+				for (int c = 0; c < 3; ++c) {
+					uint64_t dp, dv;
+					if (!GetVarint(in, end, dp) || !GetVarint(in, end, dv)) return corrupt();
+					quantized[i * 3 + c] += ZigZagDecode(dp);
+					quantized[(count + i) * 3 + c] += ZigZagDecode(dv);
+					frame.position[i][c] = double(quantized[i * 3 + c]) * m_positionQuantum;
+					frame.velocity[i][c] = double(quantized[(count + i) * 3 + c]) * m_velocityQuantum;
+				}
+			}
+			continue;
+		}
+
+		if (m_compression == TrajectoryCompression::DeltaQuantized) {
+			quantized.resize(size_t(count) * 6);
+			for (size_t i = 0; i < count; ++i) {
+				for (int c = 0; c < 3; ++c) {
+					quantized[i * 3 + c] = quantize(frame.position[i][c], m_positionQuantum);
+					quantized[(count + i) * 3 + c] = quantize(frame.velocity[i][c], m_velocityQuantum);
+				}
+			}
+		}
+	}
+	return true;
+}
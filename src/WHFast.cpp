@@ -0,0 +1,198 @@
+#include "WHFast.h"
+#include "Kepler.h"
+#include "Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+	// Third order corrector coefficients, a = sqrt(7/40), b = -sqrt(10/7)/48
+	const double CORRECTOR_A = std::sqrt(7.0 / 40.0);
+	const double CORRECTOR_B = -std::sqrt(10.0 / 7.0) / 48.0;
+}
+
+double WHFast::SuggestTimestep(const BodyState& bodies, double orbitFraction) {
+	size_t count = bodies.Size();
+	if (count < 2) return 0.0;
+
+	size_t central = std::max_element(bodies.mass.begin(), bodies.mass.end()) - bodies.mass.begin();
+	double shortestPeriod = INFINITY;
+	for (size_t i = 0; i < count; ++i) {
+		if (i == central) continue;
+		glm::dvec3 r = bodies.position[i] - bodies.position[central];
+		glm::dvec3 v = bodies.velocity[i] - bodies.velocity[central];
+		double gm = G * (bodies.mass[central] + bodies.mass[i]);
+		double dist = glm::length(r);
+		if (dist <= 0.0 || gm <= 0.0) continue;
+
+		// Unbound orbits have no period, use the dynamical time at the current distance instead
+		double invA = 2.0 / dist - glm::dot(v, v) / gm;
+		double a = invA > 0.0 ? 1.0 / invA : dist;
+		shortestPeriod = std::min(shortestPeriod, 2.0 * glm::pi<double>() * std::sqrt(a * a * a / gm));
+	}
+	return std::isfinite(shortestPeriod) ? shortestPeriod * orbitFraction : 0.0;
+}
+
+void WHFast::Integrate(BodyState& bodies, double totalTime, double maxStep) {
+	lastStepCount = 0;
+	if (bodies.Size() < 2 || totalTime <= 0.0 || maxStep <= 0.0) return;
+
+	size_t steps = size_t(std::ceil(totalTime / maxStep));
+	double dt = totalTime / double(steps);
+
+	buildOrdering(bodies);
+	if (m_eta[0] <= 0.0) {
+		// No central mass to orbit, nothing but free drift
+		for (size_t i = 0; i < bodies.Size(); ++i)
+			bodies.position[i] += bodies.velocity[i] * totalTime;
+		return;
+	}
+	inertialToJacobi(bodies);
+
+	if (useCorrector) applyCorrector(1.0, dt);
+
+	// Kepler(dt/2) Interaction(dt) Kepler(dt/2), with the inner half drifts of consecutive steps merged
+	keplerStep(0.5 * dt);
+	for (size_t i = 0; i < steps; ++i) {
+		jacobiToInertialPositions();
+		interactionStep(dt);
+		keplerStep(i + 1 == steps ? 0.5 * dt : dt);
+	}
+
+	if (useCorrector) applyCorrector(-1.0, dt);
+
+	// The centre of mass moves on a straight line
+	m_x[0] += m_vx[0] * totalTime;
+	m_y[0] += m_vy[0] * totalTime;
+	m_z[0] += m_vz[0] * totalTime;
+
+	jacobiToInertial(bodies);
+	lastStepCount = steps;
+}
+
+void WHFast::buildOrdering(const BodyState& bodies) {
+	size_t count = bodies.Size();
+	size_t central = std::max_element(bodies.mass.begin(), bodies.mass.end()) - bodies.mass.begin();
+
+	m_order.resize(count);
+	std::iota(m_order.begin(), m_order.end(), 0);
+	std::swap(m_order[0], m_order[central]);
+
+	const glm::dvec3 origin = bodies.position[central];
+	std::sort(m_order.begin() + 1, m_order.end(), [&](size_t a, size_t b) {
+		glm::dvec3 da = bodies.position[a] - origin;
+		glm::dvec3 db = bodies.position[b] - origin;
+		return glm::dot(da, da) < glm::dot(db, db);
+	});
+
+	m_eta.resize(count);
+	m_gm.resize(count);
+	m_inertial.Resize(count);
+	double eta = 0.0;
+	for (size_t i = 0; i < count; ++i) {
+		double m = bodies.mass[m_order[i]];
+		eta += m;
+		m_eta[i] = eta;
+		m_gm[i] = G * eta;
+		m_inertial.mass[i] = m;
+	}
+}
+
+void WHFast::inertialToJacobi(const BodyState& bodies) {
+	size_t count = bodies.Size();
+	m_x.resize(count); m_y.resize(count); m_z.resize(count);
+	m_vx.resize(count); m_vy.resize(count); m_vz.resize(count);
+
+	// Running centre of mass of the interior bodies (scaled by the interior mass)
+	glm::dvec3 comPos = bodies.position[m_order[0]] * m_inertial.mass[0];
+	glm::dvec3 comVel = bodies.velocity[m_order[0]] * m_inertial.mass[0];
+	for (size_t i = 1; i < count; ++i) {
+		const glm::dvec3& p = bodies.position[m_order[i]];
+		const glm::dvec3& v = bodies.velocity[m_order[i]];
+		double m = m_inertial.mass[i];
+
+		glm::dvec3 rj = p - comPos / m_eta[i - 1];
+		glm::dvec3 vj = v - comVel / m_eta[i - 1];
+		m_x[i] = rj.x; m_y[i] = rj.y; m_z[i] = rj.z;
+		m_vx[i] = vj.x; m_vy[i] = vj.y; m_vz[i] = vj.z;
+
+		comPos += p * m;
+		comVel += v * m;
+	}
+	comPos /= m_eta[count - 1];
+	comVel /= m_eta[count - 1];
+	m_x[0] = comPos.x; m_y[0] = comPos.y; m_z[0] = comPos.z;
+	m_vx[0] = comVel.x; m_vy[0] = comVel.y; m_vz[0] = comVel.z;
+}
+
+void WHFast::jacobiToInertialPositions() {
+	size_t count = m_inertial.Size();
+
+	// R_{i-1} = R_i - m_i / eta_i * r'_i, x_i = r'_i + R_{i-1}
+	glm::dvec3 com(m_x[0], m_y[0], m_z[0]);
+	for (size_t i = count - 1; i > 0; --i) {
+		glm::dvec3 rj(m_x[i], m_y[i], m_z[i]);
+		com -= rj * (m_inertial.mass[i] / m_eta[i]);
+		m_inertial.position[i] = rj + com;
+	}
+	m_inertial.position[0] = com;
+}
+
+void WHFast::jacobiToInertial(BodyState& bodies) {
+	size_t count = m_inertial.Size();
+	jacobiToInertialPositions();
+
+	glm::dvec3 com(m_vx[0], m_vy[0], m_vz[0]);
+	for (size_t i = count - 1; i > 0; --i) {
+		glm::dvec3 vj(m_vx[i], m_vy[i], m_vz[i]);
+		com -= vj * (m_inertial.mass[i] / m_eta[i]);
+		m_inertial.velocity[i] = vj + com;
+	}
+	m_inertial.velocity[0] = com;
+
+	for (size_t i = 0; i < count; ++i) {
+		bodies.position[m_order[i]] = m_inertial.position[i];
+		bodies.velocity[m_order[i]] = m_inertial.velocity[i];
+	}
+}
+
+void WHFast::keplerStep(double dt) {
+	size_t count = m_inertial.Size();
+	KeplerDriftBatch(&m_gm[1], &m_x[1], &m_y[1], &m_z[1], &m_vx[1], &m_vy[1], &m_vz[1], count - 1, dt);
+}
+
+void WHFast::interactionStep(double dt) {
+	size_t count = m_inertial.Size();
+	ComputeAccelerations(m_inertial, m_accel);
+
+	// Transform the accelerations to Jacobi coordinates (same linear map as the positions)
+	// and remove the Keplerian part that is already handled by the drift.
+	glm::dvec3 comAcc = m_accel[0] * m_inertial.mass[0];
+	for (size_t i = 1; i < count; ++i) {
+		glm::dvec3 aj = m_accel[i] - comAcc / m_eta[i - 1];
+		comAcc += m_accel[i] * m_inertial.mass[i];
+
+		double r2 = m_x[i] * m_x[i] + m_y[i] * m_y[i] + m_z[i] * m_z[i];
+		double kepler = m_gm[i] / (r2 * std::sqrt(r2));
+		m_vx[i] += dt * (aj.x + kepler * m_x[i]);
+		m_vy[i] += dt * (aj.y + kepler * m_y[i]);
+		m_vz[i] += dt * (aj.z + kepler * m_z[i]);
+	}
+}
+
+void WHFast::correctorZ(double a, double b) {
+	keplerStep(a);
+	jacobiToInertialPositions();
+	interactionStep(-b);
+	keplerStep(-2.0 * a);
+	jacobiToInertialPositions();
+	interactionStep(b);
+	keplerStep(a);
+}
+
+void WHFast::applyCorrector(double inv, double dt) {
+	correctorZ(CORRECTOR_A * dt, -inv * CORRECTOR_B * dt);
+	correctorZ(-CORRECTOR_A * dt, inv * CORRECTOR_B * dt);
+}
@@ -1,4 +1,8 @@
 ﻿#include "Game.h"
+#include "Benchmarks.h"
+#include "Ensemble.h"
+#include "Parareal.h"
+#include "Determinism.h"
 
 #define USE_GPU_ENGINE 1
 extern "C"
@@ -7,7 +11,35 @@ extern "C"
 	__declspec(dllexport) int AmdPowerXpressRequestHighPerformance = USE_GPU_ENGINE;
 }
 
-int main(void) {
+int main(int argc, char* argv[]) {
+
+	// Has to be set before anything uses the global thread pool
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--threads") == 0)
+			ThreadPool::SetGlobalThreadCount(size_t(std::max(atoi(argv[i + 1]), 0)));
+	}
+
+	// Command line tools, these run without opening a window
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--bench-lbvh") == 0)
+			return RunLBVHBenchmark();
+		if (strcmp(argv[i], "--bench-precision") == 0)
+			return RunPrecisionBenchmark();
+		if (strcmp(argv[i], "--ensemble") == 0)
+			return RunEnsembleCommand(argc, argv);
+		if (strcmp(argv[i], "--parareal") == 0)
+			return RunPararealCommand(argc, argv);
+		if (strcmp(argv[i], "--check-kepler") == 0)
+			return RunKeplerCheck();
+		if (strcmp(argv[i], "--check-regularization") == 0)
+			return RunRegularizationCheck();
+		if (strcmp(argv[i], "--check-hierarchy") == 0)
+			return RunHierarchyConvergenceCheck();
+		if (strcmp(argv[i], "--hash-log") == 0)
+			return RunHashLogCommand(argc, argv);
+		if (strcmp(argv[i], "--compare-hashes") == 0)
+			return RunCompareHashesCommand(argc, argv);
+	}
 
 	int width = 0, height = 0;
 